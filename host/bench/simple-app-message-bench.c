@@ -0,0 +1,791 @@
+//! Host benchmark for the SimpleAppMessage receive path. Synthetic payloads are serialized the
+//! same way serialize.js does, split into chunks and delivered through the AppMessage inbox
+//! stand-in so every chunk runs through the library's inbox received callback, assembly and
+//! deserialization exactly as it would on the watch.
+//!
+//! Each configuration runs in its own forked process because the library keeps its state in
+//! statics and the chunk size cannot shrink once the inbox has been opened.
+//!
+//! Built against the library with SIMPLE_APP_MESSAGE_STATIC_ALLOCATION, it also fails any
+//! configuration whose measured messages touch the heap, and skips the ones that need a decoder
+//! the build compiled out.
+
+#include "pebble-host.h"
+
+#include "simple-app-message.h"
+#include "simple-app-message-compression.h"
+#include "simple-app-message-config.h"
+
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BENCH_NAMESPACE ("bench")
+//! Each forked child registers only BENCH_NAMESPACE, so it always gets the first ID. Chunks carry
+//! the ID like they do from a phone that completed the handshake.
+#define BENCH_NAMESPACE_ID (1)
+
+//! Roughly how many payload bytes each configuration pushes through when not in quick mode
+#define BENCH_BYTES_PER_CONFIG (8 * 1024 * 1024)
+#define BENCH_MIN_MESSAGES (20)
+#define BENCH_QUICK_MESSAGES (5)
+
+//! Must match TYPES in serialize.js
+typedef enum BenchDataType {
+  BenchDataType_Null,
+  BenchDataType_Bool,
+  BenchDataType_Int,
+  BenchDataType_Data,
+  BenchDataType_String,
+} BenchDataType;
+
+//! Which receive callback the benchmark namespace registers
+typedef enum BenchApi {
+  BenchApi_Dict,
+  BenchApi_View,
+  BenchApi_Stream,
+  //! Streamed, with data values passed on in pieces
+  BenchApi_Pieces,
+
+  BenchApiCount
+} BenchApi;
+
+//! Payload formats, must match SimpleAppMessageFormat
+typedef enum BenchFormat {
+  BenchFormat_V1 = 1,
+  BenchFormat_V2 = 2,
+} BenchFormat;
+
+typedef struct BenchConfig {
+  BenchApi api;
+  BenchFormat format;
+  //! LZ compress the payload like compress.js does for a watch that announced a window
+  bool compressed;
+  uint32_t chunk_size;
+  uint32_t key_count;
+  uint32_t value_size;
+} BenchConfig;
+
+typedef struct BenchPayload {
+  uint8_t *buffer;
+  size_t size;
+  //! Size before compression
+  size_t raw_size;
+} BenchPayload;
+
+typedef struct BenchChunks {
+  uint8_t **dicts;
+  uint16_t *dict_sizes;
+  //! Where each dictionary holds its transfer ID, so it can be renumbered without rebuilding it
+  uint8_t **transfer_ids;
+  uint32_t count;
+} BenchChunks;
+
+typedef struct BenchReceiveState {
+  uint32_t expected_key_count;
+  uint32_t messages_received;
+  uint32_t messages_malformed;
+  //! Keys streamed so far for the message in progress
+  uint32_t keys_streamed;
+} BenchReceiveState;
+
+static const uint32_t s_chunk_sizes[] = { 64, 256, 1024, 4096 };
+static const uint32_t s_key_counts[] = { 4, 32, 128 };
+static const uint32_t s_value_sizes[] = { 4, 64, 512 };
+
+static const char *s_api_names[BenchApiCount] = {
+  [BenchApi_Dict] = "dict",
+  [BenchApi_View] = "view",
+  [BenchApi_Stream] = "strm",
+  [BenchApi_Pieces] = "pcs",
+};
+
+static const BenchFormat s_formats[] = { BenchFormat_V1, BenchFormat_V2 };
+static const bool s_compression[] = { false, true };
+
+static const BenchConfig s_quick_configs[] = {
+  { .api = BenchApi_Dict, .format = BenchFormat_V1, .chunk_size = 64, .key_count = 4,
+    .value_size = 4 },
+  { .api = BenchApi_Dict, .format = BenchFormat_V1, .chunk_size = 256, .key_count = 32,
+    .value_size = 64 },
+  { .api = BenchApi_Dict, .format = BenchFormat_V1, .chunk_size = 1024, .key_count = 128,
+    .value_size = 512 },
+  { .api = BenchApi_Dict, .format = BenchFormat_V2, .chunk_size = 64, .key_count = 32,
+    .value_size = 4 },
+  { .api = BenchApi_View, .format = BenchFormat_V1, .chunk_size = 256, .key_count = 32,
+    .value_size = 64 },
+  { .api = BenchApi_View, .format = BenchFormat_V1, .chunk_size = 1024, .key_count = 128,
+    .value_size = 512 },
+  { .api = BenchApi_View, .format = BenchFormat_V2, .chunk_size = 256, .key_count = 128,
+    .value_size = 64 },
+  { .api = BenchApi_Stream, .format = BenchFormat_V1, .chunk_size = 64, .key_count = 32,
+    .value_size = 512 },
+  { .api = BenchApi_Stream, .format = BenchFormat_V1, .chunk_size = 1024, .key_count = 128,
+    .value_size = 512 },
+  { .api = BenchApi_Stream, .format = BenchFormat_V2, .chunk_size = 64, .key_count = 128,
+    .value_size = 64 },
+  { .api = BenchApi_Dict, .format = BenchFormat_V2, .compressed = true, .chunk_size = 256,
+    .key_count = 32, .value_size = 64 },
+  { .api = BenchApi_View, .format = BenchFormat_V1, .compressed = true, .chunk_size = 1024,
+    .key_count = 128, .value_size = 512 },
+  { .api = BenchApi_Stream, .format = BenchFormat_V2, .compressed = true, .chunk_size = 64,
+    .key_count = 128, .value_size = 512 },
+  { .api = BenchApi_Pieces, .format = BenchFormat_V1, .chunk_size = 64, .key_count = 32,
+    .value_size = 512 },
+  { .api = BenchApi_Pieces, .format = BenchFormat_V2, .compressed = true, .chunk_size = 64,
+    .key_count = 128, .value_size = 512 },
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Payload generation
+
+static BenchDataType prv_type_for_key(uint32_t key_index) {
+  switch (key_index % 4) {
+    case 0: return BenchDataType_Int;
+    case 1: return BenchDataType_Bool;
+    case 2: return BenchDataType_String;
+    default: return BenchDataType_Data;
+  }
+}
+
+//! Small signed counters, like most of the ints real payloads carry
+static int32_t prv_int_for_key(uint32_t key_index) {
+  const int32_t magnitude = (int32_t)(key_index * 3);
+  return (key_index & 4) ? -magnitude : magnitude;
+}
+
+static void prv_write_varint(uint8_t **cursor, uint32_t value) {
+  while (value >= 0x80) {
+    *((*cursor)++) = (uint8_t)(value | 0x80);
+    value >>= 7;
+  }
+  *((*cursor)++) = (uint8_t)value;
+}
+
+//! Writes a v2 type byte, with value in the low nibble or in a varint after it
+static void prv_write_compact_type(uint8_t **cursor, BenchDataType type, uint32_t value) {
+  *((*cursor)++) = (uint8_t)((type << 4) | ((value < 0xF) ? value : 0xF));
+  if (value >= 0xF) {
+    prv_write_varint(cursor, value);
+  }
+}
+
+static void prv_payload_write_compact_value(uint8_t **cursor, const BenchConfig *config,
+                                            BenchDataType type, uint32_t key_index) {
+  switch (type) {
+    case BenchDataType_Int: {
+      const int32_t value = prv_int_for_key(key_index);
+      prv_write_compact_type(cursor, type, ((uint32_t)value << 1) ^ (uint32_t)(value >> 31));
+      break;
+    }
+    case BenchDataType_Bool:
+      prv_write_compact_type(cursor, type, key_index & 1);
+      break;
+    case BenchDataType_String:
+      prv_write_compact_type(cursor, type, 0);
+      memset(*cursor, 'a' + (key_index % 26), config->value_size - 1);
+      (*cursor)[config->value_size - 1] = '\0';
+      *cursor += config->value_size;
+      break;
+    case BenchDataType_Data:
+      prv_write_compact_type(cursor, type, config->value_size);
+      for (uint32_t j = 0; j < config->value_size; j++) {
+        *((*cursor)++) = (uint8_t)(key_index + j);
+      }
+      break;
+    case BenchDataType_Null:
+      prv_write_compact_type(cursor, type, 0);
+      break;
+  }
+}
+
+//! Greedy LZSS with the same token layout and header as compress.js. Always compresses, even when
+//! the result is larger, so the configuration measures what it says.
+static BenchPayload prv_payload_compress(const BenchPayload *payload, uint8_t num_keys) {
+  const size_t window = SIMPLE_APP_MESSAGE_COMPRESSION_WINDOW_SIZE;
+  const size_t max_match = SIMPLE_APP_MESSAGE_COMPRESSION_MIN_MATCH + 255;
+  // A flags byte per 8 literals in the worst case
+  uint8_t *buffer = malloc(8 + payload->size + (payload->size / 8) + 1);
+  uint8_t *cursor = buffer;
+  *(cursor++) = 0;
+  *(cursor++) = SIMPLE_APP_MESSAGE_COMPRESSION_TAG;
+  *(cursor++) = num_keys;
+  prv_write_varint(&cursor, payload->size);
+
+  uint8_t *flags = NULL;
+  unsigned int tokens = 8;
+  size_t pos = 0;
+  while (pos < payload->size) {
+    if (tokens == 8) {
+      flags = cursor++;
+      *flags = 0;
+      tokens = 0;
+    }
+
+    size_t best_length = 0;
+    size_t best_distance = 0;
+    const size_t max_length =
+        ((payload->size - pos) < max_match) ? (payload->size - pos) : max_match;
+    for (size_t distance = 1; (distance <= window) && (distance <= pos); distance++) {
+      size_t length = 0;
+      while ((length < max_length) &&
+             (payload->buffer[pos - distance + length] == payload->buffer[pos + length])) {
+        length++;
+      }
+      if (length > best_length) {
+        best_length = length;
+        best_distance = distance;
+        if (length == max_length) {
+          break;
+        }
+      }
+    }
+
+    if (best_length >= SIMPLE_APP_MESSAGE_COMPRESSION_MIN_MATCH) {
+      *flags |= (1 << tokens);
+      *(cursor++) = (uint8_t)(best_distance - 1);
+      *(cursor++) = (uint8_t)(best_length - SIMPLE_APP_MESSAGE_COMPRESSION_MIN_MATCH);
+      pos += best_length;
+    } else {
+      *(cursor++) = payload->buffer[pos++];
+    }
+    tokens++;
+  }
+
+  return (BenchPayload) {
+    .buffer = buffer,
+    .size = cursor - buffer,
+    .raw_size = payload->size,
+  };
+}
+
+//! Serializes a payload with the same layout as serialize.js
+static BenchPayload prv_payload_create(const BenchConfig *config) {
+  // Worst case per key: key string, type byte, 2 byte length and the value itself
+  const size_t max_size = 3 + config->key_count * (16 + 1 + 2 + config->value_size + 4);
+  uint8_t *buffer = malloc(max_size);
+  uint8_t *cursor = buffer;
+
+  if (config->format == BenchFormat_V2) {
+    *(cursor++) = 0;
+    *(cursor++) = BenchFormat_V2;
+  }
+  *(cursor++) = (uint8_t)config->key_count;
+  for (uint32_t i = 0; i < config->key_count; i++) {
+    cursor += sprintf((char *)cursor, "key%u", (unsigned int)i) + 1;
+
+    const BenchDataType type = prv_type_for_key(i);
+    if (config->format == BenchFormat_V2) {
+      prv_payload_write_compact_value(&cursor, config, type, i);
+      continue;
+    }
+
+    *(cursor++) = type;
+    switch (type) {
+      case BenchDataType_Int: {
+        const int32_t value = prv_int_for_key(i);
+        memcpy(cursor, &value, sizeof(value));
+        cursor += sizeof(value);
+        break;
+      }
+      case BenchDataType_Bool:
+        *(cursor++) = (i & 1);
+        break;
+      case BenchDataType_String:
+        memset(cursor, 'a' + (i % 26), config->value_size - 1);
+        cursor[config->value_size - 1] = '\0';
+        cursor += config->value_size;
+        break;
+      case BenchDataType_Data: {
+        const uint16_t length = (uint16_t)config->value_size;
+        memcpy(cursor, &length, sizeof(length));
+        cursor += sizeof(length);
+        for (uint32_t j = 0; j < config->value_size; j++) {
+          *(cursor++) = (uint8_t)(i + j);
+        }
+        break;
+      }
+      case BenchDataType_Null:
+        break;
+    }
+  }
+
+  BenchPayload payload = {
+    .buffer = buffer,
+    .size = cursor - buffer,
+    .raw_size = cursor - buffer,
+  };
+  if (config->compressed) {
+    BenchPayload compressed = prv_payload_compress(&payload, (uint8_t)config->key_count);
+    free(payload.buffer);
+    return compressed;
+  }
+  return payload;
+}
+
+//! Pre-builds the inbox dictionary for each chunk so only the receive path is timed
+static BenchChunks prv_chunks_create(const BenchPayload *payload, uint32_t chunk_size,
+                                     uint32_t transfer_id) {
+  const uint32_t count = (payload->size + chunk_size - 1) / chunk_size;
+  BenchChunks chunks = {
+    .dicts = malloc(count * sizeof(uint8_t *)),
+    .dict_sizes = malloc(count * sizeof(uint16_t)),
+    .transfer_ids = malloc(count * sizeof(uint8_t *)),
+    .count = count,
+  };
+
+  for (uint32_t i = 0; i < count; i++) {
+    const uint32_t offset = i * chunk_size;
+    const uint32_t length =
+        ((payload->size - offset) < chunk_size) ? (payload->size - offset) : chunk_size;
+    const uint32_t dict_size = dict_calc_buffer_size(5, sizeof(uint8_t),
+                                                     sizeof(uint32_t), sizeof(uint32_t),
+                                                     sizeof(uint32_t), length);
+    uint8_t *buffer = malloc(dict_size);
+
+    DictionaryIterator iter;
+    dict_write_begin(&iter, buffer, dict_size);
+    const uint8_t namespace_id = BENCH_NAMESPACE_ID;
+    dict_write_data(&iter, MESSAGE_KEY_SIMPLE_APP_MESSAGE_CHUNK_NAMESPACE_ID, &namespace_id,
+                    sizeof(namespace_id));
+    dict_write_int32(&iter, MESSAGE_KEY_SIMPLE_APP_MESSAGE_CHUNK_TOTAL, count);
+    dict_write_int32(&iter, MESSAGE_KEY_SIMPLE_APP_MESSAGE_CHUNK_REMAINING, count - i - 1);
+    dict_write_uint32(&iter, MESSAGE_KEY_SIMPLE_APP_MESSAGE_CHUNK_TRANSFER_ID, transfer_id);
+    dict_write_data(&iter, MESSAGE_KEY_SIMPLE_APP_MESSAGE_CHUNK_DATA, payload->buffer + offset,
+                    length);
+
+    chunks.dicts[i] = buffer;
+    chunks.dict_sizes[i] = (uint16_t)dict_write_end(&iter);
+    dict_read_begin_from_buffer(&iter, buffer, chunks.dict_sizes[i]);
+    chunks.transfer_ids[i] =
+        dict_find(&iter, MESSAGE_KEY_SIMPLE_APP_MESSAGE_CHUNK_TRANSFER_ID)->value->data;
+  }
+
+  return chunks;
+}
+
+//! The watch ignores chunks of a transfer it already dispatched, so every message needs a new
+//! transfer ID like it gets from the phone
+static void prv_chunks_set_transfer_id(const BenchChunks *chunks, uint32_t transfer_id) {
+  for (uint32_t i = 0; i < chunks->count; i++) {
+    memcpy(chunks->transfer_ids[i], &transfer_id, sizeof(transfer_id));
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Receiving
+
+static bool prv_count_keys(const char *key, SimpleDictDataType type, const void *data,
+                           size_t data_size, void *context) {
+  (*(uint32_t *)context)++;
+  return true;
+}
+
+static void prv_message_received(const SimpleDict *message, void *context) {
+  BenchReceiveState *state = context;
+  uint32_t key_count = 0;
+  simple_dict_foreach(message, prv_count_keys, &key_count);
+  state->messages_received++;
+  if (key_count != state->expected_key_count) {
+    state->messages_malformed++;
+  }
+}
+
+static bool prv_count_view_keys(const char *key, SimpleAppMessageDataType type, const void *data,
+                                size_t data_size, void *context) {
+  (*(uint32_t *)context)++;
+  return true;
+}
+
+static void prv_message_view_received(const SimpleAppMessageView *message, void *context) {
+  BenchReceiveState *state = context;
+  uint32_t key_count = 0;
+  simple_app_message_view_foreach(message, prv_count_view_keys, &key_count);
+  // The last int key is negative for most key counts, which exercises zig-zag decoding
+  const uint32_t last_int_key = ((state->expected_key_count - 1) / 4) * 4;
+  char last_int_key_name[16];
+  snprintf(last_int_key_name, sizeof(last_int_key_name), "key%u", (unsigned int)last_int_key);
+  int32_t last_int_value;
+  state->messages_received++;
+  if ((key_count != state->expected_key_count) ||
+      !simple_app_message_view_get_int(message, last_int_key_name, &last_int_value) ||
+      (last_int_value != prv_int_for_key(last_int_key))) {
+    state->messages_malformed++;
+  }
+}
+
+static void prv_key_received(const char *key, SimpleAppMessageDataType type, const void *data,
+                             size_t data_size, void *context) {
+  BenchReceiveState *state = context;
+  state->keys_streamed++;
+}
+
+static void prv_data_piece_received(const char *key, const uint8_t *data, size_t data_size,
+                                    size_t offset, size_t total_size, void *context) {
+  BenchReceiveState *state = context;
+  if (offset + data_size == total_size) {
+    state->keys_streamed++;
+  }
+}
+
+static void prv_message_stream_ended(bool complete, void *context) {
+  BenchReceiveState *state = context;
+  state->messages_received++;
+  if (!complete || (state->keys_streamed != state->expected_key_count)) {
+    state->messages_malformed++;
+  }
+  state->keys_streamed = 0;
+}
+
+static bool prv_deliver_message(const BenchChunks *chunks) {
+  for (uint32_t i = 0; i < chunks->count; i++) {
+    if (!host_app_message_deliver_inbox(chunks->dicts[i], chunks->dict_sizes[i])) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static uint64_t prv_now_ns(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return ((uint64_t)now.tv_sec * 1000000000ull) + (uint64_t)now.tv_nsec;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Runner
+
+static int prv_run_config(const BenchConfig *config, uint32_t messages) {
+  // Null keys are skipped by the SimpleDict conversion, but the generator never emits them
+  BenchReceiveState receive_state = {
+    .expected_key_count = config->key_count,
+  };
+  const bool is_streamed = (config->api == BenchApi_Stream) || (config->api == BenchApi_Pieces);
+  const SimpleAppMessageCallbacks callbacks = {
+    .message_received = (config->api == BenchApi_Dict) ? prv_message_received : NULL,
+    .message_view_received = (config->api == BenchApi_View) ? prv_message_view_received : NULL,
+    .key_received = is_streamed ? prv_key_received : NULL,
+    .data_piece_received = (config->api == BenchApi_Pieces) ? prv_data_piece_received : NULL,
+    .message_stream_ended = is_streamed ? prv_message_stream_ended : NULL,
+  };
+  if (!simple_app_message_register_callbacks(BENCH_NAMESPACE, &callbacks, &receive_state)) {
+    fprintf(stderr, "Failed to register namespace\n");
+    return EXIT_FAILURE;
+  }
+
+  const uint32_t inbox_size =
+      config->chunk_size + simple_app_message_get_minimum_inbox_size() + 1;
+  if (!simple_app_message_request_inbox_size(inbox_size) ||
+      (simple_app_message_open() != APP_MSG_OK)) {
+    fprintf(stderr, "Failed to open AppMessage with inbox size %u\n", (unsigned int)inbox_size);
+    return EXIT_FAILURE;
+  }
+
+  BenchPayload payload = prv_payload_create(config);
+  const BenchChunks chunks = prv_chunks_create(&payload, config->chunk_size, 1);
+
+  // Warm up so lazily created state is not attributed to the measured messages
+  prv_deliver_message(&chunks);
+
+  host_heap_reset_stats();
+  HostHeapStats heap_before;
+  host_heap_get_stats(&heap_before);
+
+  const uint64_t start_ns = prv_now_ns();
+  for (uint32_t i = 0; i < messages; i++) {
+    prv_chunks_set_transfer_id(&chunks, i + 2);
+    if (!prv_deliver_message(&chunks)) {
+      fprintf(stderr, "Chunk dropped by inbox\n");
+      return EXIT_FAILURE;
+    }
+  }
+  const uint64_t elapsed_ns = prv_now_ns() - start_ns;
+
+  HostHeapStats heap_after;
+  host_heap_get_stats(&heap_after);
+
+  const double elapsed_s = (double)elapsed_ns / 1e9;
+  printf("%4s %3u %3s %6u %5u %6u %8zu %5.2f %7u %11.0f %9.1f %8.0f %9.2f %9.2f %10zu\n",
+         s_api_names[config->api], (unsigned int)config->format, config->compressed ? "lz" : "-",
+         (unsigned int)config->chunk_size, (unsigned int)config->key_count,
+         (unsigned int)config->value_size, payload.size,
+         (double)payload.raw_size / payload.size, (unsigned int)chunks.count,
+         messages / elapsed_s, (double)elapsed_ns / ((double)messages * chunks.count),
+         (double)elapsed_ns * 1024 / ((double)messages * payload.raw_size),
+         (double)heap_after.malloc_count / messages, (double)heap_after.free_count / messages,
+         heap_after.peak_bytes_in_use - heap_before.bytes_in_use);
+  fflush(stdout);
+
+  const uint32_t expected_messages = messages + 1;
+  if ((receive_state.messages_received != expected_messages) ||
+      receive_state.messages_malformed) {
+    fprintf(stderr, "Expected %u messages, received %u (%u malformed)\n",
+            (unsigned int)expected_messages, (unsigned int)receive_state.messages_received,
+            (unsigned int)receive_state.messages_malformed);
+    return EXIT_FAILURE;
+  }
+
+  // Each config runs in its own process, so the stats cover the warm up and measured messages
+  SimpleAppMessageStats stats;
+  simple_app_message_get_stats(&stats);
+  uint32_t resets = 0;
+  for (int i = 0; i < SimpleAppMessageResetReason_Count; i++) {
+    resets += stats.resets[i];
+  }
+  if ((stats.messages_completed != expected_messages) ||
+      (simple_app_message_get_namespace_messages_completed(BENCH_NAMESPACE) !=
+       expected_messages) ||
+      (stats.chunks_received != expected_messages * chunks.count) || resets ||
+      stats.inbox_drops || !stats.peak_assembly_size) {
+    fprintf(stderr, "Stats don't match: %u messages, %u chunks, %u resets, %u drops\n",
+            (unsigned int)stats.messages_completed, (unsigned int)stats.chunks_received,
+            (unsigned int)resets, (unsigned int)stats.inbox_drops);
+    return EXIT_FAILURE;
+  }
+  if (SIMPLE_APP_MESSAGE_STATIC_ALLOCATION && heap_after.malloc_count) {
+    fprintf(stderr, "Allocated %u times over %u messages without the heap\n",
+            (unsigned int)heap_after.malloc_count, (unsigned int)messages);
+    return EXIT_FAILURE;
+  }
+  if (heap_after.bytes_in_use != heap_before.bytes_in_use) {
+    fprintf(stderr, "Leaked %zd bytes over %u messages\n",
+            (ssize_t)(heap_after.bytes_in_use - heap_before.bytes_in_use),
+            (unsigned int)messages);
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
+
+//! Receives the checks' messages with the view API, the one every build has
+static bool prv_open_check(const BenchConfig *config, BenchReceiveState *receive_state) {
+  const SimpleAppMessageCallbacks callbacks = {
+    .message_view_received = prv_message_view_received,
+  };
+  const uint32_t inbox_size =
+      config->chunk_size + simple_app_message_get_minimum_inbox_size() + 1;
+  return (simple_app_message_register_callbacks(BENCH_NAMESPACE, &callbacks, receive_state) &&
+          simple_app_message_request_inbox_size(inbox_size) &&
+          (simple_app_message_open() == APP_MSG_OK));
+}
+
+//! A phone that reloads numbers its transfers from 1 again, so after the chunk size request that
+//! starts its session, a transfer with the ID of one the watch finished must still be delivered
+static int prv_run_session_check(void) {
+  const BenchConfig config = {
+    .api = BenchApi_View,
+    .format = BenchFormat_V1,
+    .chunk_size = 64,
+    .key_count = 32,
+    .value_size = 4,
+  };
+  BenchReceiveState receive_state = {
+    .expected_key_count = config.key_count,
+  };
+  if (!prv_open_check(&config, &receive_state)) {
+    fprintf(stderr, "Failed to set up the session check\n");
+    return EXIT_FAILURE;
+  }
+
+  uint8_t request[dict_calc_buffer_size(2, sizeof(uint32_t), sizeof(uint32_t))];
+  DictionaryIterator iter;
+  dict_write_begin(&iter, request, sizeof(request));
+  dict_write_uint32(&iter, MESSAGE_KEY_SIMPLE_APP_MESSAGE_CHUNK_SIZE, 1);
+  dict_write_uint32(&iter, MESSAGE_KEY_SIMPLE_APP_MESSAGE_FORMAT_VERSION, config.format);
+  const uint16_t request_size = (uint16_t)dict_write_end(&iter);
+
+  BenchPayload payload = prv_payload_create(&config);
+  const BenchChunks chunks = prv_chunks_create(&payload, config.chunk_size, 1);
+  if (!prv_deliver_message(&chunks) ||
+      !host_app_message_deliver_inbox(request, request_size) ||
+      !prv_deliver_message(&chunks)) {
+    fprintf(stderr, "Chunk dropped by inbox\n");
+    return EXIT_FAILURE;
+  }
+
+  if ((receive_state.messages_received != 2) || receive_state.messages_malformed) {
+    fprintf(stderr, "Expected a message from each session, received %u (%u malformed)\n",
+            (unsigned int)receive_state.messages_received,
+            (unsigned int)receive_state.messages_malformed);
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
+
+static void prv_count_nacks(DictionaryIterator *iterator, void *context) {
+  if (dict_find(iterator, MESSAGE_KEY_SIMPLE_APP_MESSAGE_CHUNK_NACK)) {
+    (*(uint32_t *)context)++;
+  }
+}
+
+//! Delivers a chunk and lets the watch's replies go out, as the phone acknowledges them
+static bool prv_deliver_chunk(const BenchChunks *chunks, uint32_t index) {
+  const bool delivered = host_app_message_deliver_inbox(chunks->dicts[index],
+                                                        chunks->dict_sizes[index]);
+  while (host_app_message_outbox_is_pending()) {
+    host_app_message_outbox_complete(APP_MSG_OK);
+  }
+  return delivered;
+}
+
+//! The phone resends chunks it isn't sure arrived, and can move on to the next transfer before a
+//! resend of the last one does. A finished transfer's assembly is handed to the next, and a resend
+//! arriving after that must still be recognised rather than starting the transfer over.
+static int prv_run_resend_check(void) {
+  const BenchConfig config = {
+    .api = BenchApi_View,
+    .format = BenchFormat_V1,
+    .chunk_size = 64,
+    .key_count = 32,
+    .value_size = 4,
+  };
+  BenchReceiveState receive_state = {
+    .expected_key_count = config.key_count,
+  };
+  uint32_t nacks = 0;
+  host_app_message_set_outbox_handler(prv_count_nacks, &nacks);
+  if (!prv_open_check(&config, &receive_state)) {
+    fprintf(stderr, "Failed to set up the resend check\n");
+    return EXIT_FAILURE;
+  }
+
+  BenchPayload payload = prv_payload_create(&config);
+  const BenchChunks first = prv_chunks_create(&payload, config.chunk_size, 1);
+  const BenchChunks second = prv_chunks_create(&payload, config.chunk_size, 2);
+  bool delivered = true;
+  for (uint32_t i = 0; i < first.count; i++) {
+    delivered &= prv_deliver_chunk(&first, i);
+  }
+  delivered &= prv_deliver_chunk(&second, 0);
+  delivered &= prv_deliver_chunk(&first, first.count / 2);
+  for (uint32_t i = 1; i < second.count; i++) {
+    delivered &= prv_deliver_chunk(&second, i);
+  }
+  if (!delivered) {
+    fprintf(stderr, "Chunk dropped by inbox\n");
+    return EXIT_FAILURE;
+  }
+
+  if ((receive_state.messages_received != 2) || receive_state.messages_malformed || nacks) {
+    fprintf(stderr, "Expected each transfer once, received %u (%u malformed, %u NACKs)\n",
+            (unsigned int)receive_state.messages_received,
+            (unsigned int)receive_state.messages_malformed, (unsigned int)nacks);
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
+
+static bool prv_wait_for_child(pid_t pid) {
+  int status = 0;
+  if ((pid < 0) || (waitpid(pid, &status, 0) < 0)) {
+    return false;
+  }
+  return (WIFEXITED(status) && (WEXITSTATUS(status) == EXIT_SUCCESS));
+}
+
+//! @return False if the library was built without a decoder the configuration needs
+static bool prv_is_config_supported(const BenchConfig *config) {
+  return ((SIMPLE_APP_MESSAGE_DICT_MESSAGES || (config->api != BenchApi_Dict)) &&
+          (SIMPLE_APP_MESSAGE_COMPRESSION || !config->compressed) &&
+          (config->format <= SIMPLE_APP_MESSAGE_MAX_FORMAT));
+}
+
+static bool prv_fork_config(const BenchConfig *config, uint32_t messages) {
+  if (!prv_is_config_supported(config)) {
+    return true;
+  }
+
+  const pid_t pid = fork();
+  if (pid == 0) {
+    exit(prv_run_config(config, messages));
+  }
+  return prv_wait_for_child(pid);
+}
+
+static bool prv_fork_check(int (*check)(void)) {
+  const pid_t pid = fork();
+  if (pid == 0) {
+    exit(check());
+  }
+  return prv_wait_for_child(pid);
+}
+
+static uint32_t prv_messages_for_config(const BenchConfig *config, bool quick,
+                                        uint32_t messages_override) {
+  if (messages_override) {
+    return messages_override;
+  }
+  if (quick) {
+    return BENCH_QUICK_MESSAGES;
+  }
+  BenchPayload payload = prv_payload_create(config);
+  const uint32_t messages = BENCH_BYTES_PER_CONFIG / payload.size;
+  free(payload.buffer);
+  return (messages > BENCH_MIN_MESSAGES) ? messages : BENCH_MIN_MESSAGES;
+}
+
+static void prv_print_usage(const char *program) {
+  fprintf(stderr,
+          "Usage: %s [--quick] [--messages N] [--verbose]\n"
+          "  --quick       Run a handful of configurations with few messages (smoke test)\n"
+          "  --messages N  Number of measured messages per configuration\n"
+          "  --verbose     Print the library's APP_LOG output\n",
+          program);
+}
+
+int main(int argc, char **argv) {
+  bool quick = false;
+  uint32_t messages_override = 0;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--quick") == 0) {
+      quick = true;
+    } else if ((strcmp(argv[i], "--messages") == 0) && (i + 1 < argc)) {
+      messages_override = (uint32_t)strtoul(argv[++i], NULL, 10);
+    } else if (strcmp(argv[i], "--verbose") == 0) {
+      host_log_set_enabled(true);
+    } else {
+      prv_print_usage(argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+
+  printf("%4s %3s %3s %6s %5s %6s %8s %5s %7s %11s %9s %8s %9s %9s %10s\n", "api", "fmt", "cmp",
+         "chunk", "keys", "value", "payload", "ratio", "chunks", "msgs/s", "ns/chunk", "ns/KB",
+         "malloc/m", "free/m", "peak_heap");
+  fflush(stdout);
+
+  bool success = true;
+  if (quick) {
+    for (size_t i = 0; i < ARRAY_LENGTH(s_quick_configs); i++) {
+      const BenchConfig *config = &s_quick_configs[i];
+      success &= prv_fork_config(config,
+                                 prv_messages_for_config(config, quick, messages_override));
+    }
+    success &= prv_fork_check(prv_run_session_check);
+    success &= prv_fork_check(prv_run_resend_check);
+    return success ? EXIT_SUCCESS : EXIT_FAILURE;
+  }
+
+  for (BenchApi api = 0; api < BenchApiCount; api++) {
+    for (size_t f = 0; f < ARRAY_LENGTH(s_formats); f++) {
+      for (size_t z = 0; z < ARRAY_LENGTH(s_compression); z++) {
+        for (size_t c = 0; c < ARRAY_LENGTH(s_chunk_sizes); c++) {
+          for (size_t k = 0; k < ARRAY_LENGTH(s_key_counts); k++) {
+            for (size_t v = 0; v < ARRAY_LENGTH(s_value_sizes); v++) {
+              const BenchConfig config = {
+                .api = api,
+                .format = s_formats[f],
+                .compressed = s_compression[z],
+                .chunk_size = s_chunk_sizes[c],
+                .key_count = s_key_counts[k],
+                .value_size = s_value_sizes[v],
+              };
+              success &= prv_fork_config(&config, prv_messages_for_config(&config, quick,
+                                                                          messages_override));
+            }
+          }
+        }
+      }
+    }
+  }
+  return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+//! Host stand-in for @keegan-stoneware/simple-dict.
+
+#include <pebble.h>
+
+typedef struct SimpleDict SimpleDict;
+
+typedef enum SimpleDictDataType {
+  SimpleDictDataType_Raw,
+  SimpleDictDataType_Bool,
+  SimpleDictDataType_Int,
+  SimpleDictDataType_String,
+
+  SimpleDictDataTypeCount
+} SimpleDictDataType;
+
+//! @return True to continue iterating, false to stop
+typedef bool (*SimpleDictForEachCallback)(const char *key, SimpleDictDataType type,
+                                          const void *data, size_t data_size, void *context);
+
+SimpleDict *simple_dict_create(void);
+
+bool simple_dict_update_data(SimpleDict *dict, const char *key, const void *data, size_t size);
+
+bool simple_dict_update_bool(SimpleDict *dict, const char *key, bool value);
+
+bool simple_dict_update_int(SimpleDict *dict, const char *key, int value);
+
+bool simple_dict_update_string(SimpleDict *dict, const char *key, const char *value);
+
+void simple_dict_foreach(const SimpleDict *dict, SimpleDictForEachCallback callback,
+                         void *context);
+
+void simple_dict_destroy(SimpleDict *dict);
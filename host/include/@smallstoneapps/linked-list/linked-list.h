@@ -0,0 +1,30 @@
+#pragma once
+
+//! Host stand-in for @smallstoneapps/linked-list.
+
+#include <pebble.h>
+
+typedef struct LinkedRoot LinkedRoot;
+
+typedef bool (*ObjectCompare)(void *object1, void *object2);
+typedef bool (*LinkedListForEach)(void *object, void *context);
+
+LinkedRoot *linked_list_create_root(void);
+
+uint16_t linked_list_count(LinkedRoot *root);
+
+void linked_list_append(LinkedRoot *root, void *object);
+
+void linked_list_prepend(LinkedRoot *root, void *object);
+
+void *linked_list_get(LinkedRoot *root, uint16_t index);
+
+void linked_list_remove(LinkedRoot *root, uint16_t index);
+
+void linked_list_clear(LinkedRoot *root);
+
+int16_t linked_list_find(LinkedRoot *root, void *object);
+
+int16_t linked_list_find_compare(LinkedRoot *root, void *object, ObjectCompare compare);
+
+void linked_list_foreach(LinkedRoot *root, LinkedListForEach callback, void *context);
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <stdint.h>
+
+//! Host stand-in for the header the Pebble build generates from the "messageKeys" array in
+//! package.json. Keep this list in sync with package.json and message_keys.auto.c.
+
+extern uint32_t MESSAGE_KEY_SIMPLE_APP_MESSAGE_CHUNK_DATA;
+extern uint32_t MESSAGE_KEY_SIMPLE_APP_MESSAGE_CHUNK_SIZE;
+extern uint32_t MESSAGE_KEY_SIMPLE_APP_MESSAGE_CHUNK_REMAINING;
+extern uint32_t MESSAGE_KEY_SIMPLE_APP_MESSAGE_CHUNK_TOTAL;
+extern uint32_t MESSAGE_KEY_SIMPLE_APP_MESSAGE_CHUNK_NAMESPACE;
+extern uint32_t MESSAGE_KEY_SIMPLE_APP_MESSAGE_CHUNK_TRANSFER_ID;
+extern uint32_t MESSAGE_KEY_SIMPLE_APP_MESSAGE_CHUNK_NAMESPACE_ID;
+extern uint32_t MESSAGE_KEY_SIMPLE_APP_MESSAGE_NAMESPACE_TABLE;
+extern uint32_t MESSAGE_KEY_SIMPLE_APP_MESSAGE_FORMAT_VERSION;
+extern uint32_t MESSAGE_KEY_SIMPLE_APP_MESSAGE_COMPRESSION;
+extern uint32_t MESSAGE_KEY_SIMPLE_APP_MESSAGE_CHUNK_WINDOW;
+extern uint32_t MESSAGE_KEY_SIMPLE_APP_MESSAGE_CHUNK_NACK;
+extern uint32_t MESSAGE_KEY_SIMPLE_APP_MESSAGE_CHUNK_BATCH;
+extern uint32_t MESSAGE_KEY_SIMPLE_APP_MESSAGE_CHUNK_TRACE;
+extern uint32_t MESSAGE_KEY_SIMPLE_APP_MESSAGE_WATCH_OPENED;
@@ -0,0 +1,37 @@
+#pragma once
+
+//! Host stand-in for the AppMessage portion of pebble-events.
+
+#include <pebble.h>
+
+typedef void *EventHandle;
+
+typedef struct EventAppMessageHandlers {
+  AppMessageOutboxSent sent;
+  AppMessageOutboxFailed failed;
+  AppMessageInboxReceived received;
+  AppMessageInboxDropped dropped;
+} EventAppMessageHandlers;
+
+EventHandle events_app_message_subscribe_handlers(EventAppMessageHandlers handlers,
+                                                  void *context);
+
+EventHandle events_app_message_register_inbox_received(AppMessageInboxReceived received_callback,
+                                                       void *context);
+
+EventHandle events_app_message_register_inbox_dropped(AppMessageInboxDropped dropped_callback,
+                                                      void *context);
+
+EventHandle events_app_message_register_outbox_sent(AppMessageOutboxSent sent_callback,
+                                                    void *context);
+
+EventHandle events_app_message_register_outbox_failed(AppMessageOutboxFailed failed_callback,
+                                                      void *context);
+
+void events_app_message_unsubscribe(EventHandle handle);
+
+void events_app_message_request_inbox_size(uint32_t size);
+
+void events_app_message_request_outbox_size(uint32_t size);
+
+AppMessageResult events_app_message_open(void);
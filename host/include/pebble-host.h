@@ -0,0 +1,41 @@
+#pragma once
+
+//! Controls for the host stand-ins that have no equivalent in the Pebble SDK. Only benchmark and
+//! simulator code should include this header; library sources must stick to <pebble.h>.
+
+#include <pebble.h>
+
+typedef struct HostHeapStats {
+  uint32_t malloc_count;
+  uint32_t free_count;
+  size_t bytes_in_use;
+  size_t peak_bytes_in_use;
+} HostHeapStats;
+
+void host_heap_get_stats(HostHeapStats *stats_out);
+
+//! Zeroes the malloc/free counters and restarts peak tracking from the current usage
+void host_heap_reset_stats(void);
+
+void host_log_set_enabled(bool enabled);
+
+//! Called synchronously from app_message_outbox_send() with a read iterator over the message
+typedef void (*HostOutboxHandler)(DictionaryIterator *iterator, void *context);
+
+void host_app_message_set_outbox_handler(HostOutboxHandler handler, void *context);
+
+bool host_app_message_outbox_is_pending(void);
+
+//! Finishes the pending outbox send, firing the registered sent or failed callback
+void host_app_message_outbox_complete(AppMessageResult result);
+
+//! Delivers a serialized dictionary to the inbox the same way the firmware would, including
+//! dropping it when it does not fit in the opened inbox.
+//! @return True if the message was handed to the inbox received callback
+bool host_app_message_deliver_inbox(const uint8_t *buffer, uint16_t size);
+
+//! Advances the virtual clock used by app_timer, firing every timer that comes due in order
+void host_app_timer_advance(uint32_t ms);
+
+//! @return Milliseconds until the next registered timer fires, or UINT32_MAX if there is none
+uint32_t host_app_timer_next_timeout(void);
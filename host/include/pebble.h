@@ -0,0 +1,203 @@
+#pragma once
+
+//! Host stand-in for the subset of the Pebble SDK used by simple-app-message. Only what the
+//! library touches is provided, and the Tuple/Dictionary wire layout matches the firmware so
+//! that buffer sizes measured on the host are representative of the watch.
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "message_keys.auto.h"
+
+#define ARRAY_LENGTH(array) (sizeof((array)) / sizeof((array)[0]))
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Logging
+
+typedef enum {
+  APP_LOG_LEVEL_ERROR = 1,
+  APP_LOG_LEVEL_WARNING = 50,
+  APP_LOG_LEVEL_INFO = 100,
+  APP_LOG_LEVEL_DEBUG = 200,
+  APP_LOG_LEVEL_DEBUG_VERBOSE = 255,
+} AppLogLevel;
+
+void app_log(uint8_t log_level, const char *src_filename, int src_line_number, const char *fmt,
+             ...) __attribute__((format(printf, 4, 5)));
+
+#define APP_LOG(level, fmt, args...) app_log(level, __FILE__, __LINE__, fmt, ## args)
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Heap
+//
+// All allocations made by the library (and by the stand-in dependencies) are routed through a
+// counting allocator so the benchmark can report malloc/free counts and peak heap usage.
+
+void *host_heap_malloc(size_t size);
+void *host_heap_calloc(size_t count, size_t size);
+void *host_heap_realloc(void *ptr, size_t size);
+void host_heap_free(void *ptr);
+
+#ifndef HOST_HEAP_NO_REDIRECT
+#define malloc(size) host_heap_malloc(size)
+#define calloc(count, size) host_heap_calloc(count, size)
+#define realloc(ptr, size) host_heap_realloc(ptr, size)
+#define free(ptr) host_heap_free(ptr)
+#endif
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Dictionary
+
+typedef enum {
+  DICT_OK = 0,
+  DICT_NOT_ENOUGH_STORAGE = 1 << 1,
+  DICT_INVALID_ARGS = 1 << 2,
+  DICT_INTERNAL_INCONSISTENCY = 1 << 3,
+  DICT_MALLOC_FAILED = 1 << 4,
+} DictionaryResult;
+
+typedef enum {
+  TUPLE_BYTE_ARRAY = 0,
+  TUPLE_CSTRING = 1,
+  TUPLE_UINT = 2,
+  TUPLE_INT = 3,
+} TupleType;
+
+typedef struct __attribute__((__packed__)) {
+  uint32_t key;
+  TupleType type:8;
+  uint16_t length;
+  union {
+    uint8_t data[0];
+    char cstring[0];
+    uint8_t uint8;
+    uint16_t uint16;
+    uint32_t uint32;
+    int8_t int8;
+    int16_t int16;
+    int32_t int32;
+  } value[];
+} Tuple;
+
+typedef struct __attribute__((__packed__)) Dictionary {
+  uint8_t count;
+  Tuple head[];
+} Dictionary;
+
+typedef struct {
+  Dictionary *dictionary;
+  const void *end;
+  Tuple *cursor;
+} DictionaryIterator;
+
+uint32_t dict_calc_buffer_size(const uint8_t tuple_count, ...);
+
+DictionaryResult dict_write_begin(DictionaryIterator *iter, uint8_t * const buffer,
+                                  const uint16_t size);
+
+DictionaryResult dict_write_data(DictionaryIterator *iter, const uint32_t key,
+                                 const uint8_t * const data, const uint16_t size);
+
+DictionaryResult dict_write_cstring(DictionaryIterator *iter, const uint32_t key,
+                                    const char * const cstring);
+
+DictionaryResult dict_write_int(DictionaryIterator *iter, const uint32_t key,
+                                const void *integer, const uint8_t width_bytes,
+                                const bool is_signed);
+
+DictionaryResult dict_write_uint8(DictionaryIterator *iter, const uint32_t key,
+                                  const uint8_t value);
+
+DictionaryResult dict_write_uint16(DictionaryIterator *iter, const uint32_t key,
+                                   const uint16_t value);
+
+DictionaryResult dict_write_uint32(DictionaryIterator *iter, const uint32_t key,
+                                   const uint32_t value);
+
+DictionaryResult dict_write_int32(DictionaryIterator *iter, const uint32_t key,
+                                  const int32_t value);
+
+uint32_t dict_write_end(DictionaryIterator *iter);
+
+Tuple *dict_read_begin_from_buffer(DictionaryIterator *iter, const uint8_t * const buffer,
+                                   const uint16_t size);
+
+Tuple *dict_read_next(DictionaryIterator *iter);
+
+Tuple *dict_read_first(DictionaryIterator *iter);
+
+Tuple *dict_find(const DictionaryIterator *iter, const uint32_t key);
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// AppMessage
+
+typedef enum {
+  APP_MSG_OK = 0,
+  APP_MSG_SEND_TIMEOUT = 1 << 1,
+  APP_MSG_SEND_REJECTED = 1 << 2,
+  APP_MSG_NOT_CONNECTED = 1 << 3,
+  APP_MSG_APP_NOT_RUNNING = 1 << 4,
+  APP_MSG_INVALID_ARGS = 1 << 5,
+  APP_MSG_BUSY = 1 << 6,
+  APP_MSG_BUFFER_OVERFLOW = 1 << 7,
+  APP_MSG_ALREADY_RELEASED = 1 << 9,
+  APP_MSG_CALLBACK_ALREADY_REGISTERED = 1 << 10,
+  APP_MSG_CALLBACK_NOT_REGISTERED = 1 << 11,
+  APP_MSG_OUT_OF_MEMORY = 1 << 12,
+  APP_MSG_CLOSED = 1 << 13,
+  APP_MSG_INTERNAL_ERROR = 1 << 14,
+  APP_MSG_INVALID_STATE = 1 << 15,
+} AppMessageResult;
+
+typedef void (*AppMessageInboxReceived)(DictionaryIterator *iterator, void *context);
+typedef void (*AppMessageInboxDropped)(AppMessageResult reason, void *context);
+typedef void (*AppMessageOutboxSent)(DictionaryIterator *iterator, void *context);
+typedef void (*AppMessageOutboxFailed)(DictionaryIterator *iterator, AppMessageResult reason,
+                                       void *context);
+
+uint32_t app_message_inbox_size_maximum(void);
+
+uint32_t app_message_outbox_size_maximum(void);
+
+AppMessageResult app_message_outbox_begin(DictionaryIterator **iterator);
+
+AppMessageResult app_message_outbox_send(void);
+
+AppMessageResult app_message_open(const uint32_t size_inbound, const uint32_t size_outbound);
+
+void *app_message_get_context(void);
+
+void *app_message_set_context(void *context);
+
+AppMessageInboxReceived app_message_register_inbox_received(
+    AppMessageInboxReceived received_callback);
+
+AppMessageInboxDropped app_message_register_inbox_dropped(AppMessageInboxDropped dropped_callback);
+
+AppMessageOutboxSent app_message_register_outbox_sent(AppMessageOutboxSent sent_callback);
+
+AppMessageOutboxFailed app_message_register_outbox_failed(AppMessageOutboxFailed failed_callback);
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// AppTimer
+
+typedef struct AppTimer AppTimer;
+
+typedef void (*AppTimerCallback)(void *data);
+
+AppTimer *app_timer_register(uint32_t timeout_ms, AppTimerCallback callback, void *callback_data);
+
+bool app_timer_reschedule(AppTimer *timer_handle, uint32_t new_timeout_ms);
+
+void app_timer_cancel(AppTimer *timer_handle);
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Wall Time
+
+//! Reads the same virtual clock as app_timer
+uint16_t time_ms(time_t *tloc, uint16_t *out_ms);
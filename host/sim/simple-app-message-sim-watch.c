@@ -0,0 +1,258 @@
+//! Watch side of the link simulator. Runs the library's real receive path against the host
+//! stand-ins and is driven by simple-app-message-sim.js over stdin and stdout, one command per
+//! line, so the phone side runs the real index.js against the same watch code a Pebble would.
+//!
+//! Commands:
+//!   inbox <hex>    Delivers a serialized dictionary to the inbox, replying "accepted 0|1"
+//!   sent <result>  Finishes the pending outbox send with an AppMessageResult
+//!   advance <ms>   Moves the virtual clock on, firing every timer that comes due
+//!   stats          Prints the receive stats and heap usage
+//!   call <method> <id>
+//!                  Calls a method on the phone with an "id" int key, printing
+//!                  "response <method> <id> <error>" once it's answered, where error is "-" if the
+//!                  call succeeded
+//!
+//! Methods passed with --rpc-method answer every call right away with the call's "id" int key.
+//! Namespaces passed with --sync are received as state sync updates, and report the merged state.
+//!
+//! While a command runs, every message the watch sends is printed as "outbox <hex>" and every
+//! message delivered to a namespace as "received <namespace> <id> <num_keys>", where id is the
+//! message's "id" int key, or -1 if it has none. Each reply ends with "done <ms>", the time until
+//! the next timer fires, or -1 if none is set.
+
+#include "pebble-host.h"
+
+#include "simple-app-message.h"
+
+#include <stdio.h>
+
+#define SIM_LINE_MAX_SIZE (64 * 1024)
+#define SIM_DEFAULT_INBOX_SIZE (256)
+#define SIM_MAX_NAMESPACES (8)
+#define SIM_RPC_TIMEOUT_MS (30000)
+
+typedef struct SimCall {
+  char method[SIMPLE_APP_MESSAGE_NAMESPACE_MAX_SIZE_BYTES];
+  int32_t id;
+} SimCall;
+
+static char s_namespaces[SIM_MAX_NAMESPACES][SIMPLE_APP_MESSAGE_NAMESPACE_MAX_SIZE_BYTES];
+static char s_methods[SIM_MAX_NAMESPACES][SIMPLE_APP_MESSAGE_NAMESPACE_MAX_SIZE_BYTES];
+static char s_sync_namespaces[SIM_MAX_NAMESPACES][SIMPLE_APP_MESSAGE_NAMESPACE_MAX_SIZE_BYTES];
+
+static void prv_print_hex(const char *event, const uint8_t *bytes, size_t size) {
+  printf("%s ", event);
+  for (size_t i = 0; i < size; i++) {
+    printf("%02x", bytes[i]);
+  }
+  printf("\n");
+}
+
+static size_t prv_parse_hex(const char *hex, uint8_t *bytes_out, size_t max_size) {
+  size_t size = 0;
+  unsigned int byte;
+  while ((size < max_size) && (sscanf(hex, "%2x", &byte) == 1)) {
+    bytes_out[size++] = (uint8_t)byte;
+    hex += 2;
+  }
+  return size;
+}
+
+static void prv_outbox_handler(DictionaryIterator *iterator, void *context) {
+  prv_print_hex("outbox", (const uint8_t *)iterator->dictionary,
+                (const uint8_t *)iterator->end - (const uint8_t *)iterator->dictionary);
+}
+
+static void prv_message_view_received(const SimpleAppMessageView *message, void *context) {
+  const char *namespace = context;
+  int32_t id;
+  if (!simple_app_message_view_get_int(message, "id", &id)) {
+    id = -1;
+  }
+  printf("received %s %d %u\n", namespace, (int)id,
+         (unsigned int)simple_app_message_view_get_num_keys(message));
+}
+
+typedef struct SimDictSummary {
+  int32_t id;
+  unsigned int num_keys;
+} SimDictSummary;
+
+static bool prv_summarize_callback(const char *key, SimpleDictDataType type, const void *data,
+                                   size_t data_size, void *context) {
+  SimDictSummary *summary = context;
+  summary->num_keys++;
+  if ((type == SimpleDictDataType_Int) && !strcmp(key, "id")) {
+    summary->id = *((int *)data);
+  }
+  return true;
+}
+
+static void prv_message_received(const SimpleDict *message, void *context) {
+  SimDictSummary summary = {
+    .id = -1,
+  };
+  simple_dict_foreach(message, prv_summarize_callback, &summary);
+  printf("received %s %d %u\n", (const char *)context, (int)summary.id, summary.num_keys);
+}
+
+static void prv_rpc_request_received(const SimpleAppMessageRpcRequest *request,
+                                     const SimpleAppMessageView *params, void *context) {
+  int32_t id;
+  if (!simple_app_message_view_get_int(params, "id", &id)) {
+    id = -1;
+  }
+  SimpleDict *result = simple_dict_create();
+  simple_dict_update_int(result, "id", id);
+  simple_app_message_rpc_respond(request, result);
+  simple_dict_destroy(result);
+}
+
+static void prv_rpc_response_received(const SimpleAppMessageView *result, const char *error,
+                                      void *context) {
+  SimCall *call = context;
+  // Errors are printed as one word so the line splits on spaces
+  printf("response %s %d %s\n", call->method, (int)call->id, error ? "error" : "-");
+  free(call);
+}
+
+static void prv_call(char *arguments) {
+  SimCall *call = calloc(1, sizeof(SimCall));
+  char *id = strchr(arguments, ' ');
+  if (!id || !call || (id - arguments >= SIMPLE_APP_MESSAGE_NAMESPACE_MAX_SIZE_BYTES)) {
+    fprintf(stderr, "Bad call %s\n", arguments);
+    free(call);
+    return;
+  }
+  *(id++) = '\0';
+  strcpy(call->method, arguments);
+  call->id = (int32_t)atol(id);
+
+  SimpleDict *params = simple_dict_create();
+  simple_dict_update_int(params, "id", call->id);
+  if (!simple_app_message_rpc_call(call->method, params, SIM_RPC_TIMEOUT_MS,
+                                   prv_rpc_response_received, call)) {
+    prv_rpc_response_received(NULL, "not sent", call);
+  }
+  simple_dict_destroy(params);
+}
+
+static void prv_print_stats(void) {
+  SimpleAppMessageStats stats;
+  simple_app_message_get_stats(&stats);
+  uint32_t resets = 0;
+  for (int i = 0; i < SimpleAppMessageResetReason_Count; i++) {
+    resets += stats.resets[i];
+  }
+  HostHeapStats heap;
+  host_heap_get_stats(&heap);
+  printf("stats chunks=%u bytes=%u messages=%u resets=%u drops=%u peak_assembly=%zu "
+         "peak_dispatch_queue=%zu peak_heap=%zu\n", (unsigned int)stats.chunks_received,
+         (unsigned int)stats.bytes_received, (unsigned int)stats.messages_completed,
+         (unsigned int)resets, (unsigned int)stats.inbox_drops, stats.peak_assembly_size,
+         stats.peak_dispatch_queue_depth, heap.peak_bytes_in_use);
+}
+
+static void prv_handle_command(char *line) {
+  static uint8_t s_buffer[SIM_LINE_MAX_SIZE / 2];
+  char *argument = strchr(line, ' ');
+  if (argument) {
+    *(argument++) = '\0';
+  }
+
+  if (!strcmp(line, "inbox") && argument) {
+    const size_t size = prv_parse_hex(argument, s_buffer, sizeof(s_buffer));
+    printf("accepted %d\n", host_app_message_deliver_inbox(s_buffer, size));
+  } else if (!strcmp(line, "sent") && argument) {
+    host_app_message_outbox_complete((AppMessageResult)atoi(argument));
+  } else if (!strcmp(line, "advance") && argument) {
+    host_app_timer_advance((uint32_t)atol(argument));
+  } else if (!strcmp(line, "call") && argument) {
+    prv_call(argument);
+  } else if (!strcmp(line, "stats")) {
+    prv_print_stats();
+  } else {
+    fprintf(stderr, "Unknown command %s\n", line);
+  }
+
+  const uint32_t next_timeout = host_app_timer_next_timeout();
+  printf("done %ld\n", (next_timeout == UINT32_MAX) ? -1L : (long)next_timeout);
+  fflush(stdout);
+}
+
+static void prv_print_usage(const char *program) {
+  fprintf(stderr, "Usage: %s [--inbox-size BYTES] [--dispatch-queue-depth MESSAGES] "
+          "[--rpc-method METHOD]... [--sync NAMESPACE]... NAMESPACE...\n", program);
+}
+
+int main(int argc, char **argv) {
+  uint32_t inbox_size = SIM_DEFAULT_INBOX_SIZE;
+  size_t dispatch_queue_depth = 0;
+  size_t num_namespaces = 0;
+  size_t num_methods = 0;
+  size_t num_sync_namespaces = 0;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--inbox-size") && (i + 1 < argc)) {
+      inbox_size = (uint32_t)atol(argv[++i]);
+    } else if (!strcmp(argv[i], "--dispatch-queue-depth") && (i + 1 < argc)) {
+      dispatch_queue_depth = (size_t)atol(argv[++i]);
+    } else if (!strcmp(argv[i], "--rpc-method") && (i + 1 < argc) &&
+               (num_methods < SIM_MAX_NAMESPACES) &&
+               (strlen(argv[i + 1]) < SIMPLE_APP_MESSAGE_NAMESPACE_MAX_SIZE_BYTES)) {
+      strcpy(s_methods[num_methods++], argv[++i]);
+    } else if (!strcmp(argv[i], "--sync") && (i + 1 < argc) &&
+               (num_sync_namespaces < SIM_MAX_NAMESPACES) &&
+               (strlen(argv[i + 1]) < SIMPLE_APP_MESSAGE_NAMESPACE_MAX_SIZE_BYTES)) {
+      strcpy(s_sync_namespaces[num_sync_namespaces++], argv[++i]);
+    } else if ((num_namespaces < SIM_MAX_NAMESPACES) &&
+               (strlen(argv[i]) < SIMPLE_APP_MESSAGE_NAMESPACE_MAX_SIZE_BYTES)) {
+      strcpy(s_namespaces[num_namespaces++], argv[i]);
+    } else {
+      prv_print_usage(argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+
+  host_log_set_enabled(false);
+  host_app_message_set_outbox_handler(prv_outbox_handler, NULL);
+  simple_app_message_set_dispatch_queue_depth(dispatch_queue_depth);
+  for (size_t i = 0; i < num_namespaces; i++) {
+    const SimpleAppMessageCallbacks callbacks = {
+      .message_view_received = prv_message_view_received,
+    };
+    if (!simple_app_message_register_callbacks(s_namespaces[i], &callbacks, s_namespaces[i])) {
+      fprintf(stderr, "Failed to register namespace %s\n", s_namespaces[i]);
+      return EXIT_FAILURE;
+    }
+  }
+  for (size_t i = 0; i < num_sync_namespaces; i++) {
+    const SimpleAppMessageCallbacks callbacks = {
+      .message_received = prv_message_received,
+    };
+    if (!simple_app_message_register_callbacks(s_sync_namespaces[i], &callbacks,
+                                               s_sync_namespaces[i])) {
+      fprintf(stderr, "Failed to register namespace %s\n", s_sync_namespaces[i]);
+      return EXIT_FAILURE;
+    }
+  }
+  for (size_t i = 0; i < num_methods; i++) {
+    if (!simple_app_message_rpc_register_method(s_methods[i], prv_rpc_request_received, NULL)) {
+      fprintf(stderr, "Failed to register method %s\n", s_methods[i]);
+      return EXIT_FAILURE;
+    }
+  }
+  if (!simple_app_message_request_inbox_size(inbox_size) ||
+      (simple_app_message_open() != APP_MSG_OK)) {
+    fprintf(stderr, "Failed to open AppMessage with inbox size %u\n", (unsigned int)inbox_size);
+    return EXIT_FAILURE;
+  }
+
+  static char s_line[SIM_LINE_MAX_SIZE];
+  while (fgets(s_line, sizeof(s_line), stdin)) {
+    s_line[strcspn(s_line, "\r\n")] = '\0';
+    if (s_line[0]) {
+      prv_handle_command(s_line);
+    }
+  }
+  return EXIT_SUCCESS;
+}
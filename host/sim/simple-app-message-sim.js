@@ -0,0 +1,927 @@
+'use strict';
+
+/**
+ * Link simulator. Connects the real src/js/index.js, with the Pebble API
+ * stubbed out like test/js/spec does, to the real C receive path built for the
+ * host (simple-app-message-sim-watch), through a link with configurable
+ * latency, bandwidth, inbox size, drop rate and reordering. Everything runs on
+ * one virtual clock shared by both sides, so runs are deterministic and take
+ * as long as the simulation needs rather than the time they model.
+ *
+ * Run with the dev dependencies installed, after building the host targets:
+ *   node host/sim/simple-app-message-sim.js --workload bulk --latency 50
+ */
+
+var childProcess = require('child_process');
+var path = require('path');
+var mockRequire = require('mock-require');
+
+var ROOT = path.join(__dirname, '..', '..');
+var FORMATS = require(path.join(ROOT, 'src', 'js', 'lib', 'formats'));
+var serialize = require(path.join(ROOT, 'src', 'js', 'lib', 'serialize'));
+var TUPLE_TYPES = {BYTE_ARRAY: 0, CSTRING: 1, UINT: 2, INT: 3};
+// AppMessageResult values the watch's outbox is completed with
+var APP_MSG_OK = 0;
+var APP_MSG_SEND_TIMEOUT = 1 << 1;
+
+var DEFAULTS = {
+  workload: 'bulk',
+  // messages the workload sends, and bytes per message where it has a size
+  count: 20,
+  size: 512,
+  // ms between sends for workloads that spread them out
+  interval: 20,
+  // one way ms, plus up to reorder ms of jitter per packet that can reorder
+  // packets
+  latency: 30,
+  reorder: 0,
+  // bytes per second in each direction
+  bandwidth: 4000,
+  inboxSize: 256,
+  // complete messages the watch delivers together from a timer, 0 delivers
+  // each from the inbox handler
+  dispatchQueueDepth: 0,
+  // chance of a packet being lost in either direction
+  dropRate: 0,
+  // ms before the sender of a lost packet is told it failed
+  ackTimeout: 1000,
+  // make each call once the previous one is answered
+  sequential: false,
+  // ms the phone takes to answer each call in the fetch workload, like a web
+  // request would
+  handlerDelay: 0,
+  // index.js settings, only changed if set
+  windowSize: null,
+  batchWindow: null,
+  // gives up on messages that haven't arrived by then, in virtual ms
+  maxTime: 600000,
+  seed: 1,
+  watch: path.join(ROOT, 'host', 'build', 'simple-app-message-sim-watch'),
+  json: false
+};
+
+/**
+ * Scripted workloads. Each sends its messages through send(namespace, data)
+ * at the virtual times it schedules them for, and lists the namespaces the
+ * watch registers. Every message carries an id key the watch reports back.
+ */
+var WORKLOADS = {
+  // back to back messages for one namespace, each with a string of size
+  // bytes
+  bulk: {
+    namespaces: ['bulk'],
+    run: function(sim, options) {
+      for (var i = 0; i < options.count; i++) {
+        sim.send('bulk', {id: i, body: sim.randomText(options.size)});
+      }
+    }
+  },
+  // small updates for several namespaces spread out over time, which is what
+  // batching is for
+  chatty: {
+    namespaces: ['weather', 'steps', 'battery'],
+    run: function(sim, options) {
+      var namespaces = this.namespaces;
+      for (var i = 0; i < options.count; i++) {
+        sim.sendAt(i * options.interval, namespaces[i % namespaces.length],
+                   {id: i, value: i * 7});
+      }
+    }
+  },
+  // chart series of size bytes, which v3 sends as packed arrays
+  series: {
+    namespaces: ['series'],
+    run: function(sim, options) {
+      for (var i = 0; i < options.count; i++) {
+        var points = new Int16Array(Math.max(1, options.size >> 1));
+        for (var p = 0; p < points.length; p++) {
+          points[p] = Math.round(Math.sin((i + p) / 8) * 2000);
+        }
+        sim.send('series', {id: i, points: points});
+      }
+    }
+  },
+  // calls to a method the watch answers, like the fetches an app makes as
+  // it starts, all in flight at once unless sequential is set
+  rpc: {
+    namespaces: [],
+    methods: ['fetch'],
+    run: function(sim, options) {
+      var next = 0;
+      var call = function() {
+        var id = next++;
+        sim.call('fetch', {id: id, body: sim.randomText(options.size)},
+                 function() {
+                   if (options.sequential && next < options.count) {
+                     call();
+                   }
+                 });
+      };
+      for (var i = 0; i < (options.sequential ? 1 : options.count); i++) {
+        call();
+      }
+    }
+  },
+  // a state of count keys of size bytes between them, kept in sync with the
+  // watch while one key changes at a time
+  state: {
+    namespaces: [],
+    syncNamespaces: ['state'],
+    run: function(sim, options) {
+      var state = {};
+      for (var k = 0; k < options.count; k++) {
+        state['key' + k] = sim.randomText(Math.max(1, options.size /
+                                                   options.count));
+      }
+      for (var i = 0; i < options.count; i++) {
+        state['key' + i] = sim.randomText(state['key' + i].length);
+        state.id = i;
+        sim.syncAt(i * options.interval, 'state', state);
+      }
+    }
+  },
+  // calls the watch makes to a method the phone answers with size bytes
+  fetch: {
+    namespaces: [],
+    run: function(sim, options) {
+      var responses = [];
+      for (var i = 0; i < options.count; i++) {
+        responses.push({id: i, body: sim.randomText(options.size)});
+      }
+      sim.simpleAppMessage.handle('fetch', function(params, respond) {
+        setTimeout(function() {
+          respond(null, responses[params.id]);
+        }, options.handlerDelay);
+      });
+
+      var next = 0;
+      var call = function() {
+        sim.watchCall('fetch', responses[next++], function() {
+          if (options.sequential && next < options.count) {
+            call();
+          }
+        });
+      };
+      for (i = 0; i < (options.sequential ? 1 : options.count); i++) {
+        call();
+      }
+    }
+  }
+};
+
+/**
+ * @return {object} message key IDs, numbered in package.json order like the
+ * Pebble build numbers them
+ */
+function messageKeys() {
+  var keys = {};
+  require(path.join(ROOT, 'package.json')).pebble.messageKeys
+    .forEach(function(name, index) {
+      keys[name] = index;
+    });
+  return keys;
+}
+
+/**
+ * @param {Array.<string>} argv
+ * @return {object}
+ */
+function parseOptions(argv) {
+  var options = {};
+  Object.keys(DEFAULTS).forEach(function(name) {
+    options[name] = DEFAULTS[name];
+  });
+
+  for (var i = 0; i < argv.length; i++) {
+    // --drop-rate sets dropRate
+    var name = argv[i].replace(/^--/, '').replace(/-(.)/g, function(m, c) {
+      return c.toUpperCase();
+    });
+    if (!(name in DEFAULTS)) {
+      throw new Error('Unknown option ' + argv[i]);
+    }
+    if (typeof DEFAULTS[name] === 'boolean') {
+      options[name] = true;
+    } else {
+      var value = argv[++i];
+      options[name] = typeof DEFAULTS[name] === 'string' ? value : +value;
+    }
+  }
+
+  if (!WORKLOADS[options.workload]) {
+    throw new Error('Unknown workload ' + options.workload + ', expected ' +
+                    Object.keys(WORKLOADS).join(', '));
+  }
+  return options;
+}
+
+/**
+ * @param {number} seed
+ * @return {function} uniform random numbers in [0, 1), the same ones for the
+ * same seed
+ */
+function random(seed) {
+  var state = seed >>> 0;
+  return function() {
+    state = (state + 0x6D2B79F5) >>> 0;
+    var t = state;
+    t = Math.imul(t ^ (t >>> 15), t | 1);
+    t ^= t + Math.imul(t ^ (t >>> 7), t | 61);
+    return ((t ^ (t >>> 14)) >>> 0) / 4294967296;
+  };
+}
+
+/**
+ * Serialize an AppMessage payload the way the firmware lays it out: a tuple
+ * count, then per tuple a uint32 key, a type byte, a uint16 length and the
+ * value. Numbers go as int32, like PebbleKit JS sends them.
+ * @param {object} payload - keyed by message key ID
+ * @return {Buffer}
+ */
+function encodeDictionary(payload) {
+  var keys = Object.keys(payload);
+  var tuples = keys.map(function(key) {
+    var val = payload[key];
+    var type = TUPLE_TYPES.BYTE_ARRAY;
+    var value;
+    if (typeof val === 'string') {
+      type = TUPLE_TYPES.CSTRING;
+      value = Buffer.from(val + '\0', 'utf8');
+    } else if (typeof val === 'number' || typeof val === 'boolean') {
+      type = TUPLE_TYPES.INT;
+      value = Buffer.alloc(4);
+      value.writeInt32LE(+val | 0, 0);
+    } else {
+      value = Buffer.from(val);
+    }
+
+    var header = Buffer.alloc(7);
+    header.writeUInt32LE(+key, 0);
+    header.writeUInt8(type, 4);
+    header.writeUInt16LE(value.length, 5);
+    return Buffer.concat([header, value]);
+  });
+  return Buffer.concat([Buffer.from([keys.length])].concat(tuples));
+}
+
+/**
+ * @param {Buffer} bytes - a dictionary laid out like encodeDictionary()
+ * @param {object} names - message key names, keyed by ID
+ * @return {object} payload keyed by message key name, like PebbleKit JS
+ * delivers it
+ */
+function decodeDictionary(bytes, names) {
+  var payload = {};
+  var offset = 1;
+  for (var i = 0; i < bytes[0]; i++) {
+    var key = bytes.readUInt32LE(offset);
+    var type = bytes.readUInt8(offset + 4);
+    var length = bytes.readUInt16LE(offset + 5);
+    var value = bytes.subarray(offset + 7, offset + 7 + length);
+    offset += 7 + length;
+
+    if (type === TUPLE_TYPES.CSTRING) {
+      value = value.toString('utf8').replace(/\0.*$/, '');
+    } else if (type === TUPLE_TYPES.INT || type === TUPLE_TYPES.UINT) {
+      value = type === TUPLE_TYPES.INT ?
+        value.readIntLE(0, length) : value.readUIntLE(0, length);
+    } else {
+      value = Array.prototype.slice.call(value);
+    }
+    payload[names[key]] = value;
+  }
+  return payload;
+}
+
+/**
+ * The watch process, which answers one command at a time
+ * @param {string} file
+ * @param {Array.<string>} args
+ * @return {void}
+ */
+function Watch(file, args) {
+  var self = this;
+  self._process = childProcess.spawn(file, args,
+                                     {stdio: ['pipe', 'pipe', 'inherit']});
+  self._pending = [];
+  self._buffered = '';
+  // ms until the watch's next timer fires, -1 if none is set
+  self.nextTimeout = -1;
+
+  self._process.stdout.setEncoding('utf8');
+  self._process.stdout.on('data', function(text) {
+    var lines = (self._buffered + text).split('\n');
+    self._buffered = lines.pop();
+    lines.forEach(function(line) {
+      var command = self._pending[0];
+      if (line.indexOf('done ') === 0) {
+        self._pending.shift();
+        self.nextTimeout = +line.slice(5);
+        command.callback(command.lines);
+      } else {
+        command.lines.push(line);
+      }
+    });
+  });
+}
+
+/**
+ * @param {string} line
+ * @param {function} callback - called with the lines the watch printed
+ * @return {void}
+ */
+Watch.prototype.command = function(line, callback) {
+  this._pending.push({lines: [], callback: callback});
+  this._process.stdin.write(line + '\n');
+};
+
+/**
+ * @return {void}
+ */
+Watch.prototype.close = function() {
+  this._process.stdin.end();
+};
+
+/**
+ * @param {object} options - see DEFAULTS
+ * @return {void}
+ */
+function Simulator(options) {
+  this.options = options;
+  this.now = 1000000;
+  this.random = random(options.seed);
+
+  this._events = [];
+  this._nextEventId = 1;
+  this._cancelled = {};
+  this._watchNow = this.now;
+  this._linkFree = {down: 0, up: 0};
+  this._listeners = {};
+  this._messages = [];
+  this._keys = messageKeys();
+  this._keyNames = {};
+  this._firstSend = Infinity;
+  this._lastDelivery = 0;
+  this._watchStats = '';
+  this.linkStats = {packets: 0, bytes: 0, dropped: 0, nacked: 0};
+
+  var self = this;
+  Object.keys(self._keys).forEach(function(name) {
+    self._keyNames[self._keys[name]] = name;
+  });
+}
+
+/**
+ * Stand in for the timer and clock globals and the Pebble API, then load the
+ * library against them
+ * @return {void}
+ */
+Simulator.prototype.install = function() {
+  var self = this;
+
+  global.setTimeout = function(fn, ms) {
+    return self.schedule(Math.max(0, ms | 0), function(done) {
+      fn();
+      done();
+    });
+  };
+  global.clearTimeout = function(id) {
+    self._cancelled[id] = true;
+  };
+  Date.now = function() {
+    return self.now;
+  };
+
+  global.Pebble = {
+    platform: 'sim',
+    addEventListener: function(name, listener) {
+      (self._listeners[name] = self._listeners[name] || []).push(listener);
+    },
+    removeEventListener: function(name, listener) {
+      self._listeners[name] = (self._listeners[name] || [])
+        .filter(function(other) {
+          return other !== listener;
+        });
+    },
+    sendAppMessage: function(payload, success, failure) {
+      self._sendToWatch(encodeDictionary(payload), success, failure);
+    }
+  };
+
+  mockRequire('message_keys', self._keys);
+  self.simpleAppMessage = require(path.join(ROOT, 'src', 'js', 'index.js'));
+  if (self.options.windowSize !== null) {
+    self.simpleAppMessage._windowSize = self.options.windowSize;
+  }
+  if (self.options.batchWindow !== null) {
+    self.simpleAppMessage.setBatchWindow(self.options.batchWindow);
+  }
+};
+
+/**
+ * @param {number} delay - ms from now
+ * @param {function} run - called with a function to call once it's done
+ * @return {number} ID for clearTimeout()
+ */
+Simulator.prototype.schedule = function(delay, run) {
+  var event = {time: this.now + delay, id: this._nextEventId++, run: run};
+  var index = this._events.length;
+  // events due at the same time run in the order they were scheduled
+  while (index > 0 && this._events[index - 1].time > event.time) {
+    index--;
+  }
+  this._events.splice(index, 0, event);
+  return event.id;
+};
+
+/**
+ * @param {number} size
+ * @return {string} text that compresses about as well as real content
+ */
+Simulator.prototype.randomText = function(size) {
+  var words = ['sun', 'cloud', 'rain', 'wind', 'temp', 'high', 'low', '12',
+               '7', 'km/h', 'mm', 'NE', 'SW', '%'];
+  var text = '';
+  while (text.length < size) {
+    text += words[Math.floor(this.random() * words.length)] + ' ';
+  }
+  return text.slice(0, size);
+};
+
+/**
+ * @param {string} namespace
+ * @param {object} data - should have an id key for the watch to report
+ * @return {void}
+ */
+Simulator.prototype.send = function(namespace, data) {
+  this.sendAt(0, namespace, data);
+};
+
+/**
+ * @param {number} delay - ms from now
+ * @param {string} namespace
+ * @param {object} data
+ * @return {void}
+ */
+Simulator.prototype.sendAt = function(delay, namespace, data) {
+  var self = this;
+  var message = {
+    namespace: namespace,
+    id: data.id,
+    size: serialize(data, FORMATS.LATEST).length,
+    sentAt: null,
+    deliveredAt: null,
+    result: undefined,
+    done: false
+  };
+  self._messages.push(message);
+
+  self.schedule(delay, function(done) {
+    message.sentAt = self.now;
+    self._firstSend = Math.min(self._firstSend, self.now);
+    self.simpleAppMessage.send(namespace, data, function(result) {
+      message.done = true;
+      message.result = result;
+    });
+    done();
+  });
+};
+
+/**
+ * Sync a state with the watch, which counts as delivered once the watch has
+ * the whole state, or a later one that superseded it
+ * @param {number} delay - ms from now
+ * @param {string} namespace
+ * @param {object} state - should have an id key, copied as it is now
+ * @return {void}
+ */
+Simulator.prototype.syncAt = function(delay, namespace, state) {
+  var self = this;
+  var data = {};
+  Object.keys(state).forEach(function(key) {
+    data[key] = state[key];
+  });
+  var message = {
+    namespace: namespace,
+    id: data.id,
+    size: serialize(data, FORMATS.LATEST).length,
+    sentAt: null,
+    deliveredAt: null,
+    result: undefined,
+    done: false,
+    synced: true
+  };
+  self._messages.push(message);
+
+  self.schedule(delay, function(done) {
+    message.sentAt = self.now;
+    self._firstSend = Math.min(self._firstSend, self.now);
+    self.simpleAppMessage.sync(namespace, data, function(result) {
+      message.done = true;
+      message.result = result;
+    });
+    done();
+  });
+};
+
+/**
+ * Call a method on the watch, which counts as delivered once the response
+ * arrives
+ * @param {string} method
+ * @param {object} params - should have an id key
+ * @param {function} [callback] - called once the call is answered or fails
+ * @return {void}
+ */
+Simulator.prototype.call = function(method, params, callback) {
+  var self = this;
+  var message = {
+    namespace: method,
+    id: params.id,
+    size: serialize(params, FORMATS.LATEST).length,
+    sentAt: self.now,
+    deliveredAt: null,
+    result: undefined,
+    done: false
+  };
+  self._messages.push(message);
+  self._firstSend = Math.min(self._firstSend, self.now);
+
+  self.simpleAppMessage.call(method, params, function(error) {
+    message.done = true;
+    message.result = error || undefined;
+    if (!error) {
+      message.deliveredAt = self._lastDelivery = self.now;
+    }
+    if (callback) {
+      callback(error);
+    }
+  }, self.options.maxTime);
+};
+
+/**
+ * Have the watch call a method on the phone, which counts as delivered once
+ * the watch has the response
+ * @param {string} method
+ * @param {object} response - what the phone will answer with, its id is the
+ * call's
+ * @param {function} [callback] - called once the call is answered or fails
+ * @return {void}
+ */
+Simulator.prototype.watchCall = function(method, response, callback) {
+  var self = this;
+  var message = {
+    namespace: method,
+    id: response.id,
+    size: serialize(response, FORMATS.LATEST).length,
+    sentAt: null,
+    deliveredAt: null,
+    result: undefined,
+    done: false,
+    callback: callback
+  };
+  self._messages.push(message);
+
+  self.schedule(0, function(done) {
+    message.sentAt = self.now;
+    self._firstSend = Math.min(self._firstSend, self.now);
+    self._watchCommand('call ' + method + ' ' + response.id, function() {
+      done();
+    });
+  });
+};
+
+/**
+ * @param {string} method
+ * @param {number} id
+ * @param {string} error - '-' if the call succeeded
+ * @return {void}
+ */
+Simulator.prototype._answered = function(method, id, error) {
+  var self = this;
+  self._messages.forEach(function(message) {
+    if (message.namespace !== method || message.id !== id || message.done) {
+      return;
+    }
+    message.done = true;
+    if (error === '-') {
+      message.deliveredAt = self._lastDelivery = self.now;
+    } else {
+      message.result = {error: error};
+    }
+    if (message.callback) {
+      message.callback();
+    }
+  });
+};
+
+/**
+ * Put bytes on the link, which carries one packet at a time in each
+ * direction
+ * @param {string} direction - 'down' to the watch or 'up' to the phone
+ * @param {Buffer} bytes
+ * @param {function} arrive - event run once the packet arrives
+ * @param {function} lost - event run once the sender gives up on it
+ * @return {void}
+ */
+Simulator.prototype._transmit = function(direction, bytes, arrive, lost) {
+  var options = this.options;
+  var start = Math.max(this.now, this._linkFree[direction]);
+  this._linkFree[direction] = start + bytes.length * 1000 / options.bandwidth;
+  this.linkStats.packets++;
+  this.linkStats.bytes += bytes.length;
+
+  if (this.random() < options.dropRate) {
+    this.linkStats.dropped++;
+    this.schedule(options.ackTimeout, lost);
+    return;
+  }
+  var arrival = this._linkFree[direction] + options.latency +
+                this.random() * options.reorder;
+  this.schedule(arrival - this.now, arrive);
+};
+
+/**
+ * @param {Buffer} bytes
+ * @param {function} success
+ * @param {function} failure
+ * @return {void}
+ */
+Simulator.prototype._sendToWatch = function(bytes, success, failure) {
+  var self = this;
+  var transactionId = self._nextEventId;
+
+  self._transmit('down', bytes, function(done) {
+    self._watchCommand('inbox ' + bytes.toString('hex'), function(lines) {
+      var accepted = lines.indexOf('accepted 1') >= 0;
+      if (!accepted) {
+        self.linkStats.nacked++;
+      }
+      // the ack or NACK takes as long to get back
+      self.schedule(self.options.latency, function(ackDone) {
+        if (accepted) {
+          success({data: {transactionId: transactionId}});
+        } else {
+          failure({data: {transactionId: transactionId},
+                   error: {message: 'NACK'}});
+        }
+        ackDone();
+      });
+      done();
+    });
+  }, function(done) {
+    failure({data: {transactionId: transactionId},
+             error: {message: 'Timed out'}});
+    done();
+  });
+};
+
+/**
+ * @param {Buffer} bytes
+ * @return {void}
+ */
+Simulator.prototype._sendToPhone = function(bytes) {
+  var self = this;
+  var payload = decodeDictionary(bytes, self._keyNames);
+
+  self._transmit('up', bytes, function(done) {
+    (self._listeners.appmessage || []).slice().forEach(function(listener) {
+      listener({payload: payload});
+    });
+    self.schedule(self.options.latency, function(ackDone) {
+      self._watchCommand('sent ' + APP_MSG_OK, ackDone);
+    });
+    done();
+  }, function(done) {
+    self._watchCommand('sent ' + APP_MSG_SEND_TIMEOUT, done);
+  });
+};
+
+/**
+ * Run a watch command and act on what it printed
+ * @param {string} line
+ * @param {function} callback - called with the lines the watch printed
+ * @return {void}
+ */
+Simulator.prototype._watchCommand = function(line, callback) {
+  var self = this;
+  self.watch.command(line, function(lines) {
+    lines.forEach(function(output) {
+      var fields = output.split(' ');
+      if (fields[0] === 'outbox') {
+        self._sendToPhone(Buffer.from(fields[1], 'hex'));
+      } else if (fields[0] === 'received') {
+        self._delivered(fields[1], +fields[2]);
+      } else if (fields[0] === 'response') {
+        self._answered(fields[1], +fields[2], fields[3]);
+      } else if (fields[0] === 'stats') {
+        self._watchStats = fields.slice(1).join(' ');
+      }
+    });
+    callback(lines);
+  });
+};
+
+/**
+ * @param {string} namespace
+ * @param {number} id
+ * @return {void}
+ */
+Simulator.prototype._delivered = function(namespace, id) {
+  var self = this;
+  self._messages.forEach(function(message) {
+    if (message.namespace === namespace && message.deliveredAt === null &&
+        (message.id === id || (message.synced && message.id < id))) {
+      message.deliveredAt = self.now;
+      self._lastDelivery = self.now;
+    }
+  });
+};
+
+/**
+ * Bring the watch's clock up to now, firing its timers on the way
+ * @param {function} callback
+ * @return {void}
+ */
+Simulator.prototype._syncWatch = function(callback) {
+  var elapsed = this.now - this._watchNow;
+  this._watchNow = this.now;
+  // a timer set to fire right away still needs the watch to run it
+  if (elapsed <= 0 && this.watch.nextTimeout !== 0) {
+    callback();
+    return;
+  }
+  this._watchCommand('advance ' + Math.round(elapsed), function() {
+    callback();
+  });
+};
+
+/**
+ * @param {object} message
+ * @return {boolean} true if the phone gave up on the message
+ */
+function isFailed(message) {
+  return !!message.result && (!!message.result.error ||
+                              typeof message.result === 'string');
+}
+
+/**
+ * A message the phone was told was sent may still be on its way, if the watch
+ * acked chunks it then had to ask for again
+ * @return {boolean} true once every message was delivered or given up on
+ */
+Simulator.prototype._isFinished = function() {
+  return this._messages.every(function(message) {
+    return message.done && (message.deliveredAt !== null || isFailed(message));
+  });
+};
+
+/**
+ * Run events in time order, interleaved with the watch's timers, until the
+ * workload is done
+ * @param {function} callback
+ * @return {void}
+ */
+Simulator.prototype._step = function(callback) {
+  var self = this;
+  var events = self._events;
+  while (events.length && self._cancelled[events[0].id]) {
+    events.shift();
+  }
+
+  var watchDue = self.watch.nextTimeout >= 0 ?
+    self._watchNow + self.watch.nextTimeout : Infinity;
+  var eventDue = events.length ? events[0].time : Infinity;
+  var due = Math.min(watchDue, eventDue);
+  if ((self._isFinished() && self._messages.length) || due === Infinity ||
+      due > self.options.maxTime + self._firstSend) {
+    callback();
+    return;
+  }
+
+  self.now = Math.max(self.now, due);
+  self._syncWatch(function() {
+    if (eventDue > watchDue) {
+      setImmediate(self._step.bind(self, callback));
+      return;
+    }
+    events.shift().run(function() {
+      setImmediate(self._step.bind(self, callback));
+    });
+  });
+};
+
+/**
+ * @param {function} callback - called with the report
+ * @return {void}
+ */
+Simulator.prototype.run = function(callback) {
+  var self = this;
+  var workload = WORKLOADS[self.options.workload];
+  var args = [
+    '--inbox-size', String(self.options.inboxSize),
+    '--dispatch-queue-depth', String(self.options.dispatchQueueDepth)
+  ];
+  (workload.methods || []).forEach(function(method) {
+    args.push('--rpc-method', method);
+  });
+  (workload.syncNamespaces || []).forEach(function(namespace) {
+    args.push('--sync', namespace);
+  });
+  self.watch = new Watch(self.options.watch,
+                         args.concat(workload.namespaces));
+  self.install();
+  workload.run(self, self.options);
+
+  self._step(function() {
+    self._watchCommand('stats', function() {
+      self.watch.close();
+      callback(self.report());
+    });
+  });
+};
+
+/**
+ * @return {object}
+ */
+Simulator.prototype.report = function() {
+  var delivered = this._messages.filter(function(message) {
+    return message.deliveredAt !== null;
+  });
+  var latencies = delivered.map(function(message) {
+    return message.deliveredAt - message.sentAt;
+  }).sort(function(a, b) {
+    return a - b;
+  });
+  var elapsed = Math.max(1, this._lastDelivery - this._firstSend) / 1000;
+  var bytes = delivered.reduce(function(sum, message) {
+    return sum + message.size;
+  }, 0);
+
+  /**
+   * @param {number} fraction
+   * @return {number|null}
+   */
+  function percentile(fraction) {
+    return latencies.length ?
+      Math.round(latencies[Math.min(latencies.length - 1,
+                                    Math.floor(latencies.length * fraction))]) :
+      null;
+  }
+
+  return {
+    options: this.options,
+    messages: this._messages.length,
+    delivered: delivered.length,
+    failed: this._messages.filter(isFailed).length,
+    seconds: elapsed,
+    messagesPerSecond: delivered.length / elapsed,
+    // size of what was delivered in the latest format, whatever format and
+    // compression the link ended up using
+    goodput: bytes / elapsed,
+    timeToDelivery: {
+      p50: percentile(0.5),
+      p95: percentile(0.95),
+      max: latencies.length ? Math.round(latencies[latencies.length - 1]) : null
+    },
+    link: this.linkStats,
+    watch: this._watchStats
+  };
+};
+
+/**
+ * @param {object} report
+ * @return {string}
+ */
+function formatReport(report) {
+  var options = report.options;
+  return [
+    'workload ' + options.workload + ': ' + report.messages +
+      ' messages, latency ' + options.latency + ' ms, reorder ' +
+      options.reorder + ' ms, bandwidth ' + options.bandwidth +
+      ' B/s, inbox ' + options.inboxSize + ' B, drop rate ' +
+      options.dropRate,
+    'delivered ' + report.delivered + '/' + report.messages + ' (' +
+      report.failed + ' failed) in ' + report.seconds.toFixed(2) + ' s',
+    'messages/s ' + report.messagesPerSecond.toFixed(2) + ', goodput ' +
+      Math.round(report.goodput) + ' B/s',
+    'time to delivery ms: p50 ' + report.timeToDelivery.p50 + ', p95 ' +
+      report.timeToDelivery.p95 + ', max ' + report.timeToDelivery.max,
+    'link: ' + report.link.packets + ' packets, ' + report.link.bytes +
+      ' B, ' + report.link.dropped + ' dropped, ' + report.link.nacked +
+      ' NACKed',
+    'watch: ' + report.watch
+  ].join('\n');
+}
+
+module.exports = Simulator;
+module.exports.WORKLOADS = WORKLOADS;
+module.exports.encodeDictionary = encodeDictionary;
+module.exports.decodeDictionary = decodeDictionary;
+
+if (require.main === module) {
+  var options = parseOptions(process.argv.slice(2));
+  new Simulator(options).run(function(report) {
+    console.log(options.json ? JSON.stringify(report) : formatReport(report));
+    process.exitCode = report.delivered === report.messages ? 0 : 1;
+  });
+}
@@ -0,0 +1,116 @@
+#include "@smallstoneapps/linked-list/linked-list.h"
+
+typedef struct LinkedNode LinkedNode;
+
+struct LinkedNode {
+  void *object;
+  LinkedNode *next;
+};
+
+struct LinkedRoot {
+  LinkedNode *head;
+};
+
+LinkedRoot *linked_list_create_root(void) {
+  return calloc(1, sizeof(LinkedRoot));
+}
+
+uint16_t linked_list_count(LinkedRoot *root) {
+  uint16_t count = 0;
+  for (LinkedNode *node = root ? root->head : NULL; node; node = node->next) {
+    count++;
+  }
+  return count;
+}
+
+void linked_list_append(LinkedRoot *root, void *object) {
+  if (!root) {
+    return;
+  }
+  LinkedNode *new_node = calloc(1, sizeof(LinkedNode));
+  if (!new_node) {
+    return;
+  }
+  new_node->object = object;
+
+  LinkedNode **link = &root->head;
+  while (*link) {
+    link = &(*link)->next;
+  }
+  *link = new_node;
+}
+
+void linked_list_prepend(LinkedRoot *root, void *object) {
+  if (!root) {
+    return;
+  }
+  LinkedNode *new_node = calloc(1, sizeof(LinkedNode));
+  if (!new_node) {
+    return;
+  }
+  new_node->object = object;
+  new_node->next = root->head;
+  root->head = new_node;
+}
+
+static LinkedNode *prv_get_node(LinkedRoot *root, uint16_t index) {
+  LinkedNode *node = root ? root->head : NULL;
+  while (node && index--) {
+    node = node->next;
+  }
+  return node;
+}
+
+void *linked_list_get(LinkedRoot *root, uint16_t index) {
+  LinkedNode *node = prv_get_node(root, index);
+  return node ? node->object : NULL;
+}
+
+void linked_list_remove(LinkedRoot *root, uint16_t index) {
+  if (!root) {
+    return;
+  }
+  LinkedNode **link = &root->head;
+  while (*link && index--) {
+    link = &(*link)->next;
+  }
+  LinkedNode *node = *link;
+  if (node) {
+    *link = node->next;
+    free(node);
+  }
+}
+
+void linked_list_clear(LinkedRoot *root) {
+  while (root && root->head) {
+    linked_list_remove(root, 0);
+  }
+}
+
+static bool prv_object_equal(void *object1, void *object2) {
+  return (object1 == object2);
+}
+
+int16_t linked_list_find(LinkedRoot *root, void *object) {
+  return linked_list_find_compare(root, object, prv_object_equal);
+}
+
+int16_t linked_list_find_compare(LinkedRoot *root, void *object, ObjectCompare compare) {
+  int16_t index = 0;
+  for (LinkedNode *node = root ? root->head : NULL; node; node = node->next, index++) {
+    if (compare(node->object, object)) {
+      return index;
+    }
+  }
+  return -1;
+}
+
+void linked_list_foreach(LinkedRoot *root, LinkedListForEach callback, void *context) {
+  for (LinkedNode *node = root ? root->head : NULL; node;) {
+    LinkedNode *next = node->next;
+    if (!callback(node->object, context)) {
+      return;
+    }
+    node = next;
+  }
+}
@@ -0,0 +1,18 @@
+#include "message_keys.auto.h"
+
+// Same numbering the Pebble build assigns (declaration order in package.json)
+uint32_t MESSAGE_KEY_SIMPLE_APP_MESSAGE_CHUNK_DATA = 0;
+uint32_t MESSAGE_KEY_SIMPLE_APP_MESSAGE_CHUNK_SIZE = 1;
+uint32_t MESSAGE_KEY_SIMPLE_APP_MESSAGE_CHUNK_REMAINING = 2;
+uint32_t MESSAGE_KEY_SIMPLE_APP_MESSAGE_CHUNK_TOTAL = 3;
+uint32_t MESSAGE_KEY_SIMPLE_APP_MESSAGE_CHUNK_NAMESPACE = 4;
+uint32_t MESSAGE_KEY_SIMPLE_APP_MESSAGE_CHUNK_TRANSFER_ID = 5;
+uint32_t MESSAGE_KEY_SIMPLE_APP_MESSAGE_CHUNK_NAMESPACE_ID = 6;
+uint32_t MESSAGE_KEY_SIMPLE_APP_MESSAGE_NAMESPACE_TABLE = 7;
+uint32_t MESSAGE_KEY_SIMPLE_APP_MESSAGE_FORMAT_VERSION = 8;
+uint32_t MESSAGE_KEY_SIMPLE_APP_MESSAGE_COMPRESSION = 9;
+uint32_t MESSAGE_KEY_SIMPLE_APP_MESSAGE_CHUNK_WINDOW = 10;
+uint32_t MESSAGE_KEY_SIMPLE_APP_MESSAGE_CHUNK_NACK = 11;
+uint32_t MESSAGE_KEY_SIMPLE_APP_MESSAGE_CHUNK_BATCH = 12;
+uint32_t MESSAGE_KEY_SIMPLE_APP_MESSAGE_CHUNK_TRACE = 13;
+uint32_t MESSAGE_KEY_SIMPLE_APP_MESSAGE_WATCH_OPENED = 14;
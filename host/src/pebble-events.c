@@ -0,0 +1,117 @@
+#include "pebble-events/pebble-events.h"
+
+#define HOST_EVENTS_MAX_APP_MESSAGE_SUBSCRIBERS (8)
+
+typedef struct AppMessageSubscriber {
+  bool in_use;
+  EventAppMessageHandlers handlers;
+  void *context;
+} AppMessageSubscriber;
+
+static AppMessageSubscriber s_subscribers[HOST_EVENTS_MAX_APP_MESSAGE_SUBSCRIBERS];
+static uint32_t s_inbox_size;
+static uint32_t s_outbox_size;
+
+static void prv_inbox_received(DictionaryIterator *iterator, void *context) {
+  for (int i = 0; i < HOST_EVENTS_MAX_APP_MESSAGE_SUBSCRIBERS; i++) {
+    if (s_subscribers[i].in_use && s_subscribers[i].handlers.received) {
+      s_subscribers[i].handlers.received(iterator, s_subscribers[i].context);
+    }
+  }
+}
+
+static void prv_inbox_dropped(AppMessageResult reason, void *context) {
+  for (int i = 0; i < HOST_EVENTS_MAX_APP_MESSAGE_SUBSCRIBERS; i++) {
+    if (s_subscribers[i].in_use && s_subscribers[i].handlers.dropped) {
+      s_subscribers[i].handlers.dropped(reason, s_subscribers[i].context);
+    }
+  }
+}
+
+static void prv_outbox_sent(DictionaryIterator *iterator, void *context) {
+  for (int i = 0; i < HOST_EVENTS_MAX_APP_MESSAGE_SUBSCRIBERS; i++) {
+    if (s_subscribers[i].in_use && s_subscribers[i].handlers.sent) {
+      s_subscribers[i].handlers.sent(iterator, s_subscribers[i].context);
+    }
+  }
+}
+
+static void prv_outbox_failed(DictionaryIterator *iterator, AppMessageResult reason,
+                              void *context) {
+  for (int i = 0; i < HOST_EVENTS_MAX_APP_MESSAGE_SUBSCRIBERS; i++) {
+    if (s_subscribers[i].in_use && s_subscribers[i].handlers.failed) {
+      s_subscribers[i].handlers.failed(iterator, reason, s_subscribers[i].context);
+    }
+  }
+}
+
+EventHandle events_app_message_subscribe_handlers(EventAppMessageHandlers handlers,
+                                                  void *context) {
+  for (int i = 0; i < HOST_EVENTS_MAX_APP_MESSAGE_SUBSCRIBERS; i++) {
+    if (!s_subscribers[i].in_use) {
+      s_subscribers[i] = (AppMessageSubscriber) {
+        .in_use = true,
+        .handlers = handlers,
+        .context = context,
+      };
+      return &s_subscribers[i];
+    }
+  }
+  return NULL;
+}
+
+EventHandle events_app_message_register_inbox_received(AppMessageInboxReceived received_callback,
+                                                       void *context) {
+  return events_app_message_subscribe_handlers((EventAppMessageHandlers) {
+    .received = received_callback,
+  }, context);
+}
+
+EventHandle events_app_message_register_inbox_dropped(AppMessageInboxDropped dropped_callback,
+                                                      void *context) {
+  return events_app_message_subscribe_handlers((EventAppMessageHandlers) {
+    .dropped = dropped_callback,
+  }, context);
+}
+
+EventHandle events_app_message_register_outbox_sent(AppMessageOutboxSent sent_callback,
+                                                    void *context) {
+  return events_app_message_subscribe_handlers((EventAppMessageHandlers) {
+    .sent = sent_callback,
+  }, context);
+}
+
+EventHandle events_app_message_register_outbox_failed(AppMessageOutboxFailed failed_callback,
+                                                      void *context) {
+  return events_app_message_subscribe_handlers((EventAppMessageHandlers) {
+    .failed = failed_callback,
+  }, context);
+}
+
+void events_app_message_unsubscribe(EventHandle handle) {
+  AppMessageSubscriber *subscriber = handle;
+  if (subscriber) {
+    *subscriber = (AppMessageSubscriber) {0};
+  }
+}
+
+void events_app_message_request_inbox_size(uint32_t size) {
+  if (size > s_inbox_size) {
+    s_inbox_size = size;
+  }
+}
+
+void events_app_message_request_outbox_size(uint32_t size) {
+  if (size > s_outbox_size) {
+    s_outbox_size = size;
+  }
+}
+
+AppMessageResult events_app_message_open(void) {
+  app_message_register_inbox_received(prv_inbox_received);
+  app_message_register_inbox_dropped(prv_inbox_dropped);
+  app_message_register_outbox_sent(prv_outbox_sent);
+  app_message_register_outbox_failed(prv_outbox_failed);
+  // pebble-events always opens with a usable outbox, even if nobody asked for one
+  return app_message_open(s_inbox_size, s_outbox_size ? s_outbox_size : 64);
+}
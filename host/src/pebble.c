@@ -0,0 +1,508 @@
+#define HOST_HEAP_NO_REDIRECT
+#include "pebble-host.h"
+
+#include <stdarg.h>
+
+#define HOST_INBOX_SIZE_MAXIMUM (8200)
+#define HOST_OUTBOX_SIZE_MAXIMUM (8200)
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Logging
+
+static bool s_log_enabled;
+
+void host_log_set_enabled(bool enabled) {
+  s_log_enabled = enabled;
+}
+
+void app_log(uint8_t log_level, const char *src_filename, int src_line_number, const char *fmt,
+             ...) {
+  if (!s_log_enabled) {
+    return;
+  }
+
+  fprintf(stderr, "[%d] %s:%d> ", log_level, src_filename, src_line_number);
+  va_list args;
+  va_start(args, fmt);
+  vfprintf(stderr, fmt, args);
+  va_end(args);
+  fputc('\n', stderr);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Heap
+
+//! Prefix stored in front of every block so frees can be accounted for. Sized to keep the
+//! returned pointer aligned like the system allocator's.
+typedef union HostHeapHeader {
+  size_t size;
+  max_align_t align;
+} HostHeapHeader;
+
+static HostHeapStats s_heap_stats;
+
+static void *prv_heap_track(HostHeapHeader *header, size_t size) {
+  if (!header) {
+    return NULL;
+  }
+  header->size = size;
+  s_heap_stats.malloc_count++;
+  s_heap_stats.bytes_in_use += size;
+  if (s_heap_stats.bytes_in_use > s_heap_stats.peak_bytes_in_use) {
+    s_heap_stats.peak_bytes_in_use = s_heap_stats.bytes_in_use;
+  }
+  return header + 1;
+}
+
+void *host_heap_malloc(size_t size) {
+  return prv_heap_track(malloc(sizeof(HostHeapHeader) + size), size);
+}
+
+void *host_heap_calloc(size_t count, size_t size) {
+  return prv_heap_track(calloc(1, sizeof(HostHeapHeader) + (count * size)), count * size);
+}
+
+void host_heap_free(void *ptr) {
+  if (!ptr) {
+    return;
+  }
+  HostHeapHeader *header = (HostHeapHeader *)ptr - 1;
+  s_heap_stats.free_count++;
+  s_heap_stats.bytes_in_use -= header->size;
+  free(header);
+}
+
+void *host_heap_realloc(void *ptr, size_t size) {
+  if (!ptr) {
+    return host_heap_malloc(size);
+  }
+  void *new_ptr = host_heap_malloc(size);
+  if (!new_ptr) {
+    return NULL;
+  }
+  const size_t old_size = ((HostHeapHeader *)ptr - 1)->size;
+  memcpy(new_ptr, ptr, (old_size < size) ? old_size : size);
+  host_heap_free(ptr);
+  return new_ptr;
+}
+
+void host_heap_get_stats(HostHeapStats *stats_out) {
+  if (stats_out) {
+    *stats_out = s_heap_stats;
+  }
+}
+
+void host_heap_reset_stats(void) {
+  s_heap_stats.malloc_count = 0;
+  s_heap_stats.free_count = 0;
+  s_heap_stats.peak_bytes_in_use = s_heap_stats.bytes_in_use;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Dictionary
+
+#define TUPLE_HEADER_SIZE (sizeof(Tuple))
+
+uint32_t dict_calc_buffer_size(const uint8_t tuple_count, ...) {
+  uint32_t total_size = sizeof(Dictionary);
+  va_list args;
+  va_start(args, tuple_count);
+  for (uint8_t i = 0; i < tuple_count; i++) {
+    total_size += TUPLE_HEADER_SIZE + va_arg(args, uint32_t);
+  }
+  va_end(args);
+  return total_size;
+}
+
+DictionaryResult dict_write_begin(DictionaryIterator *iter, uint8_t * const buffer,
+                                  const uint16_t size) {
+  if (!iter || !buffer || (size < sizeof(Dictionary))) {
+    return DICT_INVALID_ARGS;
+  }
+  iter->dictionary = (Dictionary *)buffer;
+  iter->dictionary->count = 0;
+  iter->cursor = iter->dictionary->head;
+  iter->end = buffer + size;
+  return DICT_OK;
+}
+
+static DictionaryResult prv_dict_write(DictionaryIterator *iter, const uint32_t key,
+                                       TupleType type, const void *data, const uint16_t size) {
+  if (!iter || !iter->dictionary || (!data && size)) {
+    return DICT_INVALID_ARGS;
+  }
+  if ((uint8_t *)iter->cursor + TUPLE_HEADER_SIZE + size > (const uint8_t *)iter->end) {
+    return DICT_NOT_ENOUGH_STORAGE;
+  }
+  iter->cursor->key = key;
+  iter->cursor->type = type;
+  iter->cursor->length = size;
+  if (size) {
+    memcpy(iter->cursor->value->data, data, size);
+  }
+  iter->cursor = (Tuple *)((uint8_t *)iter->cursor + TUPLE_HEADER_SIZE + size);
+  iter->dictionary->count++;
+  return DICT_OK;
+}
+
+DictionaryResult dict_write_data(DictionaryIterator *iter, const uint32_t key,
+                                 const uint8_t * const data, const uint16_t size) {
+  return prv_dict_write(iter, key, TUPLE_BYTE_ARRAY, data, size);
+}
+
+DictionaryResult dict_write_cstring(DictionaryIterator *iter, const uint32_t key,
+                                    const char * const cstring) {
+  if (!cstring) {
+    return prv_dict_write(iter, key, TUPLE_CSTRING, NULL, 0);
+  }
+  return prv_dict_write(iter, key, TUPLE_CSTRING, cstring, strlen(cstring) + 1);
+}
+
+DictionaryResult dict_write_int(DictionaryIterator *iter, const uint32_t key,
+                                const void *integer, const uint8_t width_bytes,
+                                const bool is_signed) {
+  if ((width_bytes != 1) && (width_bytes != 2) && (width_bytes != 4)) {
+    return DICT_INVALID_ARGS;
+  }
+  return prv_dict_write(iter, key, is_signed ? TUPLE_INT : TUPLE_UINT, integer, width_bytes);
+}
+
+DictionaryResult dict_write_uint8(DictionaryIterator *iter, const uint32_t key,
+                                  const uint8_t value) {
+  return dict_write_int(iter, key, &value, sizeof(value), false);
+}
+
+DictionaryResult dict_write_uint16(DictionaryIterator *iter, const uint32_t key,
+                                   const uint16_t value) {
+  return dict_write_int(iter, key, &value, sizeof(value), false);
+}
+
+DictionaryResult dict_write_uint32(DictionaryIterator *iter, const uint32_t key,
+                                   const uint32_t value) {
+  return dict_write_int(iter, key, &value, sizeof(value), false);
+}
+
+DictionaryResult dict_write_int32(DictionaryIterator *iter, const uint32_t key,
+                                  const int32_t value) {
+  return dict_write_int(iter, key, &value, sizeof(value), true);
+}
+
+uint32_t dict_write_end(DictionaryIterator *iter) {
+  if (!iter || !iter->dictionary) {
+    return 0;
+  }
+  iter->end = iter->cursor;
+  return (uint32_t)((uint8_t *)iter->cursor - (uint8_t *)iter->dictionary);
+}
+
+Tuple *dict_read_begin_from_buffer(DictionaryIterator *iter, const uint8_t * const buffer,
+                                   const uint16_t size) {
+  if (!iter || !buffer || (size < sizeof(Dictionary))) {
+    return NULL;
+  }
+  iter->dictionary = (Dictionary *)buffer;
+  iter->end = buffer + size;
+  return dict_read_first(iter);
+}
+
+Tuple *dict_read_first(DictionaryIterator *iter) {
+  if (!iter || !iter->dictionary || !iter->dictionary->count) {
+    return NULL;
+  }
+  iter->cursor = iter->dictionary->head;
+  return iter->cursor;
+}
+
+Tuple *dict_read_next(DictionaryIterator *iter) {
+  if (!iter || !iter->cursor) {
+    return NULL;
+  }
+  Tuple *next = (Tuple *)((uint8_t *)iter->cursor + TUPLE_HEADER_SIZE + iter->cursor->length);
+  if ((const uint8_t *)next + TUPLE_HEADER_SIZE > (const uint8_t *)iter->end) {
+    iter->cursor = NULL;
+    return NULL;
+  }
+  iter->cursor = next;
+  return next;
+}
+
+Tuple *dict_find(const DictionaryIterator *iter, const uint32_t key) {
+  if (!iter || !iter->dictionary) {
+    return NULL;
+  }
+  DictionaryIterator find_iter = *iter;
+  for (Tuple *tuple = dict_read_first(&find_iter); tuple; tuple = dict_read_next(&find_iter)) {
+    if (tuple->key == key) {
+      return tuple;
+    }
+  }
+  return NULL;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// AppMessage
+
+typedef struct HostAppMessageState {
+  bool open;
+  uint32_t inbox_size;
+  uint32_t outbox_size;
+  AppMessageInboxReceived inbox_received;
+  AppMessageInboxDropped inbox_dropped;
+  AppMessageOutboxSent outbox_sent;
+  AppMessageOutboxFailed outbox_failed;
+  void *context;
+  uint8_t *inbox_buffer;
+  uint8_t *outbox_buffer;
+  DictionaryIterator outbox_iter;
+  bool outbox_writing;
+  bool outbox_pending;
+  HostOutboxHandler outbox_handler;
+  void *outbox_handler_context;
+} HostAppMessageState;
+
+static HostAppMessageState s_app_message;
+
+uint32_t app_message_inbox_size_maximum(void) {
+  return HOST_INBOX_SIZE_MAXIMUM;
+}
+
+uint32_t app_message_outbox_size_maximum(void) {
+  return HOST_OUTBOX_SIZE_MAXIMUM;
+}
+
+AppMessageResult app_message_open(const uint32_t size_inbound, const uint32_t size_outbound) {
+  if (s_app_message.open) {
+    return APP_MSG_INVALID_STATE;
+  }
+  s_app_message.inbox_buffer = malloc(size_inbound);
+  s_app_message.outbox_buffer = malloc(size_outbound);
+  if (!s_app_message.inbox_buffer || !s_app_message.outbox_buffer) {
+    free(s_app_message.inbox_buffer);
+    free(s_app_message.outbox_buffer);
+    return APP_MSG_OUT_OF_MEMORY;
+  }
+  s_app_message.inbox_size = size_inbound;
+  s_app_message.outbox_size = size_outbound;
+  s_app_message.open = true;
+  return APP_MSG_OK;
+}
+
+void *app_message_get_context(void) {
+  return s_app_message.context;
+}
+
+void *app_message_set_context(void *context) {
+  void *previous = s_app_message.context;
+  s_app_message.context = context;
+  return previous;
+}
+
+AppMessageInboxReceived app_message_register_inbox_received(
+    AppMessageInboxReceived received_callback) {
+  AppMessageInboxReceived previous = s_app_message.inbox_received;
+  s_app_message.inbox_received = received_callback;
+  return previous;
+}
+
+AppMessageInboxDropped app_message_register_inbox_dropped(
+    AppMessageInboxDropped dropped_callback) {
+  AppMessageInboxDropped previous = s_app_message.inbox_dropped;
+  s_app_message.inbox_dropped = dropped_callback;
+  return previous;
+}
+
+AppMessageOutboxSent app_message_register_outbox_sent(AppMessageOutboxSent sent_callback) {
+  AppMessageOutboxSent previous = s_app_message.outbox_sent;
+  s_app_message.outbox_sent = sent_callback;
+  return previous;
+}
+
+AppMessageOutboxFailed app_message_register_outbox_failed(
+    AppMessageOutboxFailed failed_callback) {
+  AppMessageOutboxFailed previous = s_app_message.outbox_failed;
+  s_app_message.outbox_failed = failed_callback;
+  return previous;
+}
+
+AppMessageResult app_message_outbox_begin(DictionaryIterator **iterator) {
+  if (!iterator) {
+    return APP_MSG_INVALID_ARGS;
+  }
+  if (!s_app_message.open) {
+    return APP_MSG_INVALID_STATE;
+  }
+  if (s_app_message.outbox_writing || s_app_message.outbox_pending) {
+    return APP_MSG_BUSY;
+  }
+  dict_write_begin(&s_app_message.outbox_iter, s_app_message.outbox_buffer,
+                   s_app_message.outbox_size);
+  s_app_message.outbox_writing = true;
+  *iterator = &s_app_message.outbox_iter;
+  return APP_MSG_OK;
+}
+
+AppMessageResult app_message_outbox_send(void) {
+  if (!s_app_message.outbox_writing) {
+    return s_app_message.outbox_pending ? APP_MSG_BUSY : APP_MSG_INVALID_STATE;
+  }
+  s_app_message.outbox_writing = false;
+  s_app_message.outbox_pending = true;
+
+  const uint32_t size = dict_write_end(&s_app_message.outbox_iter);
+  if (s_app_message.outbox_handler) {
+    DictionaryIterator read_iter;
+    dict_read_begin_from_buffer(&read_iter, s_app_message.outbox_buffer, size);
+    s_app_message.outbox_handler(&read_iter, s_app_message.outbox_handler_context);
+  }
+  return APP_MSG_OK;
+}
+
+void host_app_message_set_outbox_handler(HostOutboxHandler handler, void *context) {
+  s_app_message.outbox_handler = handler;
+  s_app_message.outbox_handler_context = context;
+}
+
+bool host_app_message_outbox_is_pending(void) {
+  return s_app_message.outbox_pending;
+}
+
+void host_app_message_outbox_complete(AppMessageResult result) {
+  if (!s_app_message.outbox_pending) {
+    return;
+  }
+  s_app_message.outbox_pending = false;
+
+  DictionaryIterator read_iter;
+  dict_read_begin_from_buffer(&read_iter, s_app_message.outbox_buffer,
+                              (uint8_t *)s_app_message.outbox_iter.end -
+                              s_app_message.outbox_buffer);
+  if ((result == APP_MSG_OK) && s_app_message.outbox_sent) {
+    s_app_message.outbox_sent(&read_iter, s_app_message.context);
+  } else if ((result != APP_MSG_OK) && s_app_message.outbox_failed) {
+    s_app_message.outbox_failed(&read_iter, result, s_app_message.context);
+  }
+}
+
+bool host_app_message_deliver_inbox(const uint8_t *buffer, uint16_t size) {
+  if (!s_app_message.open) {
+    return false;
+  }
+  if (size > s_app_message.inbox_size) {
+    if (s_app_message.inbox_dropped) {
+      s_app_message.inbox_dropped(APP_MSG_BUFFER_OVERFLOW, s_app_message.context);
+    }
+    return false;
+  }
+
+  memcpy(s_app_message.inbox_buffer, buffer, size);
+  DictionaryIterator iter;
+  dict_read_begin_from_buffer(&iter, s_app_message.inbox_buffer, size);
+  if (s_app_message.inbox_received) {
+    s_app_message.inbox_received(&iter, s_app_message.context);
+  }
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// AppTimer
+//
+// Timers run on a virtual clock that only moves when host_app_timer_advance() is called, which
+// keeps benchmarks and simulations deterministic. Timer bookkeeping lives outside the app heap,
+// as it does in the firmware.
+
+struct AppTimer {
+  AppTimer *next;
+  uint64_t fire_time_ms;
+  AppTimerCallback callback;
+  void *callback_data;
+};
+
+static AppTimer *s_timers;
+static uint64_t s_timer_now_ms;
+
+static void prv_timer_unlink(AppTimer *timer) {
+  for (AppTimer **link = &s_timers; *link; link = &(*link)->next) {
+    if (*link == timer) {
+      *link = timer->next;
+      return;
+    }
+  }
+}
+
+static bool prv_timer_is_registered(AppTimer *timer) {
+  for (AppTimer *iter = s_timers; iter; iter = iter->next) {
+    if (iter == timer) {
+      return true;
+    }
+  }
+  return false;
+}
+
+//! Keeps the list ordered by fire time, and by registration order for equal fire times
+static void prv_timer_insert(AppTimer *timer) {
+  AppTimer **link = &s_timers;
+  while (*link && ((*link)->fire_time_ms <= timer->fire_time_ms)) {
+    link = &(*link)->next;
+  }
+  timer->next = *link;
+  *link = timer;
+}
+
+AppTimer *app_timer_register(uint32_t timeout_ms, AppTimerCallback callback, void *callback_data) {
+  AppTimer *timer = malloc(sizeof(AppTimer));
+  if (!timer) {
+    return NULL;
+  }
+  *timer = (AppTimer) {
+    .fire_time_ms = s_timer_now_ms + timeout_ms,
+    .callback = callback,
+    .callback_data = callback_data,
+  };
+  prv_timer_insert(timer);
+  return timer;
+}
+
+bool app_timer_reschedule(AppTimer *timer_handle, uint32_t new_timeout_ms) {
+  if (!prv_timer_is_registered(timer_handle)) {
+    return false;
+  }
+  prv_timer_unlink(timer_handle);
+  timer_handle->fire_time_ms = s_timer_now_ms + new_timeout_ms;
+  prv_timer_insert(timer_handle);
+  return true;
+}
+
+void app_timer_cancel(AppTimer *timer_handle) {
+  if (!prv_timer_is_registered(timer_handle)) {
+    return;
+  }
+  prv_timer_unlink(timer_handle);
+  free(timer_handle);
+}
+
+void host_app_timer_advance(uint32_t ms) {
+  const uint64_t end_ms = s_timer_now_ms + ms;
+  while (s_timers && (s_timers->fire_time_ms <= end_ms)) {
+    AppTimer *timer = s_timers;
+    s_timers = timer->next;
+    s_timer_now_ms = timer->fire_time_ms;
+    timer->callback(timer->callback_data);
+    free(timer);
+  }
+  s_timer_now_ms = end_ms;
+}
+
+uint32_t host_app_timer_next_timeout(void) {
+  return s_timers ? (uint32_t)(s_timers->fire_time_ms - s_timer_now_ms) : UINT32_MAX;
+}
+
+uint16_t time_ms(time_t *tloc, uint16_t *out_ms) {
+  const uint16_t ms = s_timer_now_ms % 1000;
+  if (tloc) {
+    *tloc = (time_t)(s_timer_now_ms / 1000);
+  }
+  if (out_ms) {
+    *out_ms = ms;
+  }
+  return ms;
+}
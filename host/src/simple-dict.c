@@ -0,0 +1,99 @@
+#include "@keegan-stoneware/simple-dict/simple-dict.h"
+
+//! Mirrors the real simple-dict's allocation pattern: one block per entry holding the key and a
+//! copy of the value.
+typedef struct SimpleDictEntry SimpleDictEntry;
+
+struct SimpleDictEntry {
+  SimpleDictEntry *next;
+  SimpleDictDataType type;
+  size_t data_size;
+  char *key;
+  uint8_t data[];
+};
+
+struct SimpleDict {
+  SimpleDictEntry *head;
+};
+
+SimpleDict *simple_dict_create(void) {
+  return calloc(1, sizeof(SimpleDict));
+}
+
+static void prv_remove_key(SimpleDict *dict, const char *key) {
+  for (SimpleDictEntry **link = &dict->head; *link; link = &(*link)->next) {
+    if (strcmp((*link)->key, key) == 0) {
+      SimpleDictEntry *entry = *link;
+      *link = entry->next;
+      free(entry);
+      return;
+    }
+  }
+}
+
+static bool prv_update(SimpleDict *dict, const char *key, SimpleDictDataType type,
+                       const void *data, size_t data_size) {
+  if (!dict || !key) {
+    return false;
+  }
+  prv_remove_key(dict, key);
+
+  const size_t key_size = strlen(key) + 1;
+  SimpleDictEntry *entry = malloc(sizeof(SimpleDictEntry) + data_size + key_size);
+  if (!entry) {
+    return false;
+  }
+  *entry = (SimpleDictEntry) {
+    .next = dict->head,
+    .type = type,
+    .data_size = data_size,
+    .key = (char *)entry->data + data_size,
+  };
+  memcpy(entry->data, data, data_size);
+  memcpy(entry->key, key, key_size);
+  dict->head = entry;
+  return true;
+}
+
+bool simple_dict_update_data(SimpleDict *dict, const char *key, const void *data, size_t size) {
+  return prv_update(dict, key, SimpleDictDataType_Raw, data, size);
+}
+
+bool simple_dict_update_bool(SimpleDict *dict, const char *key, bool value) {
+  return prv_update(dict, key, SimpleDictDataType_Bool, &value, sizeof(value));
+}
+
+bool simple_dict_update_int(SimpleDict *dict, const char *key, int value) {
+  return prv_update(dict, key, SimpleDictDataType_Int, &value, sizeof(value));
+}
+
+bool simple_dict_update_string(SimpleDict *dict, const char *key, const char *value) {
+  if (!value) {
+    return false;
+  }
+  return prv_update(dict, key, SimpleDictDataType_String, value, strlen(value) + 1);
+}
+
+void simple_dict_foreach(const SimpleDict *dict, SimpleDictForEachCallback callback,
+                         void *context) {
+  if (!dict || !callback) {
+    return;
+  }
+  for (const SimpleDictEntry *entry = dict->head; entry; entry = entry->next) {
+    if (!callback(entry->key, entry->type, entry->data, entry->data_size, context)) {
+      return;
+    }
+  }
+}
+
+void simple_dict_destroy(SimpleDict *dict) {
+  if (!dict) {
+    return;
+  }
+  while (dict->head) {
+    SimpleDictEntry *entry = dict->head;
+    dict->head = entry->next;
+    free(entry);
+  }
+  free(dict);
+}
@@ -4,18 +4,130 @@
 
 #define SIMPLE_APP_MESSAGE_NAMESPACE_MAX_SIZE_BYTES (16)
 
+//! Must match TYPES in types.js
+typedef enum SimpleAppMessageDataType {
+  SimpleAppMessageDataType_Null,
+  SimpleAppMessageDataType_Bool,
+  SimpleAppMessageDataType_Int,
+  SimpleAppMessageDataType_Data,
+  SimpleAppMessageDataType_String,
+  //! Integers packed under a single element type, see simple_app_message_array_init()
+  SimpleAppMessageDataType_Array,
+  //! Nested keys and values, see simple_app_message_object_init()
+  SimpleAppMessageDataType_Object,
+
+  SimpleAppMessageDataType_Count
+} SimpleAppMessageDataType;
+
+//! Must match ARRAY_TYPES in types.js
+typedef enum SimpleAppMessageArrayType {
+  SimpleAppMessageArrayType_Int8,
+  SimpleAppMessageArrayType_Uint8,
+  SimpleAppMessageArrayType_Int16,
+  SimpleAppMessageArrayType_Uint16,
+  SimpleAppMessageArrayType_Int32,
+  SimpleAppMessageArrayType_Uint32,
+
+  SimpleAppMessageArrayTypeCount
+} SimpleAppMessageArrayType;
+
+//! Read-only access to the value of an array key. elements points into the received value, which
+//! is little endian and packed straight after the element type, so it is not necessarily aligned.
+//! Read it with simple_app_message_array_get_int() or simple_app_message_array_copy_ints().
+typedef struct SimpleAppMessageArray {
+  SimpleAppMessageArrayType type;
+  size_t count;
+  const uint8_t *elements;
+} SimpleAppMessageArray;
+
+//! Read-only access to the value of an object key, decoded in place each time it is walked
+typedef struct SimpleAppMessageObject {
+  const uint8_t *entries;
+  size_t size;
+  uint8_t num_keys;
+} SimpleAppMessageObject;
+
+//! Read-only view over a received message. Keys and values point directly into the library's
+//! receive buffer, so nothing is copied, but they are only valid until the callback returns.
+typedef struct SimpleAppMessageView SimpleAppMessageView;
+
 typedef void (*SimpleAppMessageReceivedCallback)(const SimpleDict *message, void *context);
 
+typedef void (*SimpleAppMessageViewReceivedCallback)(const SimpleAppMessageView *message,
+                                                     void *context);
+
+//! Called for each key of a message as soon as the chunk completing it arrives, before the rest of
+//! the message. key and data are only valid until the callback returns.
+typedef void (*SimpleAppMessageKeyReceivedCallback)(const char *key, SimpleAppMessageDataType type,
+                                                    const void *data, size_t data_size,
+                                                    void *context);
+
+//! Called with consecutive pieces of a data value as the chunks carrying them arrive, so values far
+//! larger than the heap can be written out or processed without ever being held whole. offset is
+//! where data starts within the value and total_size is the length of the whole value, which is
+//! done once offset + data_size reaches it. key and data are only valid until the callback returns.
+typedef void (*SimpleAppMessageDataPieceReceivedCallback)(const char *key, const uint8_t *data,
+                                                          size_t data_size, size_t offset,
+                                                          size_t total_size, void *context);
+
+//! Called after the last key_received of a message. If complete is false the transfer was
+//! abandoned part way through, and the keys delivered so far should be discarded.
+typedef void (*SimpleAppMessageStreamEndedCallback)(bool complete, void *context);
+
+//! Called once a message passed to simple_app_message_send() has been fully acknowledged by the
+//! phone, or once it has been given up on
+typedef void (*SimpleAppMessageSentCallback)(bool success, void *context);
+
 size_t simple_app_message_get_minimum_inbox_size(void);
 
 size_t simple_app_message_get_maximum_inbox_size(void);
 
 bool simple_app_message_request_inbox_size(uint32_t inbox_size);
 
+size_t simple_app_message_get_minimum_outbox_size(void);
+
+size_t simple_app_message_get_maximum_outbox_size(void);
+
+//! Determines the chunk size used by simple_app_message_send(). If never called, a small default
+//! outbox is requested when the module is opened.
+bool simple_app_message_request_outbox_size(uint32_t outbox_size);
+
+//! Limits how many transfers from the phone are reassembled at the same time. Once the limit is
+//! reached, a new transfer evicts the one that least recently received a chunk. Defaults to 4.
+//! Builds with SIMPLE_APP_MESSAGE_STATIC_ALLOCATION can't go above
+//! SIMPLE_APP_MESSAGE_MAX_TRANSFERS.
+void simple_app_message_set_max_concurrent_transfers(size_t max_transfers);
+
+//! Delivers complete messages from a timer instead of from the AppMessage inbox handler, so slow
+//! message_received and message_view_received callbacks don't keep the inbox busy while more
+//! chunks arrive. Messages that complete before the timer fires wait for it and are delivered in
+//! one pass, in the order they completed. If more than max_depth are waiting, the oldest is
+//! delivered right away. Keys are still streamed to key_received and data_piece_received as they
+//! arrive. Defaults to 0, which delivers each message as soon as it completes. Unavailable in
+//! builds with SIMPLE_APP_MESSAGE_STATIC_ALLOCATION.
+void simple_app_message_set_dispatch_queue_depth(size_t max_depth);
+
+//! Also tells the phone the watch app has started, so one that was already running asks for the
+//! chunk size again before its next send.
 AppMessageResult simple_app_message_open(void);
 
 typedef struct SimpleAppMessageCallbacks {
+  //! Updates the phone sends with simpleAppMessage.sync() are merged into a state kept for the
+  //! namespace, which is passed here whole in place of each update. The other callbacks see the
+  //! updates as they were sent. Compiled out along with state sync when
+  //! SIMPLE_APP_MESSAGE_DICT_MESSAGES is 0, which is the default with static allocation.
   SimpleAppMessageReceivedCallback message_received;
+  //! Cheaper alternative to message_received that skips building a SimpleDict
+  SimpleAppMessageViewReceivedCallback message_view_received;
+  //! Delivers keys while the message is still arriving. If neither message_received nor
+  //! message_view_received are set, the message is never buffered in full, so only about one
+  //! chunk plus the largest value is held in memory.
+  SimpleAppMessageKeyReceivedCallback key_received;
+  //! If set, data values are passed here in pieces instead of to key_received, and only about one
+  //! chunk is held in memory however large they are, unless the message is also buffered
+  SimpleAppMessageDataPieceReceivedCallback data_piece_received;
+  SimpleAppMessageStreamEndedCallback message_stream_ended;
+  SimpleAppMessageSentCallback message_sent;
 } SimpleAppMessageCallbacks;
 
 
@@ -24,3 +136,171 @@ bool simple_app_message_register_callbacks(const char *namespace,
                                            void *context);
 
 void simple_app_message_deregister_callbacks(const char *namespace);
+
+//! Serializes the message and queues it to be sent to the phone in chunks. Messages are sent in
+//! the order they are queued, and the namespace's message_sent callback (if registered) is called
+//! once the phone has acknowledged every chunk.
+//! @return True if the message was queued
+bool simple_app_message_send(const char *namespace, const SimpleDict *message);
+
+//! A call the phone made to a registered method. Copy it to respond once the handler has
+//! returned.
+typedef struct SimpleAppMessageRpcRequest {
+  char method[SIMPLE_APP_MESSAGE_NAMESPACE_MAX_SIZE_BYTES];
+  int32_t id;
+} SimpleAppMessageRpcRequest;
+
+//! Called with each call the phone makes to the method. Respond with
+//! simple_app_message_rpc_respond() or simple_app_message_rpc_respond_error(), now or later.
+//! params is only valid until the callback returns, and also holds the keys starting with '#'
+//! that RPC reserves.
+typedef void (*SimpleAppMessageRpcRequestCallback)(const SimpleAppMessageRpcRequest *request,
+                                                   const SimpleAppMessageView *params,
+                                                   void *context);
+
+//! Called once with the response to simple_app_message_rpc_call(). On success error is NULL and
+//! result is only valid until the callback returns. Otherwise result is NULL and error is the
+//! phone's error or says the call timed out.
+typedef void (*SimpleAppMessageRpcResponseCallback)(const SimpleAppMessageView *result,
+                                                    const char *error, void *context);
+
+//! Answers the phone's simpleAppMessage.call() for method. Methods are namespaces, which RPC
+//! registers callbacks for, so they shouldn't also be registered or sent on directly.
+bool simple_app_message_rpc_register_method(const char *method,
+                                            SimpleAppMessageRpcRequestCallback handler,
+                                            void *context);
+
+//! Stops answering calls to method. Calls that arrive afterwards get an error response.
+void simple_app_message_rpc_deregister_method(const char *method);
+
+//! Calls a method the phone handles with simpleAppMessage.handle(). Calls don't wait for earlier
+//! ones to be answered, so several can be in flight and their responses can arrive in any order.
+//! A call that can't be delivered fails once it times out.
+//! @param params May be NULL. Gets the reserved call ID key added to it.
+//! @return True if the call was queued, in which case callback will be called exactly once
+bool simple_app_message_rpc_call(const char *method, SimpleDict *params, uint32_t timeout_ms,
+                                 SimpleAppMessageRpcResponseCallback callback, void *context);
+
+//! @param result May be NULL. Gets the reserved response keys added to it.
+//! @return True if the response was queued
+bool simple_app_message_rpc_respond(const SimpleAppMessageRpcRequest *request,
+                                    SimpleDict *result);
+
+//! @return True if the response was queued
+bool simple_app_message_rpc_respond_error(const SimpleAppMessageRpcRequest *request,
+                                          const char *error);
+
+//! Why a transfer from the phone was abandoned, or why a chunk couldn't be used at all
+typedef enum SimpleAppMessageResetReason {
+  //! A chunk didn't fit the transfer in progress or was malformed
+  SimpleAppMessageResetReason_UnexpectedSequence,
+  //! No callbacks are registered for the chunk's namespace
+  SimpleAppMessageResetReason_UnknownNamespace,
+  SimpleAppMessageResetReason_MallocFailure,
+  //! The chunk's namespace is longer than SIMPLE_APP_MESSAGE_NAMESPACE_MAX_SIZE_BYTES
+  SimpleAppMessageResetReason_OversizedNamespace,
+  //! The message has more keys or bytes than a build with static allocation has room for
+  SimpleAppMessageResetReason_OversizedMessage,
+
+  SimpleAppMessageResetReason_Count
+} SimpleAppMessageResetReason;
+
+//! Counters for the receive path, kept since the app started or the stats were last reset. They
+//! are only ever incremented or compared, so they are always on.
+typedef struct SimpleAppMessageStats {
+  uint32_t chunks_received;
+  //! Chunk data only, without the dictionary around it
+  uint32_t bytes_received;
+  //! Messages delivered to a namespace, counting each message in a batch
+  uint32_t messages_completed;
+  uint32_t resets[SimpleAppMessageResetReason_Count];
+  //! Packets the system dropped before they reached the library, usually because the inbox was
+  //! full or too small
+  uint32_t inbox_drops;
+  //! Largest allocation held to reassemble a single message
+  size_t peak_assembly_size;
+  //! Time from the first to the last chunk of the most recently completed transfer, the longest
+  //! one and all of them added up
+  uint32_t last_transfer_ms;
+  uint32_t max_transfer_ms;
+  uint32_t total_transfer_ms;
+  //! Most complete messages waiting at once with simple_app_message_set_dispatch_queue_depth()
+  size_t peak_dispatch_queue_depth;
+} SimpleAppMessageStats;
+
+void simple_app_message_get_stats(SimpleAppMessageStats *stats_out);
+
+//! @return Messages delivered to the namespace since the stats were last reset
+uint32_t simple_app_message_get_namespace_messages_completed(const char *namespace);
+
+//! Zeroes every counter, including the per namespace ones
+void simple_app_message_reset_stats(void);
+
+//! @return True to continue iterating, false to stop
+typedef bool (*SimpleAppMessageViewForEachCallback)(const char *key, SimpleAppMessageDataType type,
+                                                    const void *data, size_t data_size,
+                                                    void *context);
+
+size_t simple_app_message_view_get_num_keys(const SimpleAppMessageView *view);
+
+void simple_app_message_view_foreach(const SimpleAppMessageView *view,
+                                     SimpleAppMessageViewForEachCallback callback, void *context);
+
+//! Looks up a key without copying its value. Any of the out parameters may be NULL.
+//! @return True if the key was found
+bool simple_app_message_view_find(const SimpleAppMessageView *view, const char *key,
+                                  SimpleAppMessageDataType *type_out, const void **data_out,
+                                  size_t *data_size_out);
+
+//! @return False if the key is missing or is not a bool
+bool simple_app_message_view_get_bool(const SimpleAppMessageView *view, const char *key,
+                                      bool *value_out);
+
+//! @return False if the key is missing or is not an int
+bool simple_app_message_view_get_int(const SimpleAppMessageView *view, const char *key,
+                                     int32_t *value_out);
+
+//! @return Pointer to the string in the receive buffer, or NULL if the key is missing or is not a
+//! string
+const char *simple_app_message_view_get_string(const SimpleAppMessageView *view, const char *key);
+
+//! @return Pointer to the data in the receive buffer, or NULL if the key is missing or is not data
+const uint8_t *simple_app_message_view_get_data(const SimpleAppMessageView *view, const char *key,
+                                                size_t *size_out);
+
+//! @return False if the key is missing or is not a well formed array
+bool simple_app_message_view_get_array(const SimpleAppMessageView *view, const char *key,
+                                       SimpleAppMessageArray *array_out);
+
+//! @return False if the key is missing or is not a well formed object
+bool simple_app_message_view_get_object(const SimpleAppMessageView *view, const char *key,
+                                        SimpleAppMessageObject *object_out);
+
+//! Points array at the value of an array key, as passed to a foreach, key_received callback or
+//! stored in a SimpleDict as data
+//! @return False if the value is not a well formed array
+bool simple_app_message_array_init(SimpleAppMessageArray *array, const void *data,
+                                   size_t data_size);
+
+//! @return The element at index, or 0 if it is out of bounds. Uint32 elements above INT32_MAX
+//! wrap around.
+int32_t simple_app_message_array_get_int(const SimpleAppMessageArray *array, size_t index);
+
+//! Widens count elements starting at first into ints_out, aligned and ready to use, for example
+//! to plot a series in one pass
+//! @return Number of elements copied, fewer than count if the array ends first
+size_t simple_app_message_array_copy_ints(const SimpleAppMessageArray *array, size_t first,
+                                          int32_t *ints_out, size_t count);
+
+//! Points object at the value of an object key, checking every key in it, but not the values of
+//! objects nested further down
+//! @return False if the value is not a well formed object
+bool simple_app_message_object_init(SimpleAppMessageObject *object, const void *data,
+                                    size_t data_size);
+
+size_t simple_app_message_object_get_num_keys(const SimpleAppMessageObject *object);
+
+//! Same as simple_app_message_view_foreach(), data is only valid until the callback returns
+void simple_app_message_object_foreach(const SimpleAppMessageObject *object,
+                                       SimpleAppMessageViewForEachCallback callback,
+                                       void *context);
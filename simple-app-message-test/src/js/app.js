@@ -8,6 +8,10 @@ var testData = {
   keyString: 'test'
 };
 
+simpleAppMessage.subscribe('TEST', function(data) {
+  console.log('SimpleAppMessageTest - echo: ' + JSON.stringify(data));
+});
+
 Pebble.addEventListener('ready', function() {
   simpleAppMessage.send('TEST', testData, function(e) {
     console.log('SimpleAppMessageTest - handler: ' + JSON.stringify(e));
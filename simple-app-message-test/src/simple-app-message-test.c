@@ -3,7 +3,7 @@
 #include <@keegan-stoneware/simple-app-message/simple-app-message.h>
 
 #define SIMPLE_APP_MESSAGE_NAMESPACE ("TEST")
-#define SIMPLE_APP_MESSAGE_INBOX_SIZE (48)
+#define SIMPLE_APP_MESSAGE_INBOX_SIZE (128)
 
 static bool prv_print_dict(const char *key, SimpleDictDataType type, const void *data,
                            size_t data_size, void *context) {
@@ -44,6 +44,15 @@ static void prv_simple_app_message_received_callback(const SimpleDict *message,
 
   APP_LOG(APP_LOG_LEVEL_INFO, "Received SimpleAppMessage for namespace TEST:");
   simple_dict_foreach(message, prv_print_dict, NULL);
+
+  // Echo the message back so the phone side can check the round trip
+  if (!simple_app_message_send(SIMPLE_APP_MESSAGE_NAMESPACE, message)) {
+    APP_LOG(APP_LOG_LEVEL_ERROR, "Failed to queue echo of SimpleAppMessage");
+  }
+}
+
+static void prv_simple_app_message_sent_callback(bool success, void *context) {
+  APP_LOG(APP_LOG_LEVEL_INFO, "Echo of SimpleAppMessage %s", success ? "sent" : "failed");
 }
 
 static void prv_window_unload(Window *window) {
@@ -53,6 +62,7 @@ static void prv_window_unload(Window *window) {
 static void prv_init(void) {
   const SimpleAppMessageCallbacks simple_app_message_callbacks = (SimpleAppMessageCallbacks) {
     .message_received = prv_simple_app_message_received_callback,
+    .message_sent = prv_simple_app_message_sent_callback,
   };
   const bool register_success = simple_app_message_register_callbacks(SIMPLE_APP_MESSAGE_NAMESPACE,
                                                                       &simple_app_message_callbacks,
@@ -0,0 +1,35 @@
+#include "simple-app-message-arena.h"
+
+SimpleAppMessageArena *simple_app_message_arena_create(SimpleAppMessagePool *pool,
+                                                       size_t capacity) {
+  capacity = SIMPLE_APP_MESSAGE_ARENA_ALIGN(capacity);
+  SimpleAppMessageArena *arena =
+      simple_app_message_pool_alloc(pool, sizeof(SimpleAppMessageArena) + capacity);
+  if (arena) {
+    arena->pool = pool;
+    arena->capacity = capacity;
+    arena->used = 0;
+  }
+  return arena;
+}
+
+void *simple_app_message_arena_alloc(SimpleAppMessageArena *arena, size_t size) {
+  if (!arena) {
+    return NULL;
+  }
+
+  const size_t aligned_size = SIMPLE_APP_MESSAGE_ARENA_ALIGN(size);
+  if ((aligned_size < size) || (aligned_size > arena->capacity - arena->used)) {
+    return NULL;
+  }
+
+  void *allocation = (uint8_t *)arena->data + arena->used;
+  arena->used += aligned_size;
+  return allocation;
+}
+
+void simple_app_message_arena_destroy(SimpleAppMessageArena *arena) {
+  if (arena) {
+    simple_app_message_pool_free(arena->pool, arena);
+  }
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include "simple-app-message-pool.h"
+
+#include <pebble.h>
+
+//! Every allocation handed out by an arena starts on a pointer sized boundary
+#define SIMPLE_APP_MESSAGE_ARENA_ALIGN(size) \
+    (((size) + sizeof(void *) - 1) & ~(sizeof(void *) - 1))
+
+//! Bump allocator backed by a single allocation from a pool. Individual allocations can't be
+//! freed, the whole arena is released at once by simple_app_message_arena_destroy().
+typedef struct SimpleAppMessageArena {
+  SimpleAppMessagePool *pool;
+  size_t capacity;
+  size_t used;
+  // Kept pointer aligned so the first allocation is aligned too
+  void *data[];
+} SimpleAppMessageArena;
+
+//! Bytes a pool slot needs to hold an arena of capacity bytes
+#define SIMPLE_APP_MESSAGE_ARENA_SIZE(capacity) \
+    (sizeof(SimpleAppMessageArena) + SIMPLE_APP_MESSAGE_ARENA_ALIGN(capacity))
+
+//! @param capacity Total bytes available, callers should sum SIMPLE_APP_MESSAGE_ARENA_ALIGN() of
+//! every allocation they intend to make
+//! @return NULL if the pool has no room for it
+SimpleAppMessageArena *simple_app_message_arena_create(SimpleAppMessagePool *pool,
+                                                       size_t capacity);
+
+//! @return size bytes from the arena, or NULL if the arena doesn't have enough space left
+void *simple_app_message_arena_alloc(SimpleAppMessageArena *arena, size_t size);
+
+void simple_app_message_arena_destroy(SimpleAppMessageArena *arena);
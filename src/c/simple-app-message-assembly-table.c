@@ -0,0 +1,294 @@
+#include "simple-app-message-assembly-table.h"
+
+#include "simple-app-message-pool.h"
+
+//! Finished transfers remembered after their assembly has been handed to another transfer, enough
+//! to cover the resends the phone has in flight when it moves on
+#define FINISHED_TRANSFERS (8)
+
+typedef struct AssemblyTableEntry {
+  char namespace[SIMPLE_APP_MESSAGE_NAMESPACE_MAX_SIZE_BYTES];
+  uint32_t transfer_id;
+  //! Value of the table's use counter when this entry last received a chunk
+  uint32_t last_used;
+  SimpleAppMessageAssembly *assembly;
+} AssemblyTableEntry;
+
+typedef struct FinishedTransfer {
+  char namespace[SIMPLE_APP_MESSAGE_NAMESPACE_MAX_SIZE_BYTES];
+  uint32_t transfer_id;
+} FinishedTransfer;
+
+struct SimpleAppMessageAssemblyTable {
+  size_t chunk_size;
+  SimpleAppMessageAssemblyStreamHandlers stream_handlers;
+  void *stream_context;
+  size_t max_assemblies;
+  //! Entries only move when one is evicted, recency is tracked with last_used instead
+  AssemblyTableEntry **entries;
+  uint16_t count;
+  uint16_t capacity;
+  uint32_t use_counter;
+  //! Ring of the transfers whose finished assemblies were recycled or freed, oldest overwritten
+  FinishedTransfer finished[FINISHED_TRANSFERS];
+  uint8_t num_finished;
+  uint8_t next_finished;
+};
+
+SIMPLE_APP_MESSAGE_POOL_DEFINE(s_table_pool, SimpleAppMessageAssemblyTable, 1);
+SIMPLE_APP_MESSAGE_POOL_DEFINE(s_entry_pool, AssemblyTableEntry, SIMPLE_APP_MESSAGE_MAX_TRANSFERS);
+
+#if SIMPLE_APP_MESSAGE_STATIC_ALLOCATION
+static AssemblyTableEntry *s_entries[SIMPLE_APP_MESSAGE_MAX_TRANSFERS];
+#endif
+
+SimpleAppMessageAssemblyTable *simple_app_message_assembly_table_create(
+    size_t chunk_size, size_t max_assemblies,
+    const SimpleAppMessageAssemblyStreamHandlers *stream_handlers, void *stream_context) {
+  if (!max_assemblies) {
+    return NULL;
+  }
+
+  SimpleAppMessageAssemblyTable *table =
+      simple_app_message_pool_alloc(&s_table_pool, sizeof(SimpleAppMessageAssemblyTable));
+  if (!table) {
+    return NULL;
+  }
+
+  *table = (SimpleAppMessageAssemblyTable) {0};
+#if SIMPLE_APP_MESSAGE_STATIC_ALLOCATION
+  table->entries = s_entries;
+  table->capacity = SIMPLE_APP_MESSAGE_MAX_TRANSFERS;
+#endif
+  table->chunk_size = chunk_size;
+  if (stream_handlers) {
+    table->stream_handlers = *stream_handlers;
+  }
+  table->stream_context = stream_context;
+  table->max_assemblies = max_assemblies;
+  return table;
+}
+
+//! Remembers the entry's transfer if it finished, before its assembly forgets it
+static void prv_remember_finished(SimpleAppMessageAssemblyTable *table,
+                                  const AssemblyTableEntry *entry) {
+  if (!simple_app_message_assembly_is_finished(entry->assembly)) {
+    return;
+  }
+
+  FinishedTransfer *finished = &table->finished[table->next_finished];
+  memcpy(finished->namespace, entry->namespace, sizeof(finished->namespace));
+  finished->transfer_id = entry->transfer_id;
+  table->next_finished = (table->next_finished + 1) % FINISHED_TRANSFERS;
+  if (table->num_finished < FINISHED_TRANSFERS) {
+    table->num_finished++;
+  }
+}
+
+static void prv_entry_destroy(AssemblyTableEntry *entry) {
+  if (!entry) {
+    return;
+  }
+  simple_app_message_assembly_destroy(entry->assembly);
+  simple_app_message_pool_free(&s_entry_pool, entry);
+}
+
+//! @return Index of an idle entry if there is one, otherwise of the least recently used entry
+static uint16_t prv_find_eviction_candidate(SimpleAppMessageAssemblyTable *table) {
+  uint16_t candidate = 0;
+  uint32_t candidate_age = 0;
+  for (uint16_t index = 0; index < table->count; index++) {
+    const AssemblyTableEntry *entry = table->entries[index];
+    if (!simple_app_message_assembly_is_in_progress(entry->assembly)) {
+      return index;
+    }
+
+    // Unsigned subtraction keeps the ages right across counter wraparound
+    const uint32_t age = table->use_counter - entry->last_used;
+    if (age >= candidate_age) {
+      candidate = index;
+      candidate_age = age;
+    }
+  }
+  return candidate;
+}
+
+static void prv_trim(SimpleAppMessageAssemblyTable *table, size_t max_count) {
+  while (table->count > max_count) {
+    const uint16_t index = prv_find_eviction_candidate(table);
+    AssemblyTableEntry *entry = table->entries[index];
+    if (simple_app_message_assembly_is_in_progress(entry->assembly)) {
+      APP_LOG(APP_LOG_LEVEL_WARNING, "Evicting SimpleAppMessage transfer %u for namespace %s",
+              (unsigned int)entry->transfer_id, entry->namespace);
+    }
+    prv_remember_finished(table, entry);
+    table->entries[index] = table->entries[--table->count];
+    prv_entry_destroy(entry);
+  }
+}
+
+void simple_app_message_assembly_table_set_max_assemblies(SimpleAppMessageAssemblyTable *table,
+                                                          size_t max_assemblies) {
+  if (!table || !max_assemblies) {
+    return;
+  }
+
+  // Trimmed on the next new transfer rather than here, so an assembly that is being dispatched is
+  // never freed from under the dispatcher
+  table->max_assemblies = max_assemblies;
+}
+
+static AssemblyTableEntry *prv_find_entry(const SimpleAppMessageAssemblyTable *table,
+                                          const char *namespace, uint32_t transfer_id) {
+  for (uint16_t index = 0; index < table->count; index++) {
+    AssemblyTableEntry *entry = table->entries[index];
+    if ((entry->transfer_id == transfer_id) && (strcmp(entry->namespace, namespace) == 0)) {
+      return entry;
+    }
+  }
+  return NULL;
+}
+
+//! Makes room in the entry array for one more entry
+static bool prv_reserve_entry(SimpleAppMessageAssemblyTable *table) {
+  if (table->count < table->capacity) {
+    return true;
+  }
+#if SIMPLE_APP_MESSAGE_STATIC_ALLOCATION
+  return false;
+#else
+  const uint16_t capacity = table->capacity ? (table->capacity * 2) : 4;
+  AssemblyTableEntry **entries = realloc(table->entries, capacity * sizeof(AssemblyTableEntry *));
+  if (!entries) {
+    return false;
+  }
+  table->entries = entries;
+  table->capacity = capacity;
+  return true;
+#endif
+}
+
+static AssemblyTableEntry *prv_create_entry(SimpleAppMessageAssemblyTable *table) {
+  AssemblyTableEntry *entry = simple_app_message_pool_alloc(&s_entry_pool,
+                                                            sizeof(AssemblyTableEntry));
+  if (!entry) {
+    return NULL;
+  }
+
+  *entry = (AssemblyTableEntry) {0};
+  entry->assembly = simple_app_message_assembly_create(table->chunk_size, &table->stream_handlers,
+                                                       table->stream_context);
+  if (!entry->assembly) {
+    simple_app_message_pool_free(&s_entry_pool, entry);
+    return NULL;
+  }
+  return entry;
+}
+
+//! Takes over an idle entry, or the least recently used one if the table is full
+static AssemblyTableEntry *prv_claim_entry(SimpleAppMessageAssemblyTable *table) {
+  const uint16_t count = table->count;
+  if (count) {
+    AssemblyTableEntry *entry = table->entries[prv_find_eviction_candidate(table)];
+    const bool is_idle = !simple_app_message_assembly_is_in_progress(entry->assembly);
+    if (is_idle || (count >= table->max_assemblies)) {
+      if (!is_idle) {
+        APP_LOG(APP_LOG_LEVEL_WARNING, "Evicting SimpleAppMessage transfer %u for namespace %s",
+                (unsigned int)entry->transfer_id, entry->namespace);
+      }
+      prv_remember_finished(table, entry);
+      simple_app_message_assembly_recycle(entry->assembly);
+      return entry;
+    }
+  }
+
+  if (!prv_reserve_entry(table)) {
+    return NULL;
+  }
+  AssemblyTableEntry *entry = prv_create_entry(table);
+  if (entry) {
+    table->entries[table->count++] = entry;
+  }
+  return entry;
+}
+
+SimpleAppMessageAssembly *simple_app_message_assembly_table_get(
+    SimpleAppMessageAssemblyTable *table, const char *namespace, uint32_t transfer_id) {
+  if (!table || !namespace) {
+    return NULL;
+  }
+
+  AssemblyTableEntry key = (AssemblyTableEntry) {
+    .transfer_id = transfer_id,
+  };
+  strncpy(key.namespace, namespace, sizeof(key.namespace) - 1);
+
+  AssemblyTableEntry *entry = prv_find_entry(table, key.namespace, transfer_id);
+  if (!entry) {
+    prv_trim(table, table->max_assemblies);
+    entry = prv_claim_entry(table);
+    if (!entry) {
+      APP_LOG(APP_LOG_LEVEL_ERROR, "Failed to create SimpleAppMessage assembly state");
+      return NULL;
+    }
+    memcpy(entry->namespace, key.namespace, sizeof(entry->namespace));
+    entry->transfer_id = transfer_id;
+  }
+
+  entry->last_used = ++table->use_counter;
+  return entry->assembly;
+}
+
+bool simple_app_message_assembly_table_is_finished(const SimpleAppMessageAssemblyTable *table,
+                                                   const char *namespace, uint32_t transfer_id) {
+  if (!table || !namespace) {
+    return false;
+  }
+
+  AssemblyTableEntry *entry = prv_find_entry(table, namespace, transfer_id);
+  if (entry) {
+    return simple_app_message_assembly_is_finished(entry->assembly);
+  }
+  for (uint8_t index = 0; index < table->num_finished; index++) {
+    const FinishedTransfer *finished = &table->finished[index];
+    if ((finished->transfer_id == transfer_id) &&
+        (strncmp(finished->namespace, namespace, sizeof(finished->namespace) - 1) == 0)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void simple_app_message_assembly_table_forget_idle(SimpleAppMessageAssemblyTable *table) {
+  if (!table) {
+    return;
+  }
+
+  table->num_finished = 0;
+  table->next_finished = 0;
+
+  uint16_t index = 0;
+  while (index < table->count) {
+    AssemblyTableEntry *entry = table->entries[index];
+    if (simple_app_message_assembly_is_in_progress(entry->assembly)) {
+      index++;
+      continue;
+    }
+    table->entries[index] = table->entries[--table->count];
+    prv_entry_destroy(entry);
+  }
+}
+
+void simple_app_message_assembly_table_destroy(SimpleAppMessageAssemblyTable *table) {
+  if (!table) {
+    return;
+  }
+
+  for (uint16_t index = 0; index < table->count; index++) {
+    prv_entry_destroy(table->entries[index]);
+  }
+#if !SIMPLE_APP_MESSAGE_STATIC_ALLOCATION
+  free(table->entries);
+#endif
+  simple_app_message_pool_free(&s_table_pool, table);
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include "simple-app-message-assembly.h"
+
+#include <pebble.h>
+
+//! Tracks the assemblies of transfers that are in flight at the same time, keyed by namespace and
+//! transfer ID, so that chunks of one transfer arriving between chunks of another don't reset it
+typedef struct SimpleAppMessageAssemblyTable SimpleAppMessageAssemblyTable;
+
+//! @param stream_handlers Passed to every assembly the table creates
+SimpleAppMessageAssemblyTable *simple_app_message_assembly_table_create(
+    size_t chunk_size, size_t max_assemblies,
+    const SimpleAppMessageAssemblyStreamHandlers *stream_handlers, void *stream_context);
+
+//! If the limit is lowered, the next new transfer evicts idle assemblies first, then the least
+//! recently used ones, until the table fits
+void simple_app_message_assembly_table_set_max_assemblies(SimpleAppMessageAssemblyTable *table,
+                                                          size_t max_assemblies);
+
+//! Returns the assembly for a transfer, creating one if needed. A new transfer takes over an idle
+//! assembly if there is one, otherwise the least recently used transfer is evicted once the table
+//! is full.
+//! @return NULL if no assembly could be created
+SimpleAppMessageAssembly *simple_app_message_assembly_table_get(
+    SimpleAppMessageAssemblyTable *table, const char *namespace, uint32_t transfer_id);
+
+//! Whether a transfer was completed and released, including one whose assembly has since been
+//! handed to another transfer. Chunks of such a transfer are late resends, and must not start it
+//! over.
+bool simple_app_message_assembly_table_is_finished(const SimpleAppMessageAssemblyTable *table,
+                                                   const char *namespace, uint32_t transfer_id);
+
+//! Frees the assemblies of transfers that aren't in progress, and forgets the finished ones. A phone that reconnects numbers its
+//! transfers from the start again, and would otherwise have chunks of a new transfer ignored as
+//! resends of a finished one with the same ID.
+void simple_app_message_assembly_table_forget_idle(SimpleAppMessageAssemblyTable *table);
+
+void simple_app_message_assembly_table_destroy(SimpleAppMessageAssemblyTable *table);
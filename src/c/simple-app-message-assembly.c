@@ -1,32 +1,134 @@
 #include "simple-app-message-assembly.h"
 
+#include "simple-app-message-arena.h"
+#include "simple-app-message-compression.h"
+#include "simple-app-message-config.h"
+#include "simple-app-message-stream.h"
+
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+
 typedef struct SimpleAppMessageAssemblyState {
+  //! Holds the entry index, the reassembly buffer and the namespace so that a message costs a
+  //! single allocation and is released with a single free
+  SimpleAppMessageArena *arena;
+  size_t arena_size;
+  //! When the first chunk arrived
+  uint64_t started_ms;
+  SimpleAppMessageAssemblyFlags flags;
+  SimpleAppMessageEntry *entries;
+  size_t max_entries;
+  size_t num_entries;
+  bool indexed;
   char *namespace;
+  //! Only allocated with SimpleAppMessageAssemblyFlag_Buffer
   uint8_t *buffer;
   uint8_t *buffer_cursor;
+  uint8_t *buffer_end;
+  //! Only used with SimpleAppMessageAssemblyFlag_Stream
+  bool stream_ended;
+  //! Decompresses into the buffer, or into a window sized ring if the payload isn't buffered
+  bool compressed;
+  size_t compressed_header_size;
+  SimpleAppMessageDecompressor decompressor;
+  //! One bit per chunk, only allocated for buffered transfers with
+  //! SimpleAppMessageAssemblyFlag_Retransmits that are neither streamed nor compressed. Their
+  //! chunks are written at their index in any order, everything else has to arrive in order.
+  uint8_t *received;
+  //! Length of every chunk but the last, taken from the first chunk
+  size_t stride;
+  //! Highest chunk index seen, chunks below it that haven't arrived are missing
+  uint32_t highest_index;
   uint32_t total_chunks;
   uint32_t chunks_remaining;
 } SimpleAppMessageAssemblyState;
 
+struct SimpleAppMessageDetachedMessage {
+  SimpleAppMessageAssemblyState state;
+};
+
 struct SimpleAppMessageAssembly {
   size_t chunk_size;
+  SimpleAppMessageAssemblyStreamHandlers stream_handlers;
+  void *stream_context;
+  //! Outlives the state of a single transfer so its carry buffer can be reused
+  SimpleAppMessageStream stream;
   SimpleAppMessageAssemblyState state;
+  //! Set by the last update if it found chunks missing
+  SimpleAppMessageChunkRange missing;
+  //! Set by the last update if it abandoned a transfer or couldn't start one
+  bool did_reset;
+  SimpleAppMessageResetReason reset_reason;
+  //! The transfer was released after completing, so any more of its chunks are resends
+  bool finished;
+  //! Highest index of the chunks dropped because they arrived before the first, 0 if none were
+  uint32_t early_index;
 };
 
-SimpleAppMessageAssembly *simple_app_message_assembly_create(size_t chunk_size) {
-  SimpleAppMessageAssembly *assembly = calloc(1, sizeof(SimpleAppMessageAssembly));
+//! Largest arena a transfer can need within the static limits: the entry index, the buffer or the
+//! decompressor's window, the received bitmap for one byte chunks and the namespace
+#define SIMPLE_APP_MESSAGE_STATIC_ARENA_CAPACITY                                                  \
+    (SIMPLE_APP_MESSAGE_ARENA_ALIGN(SIMPLE_APP_MESSAGE_MAX_KEYS * sizeof(SimpleAppMessageEntry)) + \
+     SIMPLE_APP_MESSAGE_ARENA_ALIGN(MAX(SIMPLE_APP_MESSAGE_MAX_MESSAGE_SIZE,                      \
+                                        SIMPLE_APP_MESSAGE_COMPRESSION_WINDOW_SIZE)) +            \
+     SIMPLE_APP_MESSAGE_ARENA_ALIGN((SIMPLE_APP_MESSAGE_MAX_MESSAGE_SIZE + 7) / 8) +              \
+     SIMPLE_APP_MESSAGE_ARENA_ALIGN(SIMPLE_APP_MESSAGE_NAMESPACE_MAX_SIZE_BYTES))
+
+typedef uint8_t AssemblyArenaSlot[SIMPLE_APP_MESSAGE_ARENA_SIZE(
+    SIMPLE_APP_MESSAGE_STATIC_ARENA_CAPACITY)];
+
+SIMPLE_APP_MESSAGE_POOL_DEFINE(s_assembly_pool, SimpleAppMessageAssembly,
+                               SIMPLE_APP_MESSAGE_MAX_TRANSFERS);
+SIMPLE_APP_MESSAGE_POOL_DEFINE(s_arena_pool, AssemblyArenaSlot, SIMPLE_APP_MESSAGE_MAX_TRANSFERS);
+//! A detached message keeps the arena of the transfer it came from, so there are never more of
+//! them than arenas
+SIMPLE_APP_MESSAGE_POOL_DEFINE(s_detached_pool, SimpleAppMessageDetachedMessage,
+                               SIMPLE_APP_MESSAGE_MAX_TRANSFERS);
+
+SimpleAppMessageAssembly *simple_app_message_assembly_create(
+    size_t chunk_size, const SimpleAppMessageAssemblyStreamHandlers *stream_handlers,
+    void *stream_context) {
+  SimpleAppMessageAssembly *assembly =
+      simple_app_message_pool_alloc(&s_assembly_pool, sizeof(SimpleAppMessageAssembly));
   if (assembly) {
+    *assembly = (SimpleAppMessageAssembly) {0};
     assembly->chunk_size = chunk_size;
+    if (stream_handlers) {
+      assembly->stream_handlers = *stream_handlers;
+    }
+    assembly->stream_context = stream_context;
+    simple_app_message_stream_init(&assembly->stream);
   }
   return assembly;
 }
 
+static uint64_t prv_now_ms(void) {
+  time_t seconds;
+  uint16_t milliseconds;
+  time_ms(&seconds, &milliseconds);
+  return ((uint64_t)seconds * 1000) + milliseconds;
+}
+
+static void prv_stream_end(SimpleAppMessageAssembly *assembly, bool complete) {
+  SimpleAppMessageAssemblyState *state = &assembly->state;
+  if (!(state->flags & SimpleAppMessageAssemblyFlag_Stream) || state->stream_ended) {
+    return;
+  }
+
+  state->stream_ended = true;
+  if (assembly->stream_handlers.stream_ended) {
+    assembly->stream_handlers.stream_ended(state->namespace, complete, assembly->stream_context);
+  }
+}
+
 static void prv_assembly_deinit(SimpleAppMessageAssembly *assembly) {
   if (!assembly) {
     return;
   }
-  free(assembly->state.namespace);
-  free(assembly->state.buffer);
+  // Let the receiver know that the keys it has been given so far won't be followed by the rest
+  prv_stream_end(assembly, false /* complete */);
+  simple_app_message_stream_reset(&assembly->stream);
+  simple_app_message_arena_destroy(assembly->state.arena);
 }
 
 static void prv_assembly_reset(SimpleAppMessageAssembly *assembly) {
@@ -37,89 +139,437 @@ static void prv_assembly_reset(SimpleAppMessageAssembly *assembly) {
   assembly->state = (SimpleAppMessageAssemblyState) {0};
 }
 
-static bool prv_assembly_in_progress(const SimpleAppMessageAssembly *assembly) {
-  return (assembly && assembly->state.namespace && assembly->state.buffer &&
-          (assembly->state.buffer_cursor > assembly->state.buffer));
+//! Resets the assembly, recording why for simple_app_message_assembly_get_reset_reason()
+static void prv_assembly_abandon(SimpleAppMessageAssembly *assembly,
+                                 SimpleAppMessageResetReason reason) {
+  assembly->did_reset = true;
+  assembly->reset_reason = reason;
+  prv_assembly_reset(assembly);
+}
+
+bool simple_app_message_assembly_is_in_progress(const SimpleAppMessageAssembly *assembly) {
+  return (assembly && assembly->state.namespace &&
+          (assembly->state.chunks_remaining < assembly->state.total_chunks));
+}
+
+bool simple_app_message_assembly_is_finished(const SimpleAppMessageAssembly *assembly) {
+  return (assembly && assembly->finished);
+}
+
+//! Sizes the arena from the first chunk: the entry index from the key count at the start of the
+//! payload, the buffer from the chunk size and total chunks, and the namespace from its length.
+//! Streaming without buffering only needs the namespace, plus the decompressor's window if the
+//! payload is compressed. A compressed payload's header gives its exact decompressed size.
+//! @param reason_out Why the transfer couldn't be started, if it returns false
+static bool prv_assembly_init(SimpleAppMessageAssembly *assembly, const char *namespace,
+                              const Tuple *total_chunks, const Tuple *chunk_data,
+                              SimpleAppMessageAssemblyFlags flags,
+                              SimpleAppMessageResetReason *reason_out) {
+  *reason_out = SimpleAppMessageResetReason_UnexpectedSequence;
+  const size_t namespace_size = strlen(namespace) + 1;
+  const uint32_t num_chunks = total_chunks->value->uint32;
+  if (!num_chunks || !chunk_data->length || (chunk_data->length > assembly->chunk_size) ||
+      (num_chunks > SIZE_MAX / assembly->chunk_size)) {
+    APP_LOG(APP_LOG_LEVEL_ERROR, "Invalid first chunk for SimpleAppMessage assembly");
+    return false;
+  }
+
+  const bool is_buffered = (flags & SimpleAppMessageAssemblyFlag_Buffer);
+  const bool is_compressed =
+      simple_app_message_compression_is_compressed(chunk_data->value->data, chunk_data->length);
+  SimpleAppMessageCompressedHeader compressed_header = {0};
+  if (is_compressed &&
+      !simple_app_message_compression_parse_header(chunk_data->value->data, chunk_data->length,
+                                                   &compressed_header)) {
+    APP_LOG(APP_LOG_LEVEL_ERROR, "Invalid compressed SimpleAppMessage header");
+    return false;
+  }
+
+  // Every payload starts with a header holding its key count
+  uint8_t max_entries = 0;
+  size_t buffer_size = 0;
+  size_t window_size = 0;
+  if (is_compressed) {
+    max_entries = is_buffered ? compressed_header.num_keys : 0;
+    buffer_size = is_buffered ? compressed_header.decompressed_size : 0;
+    window_size = is_buffered ? 0 : MIN(compressed_header.decompressed_size,
+                                        SIMPLE_APP_MESSAGE_COMPRESSION_WINDOW_SIZE);
+  } else if (is_buffered) {
+    SimpleAppMessagePayloadHeader header;
+    if (!simple_app_message_deserialize_header(chunk_data->value->data, chunk_data->length,
+                                               &header)) {
+      APP_LOG(APP_LOG_LEVEL_ERROR, "Invalid header in first SimpleAppMessage chunk");
+      return false;
+    }
+    max_entries = header.num_keys;
+    // Every chunk but the last is as long as the first one, which may be shorter than the
+    // negotiated chunk size if the phone sent the namespace string
+    buffer_size = chunk_data->length * num_chunks;
+  }
+  const bool is_indexed = is_buffered && !is_compressed &&
+                          (flags & SimpleAppMessageAssemblyFlag_Retransmits) &&
+                          !(flags & SimpleAppMessageAssemblyFlag_Stream);
+#if SIMPLE_APP_MESSAGE_STATIC_ALLOCATION
+  if ((max_entries > SIMPLE_APP_MESSAGE_MAX_KEYS) ||
+      (buffer_size > SIMPLE_APP_MESSAGE_MAX_MESSAGE_SIZE)) {
+    APP_LOG(APP_LOG_LEVEL_ERROR, "SimpleAppMessage of %u keys and %u bytes is over the limits",
+            (unsigned int)max_entries, (unsigned int)buffer_size);
+    *reason_out = SimpleAppMessageResetReason_OversizedMessage;
+    return false;
+  }
+#endif
+  const size_t received_size = is_indexed ? ((num_chunks + 7) / 8) : 0;
+  const size_t entries_size = max_entries * sizeof(SimpleAppMessageEntry);
+  const size_t arena_size = SIMPLE_APP_MESSAGE_ARENA_ALIGN(entries_size) +
+                            SIMPLE_APP_MESSAGE_ARENA_ALIGN(buffer_size) +
+                            SIMPLE_APP_MESSAGE_ARENA_ALIGN(window_size) +
+                            SIMPLE_APP_MESSAGE_ARENA_ALIGN(received_size) +
+                            SIMPLE_APP_MESSAGE_ARENA_ALIGN(namespace_size);
+  SimpleAppMessageArena *arena = simple_app_message_arena_create(&s_arena_pool, arena_size);
+  if (!arena) {
+    APP_LOG(APP_LOG_LEVEL_ERROR, "Failed to allocate arena for SimpleAppMessage assembly");
+    *reason_out = SimpleAppMessageResetReason_MallocFailure;
+    return false;
+  }
+  assembly->state.arena = arena;
+  assembly->state.arena_size = arena_size;
+
+  SimpleAppMessageEntry *entries = simple_app_message_arena_alloc(arena, entries_size);
+  uint8_t *buffer = simple_app_message_arena_alloc(arena, buffer_size);
+  uint8_t *window = simple_app_message_arena_alloc(arena, window_size);
+  // Its presence marks the transfer as indexed, so it must stay NULL when not allocated
+  uint8_t *received =
+      received_size ? simple_app_message_arena_alloc(arena, received_size) : NULL;
+  char *namespace_copy = simple_app_message_arena_alloc(arena, namespace_size);
+  if ((entries_size && !entries) || (buffer_size && !buffer) || (window_size && !window) ||
+      (received_size && !received) || !namespace_copy) {
+    APP_LOG(APP_LOG_LEVEL_ERROR, "SimpleAppMessage assembly does not fit in its arena");
+    return false;
+  }
+
+  memcpy(namespace_copy, namespace, namespace_size);
+  if (received) {
+    memset(received, 0, received_size);
+  }
+
+  assembly->finished = false;
+  assembly->state.started_ms = prv_now_ms();
+  assembly->state.flags = flags;
+  assembly->state.entries = entries;
+  assembly->state.max_entries = max_entries;
+  assembly->state.namespace = namespace_copy;
+  assembly->state.buffer = buffer;
+  assembly->state.buffer_cursor = buffer;
+  assembly->state.buffer_end = buffer + buffer_size;
+  assembly->state.received = received;
+  assembly->state.stride = chunk_data->length;
+  assembly->state.total_chunks = num_chunks;
+  assembly->state.chunks_remaining = num_chunks;
+  if (is_compressed) {
+    assembly->state.compressed = true;
+    assembly->state.compressed_header_size = compressed_header.size;
+    simple_app_message_decompressor_init(&assembly->state.decompressor,
+                                         is_buffered ? buffer : window,
+                                         is_buffered ? buffer_size : window_size,
+                                         compressed_header.decompressed_size);
+  }
+  return true;
+}
+
+static void prv_stream_entry_callback(const SimpleAppMessageEntry *entry, void *context) {
+  SimpleAppMessageAssembly *assembly = context;
+  if (assembly->stream_handlers.key_received) {
+    assembly->stream_handlers.key_received(assembly->state.namespace, entry,
+                                           assembly->stream_context);
+  }
+}
+
+//! Ends the stream once the last chunk has been fed to it
+static bool prv_assembly_stream_finish(SimpleAppMessageAssembly *assembly) {
+  if (assembly->state.chunks_remaining != 1) {
+    return true;
+  }
+
+  const bool complete = simple_app_message_stream_is_complete(&assembly->stream);
+  prv_stream_end(assembly, complete);
+  if (!complete) {
+    APP_LOG(APP_LOG_LEVEL_ERROR, "Streamed SimpleAppMessage ended part way through a key");
+    return false;
+  }
+  return true;
+}
+
+static void prv_stream_data_piece_callback(const SimpleAppMessageDataPiece *piece,
+                                           void *context) {
+  SimpleAppMessageAssembly *assembly = context;
+  if (assembly->stream_handlers.data_piece_received) {
+    assembly->stream_handlers.data_piece_received(assembly->state.namespace, piece,
+                                                  assembly->stream_context);
+  }
+}
+
+//! Data values are only split if the receiver asked for pieces, otherwise they're held until whole
+static SimpleAppMessageStreamDataPieceCallback prv_get_data_piece_callback(
+    const SimpleAppMessageAssembly *assembly) {
+  return (assembly->state.flags & SimpleAppMessageAssemblyFlag_DataPieces) ?
+         prv_stream_data_piece_callback : NULL;
+}
+
+static bool prv_assembly_stream_chunk(SimpleAppMessageAssembly *assembly, const uint8_t *data,
+                                      size_t size) {
+  if (!simple_app_message_stream_feed(&assembly->stream, data, size, prv_stream_entry_callback,
+                                      prv_get_data_piece_callback(assembly), assembly)) {
+    APP_LOG(APP_LOG_LEVEL_ERROR, "Failed to deserialize streamed SimpleAppMessage");
+    return false;
+  }
+  return prv_assembly_stream_finish(assembly);
+}
+
+static void prv_decompressed_callback(const uint8_t *data, size_t size, void *context) {
+  SimpleAppMessageAssembly *assembly = context;
+  if (assembly->state.flags & SimpleAppMessageAssemblyFlag_Stream) {
+    // A failure is remembered by the stream and checked once the chunk is done
+    simple_app_message_stream_feed(&assembly->stream, data, size, prv_stream_entry_callback,
+                                   prv_get_data_piece_callback(assembly), assembly);
+  }
+}
+
+static bool prv_assembly_decompress_chunk(SimpleAppMessageAssembly *assembly, const uint8_t *data,
+                                          size_t size) {
+  SimpleAppMessageAssemblyState *state = &assembly->state;
+  if (state->chunks_remaining == state->total_chunks) {
+    data += state->compressed_header_size;
+    size -= state->compressed_header_size;
+  }
+
+  if (!simple_app_message_decompressor_feed(&state->decompressor, data, size,
+                                            prv_decompressed_callback, assembly) ||
+      ((state->chunks_remaining == 1) &&
+       !simple_app_message_decompressor_is_complete(&state->decompressor))) {
+    APP_LOG(APP_LOG_LEVEL_ERROR, "Failed to decompress SimpleAppMessage");
+    return false;
+  }
+
+  if (state->flags & SimpleAppMessageAssemblyFlag_Buffer) {
+    state->buffer_cursor =
+        state->buffer + simple_app_message_decompressor_get_size(&state->decompressor);
+  }
+
+  if (state->flags & SimpleAppMessageAssemblyFlag_Stream) {
+    if (assembly->stream.failed) {
+      APP_LOG(APP_LOG_LEVEL_ERROR, "Failed to deserialize streamed SimpleAppMessage");
+      return false;
+    }
+    return prv_assembly_stream_finish(assembly);
+  }
+  return true;
+}
+
+static void prv_report_missing(SimpleAppMessageAssembly *assembly, uint32_t first,
+                               uint32_t last) {
+  assembly->missing = (SimpleAppMessageChunkRange) {
+    .first = first,
+    .count = last - first + 1,
+  };
 }
 
-bool simple_app_message_assembly_update(SimpleAppMessageAssembly *assembly, const Tuple *namespace,
+//! Writes a chunk of an indexed transfer at its offset and reports the chunks it skipped over
+static bool prv_assembly_place_chunk(SimpleAppMessageAssembly *assembly, uint32_t index,
+                                     const Tuple *chunk_data) {
+  SimpleAppMessageAssemblyState *state = &assembly->state;
+  const uint8_t bit = (1 << (index % 8));
+  if (state->received[index / 8] & bit) {
+    // Resent after its ack was lost
+    return true;
+  }
+
+  const bool is_last = (index == state->total_chunks - 1);
+  if (is_last ? (chunk_data->length > state->stride) : (chunk_data->length != state->stride)) {
+    APP_LOG(APP_LOG_LEVEL_ERROR, "SimpleAppMessage chunk does not match the first chunk's size");
+    prv_assembly_abandon(assembly, SimpleAppMessageResetReason_UnexpectedSequence);
+    return false;
+  }
+
+  memcpy(state->buffer + (index * state->stride), chunk_data->value->data, chunk_data->length);
+  state->received[index / 8] |= bit;
+  state->chunks_remaining--;
+  if (is_last) {
+    // Complete once the rest have arrived, the payload ends with the last chunk
+    state->buffer_end = state->buffer + (index * state->stride) + chunk_data->length;
+  }
+  if (!state->chunks_remaining) {
+    state->buffer_cursor = state->buffer_end;
+  }
+
+  if (index > state->highest_index + 1) {
+    prv_report_missing(assembly, state->highest_index + 1, index - 1);
+  }
+  state->highest_index = MAX(state->highest_index, index);
+  return true;
+}
+
+bool simple_app_message_assembly_update(SimpleAppMessageAssembly *assembly, const char *namespace,
                                         const Tuple *total_chunks, const Tuple *chunks_remaining,
-                                        const Tuple *chunk_data) {
+                                        const Tuple *chunk_data,
+                                        SimpleAppMessageAssemblyFlags flags) {
   if (!assembly || !namespace || !chunks_remaining || !total_chunks || !chunk_data) {
     APP_LOG(APP_LOG_LEVEL_ERROR, "Unexpected SimpleAppMessage packet (missing required state)");
     return false;
   }
 
+  assembly->missing = (SimpleAppMessageChunkRange) {0};
+  assembly->did_reset = false;
+  const bool retransmits = (flags & SimpleAppMessageAssemblyFlag_Retransmits);
+  if (retransmits && (chunks_remaining->value->uint32 >= total_chunks->value->uint32)) {
+    APP_LOG(APP_LOG_LEVEL_ERROR, "SimpleAppMessage chunk index out of range");
+    return false;
+  }
+  const uint32_t index = total_chunks->value->uint32 - chunks_remaining->value->uint32 - 1;
+
+  if (retransmits && assembly->finished) {
+    // Resent because its ack was lost, the transfer has already been dispatched
+    return true;
+  }
+
   // Reset the assembly state if we previously had completed an assembly
   if (simple_app_message_assembly_is_complete(assembly)) {
     prv_assembly_reset(assembly);
   }
 
-  const char *namespace_string = namespace->value->cstring;
+  bool is_assembly_in_progress = simple_app_message_assembly_is_in_progress(assembly);
+  if (is_assembly_in_progress && retransmits &&
+      (strcmp(assembly->state.namespace, namespace) == 0) &&
+      (assembly->state.total_chunks == total_chunks->value->uint32)) {
+    SimpleAppMessageAssemblyState *state = &assembly->state;
+    if (state->received) {
+      return prv_assembly_place_chunk(assembly, index, chunk_data);
+    }
 
-  const bool is_assembly_in_progress = prv_assembly_in_progress(assembly);
+    const uint32_t expected_index = state->total_chunks - state->chunks_remaining;
+    if (index < expected_index) {
+      // Resent after its ack was lost, or along with an earlier missing chunk
+      return true;
+    }
+    if (index > expected_index) {
+      // Only chunks that arrive in order can be streamed or decompressed, so this one is missing
+      // too. Asking for everything from the gap on gets them resent in order, the phone skips
+      // the ones it is already sending.
+      prv_report_missing(assembly, expected_index, index);
+      state->highest_index = MAX(state->highest_index, index);
+      APP_LOG(APP_LOG_LEVEL_DEBUG, "Dropping SimpleAppMessage chunk sent after a missing one");
+      return false;
+    }
+    if (state->highest_index > index) {
+      // Fills the gap, ask again for the chunks dropped after it in case they were all sent
+      // before the gap was reported
+      prv_report_missing(assembly, index + 1, state->highest_index);
+      state->highest_index = index;
+    }
+  }
   const bool is_message_expected_for_assembly_in_progress =
       is_assembly_in_progress &&
-      (strcmp(assembly->state.namespace, namespace_string) == 0) &&
+      (strcmp(assembly->state.namespace, namespace) == 0) &&
       (assembly->state.total_chunks == total_chunks->value->uint32) &&
       (assembly->state.chunks_remaining == (chunks_remaining->value->uint32 + 1));
   const bool is_message_expected =
       (!is_assembly_in_progress || is_message_expected_for_assembly_in_progress);
   if (!is_message_expected) {
-    prv_assembly_reset(assembly);
+    // The sender gave up on the previous transfer and started a new one, keep the new one
+    prv_assembly_abandon(assembly, SimpleAppMessageResetReason_UnexpectedSequence);
+    is_assembly_in_progress = false;
+  }
+  const bool is_first_chunk =
+      (chunks_remaining->value->uint32 + 1 == total_chunks->value->uint32);
+  if (!is_assembly_in_progress && !is_first_chunk) {
+    if (retransmits) {
+      // Nothing can be kept until the header in the first chunk has been seen
+      prv_report_missing(assembly, 0, index);
+      assembly->early_index = MAX(assembly->early_index, index);
+      APP_LOG(APP_LOG_LEVEL_DEBUG, "Dropping SimpleAppMessage chunk sent before the first one");
+    }
     return false;
   }
 
-  // If no buffer or namespace in assembly state, create them now
+  // If no arena in assembly state, create it now
   if (!is_assembly_in_progress) {
-    // TODO replace with commented out strnlen usage once Pebble supports strnlen
-    char *namespace_copy = malloc(namespace->length);
-    // malloc(strnlen(namespace_string, namespace->length));
-    if (!namespace_copy) {
-      APP_LOG(APP_LOG_LEVEL_ERROR, "Failed to malloc namespace copy for SimpleAppMessage assembly");
-      prv_assembly_reset(assembly);
+    prv_assembly_reset(assembly);
+    SimpleAppMessageResetReason reason;
+    if (!prv_assembly_init(assembly, namespace, total_chunks, chunk_data, flags, &reason)) {
+      prv_assembly_abandon(assembly, reason);
       return false;
     }
-    strncpy(namespace_copy, namespace_string, namespace->length);
-    namespace_copy[namespace->length - 1] = '\0';
-    assembly->state.namespace = namespace_copy;
-
-    uint8_t *buffer = malloc(assembly->chunk_size * total_chunks->value->uint32);
-    if (!buffer) {
-      APP_LOG(APP_LOG_LEVEL_ERROR, "Failed to malloc buffer for SimpleAppMessage assembly");
-      prv_assembly_reset(assembly);
+    if (retransmits && assembly->early_index &&
+        (assembly->early_index < assembly->state.total_chunks)) {
+      // The chunks dropped before this one may have been resent, and dropped again, before it
+      // arrived. The phone has acks for them, so only asking again gets them sent.
+      prv_report_missing(assembly, 1, assembly->early_index);
+      assembly->state.highest_index = assembly->early_index;
+    }
+    assembly->early_index = 0;
+  }
+
+  SimpleAppMessageAssemblyState *state = &assembly->state;
+  if (state->received) {
+    return prv_assembly_place_chunk(assembly, index, chunk_data);
+  }
+
+  // The decompressor checks the decompressed size itself
+  const bool is_buffered = (state->flags & SimpleAppMessageAssemblyFlag_Buffer) &&
+                           !state->compressed;
+  const size_t space_left = is_buffered ? (size_t)(state->buffer_end - state->buffer_cursor) :
+                                          assembly->chunk_size;
+  if (chunk_data->length > space_left) {
+    APP_LOG(APP_LOG_LEVEL_ERROR, "SimpleAppMessage chunk larger than the negotiated chunk size");
+    prv_assembly_abandon(assembly, SimpleAppMessageResetReason_UnexpectedSequence);
+    return false;
+  }
+
+  if (state->compressed) {
+    if (!prv_assembly_decompress_chunk(assembly, chunk_data->value->data, chunk_data->length)) {
+      prv_assembly_abandon(assembly, SimpleAppMessageResetReason_UnexpectedSequence);
       return false;
     }
-    assembly->state.buffer = buffer;
-    assembly->state.buffer_cursor = buffer;
-    assembly->state.total_chunks = total_chunks->value->uint32;
-    assembly->state.chunks_remaining = assembly->state.total_chunks;
+    state->chunks_remaining--;
+    return true;
+  }
+
+  if ((state->flags & SimpleAppMessageAssemblyFlag_Stream) &&
+      !prv_assembly_stream_chunk(assembly, chunk_data->value->data, chunk_data->length)) {
+    prv_assembly_abandon(assembly, SimpleAppMessageResetReason_UnexpectedSequence);
+    return false;
   }
 
-  memcpy(assembly->state.buffer_cursor, chunk_data->value->data, chunk_data->length);
-  assembly->state.buffer_cursor += chunk_data->length;
-  assembly->state.chunks_remaining--;
+  if (is_buffered) {
+    memcpy(state->buffer_cursor, chunk_data->value->data, chunk_data->length);
+    state->buffer_cursor += chunk_data->length;
+  }
+  state->chunks_remaining--;
 
   return true;
 }
 
 bool simple_app_message_assembly_is_complete(const SimpleAppMessageAssembly *assembly) {
-  return (prv_assembly_in_progress(assembly) && (assembly->state.total_chunks > 0) &&
-          (assembly->state.chunks_remaining == 0));
+  return (simple_app_message_assembly_is_in_progress(assembly) &&
+          (assembly->state.total_chunks > 0) && (assembly->state.chunks_remaining == 0));
 }
 
-static bool prv_deserialize_bool(const uint8_t **cursor, const uint8_t **data_out, size_t *n_out) {
+static bool prv_deserialize_bool(const uint8_t **cursor, const uint8_t *end,
+                                 const uint8_t **data_out, size_t *n_out) {
   if (!cursor) {
     return false;
   }
 
+  const size_t bool_size = sizeof(bool);
+  if (*cursor + bool_size > end) {
+    return false;
+  }
+
   if (data_out) {
     *data_out = *cursor;
   } else {
     return false;
   }
 
-  const size_t bool_size = sizeof(bool);
   if (n_out) {
     *n_out = bool_size;
   } else {
@@ -131,18 +581,23 @@ static bool prv_deserialize_bool(const uint8_t **cursor, const uint8_t **data_ou
   return true;
 }
 
-static bool prv_deserialize_int(const uint8_t **cursor, const uint8_t **data_out, size_t *n_out) {
+static bool prv_deserialize_int(const uint8_t **cursor, const uint8_t *end,
+                                const uint8_t **data_out, size_t *n_out) {
   if (!cursor) {
     return false;
   }
 
+  const size_t int_size = sizeof(int32_t);
+  if (*cursor + int_size > end) {
+    return false;
+  }
+
   if (data_out) {
     *data_out = *cursor;
   } else {
     return false;
   }
 
-  const size_t int_size = sizeof(int);
   if (n_out) {
     *n_out = int_size;
   } else {
@@ -154,14 +609,23 @@ static bool prv_deserialize_int(const uint8_t **cursor, const uint8_t **data_out
   return true;
 }
 
-static bool prv_deserialize_data(const uint8_t **cursor, const uint8_t **data_out, size_t *n_out) {
+static bool prv_deserialize_data(const uint8_t **cursor, const uint8_t *end,
+                                 const uint8_t **data_out, size_t *n_out) {
   if (!cursor) {
     return false;
   }
 
-  uint16_t data_size = *((uint16_t *)*cursor);
+  uint16_t data_size;
+  if (*cursor + sizeof(data_size) > end) {
+    return false;
+  }
+  memcpy(&data_size, *cursor, sizeof(data_size));
   *cursor += sizeof(data_size);
 
+  if (*cursor + data_size > end) {
+    return false;
+  }
+
   if (data_out) {
     *data_out = *cursor;
   } else {
@@ -179,17 +643,20 @@ static bool prv_deserialize_data(const uint8_t **cursor, const uint8_t **data_ou
   return true;
 }
 
-static bool prv_deserialize_string(const uint8_t **cursor, const uint8_t **data_out,
-                                   size_t *n_out) {
+static bool prv_deserialize_string(const uint8_t **cursor, const uint8_t *end,
+                                   const uint8_t **data_out, size_t *n_out) {
   if (!cursor) {
     return false;
   }
 
-  const char *data = *((char **)cursor);
-  const size_t data_length = strlen(data) + 1;
+  const uint8_t *terminator = memchr(*cursor, '\0', end - *cursor);
+  if (!terminator) {
+    return false;
+  }
+  const size_t data_length = terminator - *cursor + 1;
 
   if (data_out) {
-    *data_out = (uint8_t *)data;
+    *data_out = *cursor;
   } else {
     return false;
   }
@@ -206,54 +673,435 @@ static bool prv_deserialize_string(const uint8_t **cursor, const uint8_t **data_
 }
 
 //! @return True if successfully set data_out to deserialized data and n_out to deserialized data
-//! length
-typedef bool (*AssemblyDeserializeFunc)(const uint8_t **cursor, const uint8_t **data_out,
-                                        size_t *n_out);
-
-static const AssemblyDeserializeFunc s_deserialize_funcs[SimpleAppMessageAssemblyDataType_Count] = {
-  [SimpleAppMessageAssemblyDataType_Null] = NULL,
-  [SimpleAppMessageAssemblyDataType_Bool] = prv_deserialize_bool,
-  [SimpleAppMessageAssemblyDataType_Int] = prv_deserialize_int,
-  [SimpleAppMessageAssemblyDataType_Data] = prv_deserialize_data,
-  [SimpleAppMessageAssemblyDataType_String] = prv_deserialize_string,
+//! length without reading past end
+typedef bool (*AssemblyDeserializeFunc)(const uint8_t **cursor, const uint8_t *end,
+                                        const uint8_t **data_out, size_t *n_out);
+
+static const AssemblyDeserializeFunc s_deserialize_funcs[SimpleAppMessageDataType_Count] = {
+  [SimpleAppMessageDataType_Null] = NULL,
+  [SimpleAppMessageDataType_Bool] = prv_deserialize_bool,
+  [SimpleAppMessageDataType_Int] = prv_deserialize_int,
+  [SimpleAppMessageDataType_Data] = prv_deserialize_data,
+  [SimpleAppMessageDataType_String] = prv_deserialize_string,
+};
+
+SimpleAppMessageDeserializeResult simple_app_message_deserialize_varint(const uint8_t **cursor,
+                                                                       const uint8_t *end,
+                                                                       uint32_t *value_out) {
+  uint32_t value = 0;
+  for (unsigned int shift = 0; shift < 32; shift += 7) {
+    if (*cursor >= end) {
+      return SimpleAppMessageDeserializeResult_Incomplete;
+    }
+
+    const uint8_t byte = *((*cursor)++);
+    value |= (uint32_t)(byte & 0x7F) << shift;
+    if (!(byte & 0x80)) {
+      *value_out = value;
+      return SimpleAppMessageDeserializeResult_Complete;
+    }
+  }
+
+  // More than the 5 bytes a uint32_t can take up
+  return SimpleAppMessageDeserializeResult_Malformed;
+}
+
+//! Values too large for the low nibble of the type byte are written after it as a varint
+#define SIMPLE_APP_MESSAGE_NIBBLE_VARINT (0xF)
+
+static SimpleAppMessageDeserializeResult prv_deserialize_nibble_or_varint(
+    const uint8_t **cursor, const uint8_t *end, uint8_t nibble, uint32_t *value_out) {
+  if (nibble != SIMPLE_APP_MESSAGE_NIBBLE_VARINT) {
+    *value_out = nibble;
+    return SimpleAppMessageDeserializeResult_Complete;
+  }
+  return simple_app_message_deserialize_varint(cursor, end, value_out);
+}
+
+#if SIMPLE_APP_MESSAGE_MAX_FORMAT >= 2
+static SimpleAppMessageDeserializeResult prv_deserialize_compact_null(
+    const uint8_t **cursor, const uint8_t *end, uint8_t nibble, SimpleAppMessageEntry *entry) {
+  return nibble ? SimpleAppMessageDeserializeResult_Malformed :
+                  SimpleAppMessageDeserializeResult_Complete;
+}
+
+static SimpleAppMessageDeserializeResult prv_deserialize_compact_bool(
+    const uint8_t **cursor, const uint8_t *end, uint8_t nibble, SimpleAppMessageEntry *entry) {
+  if (nibble > 1) {
+    return SimpleAppMessageDeserializeResult_Malformed;
+  }
+
+  entry->scalar.bool_value = nibble;
+  entry->data = &entry->scalar.bool_value;
+  entry->size = sizeof(bool);
+  return SimpleAppMessageDeserializeResult_Complete;
+}
+
+static SimpleAppMessageDeserializeResult prv_deserialize_compact_int(
+    const uint8_t **cursor, const uint8_t *end, uint8_t nibble, SimpleAppMessageEntry *entry) {
+  uint32_t zig_zag;
+  const SimpleAppMessageDeserializeResult result =
+      prv_deserialize_nibble_or_varint(cursor, end, nibble, &zig_zag);
+  if (result != SimpleAppMessageDeserializeResult_Complete) {
+    return result;
+  }
+
+  entry->scalar.int_value = (int32_t)((zig_zag >> 1) ^ -(zig_zag & 1));
+  entry->data = &entry->scalar.int_value;
+  entry->size = sizeof(int32_t);
+  return SimpleAppMessageDeserializeResult_Complete;
+}
+
+static SimpleAppMessageDeserializeResult prv_deserialize_compact_data(
+    const uint8_t **cursor, const uint8_t *end, uint8_t nibble, SimpleAppMessageEntry *entry) {
+  uint32_t data_size;
+  const SimpleAppMessageDeserializeResult result =
+      prv_deserialize_nibble_or_varint(cursor, end, nibble, &data_size);
+  if (result != SimpleAppMessageDeserializeResult_Complete) {
+    return result;
+  }
+
+  if (data_size > (size_t)(end - *cursor)) {
+    return SimpleAppMessageDeserializeResult_Incomplete;
+  }
+
+  entry->data = *cursor;
+  entry->size = data_size;
+  *cursor += data_size;
+  return SimpleAppMessageDeserializeResult_Complete;
+}
+
+static SimpleAppMessageDeserializeResult prv_deserialize_compact_string(
+    const uint8_t **cursor, const uint8_t *end, uint8_t nibble, SimpleAppMessageEntry *entry) {
+  if (nibble) {
+    return SimpleAppMessageDeserializeResult_Malformed;
+  }
+
+  const uint8_t *data = NULL;
+  size_t n = 0;
+  if (!prv_deserialize_string(cursor, end, &data, &n)) {
+    return SimpleAppMessageDeserializeResult_Incomplete;
+  }
+
+  entry->data = data;
+  entry->size = n;
+  return SimpleAppMessageDeserializeResult_Complete;
+}
+
+//! Decodes a v2 value given the low nibble of its type byte
+typedef SimpleAppMessageDeserializeResult (*AssemblyDeserializeCompactFunc)(
+    const uint8_t **cursor, const uint8_t *end, uint8_t nibble, SimpleAppMessageEntry *entry);
+
+static const AssemblyDeserializeCompactFunc
+    s_deserialize_compact_funcs[SimpleAppMessageDataType_Count] = {
+  [SimpleAppMessageDataType_Null] = prv_deserialize_compact_null,
+  [SimpleAppMessageDataType_Bool] = prv_deserialize_compact_bool,
+  [SimpleAppMessageDataType_Int] = prv_deserialize_compact_int,
+  [SimpleAppMessageDataType_Data] = prv_deserialize_compact_data,
+  [SimpleAppMessageDataType_String] = prv_deserialize_compact_string,
+#if SIMPLE_APP_MESSAGE_MAX_FORMAT >= 3
+  // Framed like data and only checked once they're read, see simple_app_message_array_init() and
+  // simple_app_message_object_init()
+  [SimpleAppMessageDataType_Array] = prv_deserialize_compact_data,
+  [SimpleAppMessageDataType_Object] = prv_deserialize_compact_data,
+#endif
 };
+#endif
 
-bool simple_app_message_deserialize(const SimpleAppMessageAssembly *assembly,
-                                    SimpleAppMessageDeserializeCallback callback, void *context) {
-  if (!simple_app_message_assembly_is_complete(assembly)) {
+bool simple_app_message_deserialize_header(const uint8_t *buffer, size_t size,
+                                           SimpleAppMessagePayloadHeader *header_out) {
+  if (!buffer || !size || !header_out) {
     return false;
   }
 
-  const uint8_t *cursor = assembly->state.buffer;
-  uint8_t keys_left_to_read = *(cursor++);
-  while ((keys_left_to_read > 0) && (cursor < assembly->state.buffer_cursor)) {
-    const char *key = (char *)cursor;
-    const size_t key_length = strlen(key);
-    cursor += key_length + 1;
+  if ((buffer[0] != SIMPLE_APP_MESSAGE_FORMAT_MARKER) || (size == 1)) {
+    *header_out = (SimpleAppMessagePayloadHeader) {
+      .format = SimpleAppMessageFormat_V1,
+      .num_keys = buffer[0],
+      .size = sizeof(uint8_t),
+    };
+    return true;
+  }
 
-    const SimpleAppMessageAssemblyDataType type = (SimpleAppMessageAssemblyDataType)*(cursor++);
-    if (type >= SimpleAppMessageAssemblyDataType_Count) {
-      return false;
-    }
+  if ((size < SIMPLE_APP_MESSAGE_FORMAT_V2_HEADER_SIZE) ||
+      (buffer[1] < SimpleAppMessageFormat_V2) || (buffer[1] > SIMPLE_APP_MESSAGE_MAX_FORMAT)) {
+    return false;
+  }
+
+  *header_out = (SimpleAppMessagePayloadHeader) {
+    .format = buffer[1],
+    .num_keys = buffer[2],
+    .size = SIMPLE_APP_MESSAGE_FORMAT_V2_HEADER_SIZE,
+  };
+  return true;
+}
+
+void simple_app_message_entry_copy(SimpleAppMessageEntry *dest, const SimpleAppMessageEntry *src) {
+  if (!dest || !src) {
+    return;
+  }
+
+  *dest = *src;
+  if (src->data == &src->scalar) {
+    dest->data = &dest->scalar;
+  }
+}
+
+SimpleAppMessageDeserializeResult simple_app_message_deserialize_entry(
+    SimpleAppMessageFormat format, const uint8_t *buffer, const uint8_t *end,
+    SimpleAppMessageEntry *entry_out, size_t *consumed_out) {
+  if (!buffer || !end || (buffer > end)) {
+    return SimpleAppMessageDeserializeResult_Malformed;
+  }
 
+  const uint8_t *cursor = buffer;
+  const char *key = (char *)cursor;
+  const uint8_t *key_terminator = memchr(cursor, '\0', end - cursor);
+  if (!key_terminator || (key_terminator + 1 >= end)) {
+    return SimpleAppMessageDeserializeResult_Incomplete;
+  }
+  cursor = key_terminator + 1;
+
+  const uint8_t type_byte = *(cursor++);
+  const bool is_compact = (format >= SimpleAppMessageFormat_V2);
+  const SimpleAppMessageDataType type =
+      (SimpleAppMessageDataType)(is_compact ? (type_byte >> 4) : type_byte);
+  if ((type >= SimpleAppMessageDataType_Count) ||
+      ((format < SimpleAppMessageFormat_V3) && (type > SimpleAppMessageDataType_String))) {
+    return SimpleAppMessageDeserializeResult_Malformed;
+  }
+
+  SimpleAppMessageEntry entry = {
+    .key = key,
+    .type = type,
+  };
+  if (is_compact) {
+#if SIMPLE_APP_MESSAGE_MAX_FORMAT >= 2
+    const AssemblyDeserializeCompactFunc deserialize_func = s_deserialize_compact_funcs[type];
+    const SimpleAppMessageDeserializeResult result = deserialize_func ?
+        deserialize_func(&cursor, end, type_byte & 0xF, &entry) :
+        SimpleAppMessageDeserializeResult_Malformed;
+    if (result != SimpleAppMessageDeserializeResult_Complete) {
+      return result;
+    }
+#else
+    return SimpleAppMessageDeserializeResult_Malformed;
+#endif
+  } else {
+    // Every value is self delimiting, so failing to read one only ever means it was cut short
     const uint8_t *data = NULL;
-    size_t n = 0;
     const AssemblyDeserializeFunc deserialize_func = s_deserialize_funcs[type];
-    if (deserialize_func && !deserialize_func(&cursor, &data, &n)) {
+    if (deserialize_func && !deserialize_func(&cursor, end, &data, &entry.size)) {
+      return SimpleAppMessageDeserializeResult_Incomplete;
+    }
+    entry.data = data;
+  }
+
+  simple_app_message_entry_copy(entry_out, &entry);
+  if (consumed_out) {
+    *consumed_out = cursor - buffer;
+  }
+  return SimpleAppMessageDeserializeResult_Complete;
+}
+
+bool simple_app_message_deserialize_data_header(SimpleAppMessageFormat format,
+                                                const uint8_t *buffer, const uint8_t *end,
+                                                SimpleAppMessageEntry *entry_out,
+                                                size_t *header_size_out) {
+  if (!buffer || !end || (buffer >= end) || !entry_out || !header_size_out) {
+    return false;
+  }
+
+  const uint8_t *key_terminator = memchr(buffer, '\0', end - buffer);
+  if (!key_terminator || (key_terminator + 1 >= end)) {
+    return false;
+  }
+  const uint8_t *cursor = key_terminator + 1;
+
+  const uint8_t type_byte = *(cursor++);
+  uint32_t data_size;
+  if (format >= SimpleAppMessageFormat_V2) {
+    if (((type_byte >> 4) != SimpleAppMessageDataType_Data) ||
+        (prv_deserialize_nibble_or_varint(&cursor, end, type_byte & 0xF, &data_size) !=
+         SimpleAppMessageDeserializeResult_Complete)) {
+      return false;
+    }
+  } else {
+    uint16_t length;
+    if ((type_byte != SimpleAppMessageDataType_Data) || (cursor + sizeof(length) > end)) {
+      return false;
+    }
+    memcpy(&length, cursor, sizeof(length));
+    cursor += sizeof(length);
+    data_size = length;
+  }
+
+  *entry_out = (SimpleAppMessageEntry) {
+    .key = (const char *)buffer,
+    .data = cursor,
+    .size = data_size,
+    .type = SimpleAppMessageDataType_Data,
+  };
+  *header_size_out = cursor - buffer;
+  return true;
+}
+
+bool simple_app_message_deserialize_buffer(const uint8_t *buffer, size_t size,
+                                           SimpleAppMessageDeserializeCallback callback,
+                                           void *context) {
+  SimpleAppMessagePayloadHeader header;
+  if (!simple_app_message_deserialize_header(buffer, size, &header)) {
+    return false;
+  }
+
+  const uint8_t *cursor = buffer + header.size;
+  const uint8_t *end = buffer + size;
+  uint8_t keys_left_to_read = header.num_keys;
+  while ((keys_left_to_read > 0) && (cursor < end)) {
+    SimpleAppMessageEntry entry;
+    size_t consumed;
+    if (simple_app_message_deserialize_entry(header.format, cursor, end, &entry, &consumed) !=
+        SimpleAppMessageDeserializeResult_Complete) {
       return false;
     }
+    cursor += consumed;
 
-    if (callback) {
-      callback(key, type, data, n, context);
+    if (callback && !callback(&entry, context)) {
+      return true;
     }
 
     keys_left_to_read--;
   }
 
-  return (keys_left_to_read == 0) && (cursor == assembly->state.buffer_cursor);
+  return (keys_left_to_read == 0) && (cursor == end);
+}
+
+static bool prv_index_callback(const SimpleAppMessageEntry *entry, void *context) {
+  SimpleAppMessageAssemblyState *state = context;
+  if (state->num_entries >= state->max_entries) {
+    return false;
+  }
+
+  simple_app_message_entry_copy(&state->entries[state->num_entries++], entry);
+  return true;
+}
+
+static bool prv_state_get_entries(SimpleAppMessageAssemblyState *state,
+                                  const SimpleAppMessageEntry **entries_out,
+                                  size_t *num_entries_out) {
+  if (!state->indexed) {
+    // The entry index was sized from the key count at the start of the payload, so a well formed
+    // payload always fits exactly
+    state->num_entries = 0;
+    if (!simple_app_message_deserialize_buffer(state->buffer, state->buffer_cursor - state->buffer,
+                                               prv_index_callback, state) ||
+        (state->num_entries != state->max_entries)) {
+      return false;
+    }
+    state->indexed = true;
+  }
+
+  if (entries_out) {
+    *entries_out = state->entries;
+  }
+  if (num_entries_out) {
+    *num_entries_out = state->num_entries;
+  }
+  return true;
+}
+
+bool simple_app_message_assembly_get_entries(SimpleAppMessageAssembly *assembly,
+                                             const SimpleAppMessageEntry **entries_out,
+                                             size_t *num_entries_out) {
+  if (!simple_app_message_assembly_is_complete(assembly) ||
+      !(assembly->state.flags & SimpleAppMessageAssemblyFlag_Buffer)) {
+    return false;
+  }
+  return prv_state_get_entries(&assembly->state, entries_out, num_entries_out);
+}
+
+SimpleAppMessageDetachedMessage *simple_app_message_assembly_detach(
+    SimpleAppMessageAssembly *assembly) {
+  if (!simple_app_message_assembly_is_complete(assembly) ||
+      !(assembly->state.flags & SimpleAppMessageAssemblyFlag_Buffer)) {
+    return NULL;
+  }
+
+  SimpleAppMessageDetachedMessage *message =
+      simple_app_message_pool_alloc(&s_detached_pool, sizeof(SimpleAppMessageDetachedMessage));
+  if (!message) {
+    return NULL;
+  }
+  message->state = assembly->state;
+  // The message owns the arena now, releasing the assembly only ends its stream
+  assembly->state.arena = NULL;
+  simple_app_message_assembly_release(assembly);
+  return message;
+}
+
+bool simple_app_message_detached_message_get_entries(SimpleAppMessageDetachedMessage *message,
+                                                     const SimpleAppMessageEntry **entries_out,
+                                                     size_t *num_entries_out) {
+  return (message && prv_state_get_entries(&message->state, entries_out, num_entries_out));
+}
+
+void simple_app_message_detached_message_destroy(SimpleAppMessageDetachedMessage *message) {
+  if (message) {
+    simple_app_message_arena_destroy(message->state.arena);
+  }
+  simple_app_message_pool_free(&s_detached_pool, message);
+}
+
+bool simple_app_message_assembly_get_missing(const SimpleAppMessageAssembly *assembly,
+                                             SimpleAppMessageChunkRange *range_out) {
+  if (!assembly || !assembly->missing.count) {
+    return false;
+  }
+  if (range_out) {
+    *range_out = assembly->missing;
+  }
+  return true;
+}
+
+bool simple_app_message_assembly_get_reset_reason(const SimpleAppMessageAssembly *assembly,
+                                                  SimpleAppMessageResetReason *reason_out) {
+  if (!assembly || !assembly->did_reset) {
+    return false;
+  }
+  *reason_out = assembly->reset_reason;
+  return true;
+}
+
+size_t simple_app_message_assembly_get_size(const SimpleAppMessageAssembly *assembly) {
+  return assembly ? assembly->state.arena_size : 0;
+}
+
+uint32_t simple_app_message_assembly_get_elapsed_ms(const SimpleAppMessageAssembly *assembly) {
+  if (!simple_app_message_assembly_is_in_progress(assembly)) {
+    return 0;
+  }
+  return (uint32_t)(prv_now_ms() - assembly->state.started_ms);
+}
+
+void simple_app_message_assembly_release(SimpleAppMessageAssembly *assembly) {
+  prv_assembly_reset(assembly);
+  if (assembly) {
+    assembly->finished = true;
+  }
+}
+
+void simple_app_message_assembly_recycle(SimpleAppMessageAssembly *assembly) {
+  prv_assembly_reset(assembly);
+  if (assembly) {
+    assembly->finished = false;
+    assembly->early_index = 0;
+  }
 }
 
 void simple_app_message_assembly_destroy(SimpleAppMessageAssembly *assembly) {
   prv_assembly_deinit(assembly);
-  free(assembly);
+  if (assembly) {
+    simple_app_message_stream_deinit(&assembly->stream);
+  }
+  simple_app_message_pool_free(&s_assembly_pool, assembly);
 }
@@ -1,37 +1,231 @@
 #pragma once
 
+#include "simple-app-message.h"
+
 #include <pebble.h>
 
 typedef struct SimpleAppMessageAssembly SimpleAppMessageAssembly;
 
-SimpleAppMessageAssembly *simple_app_message_assembly_create(size_t chunk_size);
+//! A complete, buffered message taken out of its assembly to be decoded and delivered later
+typedef struct SimpleAppMessageDetachedMessage SimpleAppMessageDetachedMessage;
+
+//! Must match FORMATS in formats.js
+typedef enum SimpleAppMessageFormat {
+  //! Key count byte, then per key a type byte and fixed size ints, bools and data lengths
+  SimpleAppMessageFormat_V1 = 1,
+  //! Marker and version bytes ahead of the key count, then per key a single byte holding the type
+  //! in its high nibble and a small int, bool or data length in its low nibble. Larger ints are
+  //! zig-zag varints and larger data lengths are varints.
+  SimpleAppMessageFormat_V2 = 2,
+  //! v2 plus arrays and objects, both framed like data with the length in the type byte. An array
+  //! is its element type followed by the packed elements, an object is a key count followed by
+  //! its entries, encoded like the top level ones.
+  SimpleAppMessageFormat_V3 = 3,
+
+  SimpleAppMessageFormat_Latest = SimpleAppMessageFormat_V3,
+} SimpleAppMessageFormat;
+
+//! A v1 payload with no keys is a single zero byte, so a zero followed by more bytes can only be
+//! the start of a newer format
+#define SIMPLE_APP_MESSAGE_FORMAT_MARKER (0)
+
+//! Marker, version and key count, the same for v2 and v3. Senders only use either when the first
+//! chunk fits the whole header.
+#define SIMPLE_APP_MESSAGE_FORMAT_V2_HEADER_SIZE (3)
+
+typedef struct SimpleAppMessagePayloadHeader {
+  SimpleAppMessageFormat format;
+  uint8_t num_keys;
+  //! Bytes taken up by the header
+  size_t size;
+} SimpleAppMessagePayloadHeader;
+
+//! A decoded key/value pair. key and data point into the reassembled payload, except for ints and
+//! bools decoded from the v2 format, for which data points at the entry's own scalar.
+typedef struct SimpleAppMessageEntry {
+  const char *key;
+  const void *data;
+  size_t size;
+  SimpleAppMessageDataType type;
+  union {
+    int32_t int_value;
+    bool bool_value;
+  } scalar;
+} SimpleAppMessageEntry;
+
+//! Part of a data value that is passed on as it arrives rather than once the whole value is in
+typedef struct SimpleAppMessageDataPiece {
+  const char *key;
+  const uint8_t *data;
+  size_t size;
+  //! Where data starts within the value
+  size_t offset;
+  //! Length of the whole value
+  size_t total_size;
+} SimpleAppMessageDataPiece;
+
+typedef struct SimpleAppMessageChunkRange {
+  uint32_t first;
+  uint32_t count;
+} SimpleAppMessageChunkRange;
+
+typedef enum SimpleAppMessageAssemblyFlags {
+  //! Keep the whole payload so its entries can be read once the assembly is complete
+  SimpleAppMessageAssemblyFlag_Buffer = (1 << 0),
+  //! Decode entries as the chunks carrying them arrive and pass them to the stream handlers
+  SimpleAppMessageAssemblyFlag_Stream = (1 << 1),
+  //! The sender pipelines chunks and resends the ones that failed or are reported missing. Chunks
+  //! that were already received are ignored and chunks that arrive after a missing one are kept,
+  //! if the payload is only buffered, or dropped and reported missing, without abandoning the
+  //! transfer.
+  SimpleAppMessageAssemblyFlag_Retransmits = (1 << 2),
+  //! Along with SimpleAppMessageAssemblyFlag_Stream, pass data values to the data piece handler
+  //! as their bytes arrive instead of holding on to each one until it's whole
+  SimpleAppMessageAssemblyFlag_DataPieces = (1 << 3),
+} SimpleAppMessageAssemblyFlags;
+
+//! Called with each streamed entry, which is only valid for the duration of the call
+typedef void (*SimpleAppMessageAssemblyKeyReceivedCallback)(const char *namespace,
+                                                            const SimpleAppMessageEntry *entry,
+                                                            void *context);
+
+//! Called once per streamed transfer, after its last entry or once it has been abandoned
+typedef void (*SimpleAppMessageAssemblyStreamEndedCallback)(const char *namespace, bool complete,
+                                                            void *context);
+
+//! Called with consecutive pieces of each streamed data value, which are only valid for the
+//! duration of the call
+typedef void (*SimpleAppMessageAssemblyDataPieceCallback)(const char *namespace,
+                                                          const SimpleAppMessageDataPiece *piece,
+                                                          void *context);
+
+typedef struct SimpleAppMessageAssemblyStreamHandlers {
+  SimpleAppMessageAssemblyKeyReceivedCallback key_received;
+  SimpleAppMessageAssemblyStreamEndedCallback stream_ended;
+  SimpleAppMessageAssemblyDataPieceCallback data_piece_received;
+} SimpleAppMessageAssemblyStreamHandlers;
+
+SimpleAppMessageAssembly *simple_app_message_assembly_create(
+    size_t chunk_size, const SimpleAppMessageAssemblyStreamHandlers *stream_handlers,
+    void *stream_context);
 
 //! Update assembly with new state. If the assembly was complete, it will be reset and updated
 //! with the provided state. If the provided state is not valid for the assembly, the assembly
-//! will be reset.
+//! will be reset, unless SimpleAppMessageAssemblyFlag_Retransmits is set and the chunk belongs to
+//! the transfer in progress.
+//! @param flags How to handle the payload, only used when the chunk starts a new transfer, apart
+//! from SimpleAppMessageAssemblyFlag_Retransmits
 //! @return True if the assembly was successfully updated, false otherwise
-bool simple_app_message_assembly_update(SimpleAppMessageAssembly *assembly, const Tuple *namespace,
+//! @param namespace Must fit in SIMPLE_APP_MESSAGE_NAMESPACE_MAX_SIZE_BYTES
+bool simple_app_message_assembly_update(SimpleAppMessageAssembly *assembly, const char *namespace,
                                         const Tuple *total_chunks, const Tuple *chunks_remaining,
-                                        const Tuple *chunk_data);
+                                        const Tuple *chunk_data,
+                                        SimpleAppMessageAssemblyFlags flags);
+
+//! @return True if at least one chunk of a transfer has been received
+bool simple_app_message_assembly_is_in_progress(const SimpleAppMessageAssembly *assembly);
 
 bool simple_app_message_assembly_is_complete(const SimpleAppMessageAssembly *assembly);
 
-//! Must match enum in serialize.js
-typedef enum SimpleAppMessageAssemblyDataType {
-  SimpleAppMessageAssemblyDataType_Null,
-  SimpleAppMessageAssemblyDataType_Bool,
-  SimpleAppMessageAssemblyDataType_Int,
-  SimpleAppMessageAssemblyDataType_Data,
-  SimpleAppMessageAssemblyDataType_String,
+//! @return True if the last transfer was released after completing and no new one has started
+bool simple_app_message_assembly_is_finished(const SimpleAppMessageAssembly *assembly);
+
+//! Decodes a complete, buffered assembly into its entry index, which lives in the same allocation
+//! as the payload. The entries are valid until the assembly is released, reset or destroyed.
+//! @return False if the assembly isn't complete or its payload is malformed
+bool simple_app_message_assembly_get_entries(SimpleAppMessageAssembly *assembly,
+                                             const SimpleAppMessageEntry **entries_out,
+                                             size_t *num_entries_out);
+
+//! Takes the complete, buffered message out of the assembly without decoding it, and releases the
+//! assembly as simple_app_message_assembly_release() does. The message keeps the allocation it
+//! was reassembled in, so nothing is copied.
+//! @return NULL if the assembly isn't complete or buffered, or the message couldn't be allocated,
+//! in which case the assembly is left as it was
+SimpleAppMessageDetachedMessage *simple_app_message_assembly_detach(
+    SimpleAppMessageAssembly *assembly);
+
+//! Decodes a detached message into its entry index, like simple_app_message_assembly_get_entries().
+//! The entries are valid until the message is destroyed.
+bool simple_app_message_detached_message_get_entries(SimpleAppMessageDetachedMessage *message,
+                                                     const SimpleAppMessageEntry **entries_out,
+                                                     size_t *num_entries_out);
+
+void simple_app_message_detached_message_destroy(SimpleAppMessageDetachedMessage *message);
+
+//! Frees everything held for the current message in one go, leaving the assembly ready for the
+//! next one. Chunks with SimpleAppMessageAssemblyFlag_Retransmits that arrive afterwards are
+//! resends of the released message and are ignored until a new transfer is started.
+void simple_app_message_assembly_release(SimpleAppMessageAssembly *assembly);
+
+//! Frees everything held for the current message and forgets it, so the assembly can be handed to
+//! a different transfer
+void simple_app_message_assembly_recycle(SimpleAppMessageAssembly *assembly);
+
+//! Chunks the last update found missing. Only reported for transfers with
+//! SimpleAppMessageAssemblyFlag_Retransmits, for the sender to resend.
+//! @return False if the last update didn't find any chunks missing
+bool simple_app_message_assembly_get_missing(const SimpleAppMessageAssembly *assembly,
+                                             SimpleAppMessageChunkRange *range_out);
+
+//! Why the last update abandoned the transfer in progress or couldn't start a new one
+//! @return False if the last update did neither
+bool simple_app_message_assembly_get_reset_reason(const SimpleAppMessageAssembly *assembly,
+                                                  SimpleAppMessageResetReason *reason_out);
+
+//! @return Bytes allocated for the current message, 0 if none is in progress
+size_t simple_app_message_assembly_get_size(const SimpleAppMessageAssembly *assembly);
+
+//! @return Milliseconds since the first chunk of the transfer in progress arrived
+uint32_t simple_app_message_assembly_get_elapsed_ms(const SimpleAppMessageAssembly *assembly);
+
+//! @return True to continue deserializing, false to stop
+typedef bool (*SimpleAppMessageDeserializeCallback)(const SimpleAppMessageEntry *entry,
+                                                    void *context);
+
+typedef enum SimpleAppMessageDeserializeResult {
+  SimpleAppMessageDeserializeResult_Complete,
+  //! The entry runs past the end of the buffer
+  SimpleAppMessageDeserializeResult_Incomplete,
+  SimpleAppMessageDeserializeResult_Malformed,
+} SimpleAppMessageDeserializeResult;
+
+//! Reads a little endian base 128 varint without reading past end, advancing cursor past it
+SimpleAppMessageDeserializeResult simple_app_message_deserialize_varint(const uint8_t **cursor,
+                                                                       const uint8_t *end,
+                                                                       uint32_t *value_out);
+
+//! Reads the format and key count at the start of a payload. The header must be whole, a v2
+//! header cut short is reported as malformed.
+//! @return False if the payload is empty, malformed or uses an unknown format
+bool simple_app_message_deserialize_header(const uint8_t *buffer, size_t size,
+                                           SimpleAppMessagePayloadHeader *header_out);
+
+//! Copies an entry, keeping data pointed at the copy's own scalar for v2 ints and bools
+void simple_app_message_entry_copy(SimpleAppMessageEntry *dest, const SimpleAppMessageEntry *src);
 
-  SimpleAppMessageAssemblyDataType_Count
-} SimpleAppMessageAssemblyDataType;
+//! Decodes the key/value pair at the start of buffer without reading past end
+//! @param consumed_out Set to the size of the entry if it is complete
+SimpleAppMessageDeserializeResult simple_app_message_deserialize_entry(
+    SimpleAppMessageFormat format, const uint8_t *buffer, const uint8_t *end,
+    SimpleAppMessageEntry *entry_out, size_t *consumed_out);
 
-typedef void (*SimpleAppMessageDeserializeCallback)(const char *key,
-                                                    SimpleAppMessageAssemblyDataType type,
-                                                    const void *value, size_t n, void *context);
+//! Decodes the key, type and length of a data value at the start of buffer whose bytes run past
+//! end, so the value can be passed on in pieces
+//! @param entry_out data points at the start of the value and size is the whole value's length
+//! @param header_size_out Set to the bytes taken up by the key, type and length
+//! @return False if buffer doesn't start with a data value or its length isn't all there
+bool simple_app_message_deserialize_data_header(SimpleAppMessageFormat format,
+                                                const uint8_t *buffer, const uint8_t *end,
+                                                SimpleAppMessageEntry *entry_out,
+                                                size_t *header_size_out);
 
-bool simple_app_message_deserialize(const SimpleAppMessageAssembly *assembly,
-                                    SimpleAppMessageDeserializeCallback callback, void *context);
+//! Walks a serialized payload of either format, bounds checking every key and value against the
+//! buffer.
+//! @return False if the payload is malformed, true if it was walked to the end or the callback
+//! stopped early
+bool simple_app_message_deserialize_buffer(const uint8_t *buffer, size_t size,
+                                           SimpleAppMessageDeserializeCallback callback,
+                                           void *context);
 
 void simple_app_message_assembly_destroy(SimpleAppMessageAssembly *assembly);
@@ -0,0 +1,172 @@
+#include "simple-app-message-compression.h"
+
+#include "simple-app-message-config.h"
+
+bool simple_app_message_compression_is_compressed(const uint8_t *data, size_t size) {
+  // Without the decoder no payload is taken for a compressed one, so none is decompressed
+  return (SIMPLE_APP_MESSAGE_COMPRESSION && data && (size >= 2) &&
+          (data[0] == SIMPLE_APP_MESSAGE_FORMAT_MARKER) &&
+          (data[1] == SIMPLE_APP_MESSAGE_COMPRESSION_TAG));
+}
+
+bool simple_app_message_compression_parse_header(const uint8_t *data, size_t size,
+                                                 SimpleAppMessageCompressedHeader *header_out) {
+  if (!simple_app_message_compression_is_compressed(data, size) || (size < 3) || !header_out) {
+    return false;
+  }
+
+  const uint8_t *cursor = data + 3;
+  uint32_t decompressed_size;
+  if ((simple_app_message_deserialize_varint(&cursor, data + size, &decompressed_size) !=
+       SimpleAppMessageDeserializeResult_Complete) || !decompressed_size) {
+    return false;
+  }
+
+  *header_out = (SimpleAppMessageCompressedHeader) {
+    .num_keys = data[2],
+    .decompressed_size = decompressed_size,
+    .size = cursor - data,
+  };
+  return true;
+}
+
+void simple_app_message_decompressor_init(SimpleAppMessageDecompressor *decompressor,
+                                          uint8_t *output, size_t output_capacity,
+                                          size_t expected_size) {
+  if (!decompressor) {
+    return;
+  }
+
+  *decompressor = (SimpleAppMessageDecompressor) {
+    .output = output,
+    .output_capacity = output_capacity,
+    .expected_size = expected_size,
+    .state = SimpleAppMessageDecompressorState_Flags,
+  };
+}
+
+#if SIMPLE_APP_MESSAGE_COMPRESSION
+static bool prv_fail(SimpleAppMessageDecompressor *decompressor) {
+  decompressor->failed = true;
+  return false;
+}
+
+static void prv_flush(SimpleAppMessageDecompressor *decompressor,
+                      SimpleAppMessageDecompressorOutputCallback callback, void *context) {
+  if (callback && (decompressor->output_pos > decompressor->flushed_pos)) {
+    callback(decompressor->output + decompressor->flushed_pos,
+             decompressor->output_pos - decompressor->flushed_pos, context);
+  }
+  decompressor->flushed_pos = decompressor->output_pos;
+}
+
+//! Writes one byte to the ring, passing everything not yet flushed to the callback before the ring
+//! wraps and starts overwriting it
+static bool prv_put(SimpleAppMessageDecompressor *decompressor, uint8_t byte,
+                    SimpleAppMessageDecompressorOutputCallback callback, void *context) {
+  if (decompressor->total_size >= decompressor->expected_size) {
+    return false;
+  }
+
+  decompressor->output[decompressor->output_pos++] = byte;
+  decompressor->total_size++;
+  if (decompressor->output_pos == decompressor->output_capacity) {
+    prv_flush(decompressor, callback, context);
+    decompressor->output_pos = 0;
+    decompressor->flushed_pos = 0;
+  }
+  return true;
+}
+
+static bool prv_copy_match(SimpleAppMessageDecompressor *decompressor, size_t length,
+                           SimpleAppMessageDecompressorOutputCallback callback, void *context) {
+  const size_t distance = decompressor->distance;
+  const size_t history = (decompressor->total_size < decompressor->output_capacity) ?
+      decompressor->total_size : decompressor->output_capacity;
+  if (distance > history) {
+    return false;
+  }
+
+  // Byte by byte, since a match may overlap the bytes it produces
+  for (size_t i = 0; i < length; i++) {
+    const size_t pos = decompressor->output_pos;
+    const size_t source = (pos >= distance) ? (pos - distance) :
+                                              (pos + decompressor->output_capacity - distance);
+    if (!prv_put(decompressor, decompressor->output[source], callback, context)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool simple_app_message_decompressor_feed(SimpleAppMessageDecompressor *decompressor,
+                                          const uint8_t *data, size_t size,
+                                          SimpleAppMessageDecompressorOutputCallback callback,
+                                          void *context) {
+  if (!decompressor || decompressor->failed || !decompressor->output || (size && !data)) {
+    return false;
+  }
+
+  const uint8_t *cursor = data;
+  const uint8_t *end = data + size;
+  while (cursor < end) {
+    switch (decompressor->state) {
+      case SimpleAppMessageDecompressorState_Flags:
+        decompressor->flags = *(cursor++);
+        decompressor->flags_left = 8;
+        decompressor->state = SimpleAppMessageDecompressorState_Token;
+        break;
+      case SimpleAppMessageDecompressorState_Token: {
+        if (!decompressor->flags_left) {
+          decompressor->state = SimpleAppMessageDecompressorState_Flags;
+          break;
+        }
+        const bool is_match = (decompressor->flags & 1);
+        decompressor->flags >>= 1;
+        decompressor->flags_left--;
+        if (is_match) {
+          decompressor->state = SimpleAppMessageDecompressorState_Distance;
+        } else if (!prv_put(decompressor, *(cursor++), callback, context)) {
+          return prv_fail(decompressor);
+        }
+        break;
+      }
+      case SimpleAppMessageDecompressorState_Distance:
+        decompressor->distance = *(cursor++) + 1;
+        decompressor->state = SimpleAppMessageDecompressorState_Length;
+        break;
+      case SimpleAppMessageDecompressorState_Length: {
+        const size_t length = *(cursor++) + SIMPLE_APP_MESSAGE_COMPRESSION_MIN_MATCH;
+        if (!prv_copy_match(decompressor, length, callback, context)) {
+          return prv_fail(decompressor);
+        }
+        decompressor->state = SimpleAppMessageDecompressorState_Token;
+        break;
+      }
+    }
+  }
+
+  prv_flush(decompressor, callback, context);
+  return true;
+}
+
+#else
+bool simple_app_message_decompressor_feed(SimpleAppMessageDecompressor *decompressor,
+                                          const uint8_t *data, size_t size,
+                                          SimpleAppMessageDecompressorOutputCallback callback,
+                                          void *context) {
+  return false;
+}
+#endif
+
+size_t simple_app_message_decompressor_get_size(const SimpleAppMessageDecompressor *decompressor) {
+  return decompressor ? decompressor->total_size : 0;
+}
+
+bool simple_app_message_decompressor_is_complete(
+    const SimpleAppMessageDecompressor *decompressor) {
+  return (decompressor && !decompressor->failed &&
+          (decompressor->total_size == decompressor->expected_size) &&
+          ((decompressor->state == SimpleAppMessageDecompressorState_Flags) ||
+           (decompressor->state == SimpleAppMessageDecompressorState_Token)));
+}
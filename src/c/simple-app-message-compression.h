@@ -0,0 +1,87 @@
+#pragma once
+
+#include "simple-app-message-assembly.h"
+
+#include <pebble.h>
+
+//! Compressed payloads start with SIMPLE_APP_MESSAGE_FORMAT_MARKER followed by this tag, the key
+//! count and the decompressed size as a varint. The rest is the LZ stream of a normal v1 or v2
+//! payload, header included.
+#define SIMPLE_APP_MESSAGE_COMPRESSION_TAG (0x80)
+
+//! Matches reach back at most this far, so it is all the history a streaming decompressor keeps.
+//! Advertised to the phone in the chunk size response.
+#define SIMPLE_APP_MESSAGE_COMPRESSION_WINDOW_SIZE (256)
+
+//! Shortest match the LZ stream encodes, a length byte of 0 means this many bytes
+#define SIMPLE_APP_MESSAGE_COMPRESSION_MIN_MATCH (3)
+
+typedef struct SimpleAppMessageCompressedHeader {
+  uint8_t num_keys;
+  uint32_t decompressed_size;
+  //! Bytes taken up by the header
+  size_t size;
+} SimpleAppMessageCompressedHeader;
+
+//! Called with decompressed bytes as they are produced. data points into the decompressor's
+//! output buffer and is only valid for the duration of the call.
+typedef void (*SimpleAppMessageDecompressorOutputCallback)(const uint8_t *data, size_t size,
+                                                           void *context);
+
+typedef enum SimpleAppMessageDecompressorState {
+  SimpleAppMessageDecompressorState_Flags,
+  SimpleAppMessageDecompressorState_Token,
+  SimpleAppMessageDecompressorState_Distance,
+  SimpleAppMessageDecompressorState_Length,
+} SimpleAppMessageDecompressorState;
+
+//! Incremental LZSS decoder. The stream is a flags byte followed by up to 8 tokens, least
+//! significant flag first. A clear flag is a literal byte, a set flag is a match: one byte of
+//! distance - 1 and one byte of length - SIMPLE_APP_MESSAGE_COMPRESSION_MIN_MATCH.
+//!
+//! Output goes into a ring buffer that has to hold at least the window. A ring as large as the
+//! decompressed size never wraps, so it ends up holding the whole payload.
+typedef struct SimpleAppMessageDecompressor {
+  uint8_t *output;
+  size_t output_capacity;
+  size_t output_pos;
+  //! Start of the bytes that haven't been passed to the output callback yet
+  size_t flushed_pos;
+  size_t total_size;
+  size_t expected_size;
+  SimpleAppMessageDecompressorState state;
+  uint8_t flags;
+  uint8_t flags_left;
+  uint16_t distance;
+  bool failed;
+} SimpleAppMessageDecompressor;
+
+//! @return True if the payload starting with data is compressed
+bool simple_app_message_compression_is_compressed(const uint8_t *data, size_t size);
+
+//! The whole header must be in data
+//! @return False if the header is malformed
+bool simple_app_message_compression_parse_header(const uint8_t *data, size_t size,
+                                                 SimpleAppMessageCompressedHeader *header_out);
+
+//! @param output Ring buffer of at least SIMPLE_APP_MESSAGE_COMPRESSION_WINDOW_SIZE bytes, or of
+//! expected_size bytes if that is smaller
+void simple_app_message_decompressor_init(SimpleAppMessageDecompressor *decompressor,
+                                          uint8_t *output, size_t output_capacity,
+                                          size_t expected_size);
+
+//! Decompresses the next chunk of the LZ stream, passing what it produces to callback
+//! @return False if the stream is malformed or decompresses past the expected size, after which
+//! the decompressor ignores further chunks
+bool simple_app_message_decompressor_feed(SimpleAppMessageDecompressor *decompressor,
+                                          const uint8_t *data, size_t size,
+                                          SimpleAppMessageDecompressorOutputCallback callback,
+                                          void *context);
+
+//! @return Number of bytes decompressed so far
+size_t simple_app_message_decompressor_get_size(const SimpleAppMessageDecompressor *decompressor);
+
+//! @return True if exactly the expected number of bytes was decompressed and no token was cut
+//! short
+bool simple_app_message_decompressor_is_complete(
+    const SimpleAppMessageDecompressor *decompressor);
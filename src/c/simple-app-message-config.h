@@ -0,0 +1,71 @@
+#pragma once
+
+//! Build time configuration. Every setting can be overridden by defining it for the compiler, which
+//! the wscript's and host/CMakeLists.txt's options do.
+
+//! Set to 1 to receive without the heap. Namespaces, assemblies and their reassembly buffers then
+//! live in static storage sized by the limits below, so receiving uses the same memory every time
+//! and never fails because the heap is exhausted or fragmented. Messages that exceed the limits
+//! are rejected. Sending and RPC still allocate, and so does the outbox for the NACKs, traces and
+//! chunk size responses it sends back.
+#ifndef SIMPLE_APP_MESSAGE_STATIC_ALLOCATION
+#define SIMPLE_APP_MESSAGE_STATIC_ALLOCATION (0)
+#endif
+
+//! The limits below only apply with SIMPLE_APP_MESSAGE_STATIC_ALLOCATION, which sizes its storage
+//! by them
+
+//! Namespaces that can be registered, counting ones that were deregistered since they keep their ID
+#ifndef SIMPLE_APP_MESSAGE_MAX_NAMESPACES
+#define SIMPLE_APP_MESSAGE_MAX_NAMESPACES (8)
+#endif
+
+//! Largest payload that can be reassembled, counting every chunk as long as the first
+#ifndef SIMPLE_APP_MESSAGE_MAX_MESSAGE_SIZE
+#define SIMPLE_APP_MESSAGE_MAX_MESSAGE_SIZE (2048)
+#endif
+
+//! Most keys a buffered message can have
+#ifndef SIMPLE_APP_MESSAGE_MAX_KEYS
+#define SIMPLE_APP_MESSAGE_MAX_KEYS (32)
+#endif
+
+//! Transfers that can be reassembled at the same time, simple_app_message_set_max_concurrent_
+//! transfers() can't go above it
+#ifndef SIMPLE_APP_MESSAGE_MAX_TRANSFERS
+#define SIMPLE_APP_MESSAGE_MAX_TRANSFERS (2)
+#endif
+
+//! Longest entry, key included, that can be held while it runs across a chunk boundary when
+//! streaming to key_received. A longer entry fails the message, unless it's a data value and
+//! data_piece_received is set, which gets the value in pieces and only needs the key held.
+#ifndef SIMPLE_APP_MESSAGE_MAX_STREAM_CARRY_SIZE
+#define SIMPLE_APP_MESSAGE_MAX_STREAM_CARRY_SIZE (256)
+#endif
+
+//! Set to 0 to compile out decompression. The chunk size response then doesn't offer a window, so
+//! the phone never compresses.
+#ifndef SIMPLE_APP_MESSAGE_COMPRESSION
+#define SIMPLE_APP_MESSAGE_COMPRESSION (1)
+#endif
+
+//! Newest payload format decoded, announced in the chunk size response so the phone never sends a
+//! newer one. Lowering it compiles out the newer decoders: 2 leaves out v3's arrays and objects,
+//! which the view's array and object getters then fail to read, and 1 also leaves out v2's compact
+//! values. v1 is always decoded, since phones that predate payload formats send nothing else.
+#ifndef SIMPLE_APP_MESSAGE_MAX_FORMAT
+#define SIMPLE_APP_MESSAGE_MAX_FORMAT (3)
+#endif
+
+//! Set to 0 to compile out unpacking batches. The chunk size response then doesn't announce them,
+//! so the phone sends every message on its own.
+#ifndef SIMPLE_APP_MESSAGE_BATCHES
+#define SIMPLE_APP_MESSAGE_BATCHES (1)
+#endif
+
+//! Set to 0 to compile out decoding messages into a SimpleDict for message_received, along with
+//! state sync which is delivered that way. SimpleDict allocates every key it holds, so it's off by
+//! default with SIMPLE_APP_MESSAGE_STATIC_ALLOCATION.
+#ifndef SIMPLE_APP_MESSAGE_DICT_MESSAGES
+#define SIMPLE_APP_MESSAGE_DICT_MESSAGES (!SIMPLE_APP_MESSAGE_STATIC_ALLOCATION)
+#endif
@@ -0,0 +1,117 @@
+#include "simple-app-message-dispatch-queue.h"
+
+#include "@smallstoneapps/linked-list/linked-list.h"
+
+struct SimpleAppMessageDispatchQueue {
+  //! SimpleAppMessageDeferredMessage, oldest first
+  LinkedRoot *messages;
+  size_t max_depth;
+  //! Set while a pass over the queue is scheduled
+  AppTimer *timer;
+  SimpleAppMessageDispatchCallback callback;
+  void *context;
+};
+
+SimpleAppMessageDispatchQueue *simple_app_message_dispatch_queue_create(
+    size_t max_depth, SimpleAppMessageDispatchCallback callback, void *context) {
+  if (!max_depth || !callback) {
+    return NULL;
+  }
+
+  SimpleAppMessageDispatchQueue *queue = calloc(1, sizeof(SimpleAppMessageDispatchQueue));
+  if (!queue) {
+    return NULL;
+  }
+
+  queue->messages = linked_list_create_root();
+  if (!queue->messages) {
+    free(queue);
+    return NULL;
+  }
+
+  queue->max_depth = max_depth;
+  queue->callback = callback;
+  queue->context = context;
+  return queue;
+}
+
+//! Takes the oldest message off the queue before delivering it, so the callback may flush the
+//! queue itself
+static void prv_dispatch_oldest(SimpleAppMessageDispatchQueue *queue) {
+  SimpleAppMessageDeferredMessage *message = linked_list_get(queue->messages, 0);
+  linked_list_remove(queue->messages, 0);
+  queue->callback(message, queue->context);
+  simple_app_message_detached_message_destroy(message->message);
+  free(message);
+}
+
+static void prv_dispatch_to_depth(SimpleAppMessageDispatchQueue *queue, size_t depth) {
+  while (linked_list_count(queue->messages) > depth) {
+    prv_dispatch_oldest(queue);
+  }
+}
+
+static void prv_timer_callback(void *data) {
+  SimpleAppMessageDispatchQueue *queue = data;
+  queue->timer = NULL;
+  prv_dispatch_to_depth(queue, 0);
+}
+
+void simple_app_message_dispatch_queue_set_max_depth(SimpleAppMessageDispatchQueue *queue,
+                                                     size_t max_depth) {
+  if (!queue) {
+    return;
+  }
+  queue->max_depth = max_depth;
+  prv_dispatch_to_depth(queue, max_depth);
+}
+
+bool simple_app_message_dispatch_queue_push(SimpleAppMessageDispatchQueue *queue,
+                                            const SimpleAppMessageDeferredMessage *message) {
+  SimpleAppMessageDeferredMessage *copy = queue ? malloc(sizeof(*copy)) : NULL;
+  if (!copy) {
+    return false;
+  }
+  *copy = *message;
+
+  prv_dispatch_to_depth(queue, queue->max_depth ? (queue->max_depth - 1) : 0);
+  const uint16_t count_before = linked_list_count(queue->messages);
+  linked_list_append(queue->messages, copy);
+  if (linked_list_count(queue->messages) == count_before) {
+    free(copy);
+    return false;
+  }
+
+  if (!queue->timer) {
+    queue->timer = app_timer_register(0, prv_timer_callback, queue);
+  }
+  return true;
+}
+
+size_t simple_app_message_dispatch_queue_get_depth(const SimpleAppMessageDispatchQueue *queue) {
+  return queue ? linked_list_count(queue->messages) : 0;
+}
+
+void simple_app_message_dispatch_queue_flush(SimpleAppMessageDispatchQueue *queue) {
+  if (queue) {
+    prv_dispatch_to_depth(queue, 0);
+  }
+}
+
+void simple_app_message_dispatch_queue_destroy(SimpleAppMessageDispatchQueue *queue) {
+  if (!queue) {
+    return;
+  }
+
+  if (queue->timer) {
+    app_timer_cancel(queue->timer);
+  }
+  while (linked_list_count(queue->messages)) {
+    SimpleAppMessageDeferredMessage *message = linked_list_get(queue->messages, 0);
+    linked_list_remove(queue->messages, 0);
+    simple_app_message_detached_message_destroy(message->message);
+    free(message);
+  }
+  free(queue->messages);
+  free(queue);
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "simple-app-message-assembly.h"
+#include "simple-app-message-namespace.h"
+#include "simple-app-message-outbox.h"
+
+#include <pebble.h>
+
+//! Complete messages waiting to be delivered from a timer rather than from the inbox handler, so
+//! the inbox handler returns as soon as a message is reassembled
+typedef struct SimpleAppMessageDispatchQueue SimpleAppMessageDispatchQueue;
+
+typedef struct SimpleAppMessageDeferredMessage {
+  //! Owned by the queue, destroyed once it's been delivered
+  SimpleAppMessageDetachedMessage *message;
+  //! NULL for a batch, whose messages each name their namespace
+  SimpleAppMessageNamespace *namespace;
+  //! Filled in with the deserialize and dispatch times as the message is delivered
+  SimpleAppMessageOutboxTrace trace;
+  //! The phone asked for the trace to be echoed
+  bool traced;
+} SimpleAppMessageDeferredMessage;
+
+//! Delivers a message taken off the queue
+typedef void (*SimpleAppMessageDispatchCallback)(SimpleAppMessageDeferredMessage *message,
+                                                 void *context);
+
+//! @param max_depth Messages that can wait at once
+SimpleAppMessageDispatchQueue *simple_app_message_dispatch_queue_create(
+    size_t max_depth, SimpleAppMessageDispatchCallback callback, void *context);
+
+//! Delivers the oldest messages right away if the queue holds more than max_depth
+void simple_app_message_dispatch_queue_set_max_depth(SimpleAppMessageDispatchQueue *queue,
+                                                     size_t max_depth);
+
+//! Queues a copy of message, taking ownership of its detached message. Messages queued before the
+//! timer fires are delivered together, in the order they were queued. If the queue is full, the
+//! oldest message is delivered right away to make room.
+//! @return True if the message was queued, otherwise the caller keeps the detached message
+bool simple_app_message_dispatch_queue_push(SimpleAppMessageDispatchQueue *queue,
+                                            const SimpleAppMessageDeferredMessage *message);
+
+//! @return Messages currently waiting
+size_t simple_app_message_dispatch_queue_get_depth(const SimpleAppMessageDispatchQueue *queue);
+
+//! Delivers every waiting message right away
+void simple_app_message_dispatch_queue_flush(SimpleAppMessageDispatchQueue *queue);
+
+//! Drops every waiting message without delivering it
+void simple_app_message_dispatch_queue_destroy(SimpleAppMessageDispatchQueue *queue);
@@ -1,35 +1,56 @@
 #include "simple-app-message-namespace.h"
 
+#include "simple-app-message-pool.h"
+
+//! Must be a power of two
+#define SIMPLE_APP_MESSAGE_NAMESPACE_HASH_BUCKETS (16)
+
 struct SimpleAppMessageNamespace {
-  char *name;
+  char name[SIMPLE_APP_MESSAGE_NAMESPACE_MAX_SIZE_BYTES];
+  uint8_t id;
+  //! ID of the next namespace in the same hash bucket
+  uint8_t next_in_bucket;
+  bool registered;
   SimpleAppMessageCallbacks callbacks;
   void *user_context;
+  uint32_t messages_completed;
+  //! State merged from the sync updates sent to the namespace, NULL until a full update arrives
+  SimpleDict *sync_state;
+  int32_t sync_generation;
 };
 
-SimpleAppMessageNamespace *simple_app_message_namespace_create(const char *name) {
-  if (!name) {
-    return NULL;
-  }
+struct SimpleAppMessageNamespaceTable {
+  //! Indexed by ID - 1
+  SimpleAppMessageNamespace **namespaces;
+  uint16_t count;
+  uint16_t capacity;
+  uint8_t buckets[SIMPLE_APP_MESSAGE_NAMESPACE_HASH_BUCKETS];
+};
 
-  SimpleAppMessageNamespace *namespace = malloc(sizeof(*namespace));
-  if (!namespace) {
-    APP_LOG(APP_LOG_LEVEL_ERROR, "Could not malloc memory for new namespace object \"%s\"", name);
+SIMPLE_APP_MESSAGE_POOL_DEFINE(s_namespace_pool, SimpleAppMessageNamespace,
+                               SIMPLE_APP_MESSAGE_MAX_NAMESPACES);
+SIMPLE_APP_MESSAGE_POOL_DEFINE(s_table_pool, SimpleAppMessageNamespaceTable, 1);
+
+#if SIMPLE_APP_MESSAGE_STATIC_ALLOCATION
+static SimpleAppMessageNamespace *s_namespaces[SIMPLE_APP_MESSAGE_MAX_NAMESPACES];
+#endif
+
+SimpleAppMessageNamespace *simple_app_message_namespace_create(const char *name, uint8_t id) {
+  if (!name || (strlen(name) + 1 > SIMPLE_APP_MESSAGE_NAMESPACE_MAX_SIZE_BYTES)) {
     return NULL;
   }
 
-  const size_t name_length = strlen(name);
-  char *name_copy = malloc(name_length + 1);
-  if (!name_copy) {
-    APP_LOG(APP_LOG_LEVEL_ERROR, "Could not malloc memory for new namespace name \"%s\"", name);
-    free(namespace);
+  SimpleAppMessageNamespace *namespace =
+      simple_app_message_pool_alloc(&s_namespace_pool, sizeof(*namespace));
+  if (!namespace) {
+    APP_LOG(APP_LOG_LEVEL_ERROR, "Could not allocate new namespace object \"%s\"", name);
     return NULL;
   }
-  strncpy(name_copy, name, name_length);
-  name_copy[name_length] = '\0';
 
   *namespace = (SimpleAppMessageNamespace) {
-    .name = name_copy,
+    .id = id,
   };
+  strncpy(namespace->name, name, sizeof(namespace->name) - 1);
 
   return namespace;
 }
@@ -41,62 +62,226 @@ void simple_app_message_namespace_set_callbacks(SimpleAppMessageNamespace *names
     return;
   }
 
+  if (!callbacks) {
+    // The phone resyncs once it's registered again
+    simple_app_message_namespace_set_sync_state(namespace, NULL, 0);
+  }
+  namespace->registered = (callbacks != NULL);
   namespace->callbacks = callbacks ? *callbacks : (SimpleAppMessageCallbacks) {0};
   namespace->user_context = context;
 }
 
-static bool prv_find_namespace_in_list_callback(void *object1, void *object2) {
-  SimpleAppMessageNamespace *namespace1 = object1;
-  SimpleAppMessageNamespace *namespace2 = object2;
-  return (strcmp(namespace1->name, namespace2->name) == 0);
+bool simple_app_message_namespace_get_callbacks(const SimpleAppMessageNamespace *namespace,
+                                                SimpleAppMessageCallbacks *callbacks_out,
+                                                void **context_out) {
+  if (!namespace || !namespace->registered) {
+    return false;
+  }
+
+  if (callbacks_out) {
+    *callbacks_out = namespace->callbacks;
+  }
+
+  if (context_out) {
+    *context_out = namespace->user_context;
+  }
+
+  return true;
 }
 
-SimpleAppMessageNamespace *simple_app_message_namespace_find_in_list(LinkedRoot *root,
-                                                                     const char *name,
-                                                                     uint16_t *index_out) {
-  if (!root) {
-    return NULL;
+const char *simple_app_message_namespace_get_name(const SimpleAppMessageNamespace *namespace) {
+  return namespace ? namespace->name : NULL;
+}
+
+uint8_t simple_app_message_namespace_get_id(const SimpleAppMessageNamespace *namespace) {
+  return namespace ? namespace->id : SIMPLE_APP_MESSAGE_NAMESPACE_ID_NONE;
+}
+
+void simple_app_message_namespace_count_completed(SimpleAppMessageNamespace *namespace) {
+  if (namespace) {
+    namespace->messages_completed++;
   }
+}
 
-  SimpleAppMessageNamespace dummy_namespace = (SimpleAppMessageNamespace) {
-    .name = (char *)name,
-  };
-  const int16_t index = linked_list_find_compare(root, &dummy_namespace,
-                                                 prv_find_namespace_in_list_callback);
-  if (index == -1) {
+uint32_t simple_app_message_namespace_get_completed(const SimpleAppMessageNamespace *namespace) {
+  return namespace ? namespace->messages_completed : 0;
+}
+
+SimpleDict *simple_app_message_namespace_get_sync_state(const SimpleAppMessageNamespace *namespace,
+                                                        int32_t *generation_out) {
+  if (!namespace || !namespace->sync_state) {
     return NULL;
   }
 
-  if (index_out) {
-    *index_out = (uint16_t)index;
+  if (generation_out) {
+    *generation_out = namespace->sync_generation;
   }
+  return namespace->sync_state;
+}
 
-  return linked_list_get(root, (uint16_t)index);
+void simple_app_message_namespace_set_sync_state(SimpleAppMessageNamespace *namespace,
+                                                 SimpleDict *state, int32_t generation) {
+  if (!namespace) {
+    if (state) {
+      simple_dict_destroy(state);
+    }
+    return;
+  }
+
+  if (namespace->sync_state && (namespace->sync_state != state)) {
+    simple_dict_destroy(namespace->sync_state);
+  }
+  namespace->sync_state = state;
+  namespace->sync_generation = generation;
 }
 
-bool simple_app_message_namespace_get_callbacks(const SimpleAppMessageNamespace *namespace,
-                                                SimpleAppMessageCallbacks *callbacks_out,
-                                                void **context_out) {
+void simple_app_message_namespace_destroy(SimpleAppMessageNamespace *namespace) {
   if (!namespace) {
-    return false;
+    return;
   }
 
-  if (callbacks_out) {
-    *callbacks_out = namespace->callbacks;
+  simple_app_message_namespace_set_sync_state(namespace, NULL, 0);
+  simple_app_message_pool_free(&s_namespace_pool, namespace);
+}
+
+SimpleAppMessageNamespaceTable *simple_app_message_namespace_table_create(void) {
+  SimpleAppMessageNamespaceTable *table =
+      simple_app_message_pool_alloc(&s_table_pool, sizeof(SimpleAppMessageNamespaceTable));
+  if (table) {
+    *table = (SimpleAppMessageNamespaceTable) {0};
+#if SIMPLE_APP_MESSAGE_STATIC_ALLOCATION
+    table->namespaces = s_namespaces;
+    table->capacity = SIMPLE_APP_MESSAGE_MAX_NAMESPACES;
+#endif
   }
+  return table;
+}
 
-  if (context_out) {
-    *context_out = namespace->user_context;
+//! FNV-1a
+static uint8_t prv_bucket_for_name(const char *name) {
+  uint32_t hash = 2166136261u;
+  while (*name) {
+    hash ^= (uint8_t)*(name++);
+    hash *= 16777619u;
   }
+  return hash & (SIMPLE_APP_MESSAGE_NAMESPACE_HASH_BUCKETS - 1);
+}
 
-  return true;
+SimpleAppMessageNamespace *simple_app_message_namespace_table_find_by_id(
+    const SimpleAppMessageNamespaceTable *table, uint8_t id) {
+  if (!table || (id == SIMPLE_APP_MESSAGE_NAMESPACE_ID_NONE) || (id > table->count)) {
+    return NULL;
+  }
+  return table->namespaces[id - 1];
 }
 
-void simple_app_message_namespace_destroy(SimpleAppMessageNamespace *namespace) {
+SimpleAppMessageNamespace *simple_app_message_namespace_table_find(
+    const SimpleAppMessageNamespaceTable *table, const char *name) {
+  if (!table || !name) {
+    return NULL;
+  }
+
+  uint8_t id = table->buckets[prv_bucket_for_name(name)];
+  while (id != SIMPLE_APP_MESSAGE_NAMESPACE_ID_NONE) {
+    SimpleAppMessageNamespace *namespace = table->namespaces[id - 1];
+    if (strcmp(namespace->name, name) == 0) {
+      return namespace;
+    }
+    id = namespace->next_in_bucket;
+  }
+  return NULL;
+}
+
+SimpleAppMessageNamespace *simple_app_message_namespace_table_add(
+    SimpleAppMessageNamespaceTable *table, const char *name) {
+  if (!table || !name) {
+    return NULL;
+  }
+
+  SimpleAppMessageNamespace *namespace = simple_app_message_namespace_table_find(table, name);
+  if (namespace) {
+    return namespace;
+  }
+
+  if (table->count >= SIMPLE_APP_MESSAGE_NAMESPACE_MAX_COUNT) {
+    APP_LOG(APP_LOG_LEVEL_ERROR, "Too many SimpleAppMessage namespaces");
+    return NULL;
+  }
+
+  if (table->count == table->capacity) {
+#if SIMPLE_APP_MESSAGE_STATIC_ALLOCATION
+    APP_LOG(APP_LOG_LEVEL_ERROR, "More than SIMPLE_APP_MESSAGE_MAX_NAMESPACES namespaces");
+    return NULL;
+#else
+    const uint16_t capacity = table->capacity ? (table->capacity * 2) : 4;
+    SimpleAppMessageNamespace **namespaces =
+        realloc(table->namespaces, capacity * sizeof(SimpleAppMessageNamespace *));
+    if (!namespaces) {
+      APP_LOG(APP_LOG_LEVEL_ERROR, "Could not grow SimpleAppMessage namespace table");
+      return NULL;
+    }
+    table->namespaces = namespaces;
+    table->capacity = capacity;
+#endif
+  }
+
+  const uint8_t id = table->count + 1;
+  namespace = simple_app_message_namespace_create(name, id);
   if (!namespace) {
+    return NULL;
+  }
+
+  const uint8_t bucket = prv_bucket_for_name(name);
+  namespace->next_in_bucket = table->buckets[bucket];
+  table->buckets[bucket] = id;
+  table->namespaces[table->count++] = namespace;
+  return namespace;
+}
+
+size_t simple_app_message_namespace_table_serialize(const SimpleAppMessageNamespaceTable *table,
+                                                    uint8_t *buffer, size_t buffer_size) {
+  if (!table || !buffer) {
+    return 0;
+  }
+
+  size_t size = 0;
+  for (uint16_t i = 0; i < table->count; i++) {
+    const SimpleAppMessageNamespace *namespace = table->namespaces[i];
+    if (!namespace->registered) {
+      continue;
+    }
+
+    const size_t name_size = strlen(namespace->name) + 1;
+    if (size + sizeof(namespace->id) + name_size > buffer_size) {
+      break;
+    }
+    buffer[size++] = namespace->id;
+    memcpy(buffer + size, namespace->name, name_size);
+    size += name_size;
+  }
+  return size;
+}
+
+void simple_app_message_namespace_table_reset_counts(SimpleAppMessageNamespaceTable *table) {
+  if (!table) {
     return;
   }
 
-  free(namespace->name);
-  free(namespace);
+  for (uint16_t i = 0; i < table->count; i++) {
+    table->namespaces[i]->messages_completed = 0;
+  }
+}
+
+void simple_app_message_namespace_table_destroy(SimpleAppMessageNamespaceTable *table) {
+  if (!table) {
+    return;
+  }
+
+  for (uint16_t i = 0; i < table->count; i++) {
+    simple_app_message_namespace_destroy(table->namespaces[i]);
+  }
+#if !SIMPLE_APP_MESSAGE_STATIC_ALLOCATION
+  free(table->namespaces);
+#endif
+  simple_app_message_pool_free(&s_table_pool, table);
 }
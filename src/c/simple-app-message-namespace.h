@@ -2,24 +2,70 @@
 
 #include "simple-app-message.h"
 
-#include "@smallstoneapps/linked-list/linked-list.h"
-
 #include <pebble.h>
 
+//! IDs are handed out from 1, 0 means "no ID"
+#define SIMPLE_APP_MESSAGE_NAMESPACE_ID_NONE (0)
+#define SIMPLE_APP_MESSAGE_NAMESPACE_MAX_COUNT (UINT8_MAX)
+
 typedef struct SimpleAppMessageNamespace SimpleAppMessageNamespace;
 
-SimpleAppMessageNamespace *simple_app_message_namespace_create(const char *name);
+//! Namespaces indexed by their numeric ID and hashed by name, so both lookups take constant time
+typedef struct SimpleAppMessageNamespaceTable SimpleAppMessageNamespaceTable;
+
+SimpleAppMessageNamespace *simple_app_message_namespace_create(const char *name, uint8_t id);
 
 void simple_app_message_namespace_set_callbacks(SimpleAppMessageNamespace *namespace,
                                                 const SimpleAppMessageCallbacks *callbacks,
                                                 void *context);
 
-SimpleAppMessageNamespace *simple_app_message_namespace_find_in_list(LinkedRoot *root,
-                                                                     const char *name,
-                                                                     uint16_t *index_out);
-
+//! @return False if the namespace is NULL or its callbacks have been cleared
 bool simple_app_message_namespace_get_callbacks(const SimpleAppMessageNamespace *namespace,
                                                 SimpleAppMessageCallbacks *callbacks_out,
                                                 void **context_out);
 
+const char *simple_app_message_namespace_get_name(const SimpleAppMessageNamespace *namespace);
+
+uint8_t simple_app_message_namespace_get_id(const SimpleAppMessageNamespace *namespace);
+
+//! Counts a message delivered to the namespace
+void simple_app_message_namespace_count_completed(SimpleAppMessageNamespace *namespace);
+
+uint32_t simple_app_message_namespace_get_completed(const SimpleAppMessageNamespace *namespace);
+
+//! @param generation_out Set to the generation of the state, if it has one
+//! @return The state merged from the namespace's sync updates, or NULL if it has none
+SimpleDict *simple_app_message_namespace_get_sync_state(const SimpleAppMessageNamespace *namespace,
+                                                        int32_t *generation_out);
+
+//! Takes ownership of state, destroying the state it replaces. NULL drops the state.
+void simple_app_message_namespace_set_sync_state(SimpleAppMessageNamespace *namespace,
+                                                 SimpleDict *state, int32_t generation);
+
 void simple_app_message_namespace_destroy(SimpleAppMessageNamespace *namespace);
+
+SimpleAppMessageNamespaceTable *simple_app_message_namespace_table_create(void);
+
+//! Returns the namespace with this name, adding it with the next free ID if it isn't in the table
+//! yet. Namespaces are never removed, so a name keeps its ID for as long as the table exists and
+//! an ID the phone has learned can never start pointing at a different namespace.
+//! @return NULL if the table is full or out of memory
+SimpleAppMessageNamespace *simple_app_message_namespace_table_add(
+    SimpleAppMessageNamespaceTable *table, const char *name);
+
+SimpleAppMessageNamespace *simple_app_message_namespace_table_find(
+    const SimpleAppMessageNamespaceTable *table, const char *name);
+
+SimpleAppMessageNamespace *simple_app_message_namespace_table_find_by_id(
+    const SimpleAppMessageNamespaceTable *table, uint8_t id);
+
+//! Writes the ID and NUL terminated name of each namespace that has callbacks, for as many
+//! namespaces as fit in the buffer
+//! @return Number of bytes written
+size_t simple_app_message_namespace_table_serialize(const SimpleAppMessageNamespaceTable *table,
+                                                    uint8_t *buffer, size_t buffer_size);
+
+//! Zeroes the delivered message count of every namespace
+void simple_app_message_namespace_table_reset_counts(SimpleAppMessageNamespaceTable *table);
+
+void simple_app_message_namespace_table_destroy(SimpleAppMessageNamespaceTable *table);
@@ -0,0 +1,451 @@
+#include "simple-app-message-outbox.h"
+
+#include "@smallstoneapps/linked-list/linked-list.h"
+
+//! How long to wait before trying again when the AppMessage outbox is in use
+#define SIMPLE_APP_MESSAGE_OUTBOX_BUSY_RETRY_MS (20)
+
+//! Delay before the first retry of a failed send, doubled for each consecutive failure
+#define SIMPLE_APP_MESSAGE_OUTBOX_FAILED_RETRY_MS (100)
+
+//! Consecutive failures (other than APP_MSG_BUSY) after which a queued payload is dropped
+#define SIMPLE_APP_MESSAGE_OUTBOX_MAX_FAILED_ATTEMPTS (5)
+
+typedef enum OutboxEntryType {
+  OutboxEntryType_ChunkSize,
+  OutboxEntryType_Payload,
+  OutboxEntryType_Nack,
+  OutboxEntryType_Trace,
+} OutboxEntryType;
+
+//! Most uint32_t words a NACK or trace carries
+#define SIMPLE_APP_MESSAGE_OUTBOX_MAX_WORDS (5)
+
+typedef struct OutboxEntry {
+  OutboxEntryType type;
+  char namespace[SIMPLE_APP_MESSAGE_NAMESPACE_MAX_SIZE_BYTES];
+  uint8_t *payload;
+  size_t payload_size;
+  SimpleAppMessageOutboxHandshake handshake;
+  //! For a NACK, the transfer ID followed by the first missing chunk and the number missing. For
+  //! a trace, the transfer ID, the reassembly, deserialize and dispatch times and whether it was
+  //! dispatched. Little endian on the wire.
+  uint32_t words[SIMPLE_APP_MESSAGE_OUTBOX_MAX_WORDS];
+  uint8_t num_words;
+  uint32_t total_chunks;
+  uint32_t next_chunk;
+} OutboxEntry;
+
+struct SimpleAppMessageOutbox {
+  size_t chunk_size;
+  LinkedRoot *queue;
+  //! NACKs and traces, moved to the head of the queue whenever nothing is in flight
+  LinkedRoot *nacks;
+  //! True while one of our chunks has been handed to app_message_outbox_send()
+  bool in_flight;
+  AppTimer *retry_timer;
+  //! True if retry_timer is only waiting for another module to finish with the outbox
+  bool waiting_for_outbox;
+  uint8_t failed_attempts;
+  SimpleAppMessageOutboxSentCallback callback;
+  void *context;
+};
+
+static void prv_outbox_pump(SimpleAppMessageOutbox *outbox);
+
+SimpleAppMessageOutbox *simple_app_message_outbox_create(
+    size_t chunk_size, SimpleAppMessageOutboxSentCallback callback, void *context) {
+  if (!chunk_size) {
+    return NULL;
+  }
+
+  SimpleAppMessageOutbox *outbox = calloc(1, sizeof(SimpleAppMessageOutbox));
+  if (!outbox) {
+    return NULL;
+  }
+
+  outbox->queue = linked_list_create_root();
+  outbox->nacks = linked_list_create_root();
+  if (!outbox->queue || !outbox->nacks) {
+    free(outbox->queue);
+    free(outbox->nacks);
+    free(outbox);
+    return NULL;
+  }
+
+  outbox->chunk_size = chunk_size;
+  outbox->callback = callback;
+  outbox->context = context;
+  return outbox;
+}
+
+static void prv_entry_destroy(OutboxEntry *entry) {
+  if (!entry) {
+    return;
+  }
+  free(entry->payload);
+  free(entry);
+}
+
+static bool prv_enqueue(SimpleAppMessageOutbox *outbox, OutboxEntry *entry) {
+  const uint16_t count_before = linked_list_count(outbox->queue);
+  linked_list_append(outbox->queue, entry);
+  if (linked_list_count(outbox->queue) == count_before) {
+    APP_LOG(APP_LOG_LEVEL_ERROR, "Failed to queue SimpleAppMessage outbox entry");
+    prv_entry_destroy(entry);
+    return false;
+  }
+
+  prv_outbox_pump(outbox);
+  return true;
+}
+
+bool simple_app_message_outbox_enqueue_payload(SimpleAppMessageOutbox *outbox,
+                                               const char *namespace, uint8_t *payload,
+                                               size_t payload_size) {
+  if (!outbox || !namespace || !payload || !payload_size ||
+      (strlen(namespace) + 1 > SIMPLE_APP_MESSAGE_NAMESPACE_MAX_SIZE_BYTES)) {
+    free(payload);
+    return false;
+  }
+
+  OutboxEntry *entry = malloc(sizeof(OutboxEntry));
+  if (!entry) {
+    APP_LOG(APP_LOG_LEVEL_ERROR, "Failed to malloc SimpleAppMessage outbox entry");
+    free(payload);
+    return false;
+  }
+
+  *entry = (OutboxEntry) {
+    .type = OutboxEntryType_Payload,
+    .payload = payload,
+    .payload_size = payload_size,
+    .total_chunks = (payload_size + outbox->chunk_size - 1) / outbox->chunk_size,
+  };
+  strncpy(entry->namespace, namespace, sizeof(entry->namespace) - 1);
+  return prv_enqueue(outbox, entry);
+}
+
+bool simple_app_message_outbox_enqueue_chunk_size(SimpleAppMessageOutbox *outbox,
+                                                  const SimpleAppMessageOutboxHandshake *handshake,
+                                                  uint8_t *namespace_table,
+                                                  size_t namespace_table_size) {
+  if (!outbox || !handshake) {
+    free(namespace_table);
+    return false;
+  }
+
+  OutboxEntry *entry = malloc(sizeof(OutboxEntry));
+  if (!entry) {
+    APP_LOG(APP_LOG_LEVEL_ERROR, "Failed to malloc SimpleAppMessage outbox entry");
+    free(namespace_table);
+    return false;
+  }
+
+  // The namespace table rides along in the payload fields
+  *entry = (OutboxEntry) {
+    .type = OutboxEntryType_ChunkSize,
+    .handshake = *handshake,
+    .payload = namespace_table,
+    .payload_size = namespace_table_size,
+    .total_chunks = 1,
+  };
+  return prv_enqueue(outbox, entry);
+}
+
+//! Queues an entry that only carries words ahead of the payloads
+static bool prv_enqueue_words(SimpleAppMessageOutbox *outbox, OutboxEntryType type,
+                              const uint32_t *words, uint8_t num_words) {
+  OutboxEntry *entry = malloc(sizeof(OutboxEntry));
+  if (!entry) {
+    APP_LOG(APP_LOG_LEVEL_ERROR, "Failed to malloc SimpleAppMessage outbox entry");
+    return false;
+  }
+
+  *entry = (OutboxEntry) {
+    .type = type,
+    .num_words = num_words,
+    .total_chunks = 1,
+  };
+  memcpy(entry->words, words, num_words * sizeof(uint32_t));
+
+  const uint16_t count_before = linked_list_count(outbox->nacks);
+  linked_list_append(outbox->nacks, entry);
+  if (linked_list_count(outbox->nacks) == count_before) {
+    APP_LOG(APP_LOG_LEVEL_ERROR, "Failed to queue SimpleAppMessage NACK or trace");
+    prv_entry_destroy(entry);
+    return false;
+  }
+
+  prv_outbox_pump(outbox);
+  return true;
+}
+
+bool simple_app_message_outbox_enqueue_nack(SimpleAppMessageOutbox *outbox, uint32_t transfer_id,
+                                            uint32_t first, uint32_t count) {
+  if (!outbox || !count) {
+    return false;
+  }
+
+  const uint32_t nack[] = { transfer_id, first, count };
+  return prv_enqueue_words(outbox, OutboxEntryType_Nack, nack, ARRAY_LENGTH(nack));
+}
+
+bool simple_app_message_outbox_enqueue_trace(SimpleAppMessageOutbox *outbox,
+                                             const SimpleAppMessageOutboxTrace *trace) {
+  if (!outbox || !trace) {
+    return false;
+  }
+
+  const uint32_t words[] = {
+    trace->transfer_id,
+    trace->reassembly_ms,
+    trace->deserialize_ms,
+    trace->dispatch_ms,
+    trace->dispatched,
+  };
+  return prv_enqueue_words(outbox, OutboxEntryType_Trace, words, ARRAY_LENGTH(words));
+}
+
+static DictionaryResult prv_write_entry(const SimpleAppMessageOutbox *outbox,
+                                        const OutboxEntry *entry, DictionaryIterator *iter) {
+  if (entry->type == OutboxEntryType_ChunkSize) {
+    DictionaryResult result =
+        dict_write_uint32(iter, MESSAGE_KEY_SIMPLE_APP_MESSAGE_CHUNK_SIZE,
+                          entry->handshake.chunk_size);
+    if (result == DICT_OK) {
+      result = dict_write_uint8(iter, MESSAGE_KEY_SIMPLE_APP_MESSAGE_FORMAT_VERSION,
+                                entry->handshake.format_version);
+    }
+    if ((result == DICT_OK) && entry->handshake.compression_window) {
+      result = dict_write_uint16(iter, MESSAGE_KEY_SIMPLE_APP_MESSAGE_COMPRESSION,
+                                 entry->handshake.compression_window);
+    }
+    if (result == DICT_OK) {
+      result = dict_write_uint8(iter, MESSAGE_KEY_SIMPLE_APP_MESSAGE_CHUNK_WINDOW,
+                                entry->handshake.chunk_window);
+    }
+    if ((result == DICT_OK) && entry->handshake.batches) {
+      result = dict_write_uint8(iter, MESSAGE_KEY_SIMPLE_APP_MESSAGE_CHUNK_BATCH, 1);
+    }
+    if ((result == DICT_OK) && entry->handshake.traces) {
+      result = dict_write_uint8(iter, MESSAGE_KEY_SIMPLE_APP_MESSAGE_CHUNK_TRACE, 1);
+    }
+    if ((result == DICT_OK) && entry->handshake.opened) {
+      result = dict_write_uint8(iter, MESSAGE_KEY_SIMPLE_APP_MESSAGE_WATCH_OPENED, 1);
+    }
+    if ((result == DICT_OK) && entry->payload_size &&
+        (dict_write_data(iter, MESSAGE_KEY_SIMPLE_APP_MESSAGE_NAMESPACE_TABLE, entry->payload,
+                         entry->payload_size) != DICT_OK)) {
+      // The phone falls back to namespace strings without the table
+      APP_LOG(APP_LOG_LEVEL_WARNING, "SimpleAppMessage namespace table does not fit in outbox");
+    }
+    return result;
+  }
+
+  if ((entry->type == OutboxEntryType_Nack) || (entry->type == OutboxEntryType_Trace)) {
+    uint8_t bytes[sizeof(entry->words)];
+    const size_t num_bytes = entry->num_words * sizeof(uint32_t);
+    for (size_t i = 0; i < num_bytes; i++) {
+      bytes[i] = (uint8_t)(entry->words[i / sizeof(uint32_t)] >> (8 * (i % sizeof(uint32_t))));
+    }
+    const uint32_t key = (entry->type == OutboxEntryType_Nack) ?
+        MESSAGE_KEY_SIMPLE_APP_MESSAGE_CHUNK_NACK : MESSAGE_KEY_SIMPLE_APP_MESSAGE_CHUNK_TRACE;
+    return dict_write_data(iter, key, bytes, num_bytes);
+  }
+
+  const size_t offset = entry->next_chunk * outbox->chunk_size;
+  const size_t remaining_size = entry->payload_size - offset;
+  const uint16_t length =
+      (remaining_size < outbox->chunk_size) ? remaining_size : outbox->chunk_size;
+
+  DictionaryResult result =
+      dict_write_cstring(iter, MESSAGE_KEY_SIMPLE_APP_MESSAGE_CHUNK_NAMESPACE, entry->namespace);
+  if (result == DICT_OK) {
+    result = dict_write_uint32(iter, MESSAGE_KEY_SIMPLE_APP_MESSAGE_CHUNK_TOTAL,
+                               entry->total_chunks);
+  }
+  if (result == DICT_OK) {
+    result = dict_write_uint32(iter, MESSAGE_KEY_SIMPLE_APP_MESSAGE_CHUNK_REMAINING,
+                               entry->total_chunks - entry->next_chunk - 1);
+  }
+  if (result == DICT_OK) {
+    result = dict_write_data(iter, MESSAGE_KEY_SIMPLE_APP_MESSAGE_CHUNK_DATA,
+                             entry->payload + offset, length);
+  }
+  return result;
+}
+
+//! Removes the head of the queue and reports the outcome. The entry is unlinked before the
+//! callback runs so the callback can safely queue more payloads.
+static void prv_complete_head(SimpleAppMessageOutbox *outbox, bool success) {
+  OutboxEntry *entry = linked_list_get(outbox->queue, 0);
+  if (!entry) {
+    return;
+  }
+  linked_list_remove(outbox->queue, 0);
+  outbox->failed_attempts = 0;
+
+  if ((entry->type == OutboxEntryType_Payload) && outbox->callback) {
+    outbox->callback(entry->namespace, success, outbox->context);
+  }
+  prv_entry_destroy(entry);
+}
+
+static void prv_retry_timer_callback(void *context) {
+  SimpleAppMessageOutbox *outbox = context;
+  outbox->retry_timer = NULL;
+  outbox->waiting_for_outbox = false;
+  prv_outbox_pump(outbox);
+}
+
+static void prv_schedule_retry(SimpleAppMessageOutbox *outbox, uint32_t delay_ms,
+                               bool waiting_for_outbox) {
+  outbox->retry_timer = app_timer_register(delay_ms, prv_retry_timer_callback, outbox);
+  outbox->waiting_for_outbox = waiting_for_outbox;
+  if (!outbox->retry_timer) {
+    APP_LOG(APP_LOG_LEVEL_ERROR, "Failed to schedule SimpleAppMessage outbox retry");
+  }
+}
+
+static void prv_handle_attempt_failed(SimpleAppMessageOutbox *outbox, AppMessageResult reason) {
+  if (reason == APP_MSG_BUSY) {
+    prv_schedule_retry(outbox, SIMPLE_APP_MESSAGE_OUTBOX_BUSY_RETRY_MS,
+                       true /* waiting_for_outbox */);
+    return;
+  }
+
+  outbox->failed_attempts++;
+  if (outbox->failed_attempts >= SIMPLE_APP_MESSAGE_OUTBOX_MAX_FAILED_ATTEMPTS) {
+    APP_LOG(APP_LOG_LEVEL_ERROR, "Giving up on SimpleAppMessage send, last error: %d", reason);
+    prv_complete_head(outbox, false /* success */);
+    prv_outbox_pump(outbox);
+    return;
+  }
+
+  prv_schedule_retry(outbox,
+                     SIMPLE_APP_MESSAGE_OUTBOX_FAILED_RETRY_MS << (outbox->failed_attempts - 1),
+                     false /* waiting_for_outbox */);
+}
+
+static void prv_outbox_pump(SimpleAppMessageOutbox *outbox) {
+  if (outbox->in_flight || outbox->retry_timer) {
+    return;
+  }
+
+  // The head payload keeps its progress in its entry, so it picks up where it left off
+  OutboxEntry *nack = linked_list_get(outbox->nacks, 0);
+  if (nack) {
+    linked_list_remove(outbox->nacks, 0);
+    linked_list_prepend(outbox->queue, nack);
+    if (linked_list_get(outbox->queue, 0) != nack) {
+      APP_LOG(APP_LOG_LEVEL_ERROR, "Failed to queue SimpleAppMessage NACK");
+      prv_entry_destroy(nack);
+    }
+  }
+
+  OutboxEntry *entry = linked_list_get(outbox->queue, 0);
+  if (!entry) {
+    return;
+  }
+
+  DictionaryIterator *iter;
+  AppMessageResult result = app_message_outbox_begin(&iter);
+  if (result == APP_MSG_OK) {
+    const DictionaryResult write_result = prv_write_entry(outbox, entry, iter);
+    if (write_result != DICT_OK) {
+      // Retrying cannot make the chunk fit, so drop the payload
+      APP_LOG(APP_LOG_LEVEL_ERROR, "Failed to write SimpleAppMessage chunk, error code: %d",
+              write_result);
+      prv_complete_head(outbox, false /* success */);
+      prv_outbox_pump(outbox);
+      return;
+    }
+    result = app_message_outbox_send();
+  }
+
+  if (result == APP_MSG_OK) {
+    outbox->in_flight = true;
+    return;
+  }
+
+  prv_handle_attempt_failed(outbox, result);
+}
+
+static bool prv_is_own_message(const SimpleAppMessageOutbox *outbox,
+                               DictionaryIterator *iterator) {
+  return (outbox->in_flight &&
+          (dict_find(iterator, MESSAGE_KEY_SIMPLE_APP_MESSAGE_CHUNK_SIZE) ||
+           dict_find(iterator, MESSAGE_KEY_SIMPLE_APP_MESSAGE_CHUNK_NAMESPACE) ||
+           dict_find(iterator, MESSAGE_KEY_SIMPLE_APP_MESSAGE_CHUNK_NACK) ||
+           dict_find(iterator, MESSAGE_KEY_SIMPLE_APP_MESSAGE_CHUNK_TRACE)));
+}
+
+//! Another module's message just left the outbox, so stop waiting on the busy retry timer
+static void prv_handle_foreign_message_done(SimpleAppMessageOutbox *outbox) {
+  if (outbox->retry_timer && outbox->waiting_for_outbox) {
+    app_timer_cancel(outbox->retry_timer);
+    outbox->retry_timer = NULL;
+    outbox->waiting_for_outbox = false;
+    prv_outbox_pump(outbox);
+  }
+}
+
+void simple_app_message_outbox_handle_sent(SimpleAppMessageOutbox *outbox,
+                                           DictionaryIterator *iterator) {
+  if (!outbox) {
+    return;
+  }
+
+  if (!prv_is_own_message(outbox, iterator)) {
+    prv_handle_foreign_message_done(outbox);
+    return;
+  }
+
+  outbox->in_flight = false;
+  outbox->failed_attempts = 0;
+
+  OutboxEntry *entry = linked_list_get(outbox->queue, 0);
+  if (entry && (++entry->next_chunk >= entry->total_chunks)) {
+    prv_complete_head(outbox, true /* success */);
+  }
+
+  prv_outbox_pump(outbox);
+}
+
+void simple_app_message_outbox_handle_failed(SimpleAppMessageOutbox *outbox,
+                                             DictionaryIterator *iterator,
+                                             AppMessageResult reason) {
+  if (!outbox) {
+    return;
+  }
+
+  if (!prv_is_own_message(outbox, iterator)) {
+    prv_handle_foreign_message_done(outbox);
+    return;
+  }
+
+  outbox->in_flight = false;
+  prv_handle_attempt_failed(outbox, reason);
+}
+
+void simple_app_message_outbox_destroy(SimpleAppMessageOutbox *outbox) {
+  if (!outbox) {
+    return;
+  }
+
+  if (outbox->retry_timer) {
+    app_timer_cancel(outbox->retry_timer);
+  }
+
+  LinkedRoot *lists[] = { outbox->nacks, outbox->queue };
+  for (size_t i = 0; i < ARRAY_LENGTH(lists); i++) {
+    OutboxEntry *entry;
+    while ((entry = linked_list_get(lists[i], 0))) {
+      linked_list_remove(lists[i], 0);
+      prv_entry_destroy(entry);
+    }
+    free(lists[i]);
+  }
+  free(outbox);
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include "simple-app-message.h"
+
+#include <pebble.h>
+
+typedef struct SimpleAppMessageOutbox SimpleAppMessageOutbox;
+
+//! What the watch tells the phone in response to a chunk size request
+typedef struct SimpleAppMessageOutboxHandshake {
+  uint32_t chunk_size;
+  //! Newest payload format the watch decodes
+  uint8_t format_version;
+  //! Window of the compression the watch decodes, 0 if it doesn't
+  uint16_t compression_window;
+  //! Chunks of one transfer the phone may have in flight at once
+  uint8_t chunk_window;
+  //! The watch unpacks transfers that bundle messages for several namespaces
+  bool batches;
+  //! The watch echoes a trace for transfers the phone asks to trace
+  bool traces;
+  //! Sent unasked because the watch app just opened, so the phone should ask again
+  bool opened;
+} SimpleAppMessageOutboxHandshake;
+
+//! Watch side timeline of a transfer the phone asked to trace, echoed once it's been dispatched
+typedef struct SimpleAppMessageOutboxTrace {
+  uint32_t transfer_id;
+  //! From the first chunk arriving to the last
+  uint32_t reassembly_ms;
+  uint32_t deserialize_ms;
+  //! Spent in the namespace's callbacks
+  uint32_t dispatch_ms;
+  //! False if the message couldn't be deserialized or delivered
+  bool dispatched;
+} SimpleAppMessageOutboxTrace;
+
+//! Called once every chunk of a queued payload has been acknowledged, or once the outbox has given
+//! up on it
+typedef void (*SimpleAppMessageOutboxSentCallback)(const char *namespace, bool success,
+                                                   void *context);
+
+SimpleAppMessageOutbox *simple_app_message_outbox_create(
+    size_t chunk_size, SimpleAppMessageOutboxSentCallback callback, void *context);
+
+//! Queues a serialized payload to be split into chunks and sent after everything queued before
+//! it. The outbox takes ownership of payload, even on failure.
+//! @return True if the payload was queued
+bool simple_app_message_outbox_enqueue_payload(SimpleAppMessageOutbox *outbox,
+                                               const char *namespace, uint8_t *payload,
+                                               size_t payload_size);
+
+//! Queues a response to a chunk size request from the phone, along with the namespace ID table if
+//! namespace_table_size isn't 0. The outbox takes ownership of namespace_table, even on failure.
+bool simple_app_message_outbox_enqueue_chunk_size(SimpleAppMessageOutbox *outbox,
+                                                  const SimpleAppMessageOutboxHandshake *handshake,
+                                                  uint8_t *namespace_table,
+                                                  size_t namespace_table_size);
+
+//! Queues a NACK asking the phone to resend count chunks of a transfer, starting at first. NACKs
+//! go out ahead of queued payloads.
+bool simple_app_message_outbox_enqueue_nack(SimpleAppMessageOutbox *outbox, uint32_t transfer_id,
+                                            uint32_t first, uint32_t count);
+
+//! Queues a trace for the phone. Traces go out ahead of queued payloads, like NACKs.
+bool simple_app_message_outbox_enqueue_trace(SimpleAppMessageOutbox *outbox,
+                                             const SimpleAppMessageOutboxTrace *trace);
+
+//! Must be called from the AppMessage outbox sent handler. Messages sent by other modules are
+//! used as a hint that the outbox is free again.
+void simple_app_message_outbox_handle_sent(SimpleAppMessageOutbox *outbox,
+                                           DictionaryIterator *iterator);
+
+//! Must be called from the AppMessage outbox failed handler
+void simple_app_message_outbox_handle_failed(SimpleAppMessageOutbox *outbox,
+                                             DictionaryIterator *iterator,
+                                             AppMessageResult reason);
+
+void simple_app_message_outbox_destroy(SimpleAppMessageOutbox *outbox);
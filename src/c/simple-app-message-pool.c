@@ -0,0 +1,31 @@
+#include "simple-app-message-pool.h"
+
+void *simple_app_message_pool_alloc(SimpleAppMessagePool *pool, size_t size) {
+  if (!pool->storage) {
+    return malloc(size);
+  }
+
+  if (size > pool->slot_size) {
+    return NULL;
+  }
+  for (size_t i = 0; i < pool->num_slots; i++) {
+    if (!pool->used[i]) {
+      pool->used[i] = true;
+      return pool->storage + (i * pool->slot_size);
+    }
+  }
+  return NULL;
+}
+
+void simple_app_message_pool_free(SimpleAppMessagePool *pool, void *object) {
+  if (!object) {
+    return;
+  }
+  if (!pool->storage) {
+    free(object);
+    return;
+  }
+
+  const size_t offset = (size_t)((uint8_t *)object - pool->storage);
+  pool->used[offset / pool->slot_size] = false;
+}
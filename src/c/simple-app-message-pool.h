@@ -0,0 +1,37 @@
+#pragma once
+
+#include "simple-app-message-config.h"
+
+#include <pebble.h>
+
+//! Where an object type is allocated from. With SIMPLE_APP_MESSAGE_STATIC_ALLOCATION a pool is a
+//! fixed number of equally sized slots in static storage, so taking one never fragments anything
+//! and fails only once they're all in use. Otherwise it falls through to the heap.
+typedef struct SimpleAppMessagePool {
+  //! NULL for a pool backed by the heap
+  uint8_t *storage;
+  size_t slot_size;
+  size_t num_slots;
+  bool *used;
+} SimpleAppMessagePool;
+
+#if SIMPLE_APP_MESSAGE_STATIC_ALLOCATION
+//! Defines a pool of count slots, each large enough for type
+#define SIMPLE_APP_MESSAGE_POOL_DEFINE(name, type, count)                                         \
+  static union { type object; void *align; } name##_storage[(count)];                             \
+  static bool name##_used[(count)];                                                                \
+  static SimpleAppMessagePool name = {                                                             \
+    .storage = (uint8_t *)name##_storage,                                                          \
+    .slot_size = sizeof(name##_storage[0]),                                                        \
+    .num_slots = (count),                                                                          \
+    .used = name##_used,                                                                           \
+  }
+#else
+#define SIMPLE_APP_MESSAGE_POOL_DEFINE(name, type, count) \
+  static SimpleAppMessagePool name = {0}
+#endif
+
+//! @return size bytes that aren't cleared, or NULL if they don't fit a slot or none is free
+void *simple_app_message_pool_alloc(SimpleAppMessagePool *pool, size_t size);
+
+void simple_app_message_pool_free(SimpleAppMessagePool *pool, void *object);
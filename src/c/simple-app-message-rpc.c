@@ -0,0 +1,278 @@
+#include "simple-app-message.h"
+
+#include "@smallstoneapps/linked-list/linked-list.h"
+
+#include <pebble.h>
+
+//! Keys RPC adds to the messages it sends, must match KEYS in rpc.js. A call carries its ID, a
+//! response the ID of the call it answers and, if the call failed, the error.
+#define SIMPLE_APP_MESSAGE_RPC_ID_KEY ("#id")
+#define SIMPLE_APP_MESSAGE_RPC_RESPONSE_KEY ("#re")
+#define SIMPLE_APP_MESSAGE_RPC_ERROR_KEY ("#err")
+
+#define SIMPLE_APP_MESSAGE_RPC_TIMED_OUT_ERROR ("timed out")
+#define SIMPLE_APP_MESSAGE_RPC_NO_HANDLER_ERROR ("no handler for ")
+
+//! A namespace RPC registered callbacks for, because a method was registered or called
+typedef struct RpcMethod {
+  char name[SIMPLE_APP_MESSAGE_NAMESPACE_MAX_SIZE_BYTES];
+  SimpleAppMessageRpcRequestCallback handler;
+  void *context;
+} RpcMethod;
+
+//! A call waiting for its response
+typedef struct RpcCall {
+  int32_t id;
+  const RpcMethod *method;
+  AppTimer *timer;
+  SimpleAppMessageRpcResponseCallback callback;
+  void *context;
+} RpcCall;
+
+typedef struct SimpleAppMessageRpcState {
+  LinkedRoot *methods;
+  LinkedRoot *calls;
+  int32_t last_id;
+} SimpleAppMessageRpcState;
+
+static SimpleAppMessageRpcState s_rpc_state;
+
+static bool prv_init(void) {
+  if (!s_rpc_state.methods) {
+    s_rpc_state.methods = linked_list_create_root();
+  }
+  if (!s_rpc_state.calls) {
+    s_rpc_state.calls = linked_list_create_root();
+  }
+  if (!s_rpc_state.methods || !s_rpc_state.calls) {
+    APP_LOG(APP_LOG_LEVEL_ERROR, "Failed to create SimpleAppMessage RPC state");
+    return false;
+  }
+  return true;
+}
+
+static bool prv_append(LinkedRoot *root, void *object) {
+  const uint16_t count_before = linked_list_count(root);
+  linked_list_append(root, object);
+  return (linked_list_count(root) != count_before);
+}
+
+//! Adds the reserved keys to message, or to a message of its own if there is none, and sends it
+static bool prv_send(const char *method, SimpleDict *message, const char *id_key, int32_t id,
+                     const char *error) {
+  SimpleDict *own_message = message ? NULL : simple_dict_create();
+  SimpleDict *dict = message ? message : own_message;
+  if (!dict) {
+    APP_LOG(APP_LOG_LEVEL_ERROR, "Failed to create SimpleDict for SimpleAppMessage RPC");
+    return false;
+  }
+
+  const bool sent = simple_dict_update_int(dict, id_key, id) &&
+                    (!error || simple_dict_update_string(dict, SIMPLE_APP_MESSAGE_RPC_ERROR_KEY,
+                                                         error)) &&
+                    simple_app_message_send(method, dict);
+  if (own_message) {
+    simple_dict_destroy(own_message);
+  }
+  return sent;
+}
+
+static bool prv_find_call_callback(void *object1, void *object2) {
+  const RpcCall *call1 = object1;
+  const RpcCall *call2 = object2;
+  return ((call1->id == call2->id) && (call1->method == call2->method));
+}
+
+//! Forgets the call and calls it back, once
+static void prv_finish_call(uint16_t index, const SimpleAppMessageView *result,
+                            const char *error) {
+  RpcCall *call = linked_list_get(s_rpc_state.calls, index);
+  linked_list_remove(s_rpc_state.calls, index);
+  if (call->timer) {
+    app_timer_cancel(call->timer);
+  }
+  if (call->callback) {
+    call->callback(result, error, call->context);
+  }
+  free(call);
+}
+
+static void prv_call_timeout_callback(void *data) {
+  RpcCall *call = data;
+  call->timer = NULL;
+  const int16_t index = linked_list_find(s_rpc_state.calls, call);
+  if (index != -1) {
+    prv_finish_call((uint16_t)index, NULL, SIMPLE_APP_MESSAGE_RPC_TIMED_OUT_ERROR);
+  }
+}
+
+static void prv_handle_response(const RpcMethod *method, int32_t id,
+                                const SimpleAppMessageView *message) {
+  RpcCall key = {
+    .id = id,
+    .method = method,
+  };
+  const int16_t index = linked_list_find_compare(s_rpc_state.calls, &key, prv_find_call_callback);
+  if (index == -1) {
+    // Answered after it timed out
+    APP_LOG(APP_LOG_LEVEL_DEBUG, "Ignoring response to unknown call %d to %s", (int)id,
+            method->name);
+    return;
+  }
+
+  const char *error = simple_app_message_view_get_string(message,
+                                                         SIMPLE_APP_MESSAGE_RPC_ERROR_KEY);
+  prv_finish_call((uint16_t)index, error ? NULL : message, error);
+}
+
+static void prv_handle_request(const RpcMethod *method, int32_t id,
+                               const SimpleAppMessageView *message) {
+  SimpleAppMessageRpcRequest request = {
+    .id = id,
+  };
+  strncpy(request.method, method->name, sizeof(request.method));
+
+  if (!method->handler) {
+    char error[sizeof(SIMPLE_APP_MESSAGE_RPC_NO_HANDLER_ERROR) + sizeof(method->name)];
+    snprintf(error, sizeof(error), "%s%s", SIMPLE_APP_MESSAGE_RPC_NO_HANDLER_ERROR,
+             method->name);
+    simple_app_message_rpc_respond_error(&request, error);
+    return;
+  }
+  method->handler(&request, message, method->context);
+}
+
+static void prv_message_received(const SimpleAppMessageView *message, void *context) {
+  const RpcMethod *method = context;
+  int32_t id;
+  if (simple_app_message_view_get_int(message, SIMPLE_APP_MESSAGE_RPC_RESPONSE_KEY, &id)) {
+    prv_handle_response(method, id, message);
+  } else if (simple_app_message_view_get_int(message, SIMPLE_APP_MESSAGE_RPC_ID_KEY, &id)) {
+    prv_handle_request(method, id, message);
+  } else {
+    APP_LOG(APP_LOG_LEVEL_WARNING, "Ignoring message to %s that isn't a call or response",
+            method->name);
+  }
+}
+
+static bool prv_find_method_callback(void *object1, void *object2) {
+  const RpcMethod *method = object1;
+  return (strcmp(method->name, object2) == 0);
+}
+
+//! @param create Registers callbacks for the method's namespace if it doesn't have any yet
+static RpcMethod *prv_get_method(const char *name, bool create) {
+  if (!name || !prv_init()) {
+    return NULL;
+  }
+
+  const int16_t index = linked_list_find_compare(s_rpc_state.methods, (void *)name,
+                                                 prv_find_method_callback);
+  if (index != -1) {
+    return linked_list_get(s_rpc_state.methods, (uint16_t)index);
+  }
+  if (!create || (strlen(name) + 1 > SIMPLE_APP_MESSAGE_NAMESPACE_MAX_SIZE_BYTES)) {
+    return NULL;
+  }
+
+  RpcMethod *method = calloc(1, sizeof(RpcMethod));
+  if (!method) {
+    APP_LOG(APP_LOG_LEVEL_ERROR, "Failed to malloc SimpleAppMessage RPC method %s", name);
+    return NULL;
+  }
+  strncpy(method->name, name, sizeof(method->name));
+
+  const SimpleAppMessageCallbacks callbacks = {
+    .message_view_received = prv_message_received,
+  };
+  if (!simple_app_message_register_callbacks(method->name, &callbacks, method)) {
+    APP_LOG(APP_LOG_LEVEL_ERROR, "Failed to register SimpleAppMessage RPC method %s", name);
+    free(method);
+    return NULL;
+  }
+  if (!prv_append(s_rpc_state.methods, method)) {
+    APP_LOG(APP_LOG_LEVEL_ERROR, "Failed to add SimpleAppMessage RPC method %s", name);
+    simple_app_message_deregister_callbacks(method->name);
+    free(method);
+    return NULL;
+  }
+  return method;
+}
+
+bool simple_app_message_rpc_register_method(const char *method_name,
+                                            SimpleAppMessageRpcRequestCallback handler,
+                                            void *context) {
+  RpcMethod *method = prv_get_method(method_name, true /* create */);
+  if (!method) {
+    return false;
+  }
+
+  method->handler = handler;
+  method->context = context;
+  return true;
+}
+
+void simple_app_message_rpc_deregister_method(const char *method_name) {
+  // Stays registered for its namespace, to answer calls with an error and receive responses
+  RpcMethod *method = prv_get_method(method_name, false /* create */);
+  if (method) {
+    method->handler = NULL;
+    method->context = NULL;
+  }
+}
+
+bool simple_app_message_rpc_call(const char *method_name, SimpleDict *params, uint32_t timeout_ms,
+                                 SimpleAppMessageRpcResponseCallback callback, void *context) {
+  RpcMethod *method = prv_get_method(method_name, true /* create */);
+  if (!method) {
+    return false;
+  }
+
+  RpcCall *call = malloc(sizeof(RpcCall));
+  if (!call) {
+    APP_LOG(APP_LOG_LEVEL_ERROR, "Failed to malloc SimpleAppMessage RPC call");
+    return false;
+  }
+  // IDs are sent as ints, and wrap back around to 1 before they overflow
+  s_rpc_state.last_id = (s_rpc_state.last_id == INT32_MAX) ? 1 : (s_rpc_state.last_id + 1);
+  *call = (RpcCall) {
+    .id = s_rpc_state.last_id,
+    .method = method,
+    .callback = callback,
+    .context = context,
+  };
+  if (!prv_append(s_rpc_state.calls, call)) {
+    APP_LOG(APP_LOG_LEVEL_ERROR, "Failed to queue SimpleAppMessage RPC call");
+    free(call);
+    return false;
+  }
+
+  // Registered before sending, since a call without its timeout might never be called back
+  call->timer = app_timer_register(timeout_ms, prv_call_timeout_callback, call);
+  if (!call->timer) {
+    APP_LOG(APP_LOG_LEVEL_ERROR, "Failed to register SimpleAppMessage RPC call timeout");
+  }
+  if (!call->timer ||
+      !prv_send(method->name, params, SIMPLE_APP_MESSAGE_RPC_ID_KEY, call->id, NULL)) {
+    if (call->timer) {
+      app_timer_cancel(call->timer);
+    }
+    linked_list_remove(s_rpc_state.calls, (uint16_t)linked_list_find(s_rpc_state.calls, call));
+    free(call);
+    return false;
+  }
+  return true;
+}
+
+bool simple_app_message_rpc_respond(const SimpleAppMessageRpcRequest *request,
+                                    SimpleDict *result) {
+  return (request && prv_send(request->method, result, SIMPLE_APP_MESSAGE_RPC_RESPONSE_KEY,
+                              request->id, NULL));
+}
+
+bool simple_app_message_rpc_respond_error(const SimpleAppMessageRpcRequest *request,
+                                          const char *error) {
+  return (request && prv_send(request->method, NULL /* message */,
+                              SIMPLE_APP_MESSAGE_RPC_RESPONSE_KEY, request->id,
+                              error ? error : ""));
+}
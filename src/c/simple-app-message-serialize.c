@@ -0,0 +1,230 @@
+#include "simple-app-message-serialize.h"
+
+#include "simple-app-message-assembly.h"
+
+//! Number of keys is written as a single byte
+#define SIMPLE_APP_MESSAGE_SERIALIZE_MAX_NUM_KEYS (255)
+
+//! Values up to this fit in the low nibble of a v2 type byte, larger ones follow it as a varint
+#define SIMPLE_APP_MESSAGE_SERIALIZE_MAX_NIBBLE (0xE)
+#define SIMPLE_APP_MESSAGE_SERIALIZE_NIBBLE_VARINT (0xF)
+
+typedef struct SerializeMeasureState {
+  SimpleAppMessageFormat format;
+  size_t size;
+  size_t num_keys;
+  bool valid;
+} SerializeMeasureState;
+
+typedef struct SerializeWriteState {
+  SimpleAppMessageFormat format;
+  uint8_t *cursor;
+} SerializeWriteState;
+
+static uint32_t prv_zig_zag(int32_t value) {
+  return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
+
+static size_t prv_varint_size(uint32_t value) {
+  size_t size = 1;
+  while (value >= 0x80) {
+    value >>= 7;
+    size++;
+  }
+  return size;
+}
+
+static void prv_write_varint(uint8_t **cursor, uint32_t value) {
+  while (value >= 0x80) {
+    *((*cursor)++) = (uint8_t)(value | 0x80);
+    value >>= 7;
+  }
+  *((*cursor)++) = (uint8_t)value;
+}
+
+static size_t prv_nibble_or_varint_size(uint32_t value) {
+  return (value <= SIMPLE_APP_MESSAGE_SERIALIZE_MAX_NIBBLE) ? 0 : prv_varint_size(value);
+}
+
+//! Writes the v2 type byte, followed by value as a varint if it doesn't fit in the low nibble
+static void prv_write_compact_type(uint8_t **cursor, SimpleAppMessageDataType type,
+                                   uint32_t value) {
+  if (value <= SIMPLE_APP_MESSAGE_SERIALIZE_MAX_NIBBLE) {
+    *((*cursor)++) = (uint8_t)((type << 4) | value);
+    return;
+  }
+  *((*cursor)++) = (uint8_t)((type << 4) | SIMPLE_APP_MESSAGE_SERIALIZE_NIBBLE_VARINT);
+  prv_write_varint(cursor, value);
+}
+
+static size_t prv_value_size(SimpleDictDataType type, const void *data, size_t data_size) {
+  switch (type) {
+    case SimpleDictDataType_Raw:
+      return sizeof(uint16_t) + data_size;
+    case SimpleDictDataType_Bool:
+      return sizeof(uint8_t);
+    case SimpleDictDataType_Int:
+      return sizeof(int32_t);
+    case SimpleDictDataType_String:
+      return strlen(data) + 1;
+    case SimpleDictDataTypeCount:
+      break;
+  }
+  return 0;
+}
+
+//! Size of a v2 value, not counting the type byte
+static size_t prv_compact_value_size(SimpleDictDataType type, const void *data,
+                                     size_t data_size) {
+  switch (type) {
+    case SimpleDictDataType_Raw:
+      return prv_nibble_or_varint_size(data_size) + data_size;
+    case SimpleDictDataType_Bool:
+      return 0;
+    case SimpleDictDataType_Int:
+      return prv_nibble_or_varint_size(prv_zig_zag(*((int *)data)));
+    case SimpleDictDataType_String:
+      return strlen(data) + 1;
+    case SimpleDictDataTypeCount:
+      break;
+  }
+  return 0;
+}
+
+static bool prv_measure_callback(const char *key, SimpleDictDataType type, const void *data,
+                                 size_t data_size, void *context) {
+  SerializeMeasureState *state = context;
+  if (!key || (type >= SimpleDictDataTypeCount) ||
+      ((type == SimpleDictDataType_Raw) && (data_size > UINT16_MAX))) {
+    state->valid = false;
+    return false;
+  }
+
+  state->num_keys++;
+  state->size += strlen(key) + 1 + sizeof(uint8_t);
+  state->size += (state->format == SimpleAppMessageFormat_V2) ?
+      prv_compact_value_size(type, data, data_size) : prv_value_size(type, data, data_size);
+  return true;
+}
+
+static void prv_write_value(SerializeWriteState *state, SimpleDictDataType type, const void *data,
+                            size_t data_size) {
+  switch (type) {
+    case SimpleDictDataType_Raw: {
+      *(state->cursor++) = SimpleAppMessageDataType_Data;
+      const uint16_t length = (uint16_t)data_size;
+      memcpy(state->cursor, &length, sizeof(length));
+      state->cursor += sizeof(length);
+      memcpy(state->cursor, data, data_size);
+      state->cursor += data_size;
+      break;
+    }
+    case SimpleDictDataType_Bool:
+      *(state->cursor++) = SimpleAppMessageDataType_Bool;
+      *(state->cursor++) = *((bool *)data) ? 1 : 0;
+      break;
+    case SimpleDictDataType_Int: {
+      *(state->cursor++) = SimpleAppMessageDataType_Int;
+      const int32_t value = *((int *)data);
+      memcpy(state->cursor, &value, sizeof(value));
+      state->cursor += sizeof(value);
+      break;
+    }
+    case SimpleDictDataType_String: {
+      *(state->cursor++) = SimpleAppMessageDataType_String;
+      const size_t string_size = strlen(data) + 1;
+      memcpy(state->cursor, data, string_size);
+      state->cursor += string_size;
+      break;
+    }
+    case SimpleDictDataTypeCount:
+      break;
+  }
+}
+
+static void prv_write_compact_value(SerializeWriteState *state, SimpleDictDataType type,
+                                    const void *data, size_t data_size) {
+  switch (type) {
+    case SimpleDictDataType_Raw:
+      prv_write_compact_type(&state->cursor, SimpleAppMessageDataType_Data, data_size);
+      memcpy(state->cursor, data, data_size);
+      state->cursor += data_size;
+      break;
+    case SimpleDictDataType_Bool:
+      prv_write_compact_type(&state->cursor, SimpleAppMessageDataType_Bool,
+                             *((bool *)data) ? 1 : 0);
+      break;
+    case SimpleDictDataType_Int:
+      prv_write_compact_type(&state->cursor, SimpleAppMessageDataType_Int,
+                             prv_zig_zag(*((int *)data)));
+      break;
+    case SimpleDictDataType_String: {
+      prv_write_compact_type(&state->cursor, SimpleAppMessageDataType_String, 0);
+      const size_t string_size = strlen(data) + 1;
+      memcpy(state->cursor, data, string_size);
+      state->cursor += string_size;
+      break;
+    }
+    case SimpleDictDataTypeCount:
+      break;
+  }
+}
+
+static bool prv_write_callback(const char *key, SimpleDictDataType type, const void *data,
+                               size_t data_size, void *context) {
+  SerializeWriteState *state = context;
+
+  const size_t key_size = strlen(key) + 1;
+  memcpy(state->cursor, key, key_size);
+  state->cursor += key_size;
+
+  if (state->format == SimpleAppMessageFormat_V2) {
+    prv_write_compact_value(state, type, data, data_size);
+  } else {
+    prv_write_value(state, type, data, data_size);
+  }
+  return true;
+}
+
+uint8_t *simple_app_message_serialize(const SimpleDict *dict, SimpleAppMessageFormat format,
+                                      size_t *size_out) {
+  if (!dict || ((format != SimpleAppMessageFormat_V1) && (format != SimpleAppMessageFormat_V2))) {
+    return NULL;
+  }
+
+  const size_t header_size = (format == SimpleAppMessageFormat_V2) ?
+      SIMPLE_APP_MESSAGE_FORMAT_V2_HEADER_SIZE : sizeof(uint8_t);
+  SerializeMeasureState measure_state = {
+    .format = format,
+    .size = header_size,
+    .valid = true,
+  };
+  simple_dict_foreach(dict, prv_measure_callback, &measure_state);
+  if (!measure_state.valid ||
+      (measure_state.num_keys > SIMPLE_APP_MESSAGE_SERIALIZE_MAX_NUM_KEYS)) {
+    APP_LOG(APP_LOG_LEVEL_ERROR, "SimpleDict cannot be serialized for SimpleAppMessage");
+    return NULL;
+  }
+
+  uint8_t *buffer = malloc(measure_state.size);
+  if (!buffer) {
+    APP_LOG(APP_LOG_LEVEL_ERROR, "Failed to malloc buffer for serializing SimpleAppMessage");
+    return NULL;
+  }
+
+  SerializeWriteState write_state = {
+    .format = format,
+    .cursor = buffer,
+  };
+  if (format == SimpleAppMessageFormat_V2) {
+    *(write_state.cursor++) = SIMPLE_APP_MESSAGE_FORMAT_MARKER;
+    *(write_state.cursor++) = SimpleAppMessageFormat_V2;
+  }
+  *(write_state.cursor++) = (uint8_t)measure_state.num_keys;
+  simple_dict_foreach(dict, prv_write_callback, &write_state);
+
+  if (size_out) {
+    *size_out = measure_state.size;
+  }
+  return buffer;
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+#include "simple-app-message.h"
+
+#include "simple-app-message-assembly.h"
+
+#include <pebble.h>
+
+//! Serializes a SimpleDict using the same format as serialize.js, so the phone can decode it with
+//! the same type table the watch uses for incoming messages.
+//! @param format Must be one the phone announced it can decode
+//! @param size_out Set to the number of bytes in the returned buffer
+//! @return Newly allocated buffer that the caller must free, or NULL if the dictionary could not
+//! be serialized
+uint8_t *simple_app_message_serialize(const SimpleDict *dict, SimpleAppMessageFormat format,
+                                      size_t *size_out);
@@ -0,0 +1,278 @@
+#include "simple-app-message-stream.h"
+
+#include "simple-app-message-pool.h"
+
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+
+typedef uint8_t StreamCarrySlot[SIMPLE_APP_MESSAGE_MAX_STREAM_CARRY_SIZE];
+
+//! Every assembly has a stream
+SIMPLE_APP_MESSAGE_POOL_DEFINE(s_carry_pool, StreamCarrySlot, SIMPLE_APP_MESSAGE_MAX_TRANSFERS);
+
+void simple_app_message_stream_init(SimpleAppMessageStream *stream) {
+  if (!stream) {
+    return;
+  }
+  *stream = (SimpleAppMessageStream) {0};
+}
+
+void simple_app_message_stream_reset(SimpleAppMessageStream *stream) {
+  if (!stream) {
+    return;
+  }
+  *stream = (SimpleAppMessageStream) {
+    .carry = stream->carry,
+    .carry_capacity = stream->carry_capacity,
+  };
+}
+
+static bool prv_fail(SimpleAppMessageStream *stream) {
+  stream->failed = true;
+  return false;
+}
+
+static bool prv_carry_append(SimpleAppMessageStream *stream, const uint8_t *data, size_t size) {
+  const size_t required_capacity = stream->carry_size + size;
+  if (required_capacity > stream->carry_capacity) {
+#if SIMPLE_APP_MESSAGE_STATIC_ALLOCATION
+    // Takes a whole slot the first time, which is as large as the carry buffer can get
+    uint8_t *carry = stream->carry ? NULL :
+        simple_app_message_pool_alloc(&s_carry_pool, SIMPLE_APP_MESSAGE_MAX_STREAM_CARRY_SIZE);
+    if (!carry || (required_capacity > SIMPLE_APP_MESSAGE_MAX_STREAM_CARRY_SIZE)) {
+      APP_LOG(APP_LOG_LEVEL_ERROR, "SimpleAppMessage value too long for stream carry buffer");
+      simple_app_message_pool_free(&s_carry_pool, carry);
+      return false;
+    }
+    stream->carry = carry;
+    stream->carry_capacity = SIMPLE_APP_MESSAGE_MAX_STREAM_CARRY_SIZE;
+#else
+    uint8_t *carry = realloc(stream->carry, required_capacity);
+    if (!carry) {
+      APP_LOG(APP_LOG_LEVEL_ERROR, "Failed to grow SimpleAppMessage stream carry buffer");
+      return false;
+    }
+    stream->carry = carry;
+    stream->carry_capacity = required_capacity;
+#endif
+  }
+
+  memcpy(stream->carry + stream->carry_size, data, size);
+  stream->carry_size += size;
+  return true;
+}
+
+//! How much of a chunk to append to finish the entry in the carry buffer. All of it unless the
+//! carry buffer can't grow to hold it, since the entry's remaining length isn't known until it
+//! has been parsed.
+static size_t prv_carry_fill_size(const SimpleAppMessageStream *stream, size_t size) {
+#if SIMPLE_APP_MESSAGE_STATIC_ALLOCATION
+  return MIN(size, SIMPLE_APP_MESSAGE_MAX_STREAM_CARRY_SIZE - stream->carry_size);
+#else
+  return size;
+#endif
+}
+
+static void prv_deliver_entry(const SimpleAppMessageEntry *entry,
+                              SimpleAppMessageStreamEntryCallback callback,
+                              SimpleAppMessageStreamDataPieceCallback piece_callback,
+                              void *context) {
+  if (piece_callback && (entry->type == SimpleAppMessageDataType_Data)) {
+    const SimpleAppMessageDataPiece piece = {
+      .key = entry->key,
+      .data = entry->data,
+      .size = entry->size,
+      .total_size = entry->size,
+    };
+    piece_callback(&piece, context);
+  } else if (callback) {
+    callback(entry, context);
+  }
+}
+
+//! Passes on as much of the data value in progress as data holds
+//! @return Bytes of data that belonged to the value
+static size_t prv_deliver_data_piece(SimpleAppMessageStream *stream, const uint8_t *data,
+                                     size_t size,
+                                     SimpleAppMessageStreamDataPieceCallback piece_callback,
+                                     void *context) {
+  const size_t piece_size = MIN(size, stream->data_size - stream->data_offset);
+  if (piece_size) {
+    const SimpleAppMessageDataPiece piece = {
+      .key = (const char *)stream->carry,
+      .data = data,
+      .size = piece_size,
+      .offset = stream->data_offset,
+      .total_size = stream->data_size,
+    };
+    piece_callback(&piece, context);
+    stream->data_offset += piece_size;
+  }
+
+  if (stream->data_offset == stream->data_size) {
+    stream->in_data_value = false;
+    stream->carry_size = 0;
+    stream->keys_left--;
+  }
+  return piece_size;
+}
+
+typedef enum DataValueResult {
+  //! The entry isn't a data value with its whole header in the buffer
+  DataValueResult_NotStarted,
+  DataValueResult_Started,
+  DataValueResult_Failed,
+} DataValueResult;
+
+//! Starts passing on a data value that runs past end in pieces, keeping only its key. buffer may
+//! be the carry buffer itself.
+static DataValueResult prv_start_data_value(
+    SimpleAppMessageStream *stream, const uint8_t *buffer, const uint8_t *end,
+    SimpleAppMessageStreamDataPieceCallback piece_callback, void *context) {
+  SimpleAppMessageEntry entry;
+  size_t header_size;
+  if (!simple_app_message_deserialize_data_header(stream->format, buffer, end, &entry,
+                                                  &header_size)) {
+    return DataValueResult_NotStarted;
+  }
+
+  const size_t key_size = strlen(entry.key) + 1;
+  if (buffer == stream->carry) {
+    stream->carry_size = key_size;
+  } else if (!prv_carry_append(stream, buffer, key_size)) {
+    return DataValueResult_Failed;
+  }
+
+  stream->in_data_value = true;
+  stream->data_offset = 0;
+  stream->data_size = entry.size;
+  prv_deliver_data_piece(stream, entry.data, end - (const uint8_t *)entry.data, piece_callback,
+                         context);
+  return DataValueResult_Started;
+}
+
+//! Holds on to an entry that runs past the end of the chunk, or starts passing it on in pieces
+static bool prv_hold_incomplete(SimpleAppMessageStream *stream, const uint8_t *buffer,
+                                const uint8_t *end,
+                                SimpleAppMessageStreamDataPieceCallback piece_callback,
+                                void *context) {
+  if (piece_callback) {
+    switch (prv_start_data_value(stream, buffer, end, piece_callback, context)) {
+      case DataValueResult_Started:
+        return true;
+      case DataValueResult_Failed:
+        return prv_fail(stream);
+      case DataValueResult_NotStarted:
+        break;
+    }
+  }
+  if (buffer == stream->carry) {
+    return true;
+  }
+  return prv_carry_append(stream, buffer, end - buffer) || prv_fail(stream);
+}
+
+bool simple_app_message_stream_feed(SimpleAppMessageStream *stream, const uint8_t *data,
+                                    size_t size, SimpleAppMessageStreamEntryCallback callback,
+                                    SimpleAppMessageStreamDataPieceCallback piece_callback,
+                                    void *context) {
+  if (!stream || stream->failed || (size && !data)) {
+    return false;
+  }
+
+  const uint8_t *cursor = data;
+  const uint8_t *end = data + size;
+  if (!stream->started) {
+    if (cursor == end) {
+      return true;
+    }
+    // Senders keep the whole header in the first chunk
+    SimpleAppMessagePayloadHeader header;
+    if (!simple_app_message_deserialize_header(cursor, end - cursor, &header)) {
+      return prv_fail(stream);
+    }
+    stream->format = header.format;
+    stream->keys_left = header.num_keys;
+    cursor += header.size;
+    stream->started = true;
+  }
+
+  // Pass on the rest of a data value that didn't fit in the previous chunks
+  if (stream->in_data_value) {
+    cursor += prv_deliver_data_piece(stream, cursor, end - cursor, piece_callback, context);
+  }
+
+  SimpleAppMessageEntry entry;
+  size_t consumed;
+
+  // Finish the entry left over from the previous chunk
+  if (stream->carry_size && !stream->in_data_value && (cursor < end)) {
+    const size_t carried_size = stream->carry_size;
+    const size_t filled_size = prv_carry_fill_size(stream, end - cursor);
+    if (!prv_carry_append(stream, cursor, filled_size)) {
+      return prv_fail(stream);
+    }
+
+    switch (simple_app_message_deserialize_entry(stream->format, stream->carry,
+                                                 stream->carry + stream->carry_size, &entry,
+                                                 &consumed)) {
+      case SimpleAppMessageDeserializeResult_Incomplete:
+        if (!prv_hold_incomplete(stream, stream->carry, stream->carry + stream->carry_size,
+                                 piece_callback, context) ||
+            (filled_size == (size_t)(end - cursor))) {
+          return !stream->failed;
+        }
+        // What didn't fit in the carry buffer can only be the rest of a value passed on in pieces
+        if (!stream->in_data_value) {
+          APP_LOG(APP_LOG_LEVEL_ERROR, "SimpleAppMessage value too long for stream carry buffer");
+          return prv_fail(stream);
+        }
+        cursor += filled_size;
+        return simple_app_message_stream_feed(stream, cursor, end - cursor, callback,
+                                              piece_callback, context);
+      case SimpleAppMessageDeserializeResult_Malformed:
+        return prv_fail(stream);
+      case SimpleAppMessageDeserializeResult_Complete:
+        break;
+    }
+
+    stream->keys_left--;
+    prv_deliver_entry(&entry, callback, piece_callback, context);
+    stream->carry_size = 0;
+    cursor += consumed - carried_size;
+  }
+
+  while (cursor < end) {
+    if (!stream->keys_left) {
+      return prv_fail(stream);
+    }
+
+    switch (simple_app_message_deserialize_entry(stream->format, cursor, end, &entry,
+                                                 &consumed)) {
+      case SimpleAppMessageDeserializeResult_Incomplete:
+        return prv_hold_incomplete(stream, cursor, end, piece_callback, context);
+      case SimpleAppMessageDeserializeResult_Malformed:
+        return prv_fail(stream);
+      case SimpleAppMessageDeserializeResult_Complete:
+        break;
+    }
+
+    stream->keys_left--;
+    prv_deliver_entry(&entry, callback, piece_callback, context);
+    cursor += consumed;
+  }
+
+  return true;
+}
+
+bool simple_app_message_stream_is_complete(const SimpleAppMessageStream *stream) {
+  return (stream && stream->started && !stream->failed && !stream->keys_left &&
+          !stream->carry_size && !stream->in_data_value);
+}
+
+void simple_app_message_stream_deinit(SimpleAppMessageStream *stream) {
+  if (!stream) {
+    return;
+  }
+  simple_app_message_pool_free(&s_carry_pool, stream->carry);
+  *stream = (SimpleAppMessageStream) {0};
+}
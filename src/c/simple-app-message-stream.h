@@ -0,0 +1,54 @@
+#pragma once
+
+#include "simple-app-message-assembly.h"
+
+#include <pebble.h>
+
+//! Called for each key/value pair as soon as all of its bytes have arrived. The entry points into
+//! either the chunk being fed or the stream's carry buffer, so it is only valid during the call.
+typedef void (*SimpleAppMessageStreamEntryCallback)(const SimpleAppMessageEntry *entry,
+                                                    void *context);
+
+//! Called in place of the entry callback with each piece of a data value, as soon as the bytes of
+//! the piece have arrived. The piece points into the chunk being fed or the carry buffer, so it is
+//! only valid during the call.
+typedef void (*SimpleAppMessageStreamDataPieceCallback)(const SimpleAppMessageDataPiece *piece,
+                                                        void *context);
+
+//! Incremental parser for a payload that arrives one chunk at a time. Entries are decoded straight
+//! out of each chunk, only an entry that straddles a chunk boundary is copied into the carry
+//! buffer until the rest of it arrives. Data values split into pieces never are, the carry buffer
+//! only keeps their key while the rest of the value arrives.
+typedef struct SimpleAppMessageStream {
+  bool started;
+  bool failed;
+  SimpleAppMessageFormat format;
+  uint8_t keys_left;
+  uint8_t *carry;
+  size_t carry_size;
+  size_t carry_capacity;
+  //! Set while a data value is being passed on in pieces
+  bool in_data_value;
+  size_t data_offset;
+  size_t data_size;
+} SimpleAppMessageStream;
+
+void simple_app_message_stream_init(SimpleAppMessageStream *stream);
+
+//! Prepares the stream for the next payload, keeping the carry buffer allocated so a steady stream
+//! of messages doesn't keep reallocating it
+void simple_app_message_stream_reset(SimpleAppMessageStream *stream);
+
+//! Parses the next chunk of the payload, calling callback for every entry it completes
+//! @param piece_callback If not NULL, called with the pieces of every data value instead of
+//! callback, so no data value is ever held whole
+//! @return False if the payload is malformed, after which the stream ignores further chunks
+bool simple_app_message_stream_feed(SimpleAppMessageStream *stream, const uint8_t *data,
+                                    size_t size, SimpleAppMessageStreamEntryCallback callback,
+                                    SimpleAppMessageStreamDataPieceCallback piece_callback,
+                                    void *context);
+
+//! @return True if every key announced by the payload was delivered with no bytes left over
+bool simple_app_message_stream_is_complete(const SimpleAppMessageStream *stream);
+
+void simple_app_message_stream_deinit(SimpleAppMessageStream *stream);
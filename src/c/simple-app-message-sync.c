@@ -0,0 +1,146 @@
+#include "simple-app-message-sync.h"
+
+#include "simple-app-message-config.h"
+#include "simple-app-message-view.h"
+
+#if SIMPLE_APP_MESSAGE_DICT_MESSAGES
+
+typedef struct SyncCopyState {
+  SimpleDict *dict;
+  const SimpleAppMessageEntry *entries;
+  size_t num_entries;
+  bool copied;
+} SyncCopyState;
+
+static const SimpleAppMessageEntry *prv_find(const SimpleAppMessageEntry *entries,
+                                             size_t num_entries, const char *key) {
+  for (size_t i = 0; i < num_entries; i++) {
+    if (strcmp(entries[i].key, key) == 0) {
+      return &entries[i];
+    }
+  }
+  return NULL;
+}
+
+static bool prv_find_int(const SimpleAppMessageEntry *entries, size_t num_entries,
+                         const char *key, int32_t *value_out) {
+  const SimpleAppMessageEntry *entry = prv_find(entries, num_entries, key);
+  if (!entry || (entry->type != SimpleAppMessageDataType_Int)) {
+    return false;
+  }
+  memcpy(value_out, entry->data, sizeof(*value_out));
+  return true;
+}
+
+//! Keys the phone adds start with '#', none of them are part of the state
+static bool prv_is_state_entry(const SimpleAppMessageEntry *entry) {
+  return (entry->key[0] != '#') && (entry->type != SimpleAppMessageDataType_Null);
+}
+
+//! Copies every key of the retained state that the delta doesn't remove
+static bool prv_copy_callback(const char *key, SimpleDictDataType type, const void *data,
+                              size_t data_size, void *context) {
+  SyncCopyState *state = context;
+  const SimpleAppMessageEntry *entry = prv_find(state->entries, state->num_entries, key);
+  if (entry && (entry->type == SimpleAppMessageDataType_Null)) {
+    return true;
+  }
+
+  switch (type) {
+    case SimpleDictDataType_Raw:
+      state->copied = simple_dict_update_data(state->dict, key, data, data_size);
+      break;
+    case SimpleDictDataType_Bool:
+      state->copied = simple_dict_update_bool(state->dict, key, *((bool *)data));
+      break;
+    case SimpleDictDataType_Int:
+      state->copied = simple_dict_update_int(state->dict, key, *((int *)data));
+      break;
+    case SimpleDictDataType_String:
+      state->copied = simple_dict_update_string(state->dict, key, data);
+      break;
+    case SimpleDictDataTypeCount:
+      break;
+  }
+  return state->copied;
+}
+
+static bool prv_has_removals(const SimpleAppMessageEntry *entries, size_t num_entries) {
+  for (size_t i = 0; i < num_entries; i++) {
+    if (entries[i].type == SimpleAppMessageDataType_Null) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool simple_app_message_sync_is_update(const SimpleAppMessageEntry *entries, size_t num_entries) {
+  int32_t generation;
+  return prv_find_int(entries, num_entries, SIMPLE_APP_MESSAGE_SYNC_GENERATION_KEY, &generation);
+}
+
+const SimpleDict *simple_app_message_sync_apply(SimpleAppMessageNamespace *namespace,
+                                                const SimpleAppMessageEntry *entries,
+                                                size_t num_entries) {
+  int32_t generation;
+  if (!namespace ||
+      !prv_find_int(entries, num_entries, SIMPLE_APP_MESSAGE_SYNC_GENERATION_KEY, &generation)) {
+    return NULL;
+  }
+
+  int32_t base;
+  int32_t retained_generation = 0;
+  SimpleDict *retained = simple_app_message_namespace_get_sync_state(namespace,
+                                                                     &retained_generation);
+  const bool is_delta = prv_find_int(entries, num_entries, SIMPLE_APP_MESSAGE_SYNC_BASE_KEY,
+                                     &base);
+  if (is_delta && (!retained || (base != retained_generation))) {
+    APP_LOG(APP_LOG_LEVEL_WARNING, "SimpleAppMessage sync delta for %s is against generation "
+            "%d, not %d", simple_app_message_namespace_get_name(namespace), (int)base,
+            (int)retained_generation);
+    return NULL;
+  }
+
+  // Deltas that only change values are applied in place, removing keys takes a copy
+  SimpleDict *state = retained;
+  if (!is_delta || prv_has_removals(entries, num_entries)) {
+    state = simple_dict_create();
+    SyncCopyState copy_state = {
+      .dict = state,
+      .entries = entries,
+      .num_entries = num_entries,
+      .copied = (state != NULL),
+    };
+    if (state && is_delta) {
+      simple_dict_foreach(retained, prv_copy_callback, &copy_state);
+    }
+    if (!copy_state.copied) {
+      APP_LOG(APP_LOG_LEVEL_ERROR, "Failed to copy SimpleAppMessage sync state");
+      if (state) {
+        simple_dict_destroy(state);
+      }
+      simple_app_message_namespace_set_sync_state(namespace, NULL, 0);
+      return NULL;
+    }
+  }
+
+  bool merged = true;
+  for (size_t i = 0; merged && (i < num_entries); i++) {
+    if (prv_is_state_entry(&entries[i])) {
+      merged = simple_app_message_entry_update_dict(state, &entries[i]);
+    }
+  }
+  if (!merged) {
+    // Half a delta is worse than none, the next one brings the whole state back
+    APP_LOG(APP_LOG_LEVEL_ERROR, "Failed to merge SimpleAppMessage sync update");
+    if (state != retained) {
+      simple_dict_destroy(state);
+    }
+    simple_app_message_namespace_set_sync_state(namespace, NULL, 0);
+    return NULL;
+  }
+
+  simple_app_message_namespace_set_sync_state(namespace, state, generation);
+  return state;
+}
+#endif
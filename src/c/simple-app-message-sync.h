@@ -0,0 +1,28 @@
+#pragma once
+
+#include "simple-app-message.h"
+
+#include "simple-app-message-assembly.h"
+#include "simple-app-message-namespace.h"
+
+#include <pebble.h>
+
+//! Keys the phone adds to the updates simpleAppMessage.sync() sends, must match KEYS in sync.js.
+//! Every update carries the generation of the state it produces, a delta also carries the
+//! generation it was made against. The watch answers a delta it can't apply with the generation it
+//! has, or 0 if it has none, under the resync key.
+#define SIMPLE_APP_MESSAGE_SYNC_GENERATION_KEY ("#gen")
+#define SIMPLE_APP_MESSAGE_SYNC_BASE_KEY ("#base")
+#define SIMPLE_APP_MESSAGE_SYNC_RESYNC_KEY ("#resync")
+
+//! @return True if the message is an update sent with simpleAppMessage.sync()
+bool simple_app_message_sync_is_update(const SimpleAppMessageEntry *entries, size_t num_entries);
+
+//! Merges an update into the state the namespace retains. A full update replaces the state, a
+//! delta is applied to it if it was made against the state's generation, with null values
+//! removing keys.
+//! @return The merged state, owned by the namespace, or NULL if the update doesn't apply and the
+//! phone has to resend the whole state
+const SimpleDict *simple_app_message_sync_apply(SimpleAppMessageNamespace *namespace,
+                                                const SimpleAppMessageEntry *entries,
+                                                size_t num_entries);
@@ -0,0 +1,302 @@
+#include "simple-app-message-view.h"
+
+#include "simple-app-message-config.h"
+
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+
+void simple_app_message_view_init(SimpleAppMessageView *view,
+                                  const SimpleAppMessageEntry *entries, size_t num_entries) {
+  if (!view) {
+    return;
+  }
+
+  *view = (SimpleAppMessageView) {
+    .entries = entries,
+    .num_entries = num_entries,
+  };
+}
+
+size_t simple_app_message_view_get_num_keys(const SimpleAppMessageView *view) {
+  return view ? view->num_entries : 0;
+}
+
+void simple_app_message_view_foreach(const SimpleAppMessageView *view,
+                                     SimpleAppMessageViewForEachCallback callback, void *context) {
+  if (!view || !callback) {
+    return;
+  }
+
+  for (size_t i = 0; i < view->num_entries; i++) {
+    const SimpleAppMessageEntry *entry = &view->entries[i];
+    if (!callback(entry->key, entry->type, entry->data, entry->size, context)) {
+      return;
+    }
+  }
+}
+
+bool simple_app_message_view_find(const SimpleAppMessageView *view, const char *key,
+                                  SimpleAppMessageDataType *type_out, const void **data_out,
+                                  size_t *data_size_out) {
+  if (!view || !key) {
+    return false;
+  }
+
+  for (size_t i = 0; i < view->num_entries; i++) {
+    const SimpleAppMessageEntry *entry = &view->entries[i];
+    if (strcmp(entry->key, key) != 0) {
+      continue;
+    }
+
+    if (type_out) {
+      *type_out = entry->type;
+    }
+    if (data_out) {
+      *data_out = entry->data;
+    }
+    if (data_size_out) {
+      *data_size_out = entry->size;
+    }
+    return true;
+  }
+  return false;
+}
+
+static const void *prv_find_typed(const SimpleAppMessageView *view, const char *key,
+                                  SimpleAppMessageDataType type, size_t *data_size_out) {
+  SimpleAppMessageDataType found_type;
+  const void *data = NULL;
+  if (!simple_app_message_view_find(view, key, &found_type, &data, data_size_out) ||
+      (found_type != type)) {
+    return NULL;
+  }
+  return data;
+}
+
+bool simple_app_message_view_get_bool(const SimpleAppMessageView *view, const char *key,
+                                      bool *value_out) {
+  const uint8_t *data = prv_find_typed(view, key, SimpleAppMessageDataType_Bool, NULL);
+  if (!data) {
+    return false;
+  }
+
+  if (value_out) {
+    *value_out = (*data != 0);
+  }
+  return true;
+}
+
+bool simple_app_message_view_get_int(const SimpleAppMessageView *view, const char *key,
+                                     int32_t *value_out) {
+  const uint8_t *data = prv_find_typed(view, key, SimpleAppMessageDataType_Int, NULL);
+  if (!data) {
+    return false;
+  }
+
+  // Values are packed back to back in the buffer, so this may not be aligned
+  if (value_out) {
+    memcpy(value_out, data, sizeof(*value_out));
+  }
+  return true;
+}
+
+const char *simple_app_message_view_get_string(const SimpleAppMessageView *view,
+                                               const char *key) {
+  return prv_find_typed(view, key, SimpleAppMessageDataType_String, NULL);
+}
+
+const uint8_t *simple_app_message_view_get_data(const SimpleAppMessageView *view, const char *key,
+                                                size_t *size_out) {
+  return prv_find_typed(view, key, SimpleAppMessageDataType_Data, size_out);
+}
+
+bool simple_app_message_view_get_array(const SimpleAppMessageView *view, const char *key,
+                                       SimpleAppMessageArray *array_out) {
+  size_t size;
+  const void *data = prv_find_typed(view, key, SimpleAppMessageDataType_Array, &size);
+  return data && simple_app_message_array_init(array_out, data, size);
+}
+
+bool simple_app_message_view_get_object(const SimpleAppMessageView *view, const char *key,
+                                        SimpleAppMessageObject *object_out) {
+  size_t size;
+  const void *data = prv_find_typed(view, key, SimpleAppMessageDataType_Object, &size);
+  return data && simple_app_message_object_init(object_out, data, size);
+}
+
+#if SIMPLE_APP_MESSAGE_MAX_FORMAT >= 3
+//! Int8 and Uint8 take up one byte, each following pair twice as many as the pair before
+static size_t prv_array_element_size(SimpleAppMessageArrayType type) {
+  return 1 << (type / 2);
+}
+
+bool simple_app_message_array_init(SimpleAppMessageArray *array, const void *data,
+                                   size_t data_size) {
+  const uint8_t *bytes = data;
+  if (!array || !bytes || !data_size || (bytes[0] >= SimpleAppMessageArrayTypeCount)) {
+    return false;
+  }
+
+  const SimpleAppMessageArrayType type = bytes[0];
+  const size_t element_size = prv_array_element_size(type);
+  if ((data_size - 1) % element_size) {
+    return false;
+  }
+
+  *array = (SimpleAppMessageArray) {
+    .type = type,
+    .count = (data_size - 1) / element_size,
+    .elements = bytes + 1,
+  };
+  return true;
+}
+
+//! Elements are read a byte at a time, since they may not be aligned
+static int32_t prv_array_read(const SimpleAppMessageArray *array, size_t index) {
+  const uint8_t *element = array->elements + (index * prv_array_element_size(array->type));
+  switch (array->type) {
+    case SimpleAppMessageArrayType_Int8:
+      return (int8_t)element[0];
+    case SimpleAppMessageArrayType_Uint8:
+      return element[0];
+    case SimpleAppMessageArrayType_Int16:
+      return (int16_t)(element[0] | (element[1] << 8));
+    case SimpleAppMessageArrayType_Uint16:
+      return (uint16_t)(element[0] | (element[1] << 8));
+    case SimpleAppMessageArrayType_Int32:
+    case SimpleAppMessageArrayType_Uint32:
+      return (int32_t)((uint32_t)element[0] | ((uint32_t)element[1] << 8) |
+                       ((uint32_t)element[2] << 16) | ((uint32_t)element[3] << 24));
+    case SimpleAppMessageArrayTypeCount:
+      break;
+  }
+  return 0;
+}
+
+int32_t simple_app_message_array_get_int(const SimpleAppMessageArray *array, size_t index) {
+  if (!array || (index >= array->count)) {
+    return 0;
+  }
+  return prv_array_read(array, index);
+}
+
+size_t simple_app_message_array_copy_ints(const SimpleAppMessageArray *array, size_t first,
+                                          int32_t *ints_out, size_t count) {
+  if (!array || !ints_out || (first >= array->count)) {
+    return 0;
+  }
+
+  const size_t num_copied = MIN(count, array->count - first);
+  for (size_t i = 0; i < num_copied; i++) {
+    ints_out[i] = prv_array_read(array, first + i);
+  }
+  return num_copied;
+}
+
+//! Decodes every key of the object, calling callback with each one if it isn't NULL
+//! @return False if the object is malformed, true if it was walked to the end or the callback
+//! stopped early
+static bool prv_object_walk(const SimpleAppMessageObject *object,
+                            SimpleAppMessageViewForEachCallback callback, void *context) {
+  const uint8_t *cursor = object->entries;
+  const uint8_t *end = object->entries + object->size;
+  for (size_t i = 0; i < object->num_keys; i++) {
+    SimpleAppMessageEntry entry;
+    size_t consumed;
+    if (simple_app_message_deserialize_entry(SimpleAppMessageFormat_V3, cursor, end, &entry,
+                                             &consumed) !=
+        SimpleAppMessageDeserializeResult_Complete) {
+      return false;
+    }
+    cursor += consumed;
+
+    if (callback && !callback(entry.key, entry.type, entry.data, entry.size, context)) {
+      return true;
+    }
+  }
+  return (cursor == end);
+}
+
+bool simple_app_message_object_init(SimpleAppMessageObject *object, const void *data,
+                                    size_t data_size) {
+  const uint8_t *bytes = data;
+  if (!object || !bytes || !data_size) {
+    return false;
+  }
+
+  const SimpleAppMessageObject candidate = {
+    .entries = bytes + 1,
+    .size = data_size - 1,
+    .num_keys = bytes[0],
+  };
+  if (!prv_object_walk(&candidate, NULL, NULL)) {
+    return false;
+  }
+
+  *object = candidate;
+  return true;
+}
+
+void simple_app_message_object_foreach(const SimpleAppMessageObject *object,
+                                       SimpleAppMessageViewForEachCallback callback,
+                                       void *context) {
+  if (!object || !callback) {
+    return;
+  }
+  prv_object_walk(object, callback, context);
+}
+#else
+// Arrays and objects only come in v3, which isn't decoded
+bool simple_app_message_array_init(SimpleAppMessageArray *array, const void *data,
+                                   size_t data_size) {
+  return false;
+}
+
+int32_t simple_app_message_array_get_int(const SimpleAppMessageArray *array, size_t index) {
+  return 0;
+}
+
+size_t simple_app_message_array_copy_ints(const SimpleAppMessageArray *array, size_t first,
+                                          int32_t *ints_out, size_t count) {
+  return 0;
+}
+
+bool simple_app_message_object_init(SimpleAppMessageObject *object, const void *data,
+                                    size_t data_size) {
+  return false;
+}
+
+void simple_app_message_object_foreach(const SimpleAppMessageObject *object,
+                                       SimpleAppMessageViewForEachCallback callback,
+                                       void *context) {}
+#endif
+
+size_t simple_app_message_object_get_num_keys(const SimpleAppMessageObject *object) {
+  return object ? object->num_keys : 0;
+}
+
+bool simple_app_message_entry_update_dict(SimpleDict *dict, const SimpleAppMessageEntry *entry) {
+  switch (entry->type) {
+    case SimpleAppMessageDataType_Data:
+      return simple_dict_update_data(dict, entry->key, entry->data, entry->size);
+    case SimpleAppMessageDataType_Bool:
+      return simple_dict_update_bool(dict, entry->key, *((bool *)entry->data));
+    case SimpleAppMessageDataType_Int: {
+      int32_t int_value;
+      memcpy(&int_value, entry->data, sizeof(int_value));
+      return simple_dict_update_int(dict, entry->key, int_value);
+    }
+    case SimpleAppMessageDataType_String:
+      return simple_dict_update_string(dict, entry->key, entry->data);
+    case SimpleAppMessageDataType_Array:
+    case SimpleAppMessageDataType_Object:
+      // SimpleDict has no types for these, they're kept as data for simple_app_message_array_init()
+      // and simple_app_message_object_init() to read
+      return simple_dict_update_data(dict, entry->key, entry->data, entry->size);
+    case SimpleAppMessageDataType_Null:
+    case SimpleAppMessageDataType_Count:
+      APP_LOG(APP_LOG_LEVEL_WARNING, "Not handling deserialized key %s of type %d", entry->key,
+              entry->type);
+      break;
+  }
+  return true;
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include "simple-app-message.h"
+
+#include "simple-app-message-assembly.h"
+
+#include <pebble.h>
+
+struct SimpleAppMessageView {
+  const SimpleAppMessageEntry *entries;
+  size_t num_entries;
+};
+
+//! Points a view at the entry index of a complete assembly, see
+//! simple_app_message_assembly_get_entries()
+void simple_app_message_view_init(SimpleAppMessageView *view,
+                                  const SimpleAppMessageEntry *entries, size_t num_entries);
+
+//! Adds the entry to dict as message_received sees it, with arrays and objects kept as data.
+//! Null entries are logged and skipped.
+//! @return False if dict couldn't be updated
+bool simple_app_message_entry_update_dict(SimpleDict *dict, const SimpleAppMessageEntry *entry);
@@ -1,186 +1,743 @@
 #include "simple-app-message.h"
 
-#include "simple-app-message-assembly.h"
+#include "simple-app-message-assembly-table.h"
+#include "simple-app-message-compression.h"
+#include "simple-app-message-dispatch-queue.h"
 #include "simple-app-message-namespace.h"
+#include "simple-app-message-outbox.h"
+#include "simple-app-message-pool.h"
+#include "simple-app-message-serialize.h"
+#include "simple-app-message-sync.h"
+#include "simple-app-message-view.h"
 
 #include "pebble-events/pebble-events.h"
 
 #include <pebble.h>
 
 #define MAX(a, b) ((a) > (b) ? (a) : (b))
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
 
 //! SIMPLE_APP_MESSAGE_CHUNK_DATA, SIMPLE_APP_MESSAGE_CHUNK_REMAINING,
-//! SIMPLE_APP_MESSAGE_CHUNK_TOTAL, SIMPLE_APP_MESSAGE_CHUNK_NAMESPACE
+//! SIMPLE_APP_MESSAGE_CHUNK_TOTAL, SIMPLE_APP_MESSAGE_CHUNK_NAMESPACE,
+//! SIMPLE_APP_MESSAGE_CHUNK_TRANSFER_ID
 //! @note: Doesn't include SIMPLE_APP_MESSAGE_CHUNK_SIZE because that should be sent in a separate
-//! message that only includes that key
-#define SIMPLE_APP_MESSAGE_MAX_NUM_KEYS_IN_MESSAGE (4)
-
-//! One uint32_t for each key, namespace max size bytes, one uint32_t for remaining chunk value,
-//! one uint32_t for total chunk value, and at least 1 byte for the chunk size data
-#define SIMPLE_APP_MESSAGE_MIN_INBOX_SIZE                              \
-    ((SIMPLE_APP_MESSAGE_MAX_NUM_KEYS_IN_MESSAGE * sizeof(uint32_t)) + \
-     SIMPLE_APP_MESSAGE_NAMESPACE_MAX_SIZE_BYTES +                     \
-     sizeof(uint32_t) +                                                \
-     sizeof(uint32_t) +                                                \
-     1                                                                 \
+//! message that only includes that key, or SIMPLE_APP_MESSAGE_CHUNK_TRACE because the phone
+//! shrinks the chunks of a transfer it traces to make room for it
+#define SIMPLE_APP_MESSAGE_MAX_NUM_KEYS_IN_MESSAGE (5)
+
+//! Every dictionary starts with a one byte tuple count
+#define SIMPLE_APP_MESSAGE_DICT_HEADER_SIZE (sizeof(uint8_t))
+
+//! Dictionary header, one Tuple header (key, type and length) for each key, namespace max size
+//! bytes, one uint32_t each for the remaining chunk, total chunk and transfer ID values, and at
+//! least 1 byte for the chunk size data
+#define SIMPLE_APP_MESSAGE_MIN_INBOX_SIZE                           \
+    (SIMPLE_APP_MESSAGE_DICT_HEADER_SIZE +                          \
+     (SIMPLE_APP_MESSAGE_MAX_NUM_KEYS_IN_MESSAGE * sizeof(Tuple)) + \
+     SIMPLE_APP_MESSAGE_NAMESPACE_MAX_SIZE_BYTES +                  \
+     sizeof(uint32_t) +                                             \
+     sizeof(uint32_t) +                                             \
+     sizeof(uint32_t) +                                             \
+     1                                                              \
     )
 
+//! Chunks sent to the phone carry the same keys as the chunks received from it
+#define SIMPLE_APP_MESSAGE_MIN_OUTBOX_SIZE (SIMPLE_APP_MESSAGE_MIN_INBOX_SIZE)
+
+//! Outbox requested on open if simple_app_message_request_outbox_size() was never called. Large
+//! enough for the chunk size response and small messages sent to the phone.
+#define SIMPLE_APP_MESSAGE_DEFAULT_OUTBOX_SIZE (SIMPLE_APP_MESSAGE_MIN_OUTBOX_SIZE + 64)
+
+//! Transfers that can be reassembled at the same time unless changed with
+//! simple_app_message_set_max_concurrent_transfers()
+#if SIMPLE_APP_MESSAGE_STATIC_ALLOCATION
+#define SIMPLE_APP_MESSAGE_DEFAULT_MAX_CONCURRENT_TRANSFERS \
+  (MIN(4, SIMPLE_APP_MESSAGE_MAX_TRANSFERS))
+#else
+#define SIMPLE_APP_MESSAGE_DEFAULT_MAX_CONCURRENT_TRANSFERS (4)
+#endif
+
+//! A chunk that carries a one byte SIMPLE_APP_MESSAGE_CHUNK_NAMESPACE_ID instead of the namespace
+//! string has this much more room for data
+#define SIMPLE_APP_MESSAGE_NAMESPACE_ID_EXTRA_CHUNK_BYTES \
+    (SIMPLE_APP_MESSAGE_NAMESPACE_MAX_SIZE_BYTES - sizeof(uint8_t))
+
+//! Dictionary header plus the SIMPLE_APP_MESSAGE_CHUNK_SIZE, SIMPLE_APP_MESSAGE_FORMAT_VERSION,
+//! SIMPLE_APP_MESSAGE_COMPRESSION, SIMPLE_APP_MESSAGE_CHUNK_WINDOW, SIMPLE_APP_MESSAGE_CHUNK_BATCH,
+//! SIMPLE_APP_MESSAGE_CHUNK_TRACE, SIMPLE_APP_MESSAGE_WATCH_OPENED and
+//! SIMPLE_APP_MESSAGE_NAMESPACE_TABLE tuple headers and values, except the table's, in the response
+//! to a chunk size request
+#define SIMPLE_APP_MESSAGE_HANDSHAKE_OVERHEAD \
+    (SIMPLE_APP_MESSAGE_DICT_HEADER_SIZE + (8 * sizeof(Tuple)) + sizeof(uint32_t) + \
+     sizeof(uint8_t) + sizeof(uint16_t) + sizeof(uint8_t) + sizeof(uint8_t) + sizeof(uint8_t) + \
+     sizeof(uint8_t))
+
+//! Chunks of one transfer the phone may send without waiting for the ones before them to be
+//! acknowledged. Phones that send transfer IDs retransmit from the first chunk that failed, so an
+//! assembly ignores chunks it already has and drops chunks that arrive after a missing one.
+#define SIMPLE_APP_MESSAGE_CHUNK_WINDOW (4)
+
+//! Reassembles transfers sent with SIMPLE_APP_MESSAGE_CHUNK_BATCH. Can't be registered, so it
+//! never shares an assembly with a namespace.
+#define SIMPLE_APP_MESSAGE_BATCH_NAMESPACE ("")
+
 typedef struct SimpleAppMessageState {
   bool open;
   // TODO change this to a ref counter so we can provide a safe deinitializer
   bool initialized;
-  LinkedRoot *namespace_list;
+  SimpleAppMessageNamespaceTable *namespaces;
   uint32_t chunk_size;
-  SimpleAppMessageAssembly *assembly;
+  uint32_t outbox_chunk_size;
+  //! Newest payload format both sides decode, learned from the phone's chunk size request
+  SimpleAppMessageFormat phone_format;
+  size_t max_concurrent_transfers;
+  SimpleAppMessageAssemblyTable *assemblies;
+  SimpleAppMessageOutbox *outbox;
+  //! Complete messages that wait for a timer if dispatch_queue_depth isn't 0
+  size_t dispatch_queue_depth;
+  SimpleAppMessageDispatchQueue *dispatch_queue;
+  SimpleAppMessageStats stats;
 } SimpleAppMessageState;
 
 static SimpleAppMessageState s_sam_state;
 
-static void prv_send_chunk_size_response(uint32_t chunk_size) {
-  DictionaryIterator *chunk_size_message_iter;
-  const AppMessageResult chunk_size_begin_result =
-      app_message_outbox_begin(&chunk_size_message_iter);
-  if(chunk_size_begin_result != APP_MSG_OK) {
-    APP_LOG(APP_LOG_LEVEL_ERROR, "Failed to begin writing chunk size response, error code: %d",
-            chunk_size_begin_result);
-    return;
+static uint64_t prv_now_ms(void) {
+  time_t seconds;
+  uint16_t milliseconds;
+  time_ms(&seconds, &milliseconds);
+  return ((uint64_t)seconds * 1000) + milliseconds;
+}
+
+static void prv_count_reset(SimpleAppMessageResetReason reason) {
+  s_sam_state.stats.resets[reason]++;
+}
+
+static void prv_count_completed(SimpleAppMessageNamespace *namespace) {
+  s_sam_state.stats.messages_completed++;
+  simple_app_message_namespace_count_completed(namespace);
+}
+
+//! Records how long a transfer took from its first chunk to its last, which just arrived
+static void prv_count_transfer(uint32_t elapsed_ms) {
+  SimpleAppMessageStats *stats = &s_sam_state.stats;
+  stats->last_transfer_ms = elapsed_ms;
+  stats->max_transfer_ms = MAX(stats->max_transfer_ms, elapsed_ms);
+  stats->total_transfer_ms += elapsed_ms;
+}
+
+static void prv_outbox_sent_callback(const char *namespace_name, bool success, void *context) {
+  SimpleAppMessageNamespace *namespace =
+      simple_app_message_namespace_table_find(s_sam_state.namespaces, namespace_name);
+  SimpleAppMessageCallbacks user_callbacks = (SimpleAppMessageCallbacks) {0};
+  void *user_context = NULL;
+  if (simple_app_message_namespace_get_callbacks(namespace, &user_callbacks, &user_context) &&
+      user_callbacks.message_sent) {
+    user_callbacks.message_sent(success, user_context);
   }
+}
 
-  const DictionaryResult dict_write_result =
-      dict_write_uint32(chunk_size_message_iter, MESSAGE_KEY_SIMPLE_APP_MESSAGE_CHUNK_SIZE,
-                        chunk_size);
-  if (dict_write_result != DICT_OK) {
-    APP_LOG(APP_LOG_LEVEL_ERROR, "Failed to write chunk size response to dict, error code: %d",
-            dict_write_result);
-    return;
+static SimpleAppMessageOutbox *prv_get_outbox(void) {
+  if (!s_sam_state.outbox) {
+    s_sam_state.outbox = simple_app_message_outbox_create(s_sam_state.outbox_chunk_size,
+                                                          prv_outbox_sent_callback, NULL);
+    if (!s_sam_state.outbox) {
+      APP_LOG(APP_LOG_LEVEL_ERROR, "Failed to create SimpleAppMessage outbox");
+    }
   }
+  return s_sam_state.outbox;
+}
 
-  const AppMessageResult chunk_size_send_result = app_message_outbox_send();
-  if (chunk_size_send_result != APP_MSG_OK) {
-    APP_LOG(APP_LOG_LEVEL_ERROR, "Failed to send chunk size response, error code: %d",
-            chunk_size_send_result);
-    return;
+//! Responds with the chunk size, the compression and chunk windows and the IDs of the registered
+//! namespaces, as many as fit in the outbox. The phone sends the namespace string for any
+//! namespace it didn't get an ID for, and only compresses payloads if it got the window.
+//! @param opened Sent unasked when the watch app opens, marked so the phone asks again
+static void prv_send_chunk_size_response(uint32_t chunk_size, bool opened) {
+  const size_t outbox_size = s_sam_state.outbox_chunk_size + SIMPLE_APP_MESSAGE_MIN_OUTBOX_SIZE + 1;
+  const size_t table_buffer_size = outbox_size - SIMPLE_APP_MESSAGE_HANDSHAKE_OVERHEAD;
+  uint8_t *namespace_table = malloc(table_buffer_size);
+  const size_t namespace_table_size =
+      simple_app_message_namespace_table_serialize(s_sam_state.namespaces, namespace_table,
+                                                   table_buffer_size);
+
+  const SimpleAppMessageOutboxHandshake handshake = {
+    .chunk_size = chunk_size,
+    .format_version = SIMPLE_APP_MESSAGE_MAX_FORMAT,
+    .compression_window =
+        SIMPLE_APP_MESSAGE_COMPRESSION ? SIMPLE_APP_MESSAGE_COMPRESSION_WINDOW_SIZE : 0,
+    .chunk_window = SIMPLE_APP_MESSAGE_CHUNK_WINDOW,
+    .batches = SIMPLE_APP_MESSAGE_BATCHES,
+    .traces = true,
+    .opened = opened,
+  };
+  if (!simple_app_message_outbox_enqueue_chunk_size(prv_get_outbox(), &handshake, namespace_table,
+                                                    namespace_table_size)) {
+    APP_LOG(APP_LOG_LEVEL_ERROR, "Failed to queue chunk size response");
   }
 }
 
-static void prv_assembly_deserialize_callback(const char *key,
-                                              SimpleAppMessageAssemblyDataType type,
-                                              const void *value, size_t n, void *context) {
-  SimpleDict *dict = context;
+static void prv_dispatch_view(const SimpleAppMessageEntry *entries, size_t num_entries,
+                              SimpleAppMessageViewReceivedCallback callback, void *user_context) {
+  SimpleAppMessageView view;
+  simple_app_message_view_init(&view, entries, num_entries);
+  callback(&view, user_context);
+}
+
+#if SIMPLE_APP_MESSAGE_DICT_MESSAGES
+//! @note SimpleDict allocates per key, so unlike the view this path can't live in the assembly's
+//! arena
+static void prv_dispatch_dict(const SimpleAppMessageEntry *entries, size_t num_entries,
+                              SimpleAppMessageReceivedCallback callback, void *user_context) {
+  SimpleDict *dict = simple_dict_create();
   if (!dict) {
+    APP_LOG(APP_LOG_LEVEL_ERROR,
+            "Failed to create SimpleDict for deserializing SimpleAppMessage");
     return;
   }
 
-  if (!key) {
-    APP_LOG(APP_LOG_LEVEL_ERROR, "Skipping deserialization of key/value pair with missing key");
-    return;
+  for (size_t i = 0; i < num_entries; i++) {
+    simple_app_message_entry_update_dict(dict, &entries[i]);
   }
 
-  switch (type) {
-    case SimpleAppMessageAssemblyDataType_Data:
-      simple_dict_update_data(dict, key, value, n);
-      break;
-    case SimpleAppMessageAssemblyDataType_Bool:
-      simple_dict_update_bool(dict, key, *((bool *)value));
-      break;
-    case SimpleAppMessageAssemblyDataType_Int:
-      simple_dict_update_int(dict, key, *((int *)value));
-      break;
-    case SimpleAppMessageAssemblyDataType_String:
-      simple_dict_update_string(dict, key, value);
-      break;
-    case SimpleAppMessageAssemblyDataType_Null:
-    case SimpleAppMessageAssemblyDataType_Count:
-      APP_LOG(APP_LOG_LEVEL_WARNING, "Not handling deserialized key %s of type %d", key, type);
-      break;
+  callback(dict, user_context);
+
+  simple_dict_destroy(dict);
+}
+
+//! Asks the phone to send the namespace's whole state with its next sync update
+static void prv_request_resync(SimpleAppMessageNamespace *namespace) {
+  int32_t generation = 0;
+  simple_app_message_namespace_get_sync_state(namespace, &generation);
+  SimpleDict *request = simple_dict_create();
+  if (!request ||
+      !simple_dict_update_int(request, SIMPLE_APP_MESSAGE_SYNC_RESYNC_KEY, generation) ||
+      !simple_app_message_send(simple_app_message_namespace_get_name(namespace), request)) {
+    APP_LOG(APP_LOG_LEVEL_ERROR, "Failed to request SimpleAppMessage resync");
+  }
+  if (request) {
+    simple_dict_destroy(request);
   }
 }
 
-static void prv_app_message_inbox_received_callback(DictionaryIterator *iterator, void *context) {
-  if (!s_sam_state.initialized || !s_sam_state.open) {
-    APP_LOG(APP_LOG_LEVEL_ERROR,
-            "Received SimpleAppMessage packet but module not initialized/open");
+//! Passes on the state the namespace's sync updates add up to, rather than just the update
+static void prv_dispatch_sync(SimpleAppMessageNamespace *namespace,
+                              const SimpleAppMessageEntry *entries, size_t num_entries,
+                              SimpleAppMessageReceivedCallback callback, void *user_context) {
+  const SimpleDict *state = simple_app_message_sync_apply(namespace, entries, num_entries);
+  if (!state) {
+    prv_request_resync(namespace);
     return;
   }
+  callback(state, user_context);
+}
+#endif
+
+static void prv_dispatch_entries(SimpleAppMessageNamespace *namespace,
+                                 const SimpleAppMessageCallbacks *user_callbacks,
+                                 const SimpleAppMessageEntry *entries, size_t num_entries,
+                                 void *user_context) {
+  if (user_callbacks->message_view_received) {
+    prv_dispatch_view(entries, num_entries, user_callbacks->message_view_received, user_context);
+  }
 
-  if (!s_sam_state.assembly) {
-    s_sam_state.assembly = simple_app_message_assembly_create(s_sam_state.chunk_size);
-    if (!s_sam_state.assembly) {
-      APP_LOG(APP_LOG_LEVEL_ERROR, "Failed to create SimpleAppMessage assembly state");
-      return;
+#if SIMPLE_APP_MESSAGE_DICT_MESSAGES
+  if (!user_callbacks->message_received) {
+    return;
+  }
+  if (simple_app_message_sync_is_update(entries, num_entries)) {
+    prv_dispatch_sync(namespace, entries, num_entries, user_callbacks->message_received,
+                      user_context);
+  } else {
+    prv_dispatch_dict(entries, num_entries, user_callbacks->message_received, user_context);
+  }
+#endif
+}
+
+//! Decodes a complete message, either still in its assembly or detached from it to be delivered
+//! later, and records how long it took
+static bool prv_get_entries(SimpleAppMessageAssembly *assembly,
+                            SimpleAppMessageDetachedMessage *detached,
+                            const SimpleAppMessageEntry **entries_out, size_t *num_entries_out,
+                            SimpleAppMessageOutboxTrace *trace) {
+  const uint64_t started_ms = prv_now_ms();
+  const bool is_deserialized = assembly ?
+      simple_app_message_assembly_get_entries(assembly, entries_out, num_entries_out) :
+      simple_app_message_detached_message_get_entries(detached, entries_out, num_entries_out);
+  trace->deserialize_ms = (uint32_t)(prv_now_ms() - started_ms);
+  return is_deserialized;
+}
+
+#if SIMPLE_APP_MESSAGE_BATCHES
+typedef SimpleAppMessageEntry BatchedMessageEntries[SIMPLE_APP_MESSAGE_MAX_KEYS];
+
+//! Batched messages are dispatched one at a time, so they share one entry index
+SIMPLE_APP_MESSAGE_POOL_DEFINE(s_batched_entries_pool, BatchedMessageEntries, 1);
+
+typedef struct BatchedMessageState {
+  SimpleAppMessageEntry *entries;
+  size_t num_entries;
+  size_t max_entries;
+  const SimpleAppMessageCallbacks *user_callbacks;
+  void *user_context;
+} BatchedMessageState;
+
+static bool prv_batched_entry_callback(const SimpleAppMessageEntry *entry, void *context) {
+  BatchedMessageState *state = context;
+  if (state->user_callbacks->data_piece_received &&
+      (entry->type == SimpleAppMessageDataType_Data)) {
+    state->user_callbacks->data_piece_received(entry->key, entry->data, entry->size, 0,
+                                               entry->size, state->user_context);
+  } else if (state->user_callbacks->key_received) {
+    state->user_callbacks->key_received(entry->key, entry->type, entry->data, entry->size,
+                                        state->user_context);
+  }
+  if (state->num_entries < state->max_entries) {
+    simple_app_message_entry_copy(&state->entries[state->num_entries++], entry);
+  }
+  return true;
+}
+
+//! Delivers one message unpacked from a batch to its namespace the same way as if it had been
+//! sent on its own. Its payload lives in the batch's assembly, only the entry index is allocated.
+//! @return True if the message was deserialized and delivered
+static bool prv_dispatch_batched_message(const char *namespace_name, const uint8_t *payload,
+                                         size_t payload_size) {
+  SimpleAppMessageNamespace *namespace =
+      simple_app_message_namespace_table_find(s_sam_state.namespaces, namespace_name);
+  SimpleAppMessageCallbacks user_callbacks = (SimpleAppMessageCallbacks) {0};
+  void *user_context = NULL;
+  SimpleAppMessagePayloadHeader header;
+  if (!simple_app_message_namespace_get_callbacks(namespace, &user_callbacks, &user_context)) {
+    APP_LOG(APP_LOG_LEVEL_ERROR, "Unknown namespace %s in SimpleAppMessage batch",
+            namespace_name);
+    prv_count_reset(SimpleAppMessageResetReason_UnknownNamespace);
+    return false;
+  }
+  if (!simple_app_message_deserialize_header(payload, payload_size, &header)) {
+    APP_LOG(APP_LOG_LEVEL_ERROR, "Dropping batched SimpleAppMessage for namespace %s",
+            namespace_name);
+    prv_count_reset(SimpleAppMessageResetReason_UnexpectedSequence);
+    return false;
+  }
+
+  const bool is_buffered = user_callbacks.message_received || user_callbacks.message_view_received;
+  BatchedMessageState state = {
+    .max_entries = is_buffered ? header.num_keys : 0,
+    .user_callbacks = &user_callbacks,
+    .user_context = user_context,
+  };
+  if (state.max_entries) {
+    const size_t entries_size = state.max_entries * sizeof(SimpleAppMessageEntry);
+    state.entries = simple_app_message_pool_alloc(&s_batched_entries_pool, entries_size);
+    if (!state.entries) {
+      APP_LOG(APP_LOG_LEVEL_ERROR, "Failed to allocate entries for batched SimpleAppMessage");
+      // The static index is only ever too small
+      prv_count_reset(SIMPLE_APP_MESSAGE_STATIC_ALLOCATION ?
+                      SimpleAppMessageResetReason_OversizedMessage :
+                      SimpleAppMessageResetReason_MallocFailure);
+      return false;
     }
   }
 
-  // Send back the chunk size, if requested, and return
-  if (dict_find(iterator, MESSAGE_KEY_SIMPLE_APP_MESSAGE_CHUNK_SIZE)) {
-    APP_LOG(APP_LOG_LEVEL_INFO, "Received request for SimpleAppMessage chunk size");
-    prv_send_chunk_size_response(s_sam_state.chunk_size);
-    return;
+  const bool is_well_formed = simple_app_message_deserialize_buffer(payload, payload_size,
+                                                                    prv_batched_entry_callback,
+                                                                    &state);
+  if (user_callbacks.message_stream_ended) {
+    user_callbacks.message_stream_ended(is_well_formed, user_context);
+  }
+  if (!is_well_formed) {
+    APP_LOG(APP_LOG_LEVEL_ERROR, "Failed to deserialize batched SimpleAppMessage");
+    prv_count_reset(SimpleAppMessageResetReason_UnexpectedSequence);
+  } else {
+    if (is_buffered) {
+      prv_dispatch_entries(namespace, &user_callbacks, state.entries, state.num_entries,
+                           user_context);
+    }
+    prv_count_completed(namespace);
+  }
+  simple_app_message_pool_free(&s_batched_entries_pool, state.entries);
+  return is_well_formed;
+}
+
+//! A batch is an ordinary payload with a data entry per message, keyed by its namespace. Only the
+//! batch's index counts as deserializing, each message is deserialized as it's dispatched.
+//! @return True if every message in the batch was delivered
+static bool prv_dispatch_batch(SimpleAppMessageAssembly *assembly,
+                               SimpleAppMessageDetachedMessage *detached,
+                               SimpleAppMessageOutboxTrace *trace) {
+  const SimpleAppMessageEntry *entries = NULL;
+  size_t num_entries = 0;
+  const bool is_deserialized = prv_get_entries(assembly, detached, &entries, &num_entries, trace);
+  const uint64_t deserialized_ms = prv_now_ms();
+  if (!is_deserialized) {
+    APP_LOG(APP_LOG_LEVEL_ERROR, "Failed to deserialize SimpleAppMessage batch");
+    return false;
+  }
+
+  bool dispatched = true;
+  for (size_t i = 0; i < num_entries; i++) {
+    if (entries[i].type != SimpleAppMessageDataType_Data) {
+      APP_LOG(APP_LOG_LEVEL_WARNING, "Skipping SimpleAppMessage batch entry %s of type %d",
+              entries[i].key, entries[i].type);
+      dispatched = false;
+      continue;
+    }
+    dispatched &= prv_dispatch_batched_message(entries[i].key, entries[i].data, entries[i].size);
+  }
+  trace->dispatch_ms = (uint32_t)(prv_now_ms() - deserialized_ms);
+  return dispatched;
+}
+#else
+//! Batches are rejected as their chunks arrive
+static bool prv_dispatch_batch(SimpleAppMessageAssembly *assembly,
+                               SimpleAppMessageDetachedMessage *detached,
+                               SimpleAppMessageOutboxTrace *trace) {
+  return false;
+}
+#endif
+
+//! Delivers a complete message to its namespace
+//! @return True if the message was deserialized and delivered
+static bool prv_dispatch_message(SimpleAppMessageAssembly *assembly,
+                                 SimpleAppMessageDetachedMessage *detached,
+                                 SimpleAppMessageNamespace *namespace,
+                                 const SimpleAppMessageCallbacks *user_callbacks,
+                                 void *user_context, SimpleAppMessageOutboxTrace *trace) {
+  // Streamed keys have already been delivered chunk by chunk, as part of reassembly
+  if (!user_callbacks->message_received && !user_callbacks->message_view_received) {
+    prv_count_completed(namespace);
+    return true;
+  }
+
+  const SimpleAppMessageEntry *entries = NULL;
+  size_t num_entries = 0;
+  const bool is_deserialized = prv_get_entries(assembly, detached, &entries, &num_entries, trace);
+  const uint64_t deserialized_ms = prv_now_ms();
+  if (!is_deserialized) {
+    APP_LOG(APP_LOG_LEVEL_ERROR, "Failed to deserialize SimpleAppMessage");
+    prv_count_reset(SimpleAppMessageResetReason_UnexpectedSequence);
+    return false;
   }
 
+  prv_dispatch_entries(namespace, user_callbacks, entries, num_entries, user_context);
+  trace->dispatch_ms = (uint32_t)(prv_now_ms() - deserialized_ms);
+  prv_count_completed(namespace);
+  return true;
+}
+
+//! The phone only asks for a trace once the handshake says we send them, and it always sends
+//! transfer IDs by then
+static void prv_echo_trace(const SimpleAppMessageOutboxTrace *trace) {
+  simple_app_message_outbox_enqueue_trace(prv_get_outbox(), trace);
+}
+
+static void prv_dispatch_deferred(SimpleAppMessageDeferredMessage *deferred, void *context) {
+  SimpleAppMessageOutboxTrace *trace = &deferred->trace;
+  if (!deferred->namespace) {
+    trace->dispatched = prv_dispatch_batch(NULL /* assembly */, deferred->message, trace);
+  } else {
+    // The namespace may have been deregistered while the message waited
+    SimpleAppMessageCallbacks user_callbacks = (SimpleAppMessageCallbacks) {0};
+    void *user_context = NULL;
+    trace->dispatched =
+        simple_app_message_namespace_get_callbacks(deferred->namespace, &user_callbacks,
+                                                   &user_context) &&
+        prv_dispatch_message(NULL /* assembly */, deferred->message, deferred->namespace,
+                             &user_callbacks, user_context, trace);
+  }
+  if (deferred->traced) {
+    prv_echo_trace(trace);
+  }
+}
+
+//! Takes a complete message out of its assembly and queues it to be delivered from a timer
+//! @return False if the message has to be delivered right away instead
+static bool prv_defer(SimpleAppMessageAssembly *assembly,
+                      const SimpleAppMessageDeferredMessage *deferred) {
+  if (!s_sam_state.dispatch_queue) {
+    s_sam_state.dispatch_queue =
+        simple_app_message_dispatch_queue_create(s_sam_state.dispatch_queue_depth,
+                                                 prv_dispatch_deferred, NULL);
+    if (!s_sam_state.dispatch_queue) {
+      APP_LOG(APP_LOG_LEVEL_ERROR, "Failed to create SimpleAppMessage dispatch queue");
+      return false;
+    }
+  }
+
+  // Messages that are only streamed aren't buffered, and are finished off right away
+  SimpleAppMessageDeferredMessage queued = *deferred;
+  queued.message = simple_app_message_assembly_detach(assembly);
+  if (!queued.message) {
+    return false;
+  }
+  if (!simple_app_message_dispatch_queue_push(s_sam_state.dispatch_queue, &queued)) {
+    // The phone already has its acks, so the message is delivered now rather than dropped
+    APP_LOG(APP_LOG_LEVEL_WARNING, "Failed to queue SimpleAppMessage, dispatching it now");
+    prv_dispatch_deferred(&queued, NULL /* context */);
+    simple_app_message_detached_message_destroy(queued.message);
+    return true;
+  }
+  s_sam_state.stats.peak_dispatch_queue_depth =
+      MAX(s_sam_state.stats.peak_dispatch_queue_depth,
+          simple_app_message_dispatch_queue_get_depth(s_sam_state.dispatch_queue));
+  return true;
+}
+
+static void prv_stream_key_received(const char *namespace_name, const SimpleAppMessageEntry *entry,
+                                    void *context) {
+  SimpleAppMessageNamespace *namespace =
+      simple_app_message_namespace_table_find(s_sam_state.namespaces, namespace_name);
+  SimpleAppMessageCallbacks user_callbacks = (SimpleAppMessageCallbacks) {0};
+  void *user_context = NULL;
+  if (simple_app_message_namespace_get_callbacks(namespace, &user_callbacks, &user_context) &&
+      user_callbacks.key_received) {
+    user_callbacks.key_received(entry->key, entry->type, entry->data, entry->size, user_context);
+  }
+}
+
+static void prv_stream_data_piece_received(const char *namespace_name,
+                                           const SimpleAppMessageDataPiece *piece, void *context) {
+  SimpleAppMessageNamespace *namespace =
+      simple_app_message_namespace_table_find(s_sam_state.namespaces, namespace_name);
+  SimpleAppMessageCallbacks user_callbacks = (SimpleAppMessageCallbacks) {0};
+  void *user_context = NULL;
+  if (simple_app_message_namespace_get_callbacks(namespace, &user_callbacks, &user_context) &&
+      user_callbacks.data_piece_received) {
+    user_callbacks.data_piece_received(piece->key, piece->data, piece->size, piece->offset,
+                                       piece->total_size, user_context);
+  }
+}
+
+static void prv_stream_ended(const char *namespace_name, bool complete, void *context) {
+  SimpleAppMessageNamespace *namespace =
+      simple_app_message_namespace_table_find(s_sam_state.namespaces, namespace_name);
+  SimpleAppMessageCallbacks user_callbacks = (SimpleAppMessageCallbacks) {0};
+  void *user_context = NULL;
+  if (simple_app_message_namespace_get_callbacks(namespace, &user_callbacks, &user_context) &&
+      user_callbacks.message_stream_ended) {
+    user_callbacks.message_stream_ended(complete, user_context);
+  }
+}
+
+static SimpleAppMessageAssemblyFlags prv_get_assembly_flags(
+    const SimpleAppMessageCallbacks *callbacks) {
+  SimpleAppMessageAssemblyFlags flags = 0;
+  if (callbacks->message_received || callbacks->message_view_received) {
+    flags |= SimpleAppMessageAssemblyFlag_Buffer;
+  }
+  if (callbacks->key_received || callbacks->message_stream_ended) {
+    flags |= SimpleAppMessageAssemblyFlag_Stream;
+  }
+  if (callbacks->data_piece_received) {
+    flags |= SimpleAppMessageAssemblyFlag_Stream | SimpleAppMessageAssemblyFlag_DataPieces;
+  }
+  return flags;
+}
+
+//! @param reason_out Left alone unless the namespace is too long to look up
+static SimpleAppMessageNamespace *prv_find_namespace(DictionaryIterator *iterator,
+                                                     SimpleAppMessageResetReason *reason_out) {
+  const Tuple *message_namespace_id = dict_find(iterator,
+                                                MESSAGE_KEY_SIMPLE_APP_MESSAGE_CHUNK_NAMESPACE_ID);
   const Tuple *message_namespace = dict_find(iterator,
                                              MESSAGE_KEY_SIMPLE_APP_MESSAGE_CHUNK_NAMESPACE);
+  if (message_namespace_id && message_namespace_id->length) {
+    // Sent as a single byte of data, so the first byte is the ID
+    return simple_app_message_namespace_table_find_by_id(s_sam_state.namespaces,
+                                                         message_namespace_id->value->uint8);
+  }
   if (!message_namespace) {
     APP_LOG(APP_LOG_LEVEL_ERROR, "Namespace missing from SimpleAppMessage packet");
-    return;
+    return NULL;
   }
-
   if (strlen(message_namespace->value->cstring) + 1 > SIMPLE_APP_MESSAGE_NAMESPACE_MAX_SIZE_BYTES) {
     APP_LOG(APP_LOG_LEVEL_WARNING,
             "Ignoring SimpleAppMessage packet with namespace larger than max allowed size");
+    *reason_out = SimpleAppMessageResetReason_OversizedNamespace;
+    return NULL;
+  }
+  return simple_app_message_namespace_table_find(s_sam_state.namespaces,
+                                                 message_namespace->value->cstring);
+}
+
+static void prv_app_message_inbox_received_callback(DictionaryIterator *iterator, void *context) {
+  if (!s_sam_state.initialized || !s_sam_state.open) {
+    APP_LOG(APP_LOG_LEVEL_ERROR,
+            "Received SimpleAppMessage packet but module not initialized/open");
     return;
   }
 
-  SimpleAppMessageNamespace *namespace =
-      simple_app_message_namespace_find_in_list(s_sam_state.namespace_list,
-                                                message_namespace->value->cstring,
-                                                NULL /* index */);
+  if (!s_sam_state.assemblies) {
+    const SimpleAppMessageAssemblyStreamHandlers stream_handlers = {
+      .key_received = prv_stream_key_received,
+      .stream_ended = prv_stream_ended,
+      .data_piece_received = prv_stream_data_piece_received,
+    };
+    s_sam_state.assemblies =
+        simple_app_message_assembly_table_create(s_sam_state.chunk_size +
+                                                 SIMPLE_APP_MESSAGE_NAMESPACE_ID_EXTRA_CHUNK_BYTES,
+                                                 s_sam_state.max_concurrent_transfers,
+                                                 &stream_handlers, NULL);
+    if (!s_sam_state.assemblies) {
+      APP_LOG(APP_LOG_LEVEL_ERROR, "Failed to create SimpleAppMessage assembly table");
+      prv_count_reset(SimpleAppMessageResetReason_MallocFailure);
+      return;
+    }
+  }
+
+  // Send back the chunk size, if requested, and return
+  if (dict_find(iterator, MESSAGE_KEY_SIMPLE_APP_MESSAGE_CHUNK_SIZE)) {
+    APP_LOG(APP_LOG_LEVEL_INFO, "Received request for SimpleAppMessage chunk size");
+    // Phones that predate payload formats only decode v1
+    const Tuple *format_version = dict_find(iterator,
+                                            MESSAGE_KEY_SIMPLE_APP_MESSAGE_FORMAT_VERSION);
+    s_sam_state.phone_format = format_version ?
+        MIN(format_version->value->uint32, (uint32_t)SimpleAppMessageFormat_Latest) :
+        SimpleAppMessageFormat_V1;
+    // Asked at the start of every phone session, which numbers its transfers from 1 again
+    simple_app_message_assembly_table_forget_idle(s_sam_state.assemblies);
+    prv_send_chunk_size_response(s_sam_state.chunk_size, false);
+    return;
+  }
+
+  const Tuple *chunk_data = dict_find(iterator,
+                                      MESSAGE_KEY_SIMPLE_APP_MESSAGE_CHUNK_DATA);
+  s_sam_state.stats.chunks_received++;
+  s_sam_state.stats.bytes_received += chunk_data ? chunk_data->length : 0;
+
+  // Batches bundle messages for several namespaces, which are only looked up once it's complete
+  const Tuple *batch = dict_find(iterator, MESSAGE_KEY_SIMPLE_APP_MESSAGE_CHUNK_BATCH);
+  const char *namespace_name = SIMPLE_APP_MESSAGE_BATCH_NAMESPACE;
   SimpleAppMessageCallbacks user_callbacks = (SimpleAppMessageCallbacks) {0};
   void *user_context = NULL;
-  if (!simple_app_message_namespace_get_callbacks(namespace, &user_callbacks, &user_context)) {
-    APP_LOG(APP_LOG_LEVEL_ERROR, "Unknown namespace in SimpleAppMessage packet");
+  SimpleAppMessageAssemblyFlags flags = SimpleAppMessageAssemblyFlag_Buffer;
+  SimpleAppMessageNamespace *namespace = NULL;
+#if !SIMPLE_APP_MESSAGE_BATCHES
+  if (batch) {
+    APP_LOG(APP_LOG_LEVEL_ERROR, "SimpleAppMessage batches aren't supported");
+    prv_count_reset(SimpleAppMessageResetReason_UnexpectedSequence);
     return;
   }
+#endif
+  if (!batch) {
+    SimpleAppMessageResetReason reason = SimpleAppMessageResetReason_UnknownNamespace;
+    namespace = prv_find_namespace(iterator, &reason);
+    if (!simple_app_message_namespace_get_callbacks(namespace, &user_callbacks, &user_context)) {
+      APP_LOG(APP_LOG_LEVEL_ERROR, "Unknown namespace in SimpleAppMessage packet");
+      prv_count_reset(reason);
+      return;
+    }
+    namespace_name = simple_app_message_namespace_get_name(namespace);
+    flags = prv_get_assembly_flags(&user_callbacks);
+  }
 
   const Tuple *chunks_remaining = dict_find(iterator,
                                             MESSAGE_KEY_SIMPLE_APP_MESSAGE_CHUNK_REMAINING);
   const Tuple *total_chunks = dict_find(iterator,
                                         MESSAGE_KEY_SIMPLE_APP_MESSAGE_CHUNK_TOTAL);
-  const Tuple *chunk_data = dict_find(iterator,
-                                      MESSAGE_KEY_SIMPLE_APP_MESSAGE_CHUNK_DATA);
-  if (!simple_app_message_assembly_update(s_sam_state.assembly, message_namespace, total_chunks,
-                                          chunks_remaining, chunk_data)) {
-    APP_LOG(APP_LOG_LEVEL_ERROR, "Unexpected SimpleAppMessage packet received");
+  // Phones that predate transfer IDs send one transfer per namespace at a time
+  const Tuple *transfer_id = dict_find(iterator,
+                                       MESSAGE_KEY_SIMPLE_APP_MESSAGE_CHUNK_TRANSFER_ID);
+  // A resend that arrives late must not take an assembly to start a delivered transfer over
+  if (transfer_id && simple_app_message_assembly_table_is_finished(
+          s_sam_state.assemblies, namespace_name, transfer_id->value->uint32)) {
+    APP_LOG(APP_LOG_LEVEL_DEBUG, "Ignoring resent chunk of SimpleAppMessage transfer %u",
+            (unsigned int)transfer_id->value->uint32);
     return;
   }
-
-  if (!simple_app_message_assembly_is_complete(s_sam_state.assembly)) {
+  SimpleAppMessageAssembly *assembly =
+      simple_app_message_assembly_table_get(s_sam_state.assemblies, namespace_name,
+                                            transfer_id ? transfer_id->value->uint32 : 0);
+  if (!assembly) {
+    prv_count_reset(SimpleAppMessageResetReason_MallocFailure);
     return;
   }
 
-  SimpleDict *dict = simple_dict_create();
-  if (!dict) {
-    APP_LOG(APP_LOG_LEVEL_ERROR,
-            "Failed to create SimpleDict for deserializing SimpleAppMessage");
-    return;
+  if (transfer_id) {
+    flags |= SimpleAppMessageAssemblyFlag_Retransmits;
+  }
+  const bool updated = simple_app_message_assembly_update(assembly, namespace_name, total_chunks,
+                                                          chunks_remaining, chunk_data, flags);
+  SimpleAppMessageResetReason reset_reason;
+  if (simple_app_message_assembly_get_reset_reason(assembly, &reset_reason)) {
+    prv_count_reset(reset_reason);
+  }
+  s_sam_state.stats.peak_assembly_size = MAX(s_sam_state.stats.peak_assembly_size,
+                                             simple_app_message_assembly_get_size(assembly));
+
+  // Ask for just the chunks that went missing rather than waiting for the phone to time out
+  SimpleAppMessageChunkRange missing;
+  const bool is_missing =
+      transfer_id && simple_app_message_assembly_get_missing(assembly, &missing);
+  if (is_missing) {
+    simple_app_message_outbox_enqueue_nack(prv_get_outbox(), transfer_id->value->uint32,
+                                           missing.first, missing.count);
   }
 
-  if (!simple_app_message_deserialize(s_sam_state.assembly, prv_assembly_deserialize_callback,
-                                     dict)) {
-    APP_LOG(APP_LOG_LEVEL_ERROR, "Failed to deserialize SimpleAppMessage");
-    simple_dict_destroy(dict);
+  if (!updated) {
+    // A chunk dropped because it arrived out of order is asked for again, that's expected
+    if (!is_missing) {
+      APP_LOG(APP_LOG_LEVEL_ERROR, "Unexpected SimpleAppMessage packet received");
+    }
     return;
   }
 
-  if (user_callbacks.message_received) {
-    user_callbacks.message_received(dict, user_context);
+  if (!simple_app_message_assembly_is_complete(assembly)) {
+    return;
+  }
+  SimpleAppMessageDeferredMessage deferred = {
+    .namespace = namespace,
+    .trace = {
+      .transfer_id = transfer_id ? transfer_id->value->uint32 : 0,
+      .reassembly_ms = simple_app_message_assembly_get_elapsed_ms(assembly),
+    },
+    .traced = (transfer_id && dict_find(iterator, MESSAGE_KEY_SIMPLE_APP_MESSAGE_CHUNK_TRACE)),
+  };
+  prv_count_transfer(deferred.trace.reassembly_ms);
+  if (s_sam_state.dispatch_queue_depth && prv_defer(assembly, &deferred)) {
+    return;
   }
 
-  simple_dict_destroy(dict);
+  SimpleAppMessageOutboxTrace *trace = &deferred.trace;
+  trace->dispatched = batch ? prv_dispatch_batch(assembly, NULL /* detached */, trace) :
+                              prv_dispatch_message(assembly, NULL /* detached */, namespace,
+                                                   &user_callbacks, user_context, trace);
+  simple_app_message_assembly_release(assembly);
+  if (deferred.traced) {
+    prv_echo_trace(trace);
+  }
 }
 
 static void prv_app_message_inbox_dropped_callback(AppMessageResult reason, void *context) {
   APP_LOG(APP_LOG_LEVEL_ERROR, "SimpleAppMessage packet dropped, reason: %d", reason);
+  s_sam_state.stats.inbox_drops++;
+}
+
+static void prv_app_message_outbox_sent_callback(DictionaryIterator *iterator, void *context) {
+  simple_app_message_outbox_handle_sent(s_sam_state.outbox, iterator);
+}
+
+static void prv_app_message_outbox_failed_callback(DictionaryIterator *iterator,
+                                                   AppMessageResult reason, void *context) {
+  simple_app_message_outbox_handle_failed(s_sam_state.outbox, iterator, reason);
+}
+
+static void prv_init(void) {
+  if (s_sam_state.initialized) {
+    return;
+  }
+
+  if (!s_sam_state.max_concurrent_transfers) {
+    s_sam_state.max_concurrent_transfers = SIMPLE_APP_MESSAGE_DEFAULT_MAX_CONCURRENT_TRANSFERS;
+  }
+
+  events_app_message_subscribe_handlers((EventAppMessageHandlers) {
+    .sent = prv_app_message_outbox_sent_callback,
+    .failed = prv_app_message_outbox_failed_callback,
+    .received = prv_app_message_inbox_received_callback,
+    .dropped = prv_app_message_inbox_dropped_callback,
+  }, NULL);
+
+  s_sam_state.initialized = true;
 }
 
 size_t simple_app_message_get_minimum_inbox_size(void) {
@@ -207,59 +764,165 @@ bool simple_app_message_request_inbox_size(uint32_t inbox_size) {
 
   events_app_message_request_inbox_size(inbox_size);
 
-  if (s_sam_state.initialized) {
-    return true;
+  prv_init();
+  return true;
+}
+
+size_t simple_app_message_get_minimum_outbox_size(void) {
+  return SIMPLE_APP_MESSAGE_MIN_OUTBOX_SIZE;
+}
+
+size_t simple_app_message_get_maximum_outbox_size(void) {
+  return app_message_outbox_size_maximum();
+}
+
+bool simple_app_message_request_outbox_size(uint32_t outbox_size) {
+  if (s_sam_state.open) {
+    return false;
   }
 
-  events_app_message_subscribe_handlers((EventAppMessageHandlers) {
-    .received = prv_app_message_inbox_received_callback,
-    .dropped = prv_app_message_inbox_dropped_callback,
-  }, NULL);
+  // Subtract one to account for the minimum chunk size of 1 included in
+  // SIMPLE_APP_MESSAGE_MIN_OUTBOX_SIZE
+  const int64_t requested_chunk_size =
+      (int64_t)outbox_size - SIMPLE_APP_MESSAGE_MIN_OUTBOX_SIZE - 1;
+  if (requested_chunk_size <= 0) {
+    return false;
+  }
 
-  s_sam_state.initialized = true;
+  s_sam_state.outbox_chunk_size = MAX((uint32_t)requested_chunk_size,
+                                      s_sam_state.outbox_chunk_size);
+
+  events_app_message_request_outbox_size(outbox_size);
+
+  prv_init();
   return true;
 }
 
+void simple_app_message_set_max_concurrent_transfers(size_t max_transfers) {
+  if (!max_transfers) {
+    return;
+  }
+#if SIMPLE_APP_MESSAGE_STATIC_ALLOCATION
+  max_transfers = MIN(max_transfers, SIMPLE_APP_MESSAGE_MAX_TRANSFERS);
+#endif
+
+  s_sam_state.max_concurrent_transfers = max_transfers;
+  simple_app_message_assembly_table_set_max_assemblies(s_sam_state.assemblies, max_transfers);
+}
+
+void simple_app_message_set_dispatch_queue_depth(size_t max_depth) {
+#if SIMPLE_APP_MESSAGE_STATIC_ALLOCATION
+  if (max_depth) {
+    APP_LOG(APP_LOG_LEVEL_ERROR, "Deferred SimpleAppMessage dispatch needs the heap");
+    return;
+  }
+#endif
+  s_sam_state.dispatch_queue_depth = max_depth;
+  // Messages that no longer fit are delivered right away
+  simple_app_message_dispatch_queue_set_max_depth(s_sam_state.dispatch_queue, max_depth);
+}
+
 AppMessageResult simple_app_message_open(void) {
   if (!s_sam_state.initialized) {
     return APP_MSG_INVALID_STATE;
   }
 
+  if (!s_sam_state.outbox_chunk_size) {
+    simple_app_message_request_outbox_size(SIMPLE_APP_MESSAGE_DEFAULT_OUTBOX_SIZE);
+  }
+
   const AppMessageResult open_success = events_app_message_open();
   s_sam_state.open = (open_success == APP_MSG_OK);
+  // Unasked, the response tells a phone that outlived the previous launch to ask again, since
+  // this launch's namespaces may differ and it doesn't know the phone's format yet
+  if (s_sam_state.open) {
+    prv_send_chunk_size_response(s_sam_state.chunk_size, true);
+  }
   return open_success;
 }
 
 bool simple_app_message_register_callbacks(const char *namespace_name,
                                            const SimpleAppMessageCallbacks *callbacks,
                                            void *context) {
-  if (!namespace_name ||
+  // The empty name is reserved for batches
+  if (!namespace_name || !namespace_name[0] ||
       (strlen(namespace_name) + 1 > SIMPLE_APP_MESSAGE_NAMESPACE_MAX_SIZE_BYTES)) {
     return false;
   }
+#if !SIMPLE_APP_MESSAGE_DICT_MESSAGES
+  if (callbacks && callbacks->message_received) {
+    APP_LOG(APP_LOG_LEVEL_ERROR, "message_received isn't supported, use message_view_received");
+    return false;
+  }
+#endif
 
-  if (!s_sam_state.namespace_list) {
-    s_sam_state.namespace_list = linked_list_create_root();
+  if (!s_sam_state.namespaces) {
+    s_sam_state.namespaces = simple_app_message_namespace_table_create();
   }
 
   SimpleAppMessageNamespace *namespace =
-      simple_app_message_namespace_find_in_list(s_sam_state.namespace_list, namespace_name, NULL);
+      simple_app_message_namespace_table_add(s_sam_state.namespaces, namespace_name);
   if (!namespace) {
-    namespace = simple_app_message_namespace_create(namespace_name);
-    linked_list_append(s_sam_state.namespace_list, namespace);
+    return false;
   }
 
-  simple_app_message_namespace_set_callbacks(namespace, callbacks, context);
+  // NULL callbacks would mark the namespace as deregistered
+  const SimpleAppMessageCallbacks no_callbacks = {0};
+  simple_app_message_namespace_set_callbacks(namespace, callbacks ? callbacks : &no_callbacks,
+                                             context);
   return true;
 }
 
 void simple_app_message_deregister_callbacks(const char *namespace_name) {
-  uint16_t index_of_namespace_in_list;
-  SimpleAppMessageNamespace *namespace =
-      simple_app_message_namespace_find_in_list(s_sam_state.namespace_list, namespace_name,
-                                                &index_of_namespace_in_list);
-  if (namespace) {
-    linked_list_remove(s_sam_state.namespace_list, index_of_namespace_in_list);
-    simple_app_message_namespace_destroy(namespace);
+  // The namespace stays in the table so it keeps its ID if it is registered again
+  simple_app_message_namespace_set_callbacks(
+      simple_app_message_namespace_table_find(s_sam_state.namespaces, namespace_name),
+      NULL /* callbacks */, NULL /* context */);
+}
+
+bool simple_app_message_send(const char *namespace_name, const SimpleDict *message) {
+  if (!s_sam_state.open) {
+    APP_LOG(APP_LOG_LEVEL_ERROR, "Cannot send SimpleAppMessage before the module is open");
+    return false;
+  }
+
+  if (!namespace_name ||
+      (strlen(namespace_name) + 1 > SIMPLE_APP_MESSAGE_NAMESPACE_MAX_SIZE_BYTES)) {
+    return false;
+  }
+
+  SimpleAppMessageOutbox *outbox = prv_get_outbox();
+  if (!outbox) {
+    return false;
   }
+
+  // A v2 header must fit in the first chunk. A SimpleDict has no arrays or objects, so v2 is as
+  // compact as it gets even for phones that decode v3.
+  const SimpleAppMessageFormat format =
+      ((s_sam_state.phone_format >= SimpleAppMessageFormat_V2) &&
+       (s_sam_state.outbox_chunk_size >= SIMPLE_APP_MESSAGE_FORMAT_V2_HEADER_SIZE)) ?
+      SimpleAppMessageFormat_V2 : SimpleAppMessageFormat_V1;
+  size_t payload_size = 0;
+  uint8_t *payload = simple_app_message_serialize(message, format, &payload_size);
+  if (!payload) {
+    return false;
+  }
+
+  return simple_app_message_outbox_enqueue_payload(outbox, namespace_name, payload, payload_size);
+}
+
+void simple_app_message_get_stats(SimpleAppMessageStats *stats_out) {
+  if (stats_out) {
+    *stats_out = s_sam_state.stats;
+  }
+}
+
+uint32_t simple_app_message_get_namespace_messages_completed(const char *namespace_name) {
+  return simple_app_message_namespace_get_completed(
+      simple_app_message_namespace_table_find(s_sam_state.namespaces, namespace_name));
+}
+
+void simple_app_message_reset_stats(void) {
+  s_sam_state.stats = (SimpleAppMessageStats) {0};
+  simple_app_message_namespace_table_reset_counts(s_sam_state.namespaces);
 }
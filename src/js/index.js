@@ -2,6 +2,12 @@
 
 var objectToMessageKeys = require('./utils').objectToMessageKeys;
 var serialize = require('./lib/serialize');
+var deserialize = require('./lib/deserialize');
+var compress = require('./lib/compress');
+var FORMATS = require('./lib/formats');
+var Link = require('./lib/link');
+var Rpc = require('./lib/rpc');
+var Sync = require('./lib/sync');
 var Plite = require('plite');
 
 /**
@@ -11,37 +17,227 @@ var simpleAppMessage = {};
 
 simpleAppMessage._chunkSize = 0;
 simpleAppMessage._timeout = 10000;
+// least delay between chunks, the link controller adds to it when chunks fail
 /* istanbul ignore next */
 simpleAppMessage._chunkDelay = Pebble.platform === 'pypkjs' ? 40 : 0;
+simpleAppMessage._link = new Link();
 simpleAppMessage._maxNamespaceLenth = 16;
+simpleAppMessage._subscriptions = {};
+simpleAppMessage._assemblies = {};
+simpleAppMessage._receiveHandler = null;
+simpleAppMessage._transferId = 0;
+simpleAppMessage._namespaceIds = {};
+simpleAppMessage._format = FORMATS.V1;
+simpleAppMessage._compressionWindow = 0;
+// most chunks of one message in flight at once, if the watch allows it
+simpleAppMessage._windowSize = 4;
+simpleAppMessage._chunkWindow = 1;
+// times a chunk is resent before the send fails
+simpleAppMessage._maxRetries = 3;
+// resend functions of sends the watch may still NACK, keyed by transfer ID
+simpleAppMessage._transfers = {};
+simpleAppMessage._nackHandler = null;
+// ms to hold sends back for so they go out as one transfer, 0 sends right away
+simpleAppMessage._batchWindow = 0;
+simpleAppMessage._batches = false;
+simpleAppMessage._batch = null;
+// priority and supersede flag, keyed by namespace
+simpleAppMessage._namespaceOptions = {};
+// messages waiting for their turn, highest priority first
+simpleAppMessage._sendQueue = [];
+// namespaces with a message being sent
+simpleAppMessage._sending = {};
+// transfers that haven't been acked in full yet
+simpleAppMessage._activeTransfers = [];
+// called with the timeline of every transfer, if the watch echoes traces
+simpleAppMessage._traceHandler = null;
+simpleAppMessage._traceEchoes = false;
+// timelines waiting for the watch's trace, keyed by transfer ID
+simpleAppMessage._tracedTransfers = {};
+// created by the first call or handler
+simpleAppMessage._rpc = null;
+// created by the first sync
+simpleAppMessage._sync = null;
+// the watch's answer to the chunk size request, shared by every send until
+// the watch app restarts
+simpleAppMessage._handshake = null;
+// the request waiting for that answer, if any
+simpleAppMessage._handshakeRequest = null;
+simpleAppMessage._handshakeHandler = null;
+
+// sends chunks of a batch, reserved on the watch
+var BATCH_NAMESPACE = '';
+
+// the SIMPLE_APP_MESSAGE_CHUNK_TRACE tuple header and value, traced chunks
+// carry that much less data so they still fit the watch's inbox
+var TRACE_OVERHEAD = 8;
 
 /**
- * @param {string} namespace
- * @param {object} data
- * @param {function} callback
+ * @param {Array} bytes
+ * @param {number} count
+ * @return {Array.<number>} the first count little endian uint32s in bytes
+ */
+function readWords(bytes, count) {
+  var words = [];
+  for (var offset = 0; offset < count * 4; offset += 4) {
+    // >>> 0 keeps it unsigned
+    words.push((bytes[offset] | (bytes[offset + 1] << 8) |
+                (bytes[offset + 2] << 16) | (bytes[offset + 3] << 24)) >>> 0);
+  }
+  return words;
+}
+
+// what a message dropped in favour of a newer one is called back with
+var SUPERSEDED = {
+  error: 'simpleAppMessage: superseded by a newer message',
+  superseded: true
+};
+
+/**
+ * Ask the watch for its chunk size ahead of the first send, which otherwise
+ * waits a round trip for it. Called on ready, and again whenever the watch app
+ * restarts. Sends made before the watch answers share the request.
+ * @return {Plite} resolved once the watch answers, rejected with the error if
+ * it doesn't, in which case the next send asks again
+ */
+simpleAppMessage.init = function() {
+  var self = this;
+
+  if (!self._handshakeHandler) {
+    self._handshakeHandler = function(e) {
+      self._handleHandshake(e);
+    };
+    Pebble.addEventListener('appmessage', self._handshakeHandler);
+  }
+
+  if (!self._handshake) {
+    var request = {};
+    self._handshake = Plite(function(resolve, reject) {
+      request.resolve = resolve;
+      request.reject = reject;
+    });
+    self._requestHandshake(request);
+  }
+  return self._handshake;
+};
+
+/**
+ * @private
+ * @param {object} request - settles the shared handshake
  * @return {void}
  */
-simpleAppMessage.send = function(namespace, data, callback) {
+simpleAppMessage._requestHandshake = function(request) {
   var self = this;
-  var requestTimeout;
 
-  var chunkSizeResponseHandler = function(e) {
-    var chunkSize = e.payload['SIMPLE_APP_MESSAGE_CHUNK_SIZE'];
+  self._handshakeRequest = request;
+  request.timeout = setTimeout(function() {
+    self._endHandshakeRequest(
+      request, 'simpleAppMessage: Request for chunk size timed out.');
+  }, self._timeout);
 
-    // this app message was not meant for us.
-    if (typeof chunkSize === 'undefined') {
-      return;
+  Pebble.sendAppMessage(
+    objectToMessageKeys({
+      SIMPLE_APP_MESSAGE_CHUNK_SIZE: 1,
+      SIMPLE_APP_MESSAGE_FORMAT_VERSION: FORMATS.LATEST
+    }),
+    function() {},
+    function(error) {
+      console.log('simpleAppMessage: Failed to request chunk size.');
+      console.log(JSON.stringify(error));
+      self._endHandshakeRequest(request, error);
     }
+  );
+};
 
-    clearTimeout(requestTimeout);
+/**
+ * @private
+ * @param {object} request
+ * @param {*} [error] - fails the handshake, so the next send asks again
+ * @return {void}
+ */
+simpleAppMessage._endHandshakeRequest = function(request, error) {
+  // already answered or timed out
+  if (this._handshakeRequest !== request) {
+    return;
+  }
 
-    if (!chunkSize || chunkSize <= 0) {
-      throw new Error('simpleAppMessage: Fetched chunk size is invalid.');
+  clearTimeout(request.timeout);
+  this._handshakeRequest = null;
+  if (typeof error === 'undefined') {
+    request.resolve();
+  } else {
+    this._handshake = null;
+    request.reject(error);
+  }
+};
+
+/**
+ * Learn the watch's chunk size and what it supports from its answer to the
+ * chunk size request
+ * @private
+ * @param {object} e - appmessage event
+ * @return {void}
+ */
+simpleAppMessage._handleHandshake = function(e) {
+  var self = this;
+  var payload = e.payload;
+  var chunkSize = payload['SIMPLE_APP_MESSAGE_CHUNK_SIZE'];
+
+  // this app message was not meant for us.
+  if (typeof chunkSize === 'undefined') {
+    return;
+  }
+
+  var request = self._handshakeRequest;
+  if (payload['SIMPLE_APP_MESSAGE_WATCH_OPENED']) {
+    // the watch app restarted, so it may have other namespaces and doesn't
+    // know which format we send. A request in flight is answered by the watch
+    // as it is now.
+    if (!request) {
+      self._handshake = null;
+      self.init();
     }
+    return;
+  }
 
-    self._chunkSize = chunkSize;
-    self._sendData(namespace, data, callback);
-  };
+  // the answer to a request that already timed out
+  if (!request) {
+    return;
+  }
+
+  if (!chunkSize || chunkSize <= 0) {
+    self._endHandshakeRequest(
+      request, 'simpleAppMessage: Fetched chunk size is invalid.');
+    return;
+  }
+
+  self._chunkSize = chunkSize;
+  self._namespaceIds = self._parseNamespaceTable(
+    payload['SIMPLE_APP_MESSAGE_NAMESPACE_TABLE'] || []
+  );
+  // watches that predate payload formats only decode v1
+  self._format = Math.min(
+    payload['SIMPLE_APP_MESSAGE_FORMAT_VERSION'] || FORMATS.V1,
+    FORMATS.LATEST
+  );
+  // only watches that announce a window decompress
+  self._compressionWindow = payload['SIMPLE_APP_MESSAGE_COMPRESSION'] || 0;
+  // watches that don't announce a window drop a message if its chunks
+  // arrive out of order
+  self._chunkWindow = payload['SIMPLE_APP_MESSAGE_CHUNK_WINDOW'] || 1;
+  self._batches = !!payload['SIMPLE_APP_MESSAGE_CHUNK_BATCH'];
+  self._traceEchoes = !!payload['SIMPLE_APP_MESSAGE_CHUNK_TRACE'];
+  self._endHandshakeRequest(request);
+};
+
+/**
+ * @param {string} namespace
+ * @param {object} data
+ * @param {function} callback
+ * @return {void}
+ */
+simpleAppMessage.send = function(namespace, data, callback) {
+  var self = this;
 
   if (namespace.length > simpleAppMessage._maxNamespaceLenth) {
     callback({
@@ -51,30 +247,284 @@ simpleAppMessage.send = function(namespace, data, callback) {
     return;
   }
 
-  if (!self._chunkSize) {
+  if (namespace === BATCH_NAMESPACE) {
+    callback({error: 'simpleAppMessage: namespace must not be empty'});
+    return;
+  }
 
-    // fetch chunk size
-    Pebble.addEventListener('appmessage', chunkSizeResponseHandler);
+  // a restarted watch is asked again before anything else is sent to it
+  if (self._chunkSize && !self._handshakeRequest) {
+    self._queueSend(namespace, data, callback);
+    return;
+  }
 
-    Pebble.sendAppMessage(
-      objectToMessageKeys({SIMPLE_APP_MESSAGE_CHUNK_SIZE: 1}),
-      function() {},
-      function(error) {
-        console.log('simpleAppMessage: Failed to request chunk size.');
-        console.log(JSON.stringify(error));
-        callback(error);
-      }
-    );
+  self.init().then(function() {
+    self._queueSend(namespace, data, callback);
+  }, callback);
+};
 
-    requestTimeout = setTimeout(function() {
-      Pebble.removeEventListener('appmessage', chunkSizeResponseHandler);
-      callback('simpleAppMessage: Request for chunk size timed out.');
-    }, self._timeout);
-  } else {
-    self._sendData(namespace, data, callback);
+/**
+ * Hold sends back for up to _batchWindow so small messages for several
+ * namespaces go out as one transfer. A batch is sent early once it fills a
+ * chunk, or before it would take a second message for the same namespace.
+ * @param {number} window - ms, 0 sends every message right away
+ * @return {void}
+ */
+simpleAppMessage.setBatchWindow = function(window) {
+  this._batchWindow = window;
+  if (!window) {
+    this._flushBatch();
   }
 };
 
+/**
+ * Set how messages for a namespace are scheduled
+ * @param {string} namespace
+ * @param {object} options
+ * @param {number} [options.priority=0] - messages with a higher priority are
+ * sent first, and take over the link from transfers with a lower priority at
+ * the next chunk. They also skip the batch window.
+ * @param {boolean} [options.supersede=false] - drop messages for the
+ * namespace that haven't started sending once a newer one is sent. Their
+ * callbacks are called with {error, superseded: true}.
+ * @return {void}
+ */
+simpleAppMessage.setNamespaceOptions = function(namespace, options) {
+  this._namespaceOptions[namespace] = {
+    priority: options.priority || 0,
+    supersede: !!options.supersede
+  };
+};
+
+/**
+ * Trace every transfer from here on, if the watch echoes traces. Once the
+ * watch has dispatched a traced transfer it reports how long reassembling,
+ * deserializing and the namespace's callbacks took. Times in the timeline
+ * are ms since the send started, the chunks list has an entry per attempt.
+ * A batch is traced as one transfer for the namespace ''.
+ * @param {function} [handler] - called with {namespace, transferId, size,
+ * start, serialize, chunks: [{index, size, sent, acked, error}], acked,
+ * error, watch: {echoed, reassembly, deserialize, dispatch, dispatched}}
+ * once the watch's trace arrives, or without watch once the send fails or
+ * the watch's trace doesn't arrive in time. Omit it to stop tracing.
+ * @return {void}
+ */
+simpleAppMessage.setTraceHandler = function(handler) {
+  this._traceHandler = handler || null;
+};
+
+/**
+ * @private
+ * @param {string} namespace
+ * @return {{priority: number, supersede: boolean}}
+ */
+simpleAppMessage._getNamespaceOptions = function(namespace) {
+  return this._namespaceOptions[namespace] ||
+         {priority: 0, supersede: false};
+};
+
+/**
+ * @private
+ * @param {string} namespace
+ * @param {object} data
+ * @param {function} callback
+ * @return {void}
+ */
+simpleAppMessage._queueSend = function(namespace, data, callback) {
+  var self = this;
+  var options = self._getNamespaceOptions(namespace);
+
+  // watches that don't announce batches can't unpack them
+  if (!self._batchWindow || !self._batches || options.priority > 0) {
+    self._scheduleSend(namespace, data, callback);
+    return;
+  }
+
+  if (options.supersede) {
+    self._dropQueued(namespace);
+  }
+  var payload = serialize(data, self._format);
+  if (self._batch && self._batch.payloads[namespace]) {
+    if (options.supersede) {
+      self._dropBatched(namespace);
+    } else {
+      self._flushBatch();
+    }
+  }
+  if (!self._batch) {
+    self._batch = {
+      payloads: {},
+      messages: [],
+      size: 0,
+      timer: setTimeout(function() {
+        self._flushBatch();
+      }, self._batchWindow)
+    };
+  }
+
+  var batch = self._batch;
+  // the namespace, data type and length in front of the payload
+  var size = namespace.length + 4 + payload.length;
+  batch.payloads[namespace] = payload;
+  batch.messages.push({
+    namespace: namespace,
+    data: data,
+    callback: callback,
+    size: size
+  });
+  batch.size += size;
+
+  if (batch.size >= self._link.chunkSize(self._chunkSize) ||
+      batch.messages.length === 255) {
+    self._flushBatch();
+  }
+};
+
+/**
+ * Take the message for namespace back out of the batch, for a newer one that
+ * supersedes it
+ * @private
+ * @param {string} namespace
+ * @return {void}
+ */
+simpleAppMessage._dropBatched = function(namespace) {
+  var batch = this._batch;
+
+  delete batch.payloads[namespace];
+  batch.messages = batch.messages.filter(function(message) {
+    if (message.namespace !== namespace) {
+      return true;
+    }
+    batch.size -= message.size;
+    message.callback(SUPERSEDED);
+    return false;
+  });
+};
+
+/**
+ * Take the messages for namespace that haven't started sending off the
+ * queue, for a newer one that supersedes them
+ * @private
+ * @param {string} namespace
+ * @return {void}
+ */
+simpleAppMessage._dropQueued = function(namespace) {
+  this._sendQueue = this._sendQueue.filter(function(message) {
+    if (message.namespace !== namespace) {
+      return true;
+    }
+    message.callback(SUPERSEDED);
+    return false;
+  });
+};
+
+/**
+ * Send the messages held back so far. The watch unpacks a batch into the
+ * messages it holds and delivers each to its namespace.
+ * @private
+ * @return {void}
+ */
+simpleAppMessage._flushBatch = function() {
+  var batch = this._batch;
+  if (!batch) {
+    return;
+  }
+  clearTimeout(batch.timer);
+  this._batch = null;
+
+  if (batch.messages.length === 1) {
+    var message = batch.messages[0];
+    this._scheduleSend(message.namespace, message.data, message.callback);
+    return;
+  }
+
+  this._scheduleSend(BATCH_NAMESPACE, batch.payloads, function(result) {
+    batch.messages.forEach(function(batched) {
+      batched.callback(result);
+    });
+  });
+};
+
+/**
+ * Queue a message behind those with the same or a higher priority. Messages
+ * for a namespace are sent one at a time, in order.
+ * @private
+ * @param {string} namespace
+ * @param {object} data
+ * @param {function} callback
+ * @return {void}
+ */
+simpleAppMessage._scheduleSend = function(namespace, data, callback) {
+  var options = this._getNamespaceOptions(namespace);
+
+  if (options.supersede) {
+    this._dropQueued(namespace);
+  }
+  var queue = this._sendQueue;
+
+  var position = 0;
+  while (position < queue.length &&
+         queue[position].priority >= options.priority) {
+    position++;
+  }
+  queue.splice(position, 0, {
+    namespace: namespace,
+    data: data,
+    callback: callback,
+    priority: options.priority
+  });
+
+  this._pumpSends();
+};
+
+/**
+ * Start the queued messages that may go now, then let the transfers in
+ * progress send what their windows and priorities allow
+ * @private
+ * @return {void}
+ */
+simpleAppMessage._pumpSends = function() {
+  var self = this;
+  var starting = [];
+
+  // off the queue before any starts, since one that finishes right away pumps
+  // the queue again
+  self._sendQueue = self._sendQueue.filter(function(message) {
+    if (self._sending[message.namespace] ||
+        self._isPreempted(message.priority)) {
+      return true;
+    }
+
+    self._sending[message.namespace] = true;
+    starting.push(message);
+    return false;
+  });
+
+  starting.forEach(function(message) {
+    self._sendData(message.namespace, message.data, function(result) {
+      delete self._sending[message.namespace];
+      message.callback(result);
+      self._pumpSends();
+    });
+  });
+
+  self._activeTransfers.slice().forEach(function(transfer) {
+    transfer.pump();
+  });
+};
+
+/**
+ * @private
+ * @param {number} priority
+ * @return {boolean} true if a transfer with a higher priority has chunks
+ * waiting to be sent
+ */
+simpleAppMessage._isPreempted = function(priority) {
+  return this._activeTransfers.some(function(transfer) {
+    return transfer.priority > priority && transfer.isWaiting();
+  });
+};
+
 /**
  * @private
  * @param {string} namespace
@@ -84,48 +534,634 @@ simpleAppMessage.send = function(namespace, data, callback) {
  */
 simpleAppMessage._sendData = function(namespace, data, callback) {
   var self = this;
-  var dataSerialized = serialize(data);
   var chunks = [];
+  var start = Date.now();
 
   if (!self._chunkSize) {
     throw new Error('simpleAppMessage: Chunk size is invalid');
   }
 
-  while (dataSerialized.length > 0) {
-    chunks.push(dataSerialized.splice(0, self._chunkSize));
+  // a one byte namespace ID or batch flag leaves room for the bytes the
+  // namespace string would have taken up
+  var chunkSize = self._link.chunkSize(self._chunkSize);
+  if (self._namespaceIds[namespace] || namespace === BATCH_NAMESPACE) {
+    chunkSize += self._maxNamespaceLenth - 1;
+  }
+  var isTraced = !!self._traceHandler && self._traceEchoes;
+  if (isTraced) {
+    chunkSize = Math.max(1, chunkSize - TRACE_OVERHEAD);
   }
 
-  var chain = Plite.resolve(true);
-  chunks.forEach(function(chunk, index) {
-    chain = chain.then(function() {
-      var remaining = chunks.length - index - 1;
-      return self._sendChunk(namespace, chunk, remaining, chunks.length);
-    });
+  // the watch needs the whole v2 header in the first chunk
+  var format = chunkSize >= FORMATS.V2_HEADER_SIZE ? self._format : FORMATS.V1;
+  var dataSerialized = serialize(data, format);
+
+  if (self._compressionWindow && chunkSize >= compress.HEADER_MAX_SIZE) {
+    dataSerialized = compress(dataSerialized, Object.keys(data).length,
+                              self._compressionWindow) || dataSerialized;
+  }
+
+  // views into the payload, nothing is copied until a chunk is sent
+  for (var offset = 0; offset < dataSerialized.length; offset += chunkSize) {
+    chunks.push(dataSerialized.subarray(offset, offset + chunkSize));
+  }
+
+  // lets the watch tell apart chunks of sends that are in flight at the same
+  // time, so they don't reset each other's reassembly
+  var transferId = self._transferId = (self._transferId + 1) % 0x10000;
+
+  var trace = isTraced ? {
+    namespace: namespace,
+    transferId: transferId,
+    size: dataSerialized.length,
+    start: start,
+    serialize: Date.now() - start,
+    chunks: [],
+    acked: null,
+    watch: null
+  } : null;
+
+  self._sendChunks(namespace, chunks, transferId, callback, trace);
+};
+
+/**
+ * Keep up to a window of chunks in flight. Only the chunks that fail, or that
+ * the watch reports missing, are sent again. Gaps are filled before anything
+ * after them, since the watch keeps chunks that arrive early only for
+ * messages it buffers whole. The watch only reports chunks missing when
+ * later ones arrive, so those resends don't count against _maxRetries. While
+ * a transfer with a higher priority has chunks waiting, no new ones are sent.
+ * @private
+ * @param {string} namespace
+ * @param {Array.<Uint8Array>} chunks
+ * @param {number} transferId
+ * @param {function} callback - called with the last ack once
+ * every chunk is acknowledged, or with the error once a chunk has been resent
+ * more than _maxRetries times
+ * @param {object} [trace] - timeline to record the chunks in, reported once
+ * the watch echoes its trace
+ * @return {void}
+ */
+simpleAppMessage._sendChunks = function(namespace, chunks, transferId,
+                                        callback, trace) {
+  var self = this;
+  var windowSize = Math.max(1, Math.min(self._windowSize, self._chunkWindow));
+  // indices of the chunks waiting to be sent, in ascending order
+  var queue = chunks.map(function(chunk, index) {
+    return index;
   });
+  var inFlight = {};
+  var numInFlight = 0;
+  var acked = {};
+  var numAcked = 0;
+  var retries = {};
+  var finished = false;
+  var failed = false;
+  var transfer = {
+    priority: self._getNamespaceOptions(namespace).priority,
+    isWaiting: function() {
+      return !failed && queue.length > 0;
+    },
+    pump: pump
+  };
+
+  /**
+   * @return {void}
+   */
+  function finish() {
+    finished = true;
+    self._activeTransfers.splice(self._activeTransfers.indexOf(transfer), 1);
+  }
+
+  /**
+   * @param {number} index
+   * @return {void}
+   */
+  function enqueue(index) {
+    if (acked[index]) {
+      delete acked[index];
+      numAcked--;
+    }
+
+    var position = 0;
+    while (position < queue.length && queue[position] < index) {
+      position++;
+    }
+    queue.splice(position, 0, index);
+  }
+
+  /**
+   * @param {number} index
+   * @param {*} error
+   * @return {void}
+   */
+  function retry(index, error) {
+    retries[index] = (retries[index] || 0) + 1;
+    if (retries[index] > self._maxRetries) {
+      failed = true;
+      self._forgetTransfer(transferId, resend);
+      if (!finished) {
+        finish();
+        callback(error);
+        if (trace) {
+          trace.error = error;
+          self._reportTrace(trace);
+        }
+      }
+      return;
+    }
+    enqueue(index);
+  }
+
+  /**
+   * Chunks the watch asks for after the transfer finished are resent
+   * regardless of priority
+   * @return {void}
+   */
+  function pump() {
+    while (!failed && numInFlight < windowSize && queue.length &&
+           (finished || !self._isPreempted(transfer.priority))) {
+      send(queue.shift());
+    }
+  }
+
+  /**
+   * @param {number} index
+   * @return {void}
+   */
+  function send(index) {
+    var remaining = chunks.length - index - 1;
+    inFlight[index] = true;
+    numInFlight++;
+
+    self._sendChunk(namespace, chunks[index], remaining, chunks.length,
+                    transferId, trace)
+      .then(function(result) {
+        delete inFlight[index];
+        numInFlight--;
+        acked[index] = true;
+        numAcked++;
+        if (!finished && numAcked === chunks.length) {
+          finish();
+          if (trace) {
+            trace.acked = Date.now() - trace.start;
+          }
+          callback(result);
+          // the watch may still report chunks it dropped after acking them,
+          // or its trace may be lost
+          setTimeout(function() {
+            self._forgetTransfer(transferId, resend);
+            if (trace) {
+              self._reportTrace(trace);
+            }
+          }, self._timeout);
+        }
+        pump();
+        self._pumpSends();
+      }, function(error) {
+        delete inFlight[index];
+        numInFlight--;
+        retry(index, error);
+        pump();
+        self._pumpSends();
+      });
+  }
+
+  /**
+   * @param {number} first
+   * @param {number} count
+   * @return {void}
+   */
+  function resend(first, count) {
+    self._link.failed(Date.now());
+    var last = Math.min(first + count, chunks.length);
+    for (var index = first; index < last; index++) {
+      // chunks on their way already may well be the ones it's missing
+      if (!inFlight[index] && queue.indexOf(index) === -1) {
+        enqueue(index);
+      }
+    }
+    pump();
+  }
+
+  self._activeTransfers.push(transfer);
+  self._watchTransfer(transferId, resend);
+  if (trace) {
+    self._tracedTransfers[transferId] = trace;
+  }
+  pump();
+};
+
+/**
+ * Route the watch's NACKs and traces for a transfer to the function that
+ * resends them and its timeline
+ * @private
+ * @param {number} transferId
+ * @param {function} resend - called with the first missing chunk and the
+ * number missing
+ * @return {void}
+ */
+simpleAppMessage._watchTransfer = function(transferId, resend) {
+  var self = this;
+
+  self._transfers[transferId] = resend;
+  if (!self._nackHandler) {
+    self._nackHandler = function(e) {
+      self._handleNack(e);
+      self._handleTrace(e);
+    };
+    Pebble.addEventListener('appmessage', self._nackHandler);
+  }
+};
+
+/**
+ * @private
+ * @param {number} transferId
+ * @param {function} resend - as passed to _watchTransfer, in case the ID has
+ * since been reused
+ * @return {void}
+ */
+simpleAppMessage._forgetTransfer = function(transferId, resend) {
+  var self = this;
+
+  if (self._transfers[transferId] !== resend) {
+    return;
+  }
+  delete self._transfers[transferId];
+
+  if (!Object.keys(self._transfers).length) {
+    Pebble.removeEventListener('appmessage', self._nackHandler);
+    self._nackHandler = null;
+  }
+};
 
-  chain = chain.then(callback);
-  chain = chain.catch(callback);
+/**
+ * @private
+ * @param {object} e - appmessage event
+ * @return {void}
+ */
+simpleAppMessage._handleNack = function(e) {
+  var nack = e.payload['SIMPLE_APP_MESSAGE_CHUNK_NACK'];
+
+  // not a NACK, or one that doesn't have the transfer ID, first and count
+  if (!nack || nack.length < 12) {
+    return;
+  }
+
+  var values = readWords(nack, 3);
+  var resend = this._transfers[values[0]];
+  if (resend) {
+    resend(values[1], values[2]);
+  }
+};
+
+/**
+ * @private
+ * @param {object} e - appmessage event
+ * @return {void}
+ */
+simpleAppMessage._handleTrace = function(e) {
+  var echo = e.payload['SIMPLE_APP_MESSAGE_CHUNK_TRACE'];
+
+  // the watch's trace is the transfer ID, reassembly, deserialize and
+  // dispatch times and whether it was dispatched, the handshake only
+  // announces that the watch sends them
+  if (!echo || echo.length < 20) {
+    return;
+  }
+
+  var values = readWords(echo, 5);
+  var trace = this._tracedTransfers[values[0]];
+  if (!trace) {
+    return;
+  }
+
+  trace.watch = {
+    echoed: Date.now() - trace.start,
+    reassembly: values[1],
+    deserialize: values[2],
+    dispatch: values[3],
+    dispatched: !!values[4]
+  };
+  this._reportTrace(trace);
+};
+
+/**
+ * Hand a timeline to the trace handler, once
+ * @private
+ * @param {object} trace
+ * @return {void}
+ */
+simpleAppMessage._reportTrace = function(trace) {
+  if (this._tracedTransfers[trace.transferId] !== trace) {
+    return;
+  }
+  delete this._tracedTransfers[trace.transferId];
+
+  if (this._traceHandler) {
+    this._traceHandler(trace);
+  }
 };
 
 /**
  * @private
  * @param {string} namespace
- * @param {object} data
+ * @param {Uint8Array} data
  * @param {number} remaining - remaining chunks
  * @param {number} total - total number of chunks
+ * @param {number} transferId - shared by every chunk of one message
+ * @param {object} [trace] - timeline to record the attempt in, asks the watch
+ * to echo its trace
  * @return {Plite}
  */
-simpleAppMessage._sendChunk = function(namespace, data, remaining, total) {
+simpleAppMessage._sendChunk = function(namespace, data, remaining, total,
+                                       transferId, trace) {
+  var chunk = {
+    // PebbleKit JS only takes plain arrays of bytes
+    SIMPLE_APP_MESSAGE_CHUNK_DATA: Array.prototype.slice.call(data),
+    SIMPLE_APP_MESSAGE_CHUNK_REMAINING: remaining,
+    SIMPLE_APP_MESSAGE_CHUNK_TOTAL: total,
+    SIMPLE_APP_MESSAGE_CHUNK_TRANSFER_ID: transferId
+  };
+
+  var namespaceId = simpleAppMessage._namespaceIds[namespace];
+  if (namespace === BATCH_NAMESPACE) {
+    chunk.SIMPLE_APP_MESSAGE_CHUNK_BATCH = 1;
+  } else if (namespaceId) {
+    // sent as data so it only takes up a single byte
+    chunk.SIMPLE_APP_MESSAGE_CHUNK_NAMESPACE_ID = [namespaceId];
+  } else {
+    chunk.SIMPLE_APP_MESSAGE_CHUNK_NAMESPACE = namespace;
+  }
+
+  // any chunk may be the one that completes the transfer
+  var attempt = null;
+  if (trace) {
+    chunk.SIMPLE_APP_MESSAGE_CHUNK_TRACE = 1;
+    attempt = {index: total - remaining - 1, size: data.length, sent: null,
+               acked: null};
+    trace.chunks.push(attempt);
+  }
+
+  var link = simpleAppMessage._link;
   return Plite(function(resolve, reject) {
     setTimeout(function() {
-      Pebble.sendAppMessage(objectToMessageKeys({
-        SIMPLE_APP_MESSAGE_CHUNK_DATA: data,
-        SIMPLE_APP_MESSAGE_CHUNK_REMAINING: remaining,
-        SIMPLE_APP_MESSAGE_CHUNK_TOTAL: total,
-        SIMPLE_APP_MESSAGE_CHUNK_NAMESPACE: namespace
-      }), resolve, reject);
-    }, simpleAppMessage._chunkDelay);
+      var sentAt = Date.now();
+      if (attempt) {
+        attempt.sent = sentAt - trace.start;
+      }
+      Pebble.sendAppMessage(objectToMessageKeys(chunk), function(result) {
+        link.acked(Date.now() - sentAt);
+        if (attempt) {
+          attempt.acked = Date.now() - trace.start;
+        }
+        resolve(result);
+      }, function(error) {
+        link.failed(Date.now());
+        if (attempt) {
+          attempt.error = error;
+        }
+        reject(error);
+      });
+    }, link.schedule(simpleAppMessage._chunkDelay, Date.now()));
+  });
+};
+
+/**
+ * What the link controller has learned from recent sends. The chunk size and
+ * delay apply to the next message sent.
+ * @return {{chunkSize: number, chunkDelay: number, latency: number,
+ * failureRate: number}} chunk size in bytes, delay and average latency in ms,
+ * and the recent share of chunks that failed or went missing
+ */
+simpleAppMessage.getLinkEstimates = function() {
+  return this._link.estimates(this._chunkDelay);
+};
+
+/**
+ * Parse the namespace IDs the watch sends along with its chunk size. Watches
+ * that predate namespace IDs don't send a table, in which case every chunk
+ * carries the namespace string.
+ * @private
+ * @param {Array} bytes - the ID followed by the NUL terminated name, for each
+ * namespace
+ * @return {object} IDs keyed by namespace
+ */
+simpleAppMessage._parseNamespaceTable = function(bytes) {
+  var namespaceIds = {};
+  var offset = 0;
+
+  while (offset < bytes.length) {
+    var id = bytes[offset];
+    var name;
+    try {
+      name = deserialize.readString(bytes, offset + 1);
+    } catch (error) {
+      console.log('simpleAppMessage: Ignoring truncated namespace table');
+      break;
+    }
+
+    namespaceIds[name.value] = id;
+    offset = name.next;
+  }
+
+  return namespaceIds;
+};
+
+/**
+ * Listen for messages sent from the watch with simple_app_message_send()
+ * @param {string} namespace
+ * @param {function} callback - called with the deserialized message
+ * @return {void}
+ */
+simpleAppMessage.subscribe = function(namespace, callback) {
+  var self = this;
+
+  if (!self._subscriptions[namespace]) {
+    self._subscriptions[namespace] = [];
+  }
+  self._subscriptions[namespace].push(callback);
+
+  if (!self._receiveHandler) {
+    self._receiveHandler = function(e) {
+      self._handleAppMessage(e);
+    };
+    Pebble.addEventListener('appmessage', self._receiveHandler);
+  }
+};
+
+/**
+ * @param {string} namespace
+ * @param {function} [callback] - if omitted, all callbacks for the namespace
+ * are removed
+ * @return {void}
+ */
+simpleAppMessage.unsubscribe = function(namespace, callback) {
+  var self = this;
+  var callbacks = self._subscriptions[namespace] || [];
+
+  callbacks = callback ? callbacks.filter(function(subscribed) {
+    return subscribed !== callback;
+  }) : [];
+
+  if (callbacks.length) {
+    self._subscriptions[namespace] = callbacks;
+  } else {
+    delete self._subscriptions[namespace];
+    delete self._assemblies[namespace];
+  }
+
+  if (!Object.keys(self._subscriptions).length && self._receiveHandler) {
+    Pebble.removeEventListener('appmessage', self._receiveHandler);
+    self._receiveHandler = null;
+  }
+};
+
+/**
+ * Call a method the watch registered with
+ * simple_app_message_rpc_register_method(). Calls don't wait for each other,
+ * so several can be in flight and their responses can arrive in any order.
+ * @param {string} method - a namespace reserved for the method's calls
+ * @param {object} params
+ * @param {function} callback - called with an error, or null and the result.
+ * Errors are {error}, with timedOut set if the response didn't arrive in
+ * time.
+ * @param {number} [timeout] - ms to wait for the response, defaults to the
+ * send timeout
+ * @return {void}
+ */
+simpleAppMessage.call = function(method, params, callback, timeout) {
+  this._getRpc().call(method, params, callback, timeout);
+};
+
+/**
+ * Answer calls the watch makes with simple_app_message_rpc_call()
+ * @param {string} method - a namespace reserved for the method's calls
+ * @param {function} handler - called with the params and a function to call
+ * with an error, or null and the result, once they're ready
+ * @return {void}
+ */
+simpleAppMessage.handle = function(method, handler) {
+  this._getRpc().handle(method, handler);
+};
+
+/**
+ * @param {string} method
+ * @return {void}
+ */
+simpleAppMessage.unhandle = function(method) {
+  this._getRpc().unhandle(method);
+};
+
+/**
+ * @private
+ * @return {Rpc}
+ */
+simpleAppMessage._getRpc = function() {
+  if (!this._rpc) {
+    this._rpc = new Rpc(this, this._timeout);
+  }
+  return this._rpc;
+};
+
+/**
+ * Keep the watch's copy of a namespace's state up to date. The first update,
+ * and any after the watch loses track, carries the whole state. After that
+ * only the keys that changed since the last state the watch acknowledged are
+ * sent, with removed keys sent as null, and the watch passes the whole state
+ * to the namespace's message_received callback. While an update is in flight
+ * later states wait, and only the newest is sent. Don't send on the namespace
+ * directly.
+ * @param {string} namespace
+ * @param {object} state - keys set to null or undefined are removed
+ * @param {function} [callback] - called with the result of the send that
+ * carries the state, or with nothing if it hadn't changed
+ * @return {void}
+ */
+simpleAppMessage.sync = function(namespace, state, callback) {
+  this._getSync().update(namespace, state, callback);
+};
+
+/**
+ * @private
+ * @return {Sync}
+ */
+simpleAppMessage._getSync = function() {
+  if (!this._sync) {
+    this._sync = new Sync(this);
+  }
+  return this._sync;
+};
+
+/**
+ * Reassemble chunks sent by the watch and dispatch complete messages to the
+ * namespace's subscribers
+ * @private
+ * @param {object} e - appmessage event
+ * @return {void}
+ */
+simpleAppMessage._handleAppMessage = function(e) {
+  var self = this;
+  var payload = e.payload;
+  var namespace = payload['SIMPLE_APP_MESSAGE_CHUNK_NAMESPACE'];
+
+  // not a chunk, or nobody is listening for it
+  if (typeof namespace === 'undefined' || !self._subscriptions[namespace]) {
+    return;
+  }
+
+  var total = payload['SIMPLE_APP_MESSAGE_CHUNK_TOTAL'];
+  var remaining = payload['SIMPLE_APP_MESSAGE_CHUNK_REMAINING'];
+  var data = payload['SIMPLE_APP_MESSAGE_CHUNK_DATA'] || [];
+  var assembly = self._assemblies[namespace];
+
+  var isExpected = assembly &&
+                   assembly.total === total &&
+                   assembly.remaining === remaining + 1;
+
+  if (!isExpected) {
+    delete self._assemblies[namespace];
+
+    if (remaining !== total - 1) {
+      console.log('simpleAppMessage: Unexpected chunk for namespace ' +
+                  namespace);
+      return;
+    }
+
+    assembly = self._assemblies[namespace] = {
+      total: total,
+      remaining: total,
+      bytes: []
+    };
+  }
+
+  for (var i = 0; i < data.length; i++) {
+    assembly.bytes.push(data[i]);
+  }
+  assembly.remaining = remaining;
+
+  if (remaining > 0) {
+    return;
+  }
+
+  delete self._assemblies[namespace];
+
+  var message;
+  try {
+    message = deserialize(assembly.bytes);
+  } catch (error) {
+    console.log(error.message);
+    return;
+  }
+
+  self._subscriptions[namespace].slice().forEach(function(callback) {
+    callback(message);
   });
 };
 
+// ask for the chunk size before the first send needs it
+Pebble.addEventListener('ready', function() {
+  simpleAppMessage.init();
+});
+
 module.exports = simpleAppMessage;
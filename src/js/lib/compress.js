@@ -0,0 +1,97 @@
+'use strict';
+
+var FORMATS = require('./formats');
+var varintSize = require('./serialize').varintSize;
+var writeVarint = require('./serialize').writeVarint;
+
+// must match simple-app-message-compression.h
+var TAG = 0x80;
+var MIN_MATCH = 3;
+var MAX_MATCH = MIN_MATCH + 255;
+
+/**
+ * Longest match for the bytes at pos within the window before it
+ * @param {Uint8Array} bytes
+ * @param {number} pos
+ * @param {number} window
+ * @return {{distance: number, length: number}}
+ */
+function findMatch(bytes, pos, window) {
+  var best = {distance: 0, length: 0};
+  var maxLength = Math.min(MAX_MATCH, bytes.length - pos);
+  var start = Math.max(0, pos - window);
+
+  for (var candidate = pos - 1; candidate >= start; candidate--) {
+    var length = 0;
+    // a match may run on into the bytes it produces
+    while (length < maxLength &&
+           bytes[candidate + length] === bytes[pos + length]) {
+      length++;
+    }
+    if (length > best.length) {
+      best = {distance: pos - candidate, length: length};
+      if (length === maxLength) {
+        break;
+      }
+    }
+  }
+
+  return best;
+}
+
+/**
+ * LZSS compress a serialized payload for a watch that announced it decodes
+ * compressed payloads with the given window. The result is the compression
+ * header followed by a flags byte per 8 tokens, least significant flag
+ * first. A literal is one byte, a match is distance - 1 and length - 3.
+ * @param {Uint8Array} payload - output of serialize
+ * @param {number} numKeys
+ * @param {number} window - match distance the watch keeps history for
+ * @return {Uint8Array|null} null if compressing doesn't make the payload
+ * smaller
+ */
+module.exports = function(payload, numKeys, window) {
+  // room for the flags byte and match that take it past the payload's size
+  var result = new Uint8Array(payload.length + 3);
+  var size = 3 + varintSize(payload.length);
+  if (size >= payload.length) {
+    return null;
+  }
+  result[0] = FORMATS.MARKER;
+  result[1] = TAG;
+  result[2] = numKeys;
+  writeVarint(result, 3, payload.length);
+
+  var flagsIndex = 0;
+  var tokens = 8;
+  var pos = 0;
+  window = Math.min(window, 256);
+
+  while (pos < payload.length) {
+    if (tokens === 8) {
+      flagsIndex = size++;
+      tokens = 0;
+    }
+
+    var match = findMatch(payload, pos, window);
+    if (match.length >= MIN_MATCH) {
+      result[flagsIndex] |= 1 << tokens;
+      result[size++] = match.distance - 1;
+      result[size++] = match.length - MIN_MATCH;
+      pos += match.length;
+    } else {
+      result[size++] = payload[pos++];
+    }
+    tokens++;
+
+    if (size >= payload.length) {
+      return null;
+    }
+  }
+
+  return result.subarray(0, size);
+};
+
+// the watch needs the whole header in the first chunk, the size varint takes
+// up to 5 bytes
+module.exports.HEADER_MAX_SIZE = 8;
@@ -0,0 +1,313 @@
+'use strict';
+
+var TYPES = require('./types');
+var FORMATS = require('./formats');
+
+// indexed by the element type of a v3 array
+var TYPED_ARRAYS = [
+  Int8Array, Uint8Array, Int16Array, Uint16Array, Int32Array, Uint32Array
+];
+
+/**
+ * Decode a NUL terminated UTF-8 string starting at offset
+ * @param {Array} bytes
+ * @param {number} offset
+ * @return {{value: string, next: number}}
+ */
+function readString(bytes, offset) {
+  var end = offset;
+  while (end < bytes.length && bytes[end] !== 0) {
+    end++;
+  }
+
+  if (end >= bytes.length) {
+    throw new Error('simpleAppMessage: Unterminated string in payload');
+  }
+
+  var value = '';
+  var i = offset;
+  while (i < end) {
+    var byte = bytes[i++];
+    var codePoint = byte;
+    var extraBytes = 0;
+
+    if (byte >= 0xF0) {
+      codePoint = byte & 0x07;
+      extraBytes = 3;
+    } else if (byte >= 0xE0) {
+      codePoint = byte & 0x0F;
+      extraBytes = 2;
+    } else if (byte >= 0xC0) {
+      codePoint = byte & 0x1F;
+      extraBytes = 1;
+    }
+
+    for (; extraBytes > 0 && i < end; extraBytes--) {
+      codePoint = (codePoint << 6) | (bytes[i++] & 0x3F);
+    }
+
+    if (codePoint > 0xFFFF) {
+      codePoint -= 0x10000;
+      value += String.fromCharCode(0xD800 + (codePoint >> 10),
+                                   0xDC00 + (codePoint & 0x3FF));
+    } else {
+      value += String.fromCharCode(codePoint);
+    }
+  }
+
+  return {value: value, next: end + 1};
+}
+
+/**
+ * @param {Array} bytes
+ * @param {number} offset
+ * @param {number} size
+ * @return {void}
+ */
+function ensureAvailable(bytes, offset, size) {
+  if (offset + size > bytes.length) {
+    throw new Error('simpleAppMessage: Payload is truncated');
+  }
+}
+
+/**
+ * Read the format and key count at the start of a payload
+ * @param {Array} bytes
+ * @return {{format: number, keys: number, next: number}}
+ */
+function readHeader(bytes) {
+  ensureAvailable(bytes, 0, 1);
+  var isCompact = bytes[0] === FORMATS.MARKER &&
+                  bytes.length >= FORMATS.V2_HEADER_SIZE &&
+                  bytes[1] >= FORMATS.V2 && bytes[1] <= FORMATS.LATEST;
+
+  // anything else after a zero key count is rejected as trailing data
+  if (!isCompact) {
+    return {format: FORMATS.V1, keys: bytes[0], next: 1};
+  }
+  return {format: bytes[1], keys: bytes[2], next: FORMATS.V2_HEADER_SIZE};
+}
+
+/**
+ * Decode a little endian base 128 varint starting at offset
+ * @param {Array} bytes
+ * @param {number} offset
+ * @return {{value: number, next: number}}
+ */
+function readVarint(bytes, offset) {
+  var value = 0;
+  for (var shift = 0; shift < 35; shift += 7) {
+    ensureAvailable(bytes, offset, 1);
+    var byte = bytes[offset++];
+    value += (byte & 0x7F) * Math.pow(2, shift);
+    if (!(byte & 0x80)) {
+      return {value: value, next: offset};
+    }
+  }
+  throw new Error('simpleAppMessage: Varint too long in payload');
+}
+
+/**
+ * Decode a v1 value of the given type starting at offset
+ * @param {Array} bytes
+ * @param {number} offset
+ * @param {number} type
+ * @return {{value: *, next: number}}
+ */
+function readValue(bytes, offset, type) {
+  switch (type) {
+    case TYPES.NULL:
+      return {value: null, next: offset};
+
+    case TYPES.BOOL:
+      ensureAvailable(bytes, offset, 1);
+      return {value: bytes[offset] !== 0, next: offset + 1};
+
+    case TYPES.INT:
+      ensureAvailable(bytes, offset, 4);
+      return {
+        value: bytes[offset] |
+               (bytes[offset + 1] << 8) |
+               (bytes[offset + 2] << 16) |
+               (bytes[offset + 3] << 24),
+        next: offset + 4
+      };
+
+    case TYPES.DATA:
+      ensureAvailable(bytes, offset, 2);
+      var length = bytes[offset] | (bytes[offset + 1] << 8);
+      offset += 2;
+      ensureAvailable(bytes, offset, length);
+      return {
+        value: Array.prototype.slice.call(bytes, offset, offset + length),
+        next: offset + length
+      };
+
+    case TYPES.STRING:
+      return readString(bytes, offset);
+
+    default:
+      throw new Error('simpleAppMessage: Unknown type ' + type +
+                      ' in payload');
+  }
+}
+
+/**
+ * Decode the data of a v3 array, its element type followed by the elements
+ * @param {Array} bytes
+ * @return {Int8Array|Uint8Array|Int16Array|Uint16Array|Int32Array|Uint32Array}
+ */
+function readArray(bytes) {
+  ensureAvailable(bytes, 0, 1);
+  var TypedArray = TYPED_ARRAYS[bytes[0]];
+  if (!TypedArray) {
+    throw new Error('simpleAppMessage: Unknown array type ' + bytes[0] +
+                    ' in payload');
+  }
+
+  var size = TypedArray.BYTES_PER_ELEMENT;
+  if ((bytes.length - 1) % size) {
+    throw new Error('simpleAppMessage: Payload is truncated');
+  }
+
+  var result = new TypedArray((bytes.length - 1) / size);
+  for (var i = 0; i < result.length; i++) {
+    var value = 0;
+    for (var b = size; b > 0; b--) {
+      value = value * 256 + bytes[i * size + b];
+    }
+    // stored modulo the element size, which restores the sign
+    result[i] = value;
+  }
+  return result;
+}
+
+/**
+ * Decode the data of a v3 object, its key count followed by its entries
+ * @param {Array} bytes
+ * @return {object}
+ */
+function readObject(bytes) {
+  ensureAvailable(bytes, 0, 1);
+  var entries = readEntries(bytes, 1, bytes[0], FORMATS.V3);
+  if (entries.next !== bytes.length) {
+    throw new Error('simpleAppMessage: Unexpected data at end of object');
+  }
+  return entries.value;
+}
+
+/**
+ * Decode a v2 or v3 value starting at offset, given the low nibble of its
+ * type byte
+ * @param {Array} bytes
+ * @param {number} offset
+ * @param {number} type
+ * @param {number} nibble
+ * @return {{value: *, next: number}}
+ */
+function readCompactValue(bytes, offset, type, nibble) {
+  var small = {value: nibble, next: offset};
+  if (type === TYPES.INT || type === TYPES.DATA || type === TYPES.ARRAY ||
+      type === TYPES.OBJECT) {
+    small = nibble === 0xF ? readVarint(bytes, offset) : small;
+  }
+  var end = small.next + small.value;
+
+  switch (type) {
+    case TYPES.NULL:
+      return {value: null, next: offset};
+
+    case TYPES.BOOL:
+      return {value: nibble !== 0, next: offset};
+
+    case TYPES.INT:
+      // undo the zig-zag encoding, keeping the result a signed 32 bit int
+      return {
+        value: ((small.value >>> 1) ^ -(small.value & 1)) | 0,
+        next: small.next
+      };
+
+    case TYPES.DATA:
+      ensureAvailable(bytes, small.next, small.value);
+      return {
+        value: Array.prototype.slice.call(bytes, small.next, end),
+        next: end
+      };
+
+    case TYPES.STRING:
+      return readString(bytes, offset);
+
+    case TYPES.ARRAY:
+      ensureAvailable(bytes, small.next, small.value);
+      return {
+        value: readArray(Array.prototype.slice.call(bytes, small.next, end)),
+        next: end
+      };
+
+    case TYPES.OBJECT:
+      ensureAvailable(bytes, small.next, small.value);
+      return {
+        value: readObject(Array.prototype.slice.call(bytes, small.next, end)),
+        next: end
+      };
+
+    default:
+      throw new Error('simpleAppMessage: Unknown type ' + type +
+                      ' in payload');
+  }
+}
+
+/**
+ * Decode count keys and their values starting at offset
+ * @param {Array} bytes
+ * @param {number} offset
+ * @param {number} count
+ * @param {number} format
+ * @return {{value: object, next: number}}
+ */
+function readEntries(bytes, offset, count, format) {
+  var result = {};
+
+  for (var keysLeft = count; keysLeft > 0; keysLeft--) {
+    var key = readString(bytes, offset);
+    offset = key.next;
+
+    ensureAvailable(bytes, offset, 1);
+    var typeByte = bytes[offset++];
+    var type = format >= FORMATS.V2 ? typeByte >> 4 : typeByte;
+    // arrays and objects only exist from v3 on
+    if (format < FORMATS.V3 && type > TYPES.STRING) {
+      throw new Error('simpleAppMessage: Unknown type ' + type +
+                      ' in payload');
+    }
+    var value = format >= FORMATS.V2 ?
+      readCompactValue(bytes, offset, type, typeByte & 0xF) :
+      readValue(bytes, offset, typeByte);
+
+    result[key.value] = value.value;
+    offset = value.next;
+  }
+
+  return {value: result, next: offset};
+}
+
+/**
+ * Deserialize a payload produced by simple_app_message_serialize() on the
+ * watch (the same format produced by serialize.js) back into an object.
+ * Either format is accepted, the header says which one was used.
+ * @param {Array} bytes
+ * @return {object}
+ */
+function deserialize(bytes) {
+  var header = readHeader(bytes);
+  var entries = readEntries(bytes, header.next, header.keys, header.format);
+
+  if (entries.next !== bytes.length) {
+    throw new Error('simpleAppMessage: Unexpected data at end of payload');
+  }
+
+  return entries.value;
+}
+
+module.exports = deserialize;
+module.exports.readString = readString;
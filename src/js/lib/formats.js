@@ -0,0 +1,18 @@
+'use strict';
+
+/**
+ * Payload format versions. Must match SimpleAppMessageFormat in
+ * simple-app-message-assembly.h
+ */
+module.exports = {
+  V1: 1,
+  V2: 2,
+  // v2 plus typed arrays and nested objects
+  V3: 3,
+  LATEST: 3,
+
+  // a v1 payload with no keys is a single zero byte, so a zero followed by
+  // more bytes marks a newer format
+  MARKER: 0,
+  V2_HEADER_SIZE: 3
+};
@@ -0,0 +1,110 @@
+'use strict';
+
+// smallest chunk the controller shrinks to, still fits any payload header
+var MIN_CHUNK_SIZE = 16;
+// bytes a chunk grows by per ack, as a fraction of the watch's chunk size
+var INCREASE_DIVISOR = 16;
+// ms the delay between chunks backs off from and shrinks by per ack
+var DELAY_STEP = 10;
+var MAX_DELAY = 1000;
+// weight of a new sample in the latency and failure rate averages
+var SMOOTHING = 1 / 8;
+
+/**
+ * AIMD controller for the chunk size and the delay between chunks. Acks grow
+ * the chunk size and shrink the delay a step at a time, failures and NACKs
+ * halve the chunk size and double the delay, so a bad link backs off quickly
+ * and a good one recovers over a few chunks.
+ * @return {void}
+ */
+function Link() {
+  this._maxChunkSize = 0;
+  this._chunkSize = 0;
+  this._delay = 0;
+  this._latency = 0;
+  this._failureRate = 0;
+  this._lastSendAt = 0;
+  this._holdUntil = 0;
+}
+
+/**
+ * @param {number} maxChunkSize - the chunk size the watch announced, starts
+ * the controller over at that size if it changed
+ * @return {number} size to split the next message into
+ */
+Link.prototype.chunkSize = function(maxChunkSize) {
+  if (maxChunkSize !== this._maxChunkSize) {
+    this._maxChunkSize = this._chunkSize = maxChunkSize;
+  }
+  return this._chunkSize;
+};
+
+/**
+ * @param {number} minDelay - delay the platform always needs
+ * @return {number} ms to leave between chunks
+ */
+Link.prototype.delay = function(minDelay) {
+  return minDelay + this._delay;
+};
+
+/**
+ * Book the next slot to send a chunk in. Slots never move backwards, so
+ * chunks go out in the order they were booked even as the delay shrinks.
+ * @param {number} minDelay - delay the platform always needs
+ * @param {number} now - current time in ms
+ * @return {number} ms to wait before sending the chunk
+ */
+Link.prototype.schedule = function(minDelay, now) {
+  var sendAt = Math.max(now + minDelay,
+                        this._lastSendAt + this.delay(minDelay));
+  this._lastSendAt = sendAt;
+  return sendAt - now;
+};
+
+/**
+ * @param {number} latency - ms from sending a chunk to its ack
+ * @return {void}
+ */
+Link.prototype.acked = function(latency) {
+  var step = Math.max(1, Math.floor(this._maxChunkSize / INCREASE_DIVISOR));
+  this._chunkSize = Math.min(this._maxChunkSize, this._chunkSize + step);
+  this._delay = Math.max(0, this._delay - DELAY_STEP);
+  this._latency = this._latency ?
+    this._latency + (latency - this._latency) * SMOOTHING : latency;
+  this._failureRate -= this._failureRate * SMOOTHING;
+};
+
+/**
+ * A chunk failed to send or the watch reported chunks missing. One loss
+ * usually takes the chunks right behind it down too, so the controller only
+ * backs off once per round trip.
+ * @param {number} now - current time in ms
+ * @return {void}
+ */
+Link.prototype.failed = function(now) {
+  this._failureRate += (1 - this._failureRate) * SMOOTHING;
+  if (now < this._holdUntil) {
+    return;
+  }
+
+  this._chunkSize = Math.max(Math.min(MIN_CHUNK_SIZE, this._maxChunkSize),
+                             Math.floor(this._chunkSize / 2));
+  this._delay = Math.min(MAX_DELAY, Math.max(DELAY_STEP, this._delay * 2));
+  this._holdUntil = now + (2 * this._latency) + this._delay;
+};
+
+/**
+ * @param {number} minDelay - delay the platform always needs
+ * @return {{chunkSize: number, chunkDelay: number, latency: number,
+ * failureRate: number}}
+ */
+Link.prototype.estimates = function(minDelay) {
+  return {
+    chunkSize: this._chunkSize,
+    chunkDelay: this.delay(minDelay),
+    latency: Math.round(this._latency),
+    failureRate: this._failureRate
+  };
+};
+
+module.exports = Link;
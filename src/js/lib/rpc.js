@@ -0,0 +1,216 @@
+'use strict';
+
+// keys an RPC adds to the messages it sends, must match
+// simple-app-message-rpc.c. A call carries its ID, a response the ID of the
+// call it answers and, if the call failed, the error.
+var KEYS = {
+  ID: '#id',
+  RESPONSE: '#re',
+  ERROR: '#err'
+};
+
+// IDs are sent as ints, and wrap back around to 1 before they overflow
+var MAX_ID = 0x7fffffff;
+
+/**
+ * @param {*} result - what a send was called back with
+ * @return {boolean}
+ */
+function isSendError(result) {
+  return typeof result === 'string' || !!(result && result.error);
+}
+
+/**
+ * @param {object} message
+ * @return {object} the message without the keys RPC adds to it
+ */
+function withoutKeys(message) {
+  var params = {};
+  Object.keys(message).forEach(function(key) {
+    if (key !== KEYS.ID && key !== KEYS.RESPONSE && key !== KEYS.ERROR) {
+      params[key] = message[key];
+    }
+  });
+  return params;
+}
+
+/**
+ * @param {object} data
+ * @param {string} key
+ * @param {*} value
+ * @return {object} a copy of data with key set to value
+ */
+function withKey(data, key, value) {
+  var message = withoutKeys(data || {});
+  message[key] = value;
+  return message;
+}
+
+/**
+ * Request/response calls over namespaces, in both directions. A call is sent
+ * on the namespace named after its method with an ID the response carries
+ * back, so any number of calls can be in flight at once and their responses
+ * can arrive in any order. Methods are namespaces, so they can't be longer
+ * than a namespace and shouldn't be subscribed to or sent on directly.
+ * @param {object} transport - sends with send(namespace, data, callback) and
+ * receives with subscribe(namespace, callback), like simpleAppMessage
+ * @param {number} timeout - ms a call waits for its response by default
+ * @return {void}
+ */
+function Rpc(transport, timeout) {
+  this._transport = transport;
+  this._timeout = timeout;
+  this._nextId = 1;
+  // calls waiting for a response, by ID
+  this._pending = {};
+  // handlers for calls from the watch, by method
+  this._handlers = {};
+  this._subscribed = {};
+}
+
+/**
+ * Call a method on the watch. Sending doesn't wait for earlier calls to be
+ * answered.
+ * @param {string} method
+ * @param {object} params
+ * @param {function} callback - called with an error, or null and the result.
+ * Errors are {error} like a failed send, with timedOut set if the response
+ * didn't arrive in time.
+ * @param {number} [timeout] - ms to wait for the response
+ * @return {void}
+ */
+Rpc.prototype.call = function(method, params, callback, timeout) {
+  var self = this;
+  var id = self._nextId;
+  self._nextId = id === MAX_ID ? 1 : id + 1;
+  self._listen(method);
+
+  self._pending[id] = {
+    callback: callback,
+    timer: setTimeout(function() {
+      self._finish(id, {
+        error: 'simpleAppMessage: call to ' + method + ' timed out',
+        timedOut: true
+      });
+    }, timeout || self._timeout)
+  };
+
+  self._transport.send(method, withKey(params, KEYS.ID, id), function(result) {
+    if (isSendError(result)) {
+      self._finish(id, {
+        error: 'simpleAppMessage: failed to send call to ' + method,
+        cause: result
+      });
+    }
+  });
+};
+
+/**
+ * Answer calls the watch makes to a method
+ * @param {string} method
+ * @param {function} handler - called with the params and a function to call
+ * with an error, or null and the result, once they're ready
+ * @return {void}
+ */
+Rpc.prototype.handle = function(method, handler) {
+  this._handlers[method] = handler;
+  this._listen(method);
+};
+
+/**
+ * Stop answering calls to a method. Later calls get an error response.
+ * @param {string} method
+ * @return {void}
+ */
+Rpc.prototype.unhandle = function(method) {
+  delete this._handlers[method];
+};
+
+/**
+ * @private
+ * @param {string} method
+ * @return {void}
+ */
+Rpc.prototype._listen = function(method) {
+  var self = this;
+  if (self._subscribed[method]) {
+    return;
+  }
+  self._subscribed[method] = true;
+  self._transport.subscribe(method, function(message) {
+    self._receive(method, message);
+  });
+};
+
+/**
+ * @private
+ * @param {number} id
+ * @param {object} error
+ * @param {object} [result]
+ * @return {void}
+ */
+Rpc.prototype._finish = function(id, error, result) {
+  var call = this._pending[id];
+  // answered, failed or timed out already
+  if (!call) {
+    return;
+  }
+  delete this._pending[id];
+  clearTimeout(call.timer);
+  call.callback(error, result);
+};
+
+/**
+ * @private
+ * @param {string} method
+ * @param {object} message
+ * @return {void}
+ */
+Rpc.prototype._receive = function(method, message) {
+  if (typeof message[KEYS.RESPONSE] === 'number') {
+    var error = message[KEYS.ERROR];
+    this._finish(message[KEYS.RESPONSE],
+                 typeof error === 'undefined' ? null : {error: error},
+                 withoutKeys(message));
+  } else if (typeof message[KEYS.ID] === 'number') {
+    this._answer(method, message[KEYS.ID], withoutKeys(message));
+  }
+};
+
+/**
+ * @private
+ * @param {string} method
+ * @param {number} id
+ * @param {object} params
+ * @return {void}
+ */
+Rpc.prototype._answer = function(method, id, params) {
+  var self = this;
+  var handler = self._handlers[method];
+  var answered = false;
+
+  var respond = function(error, result) {
+    if (answered) {
+      return;
+    }
+    answered = true;
+    var response = withKey(result, KEYS.RESPONSE, id);
+    if (error) {
+      response[KEYS.ERROR] = String(error.error || error);
+    }
+    self._transport.send(method, response, function(sendResult) {
+      if (isSendError(sendResult)) {
+        console.log('simpleAppMessage: Failed to respond to ' + method);
+      }
+    });
+  };
+
+  if (!handler) {
+    respond('no handler for ' + method);
+    return;
+  }
+  handler(params, respond);
+};
+
+module.exports = Rpc;
+module.exports.KEYS = KEYS;
@@ -1,89 +1,428 @@
 'use strict';
 
+var TYPES = require('./types');
+var ARRAY_TYPES = TYPES.ARRAY_TYPES;
+var FORMATS = require('./formats');
+
+// values up to this fit in the low nibble of a v2 type byte
+var MAX_NIBBLE = 0xE;
+var NIBBLE_VARINT = 0xF;
+
 /**
- * serialize and object into an Array ready for transport via appMessage
- * @param {object} data
- * @return {Array}
+ * @param {number} val
+ * @return {number} bytes varint(val) takes up
  */
-module.exports = function(data) {
-  var keys = Object.keys(data);
-  var length = keys.length;
-  var result = [];
-  var TYPES = {
-    NULL: 0,
-    BOOL: 1,
-    INT: 2,
-    DATA: 3,
-    STRING: 4
-  };
-
-  /**
-   * @private
-   * @param {null|boolean|string|Array|number} val
-   * @param {boolean} [useTerminator=true]
-   * @return {void}
-   */
-  function _pushResult(val, useTerminator) {
-    if (useTerminator) {
-      result = result.concat(val, '\0');
+function varintSize(val) {
+  var size = 1;
+  while (val >= 0x80) {
+    size++;
+    val >>>= 7;
+  }
+  return size;
+}
+
+/**
+ * @param {Uint8Array} bytes
+ * @param {number} offset
+ * @param {number} val
+ * @return {number} offset after the varint
+ */
+function writeVarint(bytes, offset, val) {
+  while (val >= 0x80) {
+    bytes[offset++] = (val & 0x7F) | 0x80;
+    val >>>= 7;
+  }
+  bytes[offset++] = val;
+  return offset;
+}
+
+/**
+ * @param {string} str
+ * @return {number} bytes str takes up as UTF-8, without the terminator
+ */
+function utf8Size(str) {
+  var size = 0;
+  for (var i = 0; i < str.length; i++) {
+    var code = str.charCodeAt(i);
+    if (code < 0x80) {
+      size += 1;
+    } else if (code < 0x800) {
+      size += 2;
+    } else if (code >= 0xD800 && code <= 0xDBFF && i + 1 < str.length) {
+      // a surrogate pair is a single 4 byte code point
+      size += 4;
+      i++;
     } else {
-      result = result.concat(val);
+      size += 3;
+    }
+  }
+  return size;
+}
+
+/**
+ * Write str as NUL terminated UTF-8
+ * @param {Uint8Array} bytes
+ * @param {number} offset
+ * @param {string} str
+ * @return {number} offset after the terminator
+ */
+function writeString(bytes, offset, str) {
+  for (var i = 0; i < str.length; i++) {
+    var code = str.charCodeAt(i);
+    if (code < 0x80) {
+      bytes[offset++] = code;
+    } else if (code < 0x800) {
+      bytes[offset++] = 0xC0 | (code >> 6);
+      bytes[offset++] = 0x80 | (code & 0x3F);
+    } else if (code >= 0xD800 && code <= 0xDBFF && i + 1 < str.length) {
+      code = 0x10000 + ((code - 0xD800) << 10) +
+             (str.charCodeAt(++i) - 0xDC00);
+      bytes[offset++] = 0xF0 | (code >> 18);
+      bytes[offset++] = 0x80 | ((code >> 12) & 0x3F);
+      bytes[offset++] = 0x80 | ((code >> 6) & 0x3F);
+      bytes[offset++] = 0x80 | (code & 0x3F);
+    } else {
+      bytes[offset++] = 0xE0 | (code >> 12);
+      bytes[offset++] = 0x80 | ((code >> 6) & 0x3F);
+      bytes[offset++] = 0x80 | (code & 0x3F);
+    }
+  }
+  bytes[offset++] = 0;
+  return offset;
+}
+
+/**
+ * @param {number} val
+ * @return {number} bytes the v2 type byte for val takes up
+ */
+function compactTypeSize(val) {
+  return val <= MAX_NIBBLE ? 1 : 1 + varintSize(val);
+}
+
+/**
+ * v2 type byte, followed by val as a varint if it doesn't fit in the low
+ * nibble
+ * @param {Uint8Array} bytes
+ * @param {number} offset
+ * @param {number} type
+ * @param {number} val
+ * @return {number} offset after the type
+ */
+function writeCompactType(bytes, offset, type, val) {
+  if (val <= MAX_NIBBLE) {
+    bytes[offset++] = (type << 4) | val;
+    return offset;
+  }
+  bytes[offset++] = (type << 4) | NIBBLE_VARINT;
+  return writeVarint(bytes, offset, val);
+}
+
+/**
+ * @param {*} val
+ * @return {boolean} true if val is sent as data
+ */
+function isData(val) {
+  return Array.isArray(val) || ArrayBuffer.isView(val);
+}
+
+/**
+ * Wider typed arrays are sent as the bytes they hold, which are little
+ * endian on every phone like the elements of a v3 array
+ * @param {Array|ArrayBufferView} val
+ * @return {Array|Uint8Array} the bytes of val
+ */
+function dataBytes(val) {
+  if (Array.isArray(val) || val instanceof Uint8Array) {
+    return val;
+  }
+  return new Uint8Array(val.buffer, val.byteOffset, val.byteLength);
+}
+
+/**
+ * @param {*} val
+ * @return {boolean} true if val is a plain object, sent as a v3 object
+ */
+function isObject(val) {
+  return Object.prototype.toString.call(val) === '[object Object]';
+}
+
+/**
+ * @param {number} arrayType
+ * @return {number} bytes each element of an array of arrayType takes up
+ */
+function elementSize(arrayType) {
+  return 1 << (arrayType >> 1);
+}
+
+/**
+ * Element type of the v3 array val is sent as. Arrays that fit in bytes are
+ * still sent as data, so watches reading them as data keep working. Throws if
+ * an element of a plain array isn't an integer that fits in 32 bits, rather
+ * than sending it cut short.
+ * @param {*} val
+ * @return {number|null} null if val isn't sent as an array
+ */
+function arrayType(val) {
+  if (val instanceof Int8Array) {
+    return ARRAY_TYPES.INT8;
+  } else if (val instanceof Int16Array) {
+    return ARRAY_TYPES.INT16;
+  } else if (val instanceof Uint16Array) {
+    return ARRAY_TYPES.UINT16;
+  } else if (val instanceof Int32Array) {
+    return ARRAY_TYPES.INT32;
+  } else if (val instanceof Uint32Array) {
+    return ARRAY_TYPES.UINT32;
+  } else if (!Array.isArray(val)) {
+    return null;
+  }
+
+  var min = 0;
+  var max = 0;
+  for (var i = 0; i < val.length; i++) {
+    if (typeof val[i] !== 'number' || Math.floor(val[i]) !== val[i]) {
+      throw new Error('simpleAppMessage: Array elements must be integers');
     }
+    min = Math.min(min, val[i]);
+    max = Math.max(max, val[i]);
   }
 
-  if (length > 255) {
+  if (min >= 0 && max <= 0xFF) {
+    return null;
+  } else if (min >= -0x80 && max <= 0x7F) {
+    return ARRAY_TYPES.INT8;
+  } else if (min >= -0x8000 && max <= 0x7FFF) {
+    return ARRAY_TYPES.INT16;
+  } else if (min >= 0 && max <= 0xFFFF) {
+    return ARRAY_TYPES.UINT16;
+  } else if (min >= -0x80000000 && max <= 0x7FFFFFFF) {
+    return ARRAY_TYPES.INT32;
+  } else if (min >= 0 && max <= 0xFFFFFFFF) {
+    return ARRAY_TYPES.UINT32;
+  }
+  throw new Error('simpleAppMessage: Array elements must fit in 32 bits');
+}
+
+/**
+ * zig-zag keeps small negative numbers small
+ * @param {number} val
+ * @return {number}
+ */
+function zigZag(val) {
+  return ((val << 1) ^ (val >> 31)) >>> 0;
+}
+
+/**
+ * @param {object} data
+ * @return {Array.<string>}
+ */
+function objectKeys(data) {
+  var keys = Object.keys(data);
+  if (keys.length > 255) {
     throw new Error('Number of items must be less than 255');
   }
+  return keys;
+}
+
+/**
+ * @param {*} val
+ * @param {number} format
+ * @return {number} bytes val takes up, with its type
+ */
+function valueSize(val, format) {
+  var compact = format >= FORMATS.V2;
+  var length;
+
+  switch (typeof val) {
+    case 'object' :
+      if (format >= FORMATS.V3 && arrayType(val) !== null) {
+        length = 1 + val.length * elementSize(arrayType(val));
+        return compactTypeSize(length) + length;
+      }
+      if (format >= FORMATS.V3 && isObject(val)) {
+        length = 1 + entriesSize(val, objectKeys(val), format);
+        return compactTypeSize(length) + length;
+      }
+      if (isData(val)) {
+        length = dataBytes(val).length;
+        return (compact ? compactTypeSize(length) : 3) + length;
+      }
+      return 1;
+
+    case 'number' :
+      return compact ? compactTypeSize(zigZag(val)) : 5;
+
+    case 'string' :
+      return 1 + utf8Size(val) + 1;
+
+    case 'boolean' :
+      return compact ? 1 : 2;
+  }
+  return 0;
+}
 
-  // number of keys
-  _pushResult(length);
+/**
+ * @param {object} data
+ * @param {Array.<string>} keys
+ * @param {number} format
+ * @return {number} bytes the keys of data take up, with their values
+ */
+function entriesSize(data, keys, format) {
+  var size = 0;
+  for (var i = 0; i < keys.length; i++) {
+    size += utf8Size(keys[i]) + 1 + valueSize(data[keys[i]], format);
+  }
+  return size;
+}
 
-  for (var i = 0; i < length; i++) {
-    var key = keys[i];
-    var val = data[key];
+/**
+ * v3 array: the element type, then every element little endian
+ * @param {Uint8Array} bytes
+ * @param {number} offset
+ * @param {Array|Int8Array|Int16Array|Uint16Array|Int32Array|Uint32Array} val
+ * @param {number} type
+ * @return {number} offset after val
+ */
+function writeArray(bytes, offset, val, type) {
+  var size = elementSize(type);
+  offset = writeCompactType(bytes, offset, TYPES.ARRAY, 1 + val.length * size);
+  bytes[offset++] = type;
+  for (var i = 0; i < val.length; i++) {
+    for (var shift = 0; shift < size * 8; shift += 8) {
+      bytes[offset++] = (val[i] >>> shift) & 255;
+    }
+  }
+  return offset;
+}
 
-    // key
-    _pushResult(key.split(''), true);
+/**
+ * v3 object: the number of keys, then the keys and values
+ * @param {Uint8Array} bytes
+ * @param {number} offset
+ * @param {object} val
+ * @param {number} format
+ * @return {number} offset after val
+ */
+function writeObject(bytes, offset, val, format) {
+  var keys = objectKeys(val);
+  offset = writeCompactType(bytes, offset, TYPES.OBJECT,
+                            1 + entriesSize(val, keys, format));
+  bytes[offset++] = keys.length;
+  return writeEntries(bytes, offset, val, keys, format);
+}
 
-    switch (typeof val) {
-      case 'object' :
-        if (Array.isArray(val)) {
-          _pushResult(TYPES.DATA);
-          _pushResult(
-            [
-              (val.length >>> 0) & 255,
-              (val.length >>> 8) & 255
+/**
+ * @param {Uint8Array} bytes
+ * @param {number} offset
+ * @param {*} val
+ * @param {number} format
+ * @return {number} offset after val
+ */
+function writeValue(bytes, offset, val, format) {
+  var compact = format >= FORMATS.V2;
 
-            ].concat(val)
-          );
+  switch (typeof val) {
+    case 'object' :
+      if (format >= FORMATS.V3 && arrayType(val) !== null) {
+        return writeArray(bytes, offset, val, arrayType(val));
+      }
+      if (format >= FORMATS.V3 && isObject(val)) {
+        return writeObject(bytes, offset, val, format);
+      }
+      if (isData(val)) {
+        val = dataBytes(val);
+        if (compact) {
+          offset = writeCompactType(bytes, offset, TYPES.DATA, val.length);
         } else {
-          _pushResult(TYPES.NULL);
+          bytes[offset++] = TYPES.DATA;
+          bytes[offset++] = val.length & 255;
+          bytes[offset++] = (val.length >>> 8) & 255;
         }
+        bytes.set(val, offset);
+        return offset + val.length;
+      }
+      if (compact) {
+        return writeCompactType(bytes, offset, TYPES.NULL, 0);
+      }
+      bytes[offset++] = TYPES.NULL;
+      return offset;
 
-        break;
-
-      case 'number' :
-        _pushResult(TYPES.INT);
-        _pushResult([
-          (val >>> 0) & 255,
-          (val >>> 8) & 255,
-          (val >>> 16) & 255,
-          (val >>> 24) & 255
-        ]);
-        break;
-
-      case 'string' :
-        _pushResult(TYPES.STRING);
-        _pushResult(val.split(''), true);
-        break;
-
-      case 'boolean' :
-        _pushResult(TYPES.BOOL);
-        _pushResult(val ? 1 : 0);
-        break;
-    }
+    case 'number' :
+      if (compact) {
+        return writeCompactType(bytes, offset, TYPES.INT, zigZag(val));
+      }
+      bytes[offset++] = TYPES.INT;
+      bytes[offset++] = val & 255;
+      bytes[offset++] = (val >>> 8) & 255;
+      bytes[offset++] = (val >>> 16) & 255;
+      bytes[offset++] = (val >>> 24) & 255;
+      return offset;
+
+    case 'string' :
+      if (compact) {
+        offset = writeCompactType(bytes, offset, TYPES.STRING, 0);
+      } else {
+        bytes[offset++] = TYPES.STRING;
+      }
+      return writeString(bytes, offset, val);
+
+    case 'boolean' :
+      if (compact) {
+        return writeCompactType(bytes, offset, TYPES.BOOL, val ? 1 : 0);
+      }
+      bytes[offset++] = TYPES.BOOL;
+      bytes[offset++] = val ? 1 : 0;
+      return offset;
+  }
+  return offset;
+}
 
+/**
+ * @param {Uint8Array} bytes
+ * @param {number} offset
+ * @param {object} data
+ * @param {Array.<string>} keys
+ * @param {number} format
+ * @return {number} offset after the last value
+ */
+function writeEntries(bytes, offset, data, keys, format) {
+  for (var i = 0; i < keys.length; i++) {
+    offset = writeString(bytes, offset, keys[i]);
+    offset = writeValue(bytes, offset, data[keys[i]], format);
   }
+  return offset;
+}
 
-  return result;
+/**
+ * Serialize an object into bytes ready for transport via appMessage. The
+ * payload is measured first and then written into a single buffer, strings
+ * as UTF-8. Typed arrays, arrays of numbers that don't fit in bytes and
+ * nested objects keep their shape with the v3 format, older formats send
+ * arrays as bytes, typed arrays as the bytes they hold and objects as null.
+ * @param {object} data
+ * @param {number} [format=FORMATS.V1] - only use a format the watch
+ * announced it can decode
+ * @return {Uint8Array}
+ */
+module.exports = function(data, format) {
+  format = format || FORMATS.V1;
+  var keys = objectKeys(data);
+  var compact = format >= FORMATS.V2;
+
+  // marker and version, then the number of keys
+  var size = (compact ? 2 : 0) + 1 + entriesSize(data, keys, format);
+
+  var bytes = new Uint8Array(size);
+  var offset = 0;
+  if (compact) {
+    bytes[offset++] = FORMATS.MARKER;
+    bytes[offset++] = format;
+  }
+  bytes[offset++] = keys.length;
+  writeEntries(bytes, offset, data, keys, format);
+
+  return bytes;
 };
+
+module.exports.varintSize = varintSize;
+module.exports.writeVarint = writeVarint;
@@ -0,0 +1,219 @@
+'use strict';
+
+// keys a sync update adds to the state it sends, must match
+// simple-app-message-sync.h. An update carries its generation and, if it's a
+// delta, the generation it applies to. The watch asks for the whole state
+// again with RESYNC when it doesn't have that generation.
+var KEYS = {
+  GENERATION: '#gen',
+  BASE: '#base',
+  RESYNC: '#resync'
+};
+
+// generations are sent as ints, and wrap back around to 1 before they overflow
+var MAX_GENERATION = 0x7fffffff;
+
+/**
+ * @param {*} result - what a send was called back with
+ * @return {boolean}
+ */
+function isSendError(result) {
+  return typeof result === 'string' || !!(result && result.error);
+}
+
+/**
+ * @param {*} a
+ * @param {*} b
+ * @return {boolean} whether a and b would be sent as the same value
+ */
+function isEqual(a, b) {
+  if (a === b) {
+    return true;
+  }
+  if (!a || !b || typeof a !== 'object' || typeof b !== 'object' ||
+      a.constructor !== b.constructor) {
+    return false;
+  }
+  var keys = Object.keys(a);
+  return keys.length === Object.keys(b).length && keys.every(function(key) {
+    return isEqual(a[key], b[key]);
+  });
+}
+
+/**
+ * @param {*} value
+ * @return {boolean} whether value is part of the state, null and undefined
+ * aren't
+ */
+function isSet(value) {
+  return value !== null && typeof value !== 'undefined';
+}
+
+/**
+ * @param {object} state
+ * @return {object} a copy of the keys that are part of the state
+ */
+function copyState(state) {
+  var copy = {};
+  Object.keys(state).forEach(function(key) {
+    if (isSet(state[key])) {
+      copy[key] = state[key];
+    }
+  });
+  return copy;
+}
+
+/**
+ * @param {object} from
+ * @param {object} to
+ * @return {object} the keys that changed from from to to, with the ones that
+ * were removed set to null
+ */
+function diff(from, to) {
+  var delta = {};
+  Object.keys(to).forEach(function(key) {
+    if (!isEqual(from[key], to[key])) {
+      delta[key] = to[key];
+    }
+  });
+  Object.keys(from).forEach(function(key) {
+    if (!(key in to)) {
+      delta[key] = null;
+    }
+  });
+  return delta;
+}
+
+/**
+ * Keeps a state object per namespace in sync with the watch, which passes the
+ * whole state to the namespace's message_received callback. After the first
+ * update only the keys that changed since the last state the watch
+ * acknowledged are sent. One update per namespace is in flight at a time, and
+ * only the newest state waiting behind it is sent.
+ * @param {object} transport - sends with send(namespace, data, callback) and
+ * receives with subscribe(namespace, callback), like simpleAppMessage
+ * @return {void}
+ */
+function Sync(transport) {
+  this._transport = transport;
+  // by namespace
+  this._namespaces = {};
+}
+
+/**
+ * @param {string} namespace
+ * @param {object} state - keys set to null or undefined aren't part of it
+ * @param {function} [callback] - called with the result of the send that
+ * carries the state, or with nothing if it hadn't changed
+ * @return {void}
+ */
+Sync.prototype.update = function(namespace, state, callback) {
+  var entry = this._get(namespace);
+  entry.latest = copyState(state);
+  entry.dirty = true;
+  if (callback) {
+    entry.callbacks.push(callback);
+  }
+  if (!entry.inFlight) {
+    this._flush(namespace);
+  }
+};
+
+/**
+ * @private
+ * @param {string} namespace
+ * @return {object}
+ */
+Sync.prototype._get = function(namespace) {
+  var self = this;
+  if (!self._namespaces[namespace]) {
+    self._namespaces[namespace] = {
+      // the last state the watch acknowledged, and its generation
+      acked: null,
+      generation: 0,
+      latest: null,
+      dirty: false,
+      inFlight: false,
+      resync: false,
+      callbacks: []
+    };
+    self._transport.subscribe(namespace, function(message) {
+      if (KEYS.RESYNC in message) {
+        self._resync(namespace);
+      }
+    });
+  }
+  return self._namespaces[namespace];
+};
+
+/**
+ * @private
+ * @param {string} namespace
+ * @return {void}
+ */
+Sync.prototype._resync = function(namespace) {
+  var entry = this._namespaces[namespace];
+  // the update in flight may be what the watch is missing, so wait for it
+  if (entry.inFlight) {
+    entry.resync = true;
+    return;
+  }
+  entry.acked = null;
+  this._flush(namespace);
+};
+
+/**
+ * @private
+ * @param {string} namespace
+ * @return {void}
+ */
+Sync.prototype._flush = function(namespace) {
+  var self = this;
+  var entry = self._namespaces[namespace];
+  var state = entry.latest;
+  var callbacks = entry.callbacks;
+  entry.callbacks = [];
+  entry.dirty = false;
+
+  var message = copyState(state);
+  if (entry.acked) {
+    message = diff(entry.acked, state);
+    if (!Object.keys(message).length) {
+      callbacks.forEach(function(callback) {
+        callback();
+      });
+      return;
+    }
+    message[KEYS.BASE] = entry.generation;
+  }
+  var generation = entry.generation === MAX_GENERATION ?
+    1 : entry.generation + 1;
+  message[KEYS.GENERATION] = generation;
+
+  entry.inFlight = true;
+  self._transport.send(namespace, message, function(result) {
+    entry.inFlight = false;
+    // if the watch did get a failed update, the next delta's base won't match
+    // and it asks for the whole state
+    if (!isSendError(result)) {
+      entry.acked = state;
+      entry.generation = generation;
+    }
+    if (entry.resync) {
+      entry.resync = false;
+      entry.acked = null;
+      entry.dirty = true;
+    }
+    callbacks.forEach(function(callback) {
+      callback(result);
+    });
+    // unless a callback already sent it
+    if (entry.dirty) {
+      self._flush(namespace);
+    }
+  });
+};
+
+module.exports = Sync;
+module.exports.KEYS = KEYS;
+module.exports.diff = diff;
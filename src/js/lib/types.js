@@ -0,0 +1,28 @@
+'use strict';
+
+/**
+ * Type identifiers used in serialized payloads. Must match
+ * SimpleAppMessageDataType in simple-app-message.h
+ */
+module.exports = {
+  NULL: 0,
+  BOOL: 1,
+  INT: 2,
+  DATA: 3,
+  STRING: 4,
+  ARRAY: 5,
+  OBJECT: 6
+};
+
+/**
+ * Element types of an ARRAY value, the first byte of its data. Must match
+ * SimpleAppMessageArrayType in simple-app-message.h
+ */
+module.exports.ARRAY_TYPES = {
+  INT8: 0,
+  UINT8: 1,
+  INT16: 2,
+  UINT16: 3,
+  INT32: 4,
+  UINT32: 5
+};
@@ -28,7 +28,17 @@ module.exports.messageKeys = function() {
     SIMPLE_APP_MESSAGE_CHUNK_SIZE: 1,
     SIMPLE_APP_MESSAGE_CHUNK_REMAINING: 2,
     SIMPLE_APP_MESSAGE_CHUNK_TOTAL: 3,
-    SIMPLE_APP_MESSAGE_CHUNK_NAMESPACE: 4
+    SIMPLE_APP_MESSAGE_CHUNK_NAMESPACE: 4,
+    SIMPLE_APP_MESSAGE_CHUNK_TRANSFER_ID: 5,
+    SIMPLE_APP_MESSAGE_CHUNK_NAMESPACE_ID: 6,
+    SIMPLE_APP_MESSAGE_NAMESPACE_TABLE: 7,
+    SIMPLE_APP_MESSAGE_FORMAT_VERSION: 8,
+    SIMPLE_APP_MESSAGE_COMPRESSION: 9,
+    SIMPLE_APP_MESSAGE_CHUNK_WINDOW: 10,
+    SIMPLE_APP_MESSAGE_CHUNK_NACK: 11,
+    SIMPLE_APP_MESSAGE_CHUNK_BATCH: 12,
+    SIMPLE_APP_MESSAGE_CHUNK_TRACE: 13,
+    SIMPLE_APP_MESSAGE_WATCH_OPENED: 14
   };
 };
 
@@ -41,3 +51,26 @@ module.exports.appMessageData = function() {
     testBool: true
   };
 };
+
+/**
+ * Records what's sent and delivers messages to subscribers on demand
+ * @return {object}
+ */
+module.exports.transport = function() {
+  var subscribers = {};
+  return {
+    sent: [],
+    send: function(namespace, data, callback) {
+      this.sent.push({namespace: namespace, data: data, callback: callback});
+    },
+    subscribe: function(namespace, callback) {
+      subscribers[namespace] = (subscribers[namespace] || []).concat(callback);
+    },
+    deliver: function(namespace, message) {
+      (subscribers[namespace] || []).forEach(function(callback) {
+        callback(message);
+      });
+    },
+    subscribers: subscribers
+  };
+};
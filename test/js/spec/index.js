@@ -9,14 +9,49 @@ var utils = require('../../../src/js/utils');
 var fixtures = require('../fixtures');
 var sinon = require('sinon');
 var serialize = require('../../../src/js/lib/serialize');
+var compress = require('../../../src/js/lib/compress');
+var Link = require('../../../src/js/lib/link');
+var Plite = require('plite');
+// the Pebble the module registered its ready listener with
+var loadedPebble = global.Pebble;
 
 describe('simpleAppMessage', function() {
   var originalTimeout = simpleAppMessage._timeout;
+  var originalMaxRetries = simpleAppMessage._maxRetries;
+  var originalWindowSize = simpleAppMessage._windowSize;
 
   beforeEach(function() {
     stubs.Pebble();
     simpleAppMessage._chunkSize = 0;
     simpleAppMessage._timeout = 50;
+    simpleAppMessage._subscriptions = {};
+    simpleAppMessage._assemblies = {};
+    simpleAppMessage._receiveHandler = null;
+    simpleAppMessage._transferId = 0;
+    simpleAppMessage._namespaceIds = {};
+    simpleAppMessage._format = 1;
+    simpleAppMessage._compressionWindow = 0;
+    simpleAppMessage._chunkWindow = 1;
+    simpleAppMessage._maxRetries = originalMaxRetries;
+    simpleAppMessage._windowSize = originalWindowSize;
+    simpleAppMessage._transfers = {};
+    simpleAppMessage._nackHandler = null;
+    simpleAppMessage._link = new Link();
+    simpleAppMessage._batchWindow = 0;
+    simpleAppMessage._batches = false;
+    simpleAppMessage._batch = null;
+    simpleAppMessage._namespaceOptions = {};
+    simpleAppMessage._sendQueue = [];
+    simpleAppMessage._sending = {};
+    simpleAppMessage._activeTransfers = [];
+    simpleAppMessage._traceHandler = null;
+    simpleAppMessage._traceEchoes = false;
+    simpleAppMessage._tracedTransfers = {};
+    simpleAppMessage._rpc = null;
+    simpleAppMessage._sync = null;
+    simpleAppMessage._handshake = null;
+    simpleAppMessage._handshakeRequest = null;
+    simpleAppMessage._handshakeHandler = null;
   });
 
   afterEach(function() {
@@ -54,7 +89,7 @@ describe('simpleAppMessage', function() {
         });
 
       assert(Pebble.sendAppMessage.calledWith(
-        utils.objectToMessageKeys({ SIMPLE_APP_MESSAGE_CHUNK_SIZE: 1 })
+        utils.objectToMessageKeys(chunkSizeRequest())
       ));
     });
 
@@ -74,46 +109,111 @@ describe('simpleAppMessage', function() {
       });
 
       assert(Pebble.sendAppMessage.neverCalledWith(
-        utils.objectToMessageKeys({ SIMPLE_APP_MESSAGE_CHUNK_SIZE: 1 })
+        utils.objectToMessageKeys(chunkSizeRequest())
       ));
       assert.strictEqual(simpleAppMessage._chunkSize, 64);
     });
 
-    it('logs an error for failed app messages', function() {
+    it('logs an error for failed app messages', function(done) {
       var error = {error: 'someError'};
-      var callbackStub = sinon.stub();
       sinon.stub(simpleAppMessage, '_sendData');
       sinon.stub(console, 'log');
 
-      simpleAppMessage.send('TEST', {}, callbackStub);
+      simpleAppMessage.send('TEST', {}, function(result) {
+        assert(console.log.calledWithMatch('Failed to request chunk size'));
+        assert(console.log.calledWith(JSON.stringify(error)));
+        assert.strictEqual(result, error);
+        sinon.assert.notCalled(simpleAppMessage._sendData);
+
+        simpleAppMessage._sendData.restore();
+        console.log.restore();
+        done();
+      });
       Pebble.sendAppMessage.callArgWith(2, error);
 
       assert(Pebble.sendAppMessage.calledWith(
-        utils.objectToMessageKeys({ SIMPLE_APP_MESSAGE_CHUNK_SIZE: 1 })
+        utils.objectToMessageKeys(chunkSizeRequest())
       ));
+    });
 
-      assert(console.log.calledWithMatch('Failed to request chunk size'));
-      assert(console.log.calledWith(JSON.stringify(error)));
-      assert(callbackStub.calledWith(error));
+    it('fails the send if the returned chunk size is zero', function(done) {
+      simpleAppMessage.send('TEST', {}, function(error) {
+        assert.strictEqual(error,
+                           'simpleAppMessage: Fetched chunk size is invalid.');
+        assert.strictEqual(simpleAppMessage._chunkSize, 0);
+        done();
+      });
 
-      simpleAppMessage._sendData.restore();
-      console.log.restore();
+      Pebble.addEventListener
+        .withArgs('appmessage')
+        .callArgWith(1, {
+          payload: { SIMPLE_APP_MESSAGE_CHUNK_SIZE: 0 }
+        });
+      assert(Pebble.sendAppMessage.calledWith(
+        utils.objectToMessageKeys(chunkSizeRequest())
+      ));
     });
 
-    it('throws if the returned chunk size is zero', function() {
-      simpleAppMessage.send('TEST', {}, function() {});
+    it('shares one chunk size request between early sends', function(done) {
+      sinon.stub(simpleAppMessage, '_sendData').callsArg(2);
+      var callback = sinon.spy(function() {
+        if (callback.callCount < 2) {
+          return;
+        }
+        sinon.assert.calledOnce(Pebble.sendAppMessage);
+        sinon.assert.calledOnce(Pebble.addEventListener);
+        sinon.assert.calledTwice(simpleAppMessage._sendData);
+        simpleAppMessage._sendData.restore();
+        done();
+      });
 
-      assert.throws(function() {
-        Pebble.addEventListener
-          .withArgs('appmessage')
-          .callArgWith(1, {
-            payload: { SIMPLE_APP_MESSAGE_CHUNK_SIZE: 0 }
-          });
+      simpleAppMessage.send('A', {}, callback);
+      simpleAppMessage.send('B', {}, callback);
+
+      Pebble.addEventListener
+        .withArgs('appmessage')
+        .callArgWith(1, {
+          payload: { SIMPLE_APP_MESSAGE_CHUNK_SIZE: 64 }
+        });
+    });
+
+    it('asks again after a failed chunk size request', function(done) {
+      sinon.stub(console, 'log');
+
+      simpleAppMessage.send('TEST', {}, function() {
+        console.log.restore();
+        simpleAppMessage.send('TEST', {}, function() {});
+
+        sinon.assert.calledTwice(Pebble.sendAppMessage);
+        sinon.assert.alwaysCalledWith(
+          Pebble.sendAppMessage,
+          utils.objectToMessageKeys(chunkSizeRequest())
+        );
+        done();
       });
-      assert(Pebble.sendAppMessage.calledWith(
-        utils.objectToMessageKeys({ SIMPLE_APP_MESSAGE_CHUNK_SIZE: 1 })
-      ));
-      assert.strictEqual(simpleAppMessage._chunkSize, 0);
+      Pebble.sendAppMessage.callArgWith(2, {error: 'someError'});
+    });
+
+    it('ignores a failure reported after the request timed out',
+    function(done) {
+      var callback = sinon.spy();
+      sinon.stub(console, 'log');
+
+      simpleAppMessage.send('TEST', {}, callback);
+
+      setTimeout(function() {
+        Pebble.sendAppMessage.callArgWith(2, {error: 'someError'});
+
+        setTimeout(function() {
+          sinon.assert.calledOnce(callback);
+          sinon.assert.calledWith(
+            callback,
+            'simpleAppMessage: Request for chunk size timed out.'
+          );
+          console.log.restore();
+          done();
+        }, 10);
+      }, simpleAppMessage._timeout + 10);
     });
 
     it('does nothing if it receives an appMessage without chunk size in the payload',
@@ -141,6 +241,169 @@ describe('simpleAppMessage', function() {
         });
     });
 
+    it('learns namespace IDs from the chunk size response', function(done) {
+      sinon.stub(simpleAppMessage, '_sendData', function(namespace, data,
+                                                         callback) {
+        assert.deepEqual(simpleAppMessage._namespaceIds, {A: 1, BC: 2});
+        callback();
+      });
+
+      simpleAppMessage.send('TEST', {}, function() {
+        simpleAppMessage._sendData.restore();
+        done();
+      });
+
+      Pebble.addEventListener
+        .withArgs('appmessage')
+        .callArgWith(1, {
+          payload: {
+            SIMPLE_APP_MESSAGE_CHUNK_SIZE: 64,
+            SIMPLE_APP_MESSAGE_NAMESPACE_TABLE: [1, 0x41, 0, 2, 0x42, 0x43, 0]
+          }
+        });
+    });
+
+    it('learns the payload format from the chunk size response', function(done) {
+      sinon.stub(simpleAppMessage, '_sendData', function(namespace, data,
+                                                         callback) {
+        assert.strictEqual(simpleAppMessage._format, 3);
+        callback();
+      });
+
+      simpleAppMessage.send('TEST', {}, function() {
+        simpleAppMessage._sendData.restore();
+        done();
+      });
+
+      Pebble.addEventListener
+        .withArgs('appmessage')
+        .callArgWith(1, {
+          payload: {
+            SIMPLE_APP_MESSAGE_CHUNK_SIZE: 64,
+            SIMPLE_APP_MESSAGE_FORMAT_VERSION: 99
+          }
+        });
+    });
+
+    it('keeps using v1 with watches that do not announce a format',
+    function(done) {
+      simpleAppMessage._format = 2;
+      sinon.stub(simpleAppMessage, '_sendData', function(namespace, data,
+                                                         callback) {
+        assert.strictEqual(simpleAppMessage._format, 1);
+        assert.strictEqual(simpleAppMessage._compressionWindow, 0);
+        assert.strictEqual(simpleAppMessage._chunkWindow, 1);
+        callback();
+      });
+
+      simpleAppMessage.send('TEST', {}, function() {
+        simpleAppMessage._sendData.restore();
+        done();
+      });
+
+      Pebble.addEventListener
+        .withArgs('appmessage')
+        .callArgWith(1, {
+          payload: { SIMPLE_APP_MESSAGE_CHUNK_SIZE: 64 }
+        });
+    });
+
+    it('learns the compression window from the chunk size response',
+    function(done) {
+      sinon.stub(simpleAppMessage, '_sendData', function(namespace, data,
+                                                         callback) {
+        assert.strictEqual(simpleAppMessage._compressionWindow, 256);
+        callback();
+      });
+
+      simpleAppMessage.send('TEST', {}, function() {
+        simpleAppMessage._sendData.restore();
+        done();
+      });
+
+      Pebble.addEventListener
+        .withArgs('appmessage')
+        .callArgWith(1, {
+          payload: {
+            SIMPLE_APP_MESSAGE_CHUNK_SIZE: 64,
+            SIMPLE_APP_MESSAGE_COMPRESSION: 256
+          }
+        });
+    });
+
+    it('learns the chunk window from the chunk size response', function(done) {
+      sinon.stub(simpleAppMessage, '_sendData', function(namespace, data,
+                                                         callback) {
+        assert.strictEqual(simpleAppMessage._chunkWindow, 4);
+        callback();
+      });
+
+      simpleAppMessage.send('TEST', {}, function() {
+        simpleAppMessage._sendData.restore();
+        done();
+      });
+
+      Pebble.addEventListener
+        .withArgs('appmessage')
+        .callArgWith(1, {
+          payload: {
+            SIMPLE_APP_MESSAGE_CHUNK_SIZE: 64,
+            SIMPLE_APP_MESSAGE_CHUNK_WINDOW: 4
+          }
+        });
+    });
+
+    it('learns batch support from the chunk size response', function(done) {
+      sinon.stub(simpleAppMessage, '_sendData', function(namespace, data,
+                                                         callback) {
+        assert.strictEqual(simpleAppMessage._batches, true);
+        callback();
+      });
+
+      simpleAppMessage.send('TEST', {}, function() {
+        simpleAppMessage._sendData.restore();
+        done();
+      });
+
+      Pebble.addEventListener
+        .withArgs('appmessage')
+        .callArgWith(1, {
+          payload: {
+            SIMPLE_APP_MESSAGE_CHUNK_SIZE: 64,
+            SIMPLE_APP_MESSAGE_CHUNK_BATCH: 1
+          }
+        });
+    });
+
+    it('learns trace support from the chunk size response', function(done) {
+      sinon.stub(simpleAppMessage, '_sendData', function(namespace, data,
+                                                         callback) {
+        assert.strictEqual(simpleAppMessage._traceEchoes, true);
+        callback();
+      });
+
+      simpleAppMessage.send('TEST', {}, function() {
+        simpleAppMessage._sendData.restore();
+        done();
+      });
+
+      Pebble.addEventListener
+        .withArgs('appmessage')
+        .callArgWith(1, {
+          payload: {
+            SIMPLE_APP_MESSAGE_CHUNK_SIZE: 64,
+            SIMPLE_APP_MESSAGE_CHUNK_TRACE: 1
+          }
+        });
+    });
+
+    it('errors if namespace is empty', function(done) {
+      simpleAppMessage.send('', {}, function(error) {
+        assert.ok(/must not be empty/.test(error.error));
+        done();
+      });
+    });
+
     it('fires error callback if chunk size request timed out', function(done) {
       var startTime = new Date().getTime();
 
@@ -157,6 +420,75 @@ describe('simpleAppMessage', function() {
 
   });
 
+  describe('.init', function() {
+    it('asks for the chunk size ahead of the first send', function(done) {
+      sinon.stub(simpleAppMessage, '_sendData').callsArg(2);
+
+      simpleAppMessage.init().then(function() {
+        simpleAppMessage.send('TEST', {}, function() {
+          sinon.assert.calledOnce(Pebble.sendAppMessage);
+          sinon.assert.calledOnce(simpleAppMessage._sendData);
+          simpleAppMessage._sendData.restore();
+          done();
+        });
+      });
+
+      assert(Pebble.sendAppMessage.calledWith(
+        utils.objectToMessageKeys(chunkSizeRequest())
+      ));
+      Pebble.addEventListener
+        .withArgs('appmessage')
+        .callArgWith(1, {
+          payload: { SIMPLE_APP_MESSAGE_CHUNK_SIZE: 64 }
+        });
+    });
+
+    it('is called on ready', function() {
+      loadedPebble.addEventListener.withArgs('ready').callArg(1);
+
+      sinon.assert.calledOnce(Pebble.sendAppMessage);
+      sinon.assert.calledWith(Pebble.sendAppMessage,
+                              utils.objectToMessageKeys(chunkSizeRequest()));
+    });
+
+    it('asks again when the watch app restarts', function(done) {
+      simpleAppMessage.init().then(function() {
+        respond({ SIMPLE_APP_MESSAGE_WATCH_OPENED: 1 });
+
+        sinon.assert.calledTwice(Pebble.sendAppMessage);
+        assert(simpleAppMessage._handshakeRequest);
+        simpleAppMessage.init().then(function() {
+          assert.strictEqual(simpleAppMessage._handshakeRequest, null);
+          done();
+        });
+        respond();
+      });
+      respond();
+    });
+
+    it('keeps its request when the watch app opens meanwhile', function(done) {
+      simpleAppMessage.init().then(function() {
+        sinon.assert.calledOnce(Pebble.sendAppMessage);
+        done();
+      });
+
+      respond({ SIMPLE_APP_MESSAGE_WATCH_OPENED: 1 });
+      assert(simpleAppMessage._handshakeRequest);
+      respond();
+    });
+
+    it('ignores answers to requests that timed out', function(done) {
+      simpleAppMessage.init().then(null, function() {
+        respond();
+
+        sinon.assert.calledOnce(Pebble.sendAppMessage);
+        assert.strictEqual(simpleAppMessage._chunkSize, 0);
+        assert.strictEqual(simpleAppMessage._handshake, null);
+        done();
+      });
+    });
+  });
+
   describe('._sendData', function() {
     it('calls _sendChunk for each chunk in order', function(done) {
       var callback = sinon.spy(function() {
@@ -192,8 +524,8 @@ describe('simpleAppMessage', function() {
       // success on first message
       Pebble.sendAppMessage.onFirstCall().callsArg(1);
 
-      // fail on second
-      Pebble.sendAppMessage.onSecondCall().callsArgWith(2, expectedError);
+      // fail on second and every retry
+      Pebble.sendAppMessage.callsArgWith(2, expectedError);
 
       var testData = {test1: 'TEST1', test2: 'TEST2'};
       simpleAppMessage._sendData('TEST', testData, function(error) {
@@ -216,29 +548,1032 @@ describe('simpleAppMessage', function() {
       });
     });
 
-    it('throws if chunk size is missing', function() {
-      assert.throws(function() {
-        simpleAppMessage._sendData('TEST', {}, function() {});
-      }, /simpleAppMessage:/);
+    it('uses one transfer ID per message', function(done) {
+      var callback = sinon.spy(function() {
+        if (callback.callCount < 2) {
+          return;
+        }
+
+        var transferIds = {};
+        simpleAppMessage._sendChunk.args.forEach(function(args) {
+          transferIds[args[0]] = (transferIds[args[0]] || []).concat(args[4]);
+        });
+        simpleAppMessage._sendChunk.restore();
+        assert.deepEqual(transferIds, {TEST: [1, 1, 1], OTHER: [2]});
+        done();
+      });
+
+      sinon.spy(simpleAppMessage, '_sendChunk');
+      simpleAppMessage._chunkSize = 12;
+      Pebble.sendAppMessage.callsArg(1);
+
+      var data = {test1: 'value1', test2: 'value2'};
+      simpleAppMessage._sendData('TEST', data, callback);
+      simpleAppMessage._sendData('OTHER', {}, callback);
     });
-  });
 
-  describe('._sendChunk', function() {
-    it('sends the chunk with the correct data and returns a promise', function() {
-      var chunk = serialize({test1: 'TEST1', test2: 'TEST2'});
-      var result = simpleAppMessage._sendChunk('TEST', chunk, 1, 2);
+    it('wraps the transfer ID at 16 bits', function() {
+      sinon.spy(simpleAppMessage, '_sendChunk');
+      simpleAppMessage._chunkSize = 64;
+      simpleAppMessage._transferId = 0xFFFF;
 
-      assert.strictEqual(typeof result.then, 'function');
-      assert.strictEqual(typeof result.catch, 'function');
+      simpleAppMessage._sendData('TEST', {a: 1}, function() {});
 
-      result.then(function() {
-        sinon.assert.calledWith(Pebble.sendAppMessage, utils.objectToMessageKeys({
-          SIMPLE_APP_MESSAGE_CHUNK_DATA: chunk,
-          SIMPLE_APP_MESSAGE_CHUNK_REMAINING: 1,
-          SIMPLE_APP_MESSAGE_CHUNK_TOTAL: 2,
-          SIMPLE_APP_MESSAGE_CHUNK_NAMESPACE: 'TEST'
-        }));
+      var transferId = simpleAppMessage._sendChunk.firstCall.args[4];
+      simpleAppMessage._sendChunk.restore();
+      assert.strictEqual(transferId, 0);
+    });
+
+    it('uses larger chunks for namespaces with an ID', function(done) {
+      var data = {test1: 'value1', test2: 'value2'};
+      var callback = sinon.spy(function() {
+        var chunk1 = serialize(data).slice(0, 27);
+        var chunk2 = serialize(data).slice(27);
+        sinon.assert.calledTwice(simpleAppMessage._sendChunk);
+        sinon.assert.calledWith(simpleAppMessage._sendChunk, 'TEST', chunk1, 1);
+        sinon.assert.calledWith(simpleAppMessage._sendChunk, 'TEST', chunk2, 0);
+
+        simpleAppMessage._sendChunk.restore();
+        done();
       });
+
+      sinon.spy(simpleAppMessage, '_sendChunk');
+      simpleAppMessage._chunkSize = 12;
+      simpleAppMessage._namespaceIds = {TEST: 3};
+      Pebble.sendAppMessage.callsArg(1);
+
+      simpleAppMessage._sendData('TEST', data, callback);
     });
-  });
-});
+
+    it('splits messages at the link\'s chunk size', function() {
+      sinon.spy(simpleAppMessage, '_sendChunk');
+      simpleAppMessage._chunkSize = 32;
+      simpleAppMessage._link.chunkSize(32);
+      simpleAppMessage._link.failed(Date.now());
+
+      simpleAppMessage._sendData('TEST', {test1: 'value1', test2: 'value2'},
+                                 function() {});
+
+      var chunk = simpleAppMessage._sendChunk.firstCall.args[1];
+      simpleAppMessage._sendChunk.restore();
+      assert.strictEqual(chunk.length, 16);
+    });
+
+    it('serializes with the format the watch announced', function() {
+      sinon.spy(simpleAppMessage, '_sendChunk');
+      simpleAppMessage._chunkSize = 64;
+      simpleAppMessage._format = 2;
+
+      simpleAppMessage._sendData('TEST', {a: 1}, function() {});
+
+      var chunk = simpleAppMessage._sendChunk.firstCall.args[1];
+      simpleAppMessage._sendChunk.restore();
+      assert.deepEqual(chunk, serialize({a: 1}, 2));
+    });
+
+    it('falls back to v1 if the v2 header does not fit in a chunk', function() {
+      sinon.spy(simpleAppMessage, '_sendChunk');
+      simpleAppMessage._chunkSize = 2;
+      simpleAppMessage._format = 2;
+
+      simpleAppMessage._sendData('TEST', {}, function() {});
+
+      var chunk = simpleAppMessage._sendChunk.firstCall.args[1];
+      simpleAppMessage._sendChunk.restore();
+      assert.deepEqual(chunk, new Uint8Array([0]));
+    });
+
+    it('compresses for watches that announced a window', function() {
+      var data = {a: 'abcabcabcabcabcabcabc', b: 'abcabcabcabcabcabcabc'};
+      sinon.spy(simpleAppMessage, '_sendChunk');
+      simpleAppMessage._chunkSize = 64;
+      simpleAppMessage._compressionWindow = 256;
+
+      simpleAppMessage._sendData('TEST', data, function() {});
+
+      var chunk = simpleAppMessage._sendChunk.firstCall.args[1];
+      simpleAppMessage._sendChunk.restore();
+      assert.deepEqual(chunk, compress(serialize(data, 1), 2, 256));
+      assert.deepEqual(Array.from(chunk.subarray(0, 2)), [0, 0x80]);
+    });
+
+    it('sends payloads that do not get smaller uncompressed', function() {
+      sinon.spy(simpleAppMessage, '_sendChunk');
+      simpleAppMessage._chunkSize = 64;
+      simpleAppMessage._compressionWindow = 256;
+
+      simpleAppMessage._sendData('TEST', {a: 1}, function() {});
+
+      var chunk = simpleAppMessage._sendChunk.firstCall.args[1];
+      simpleAppMessage._sendChunk.restore();
+      assert.deepEqual(chunk, serialize({a: 1}));
+    });
+
+    it('does not compress if the header does not fit in a chunk', function() {
+      var data = {a: 'aaaaaaaaaaaaaaaaaaaaaaaaaaaa'};
+      sinon.spy(simpleAppMessage, '_sendChunk');
+      simpleAppMessage._chunkSize = 4;
+      simpleAppMessage._compressionWindow = 256;
+
+      simpleAppMessage._sendData('TEST', data, function() {});
+
+      var chunk = simpleAppMessage._sendChunk.firstCall.args[1];
+      simpleAppMessage._sendChunk.restore();
+      assert.deepEqual(chunk, serialize(data).slice(0, 4));
+    });
+
+    describe('with a chunk window', function() {
+      var data = {test1: 'value1', test2: 'value2'};
+      var sent;
+      var inFlight;
+      var maxInFlight;
+      var failures;
+
+      beforeEach(function() {
+        sent = [];
+        inFlight = 0;
+        maxInFlight = 0;
+        // chunk index to the number of times it fails before it gets through
+        failures = {};
+        simpleAppMessage._chunkSize = 4;
+        simpleAppMessage._chunkWindow = 2;
+        sinon.stub(simpleAppMessage, '_sendChunk', function(namespace, chunk,
+                                                            remaining, total) {
+          var index = total - remaining - 1;
+          sent.push(index);
+          maxInFlight = Math.max(maxInFlight, ++inFlight);
+          return Plite(function(resolve, reject) {
+            setTimeout(function() {
+              inFlight--;
+              if (failures[index]) {
+                failures[index]--;
+                reject({index: index});
+              } else {
+                resolve({index: index});
+              }
+            }, 1);
+          });
+        });
+      });
+
+      afterEach(function() {
+        simpleAppMessage._sendChunk.restore();
+      });
+
+      /**
+       * @param {Array} nack
+       * @return {void}
+       */
+      function sendNack(nack) {
+        Pebble.addEventListener.withArgs('appmessage').firstCall.args[1]({
+          payload: {SIMPLE_APP_MESSAGE_CHUNK_NACK: nack}
+        });
+      }
+
+      it('keeps the watch\'s window of chunks in flight', function(done) {
+        simpleAppMessage._sendData('TEST', data, function(result) {
+          var total = Math.ceil(serialize(data).length / 4);
+          assert.strictEqual(maxInFlight, 2);
+          assert.deepEqual(sent, Array.apply(null, Array(total)).map(
+            function(value, index) { return index; }));
+          assert.deepEqual(result, {index: total - 1});
+          done();
+        });
+      });
+
+      it('never exceeds its own window', function(done) {
+        simpleAppMessage._chunkWindow = 16;
+        simpleAppMessage._windowSize = 3;
+
+        simpleAppMessage._sendData('TEST', data, function() {
+          assert.strictEqual(maxInFlight, 3);
+          done();
+        });
+      });
+
+      it('resends only the chunk that failed', function(done) {
+        failures[1] = 1;
+
+        simpleAppMessage._sendData('TEST', data, function(result) {
+          var total = Math.ceil(serialize(data).length / 4);
+          assert.deepEqual(sent.slice(0, 5), [0, 1, 2, 1, 3]);
+          assert.strictEqual(sent.length, total + 1);
+          assert.strictEqual(typeof result.index, 'number');
+          done();
+        });
+      });
+
+      it('resends chunks the watch reports missing', function(done) {
+        simpleAppMessage._sendData('TEST', data, function() {
+          sent = [];
+          // transfer 1, first 2, count 2
+          sendNack([1, 0, 0, 0, 2, 0, 0, 0, 2, 0, 0, 0]);
+
+          setTimeout(function() {
+            assert.deepEqual(sent, [2, 3]);
+            done();
+          }, 10);
+        });
+      });
+
+      it('ignores NACKs for other transfers', function(done) {
+        simpleAppMessage._sendData('TEST', data, function() {
+          sent = [];
+          sendNack([2, 0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 0]);
+          sendNack([1, 0, 0]);
+          Pebble.addEventListener.firstCall.args[1]({payload: {}});
+
+          setTimeout(function() {
+            assert.deepEqual(sent, []);
+            done();
+          }, 10);
+        });
+      });
+
+      it('does not count resends the watch asked for as retries',
+      function(done) {
+        simpleAppMessage._maxRetries = 0;
+
+        simpleAppMessage._sendData('TEST', data, function() {
+          sent = [];
+          sendNack([1, 0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 0]);
+
+          setTimeout(function() {
+            sendNack([1, 0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 0]);
+
+            setTimeout(function() {
+              assert.deepEqual(sent, [0, 0]);
+              done();
+            }, 10);
+          }, 10);
+        });
+      });
+
+      it('stops listening for NACKs after the timeout', function(done) {
+        simpleAppMessage._sendData('TEST', data, function() {
+          sinon.assert.notCalled(Pebble.removeEventListener);
+
+          setTimeout(function() {
+            sinon.assert.calledOnce(Pebble.removeEventListener);
+            assert.deepEqual(simpleAppMessage._transfers, {});
+            done();
+          }, simpleAppMessage._timeout + 10);
+        });
+      });
+
+      it('keeps resend functions for reused transfer IDs', function() {
+        var first = function() {};
+        var second = function() {};
+        simpleAppMessage._watchTransfer(7, first);
+        simpleAppMessage._watchTransfer(7, second);
+        simpleAppMessage._watchTransfer(8, first);
+        simpleAppMessage._forgetTransfer(7, first);
+
+        assert.strictEqual(simpleAppMessage._transfers[7], second);
+        sinon.assert.calledOnce(Pebble.addEventListener);
+
+        simpleAppMessage._forgetTransfer(7, second);
+        sinon.assert.notCalled(Pebble.removeEventListener);
+        simpleAppMessage._forgetTransfer(8, first);
+        sinon.assert.calledOnce(Pebble.removeEventListener);
+      });
+
+      it('fails once a chunk keeps failing', function(done) {
+        var callback = sinon.spy();
+        simpleAppMessage._chunkWindow = 3;
+        simpleAppMessage._maxRetries = 1;
+        failures[0] = 10;
+        failures[1] = 10;
+
+        simpleAppMessage._sendData('TEST', data, callback);
+
+        setTimeout(function() {
+          sinon.assert.calledOnce(callback);
+          sinon.assert.calledWith(callback, {index: 0});
+          assert.deepEqual(sent, [0, 1, 2, 0, 1, 3]);
+          sinon.assert.calledOnce(Pebble.removeEventListener);
+          done();
+        }, 20);
+      });
+    });
+
+    it('throws if chunk size is missing', function() {
+      assert.throws(function() {
+        simpleAppMessage._sendData('TEST', {}, function() {});
+      }, /simpleAppMessage:/);
+    });
+  });
+
+  describe('batching', function() {
+    beforeEach(function() {
+      simpleAppMessage._chunkSize = 64;
+      simpleAppMessage._batches = true;
+      simpleAppMessage.setBatchWindow(5);
+      sinon.spy(simpleAppMessage, '_sendData');
+      Pebble.sendAppMessage.callsArg(1);
+    });
+
+    afterEach(function() {
+      simpleAppMessage._sendData.restore();
+    });
+
+    it('sends messages within the window as one transfer', function(done) {
+      var callbackA = sinon.spy();
+
+      simpleAppMessage.send('A', {a: 1}, callbackA);
+      simpleAppMessage.send('B', {b: 'x'}, function() {
+        sinon.assert.calledOnce(simpleAppMessage._sendData);
+        sinon.assert.calledWith(simpleAppMessage._sendData, '', {
+          A: serialize({a: 1}, simpleAppMessage._format),
+          B: serialize({b: 'x'}, simpleAppMessage._format)
+        });
+        sinon.assert.calledWithMatch(Pebble.sendAppMessage,
+                                     utils.objectToMessageKeys({
+          SIMPLE_APP_MESSAGE_CHUNK_BATCH: 1
+        }));
+        sinon.assert.calledOnce(callbackA);
+        done();
+      });
+
+      sinon.assert.notCalled(simpleAppMessage._sendData);
+    });
+
+    it('sends a message on its own if nothing joins it', function(done) {
+      simpleAppMessage.send('A', {a: 1}, function() {
+        sinon.assert.calledWith(simpleAppMessage._sendData, 'A', {a: 1});
+        done();
+      });
+    });
+
+    it('sends the batch once it fills a chunk', function() {
+      simpleAppMessage._chunkSize = 24;
+
+      simpleAppMessage.send('A', {a: 'abcdef'}, function() {});
+      sinon.assert.notCalled(simpleAppMessage._sendData);
+      simpleAppMessage.send('B', {b: 'abcdef'}, function() {});
+      sinon.assert.calledOnce(simpleAppMessage._sendData);
+      assert.strictEqual(simpleAppMessage._batch, null);
+    });
+
+    it('sends the batch before a second message for a namespace', function() {
+      simpleAppMessage.send('A', {a: 1}, function() {});
+      simpleAppMessage.send('A', {a: 2}, function() {});
+
+      sinon.assert.calledOnce(simpleAppMessage._sendData);
+      sinon.assert.calledWith(simpleAppMessage._sendData, 'A', {a: 1});
+    });
+
+    it('sends right away without a window', function() {
+      simpleAppMessage.setBatchWindow(0);
+      simpleAppMessage.send('A', {a: 1}, function() {});
+
+      sinon.assert.calledOnce(simpleAppMessage._sendData);
+    });
+
+    it('sends right away to watches that do not unpack batches', function() {
+      simpleAppMessage._batches = false;
+      simpleAppMessage.send('A', {a: 1}, function() {});
+
+      sinon.assert.calledOnce(simpleAppMessage._sendData);
+    });
+
+    it('sends what it held back once the window is turned off', function() {
+      simpleAppMessage.send('A', {a: 1}, function() {});
+      simpleAppMessage.setBatchWindow(0);
+
+      sinon.assert.calledOnce(simpleAppMessage._sendData);
+    });
+
+    it('sends higher priority messages right away', function() {
+      simpleAppMessage.setNamespaceOptions('A', {priority: 1});
+      simpleAppMessage.send('A', {a: 1}, function() {});
+
+      sinon.assert.calledOnce(simpleAppMessage._sendData);
+    });
+
+    it('replaces a superseded message in the batch', function(done) {
+      var callbackA = sinon.spy();
+      simpleAppMessage.setNamespaceOptions('A', {supersede: true});
+
+      simpleAppMessage.send('A', {a: 1}, callbackA);
+      simpleAppMessage.send('B', {b: 2}, function() {});
+      simpleAppMessage.send('A', {a: 3}, function() {
+        sinon.assert.calledWith(simpleAppMessage._sendData, '', {
+          B: serialize({b: 2}, simpleAppMessage._format),
+          A: serialize({a: 3}, simpleAppMessage._format)
+        });
+        done();
+      });
+
+      sinon.assert.calledWith(callbackA, sinon.match({superseded: true}));
+      sinon.assert.notCalled(simpleAppMessage._sendData);
+    });
+
+    it('drops a superseded message queued behind one that is sending',
+    function() {
+      var superseded = sinon.spy();
+      simpleAppMessage.setNamespaceOptions('A', {supersede: true});
+      Pebble.sendAppMessage = sinon.stub();
+
+      simpleAppMessage.send('A', {a: 1}, function() {});
+      simpleAppMessage._flushBatch();
+      simpleAppMessage.send('A', {a: 2}, superseded);
+      simpleAppMessage._flushBatch();
+      assert.strictEqual(simpleAppMessage._sendQueue.length, 1);
+
+      simpleAppMessage.send('A', {a: 3}, function() {});
+      sinon.assert.calledWith(superseded, sinon.match({superseded: true}));
+      assert.deepEqual(simpleAppMessage._sendQueue, []);
+      assert.deepEqual(simpleAppMessage._batch.messages[0].data, {a: 3});
+    });
+  });
+
+  describe('scheduling', function() {
+    var callbacks;
+
+    beforeEach(function() {
+      simpleAppMessage._chunkSize = 64;
+      callbacks = [];
+      sinon.stub(simpleAppMessage, '_sendData', function(namespace, data,
+                                                         callback) {
+        callbacks.push(callback);
+      });
+    });
+
+    afterEach(function() {
+      simpleAppMessage._sendData.restore();
+    });
+
+    it('sends messages for a namespace one at a time', function() {
+      var callback = sinon.spy();
+
+      simpleAppMessage.send('A', {a: 1}, callback);
+      simpleAppMessage.send('A', {a: 2}, function() {});
+      simpleAppMessage.send('B', {b: 1}, function() {});
+      sinon.assert.calledTwice(simpleAppMessage._sendData);
+
+      callbacks[0]({some: 'result'});
+      sinon.assert.calledWith(callback, {some: 'result'});
+      sinon.assert.calledThrice(simpleAppMessage._sendData);
+      sinon.assert.calledWith(simpleAppMessage._sendData.thirdCall, 'A',
+                              {a: 2});
+    });
+
+    it('drops messages superseded before they started', function() {
+      var superseded = sinon.spy();
+      simpleAppMessage.setNamespaceOptions('A', {supersede: true});
+
+      simpleAppMessage.send('A', {a: 1}, function() {});
+      simpleAppMessage.send('B', {b: 1}, function() {});
+      simpleAppMessage.send('B', {b: 2}, function() {});
+      simpleAppMessage.send('A', {a: 2}, superseded);
+      simpleAppMessage.send('A', {a: 3}, function() {});
+      sinon.assert.calledWith(superseded, {
+        error: 'simpleAppMessage: superseded by a newer message',
+        superseded: true
+      });
+
+      callbacks[0]();
+      sinon.assert.calledThrice(simpleAppMessage._sendData);
+      sinon.assert.calledWith(simpleAppMessage._sendData.thirdCall, 'A',
+                              {a: 3});
+      assert.deepEqual(simpleAppMessage._sendQueue[0].data, {b: 2});
+    });
+
+    it('queues messages behind those with the same or a higher priority',
+    function() {
+      simpleAppMessage.setNamespaceOptions('H', {priority: 1});
+
+      simpleAppMessage.send('A', {a: 1}, function() {});
+      simpleAppMessage.send('H', {h: 1}, function() {});
+      simpleAppMessage.send('A', {a: 2}, function() {});
+      simpleAppMessage.send('H', {h: 2}, function() {});
+      simpleAppMessage.send('H', {h: 3}, function() {});
+
+      assert.deepEqual(simpleAppMessage._sendQueue.map(function(message) {
+        return message.data;
+      }), [{h: 2}, {h: 3}, {a: 2}]);
+    });
+  });
+
+  describe('preemption', function() {
+    var sent;
+
+    beforeEach(function() {
+      sent = [];
+      simpleAppMessage._chunkSize = 4;
+      simpleAppMessage.setNamespaceOptions('HIGH', {priority: 1});
+      sinon.stub(simpleAppMessage, '_sendChunk', function(namespace) {
+        sent.push(namespace);
+        return Plite(function(resolve) {
+          setTimeout(resolve, 1);
+        });
+      });
+    });
+
+    afterEach(function() {
+      simpleAppMessage._sendChunk.restore();
+    });
+
+    it('sends a higher priority transfer before the rest of a lower one',
+    function(done) {
+      var high = {h: 'high'};
+
+      simpleAppMessage.send('BULK', {b: 'takes many chunks'}, function() {
+        var first = sent.indexOf('HIGH');
+        var last = sent.lastIndexOf('HIGH');
+
+        assert.strictEqual(first, 1);
+        assert.strictEqual(last - first + 1,
+                           Math.ceil(serialize(high).length / 4));
+        assert.ok(sent.indexOf('OTHER') > last);
+        done();
+      });
+      simpleAppMessage.send('HIGH', high, function() {});
+      simpleAppMessage.send('OTHER', {o: 1}, function() {});
+    });
+  });
+
+  describe('tracing', function() {
+    var data = {test1: 'value1', test2: 'value2'};
+    var traceHandler;
+
+    beforeEach(function() {
+      simpleAppMessage._chunkSize = 16;
+      simpleAppMessage._traceEchoes = true;
+      traceHandler = sinon.spy();
+      simpleAppMessage.setTraceHandler(traceHandler);
+      Pebble.sendAppMessage.callsArg(1);
+    });
+
+    /**
+     * @param {Array} echo
+     * @return {void}
+     */
+    function sendTrace(echo) {
+      Pebble.addEventListener.withArgs('appmessage').firstCall.args[1]({
+        payload: {SIMPLE_APP_MESSAGE_CHUNK_TRACE: echo}
+      });
+    }
+
+    it('reports the timeline once the watch echoes its trace', function(done) {
+      simpleAppMessage._sendData('TEST', data, function() {
+        sinon.assert.calledWithMatch(Pebble.sendAppMessage,
+                                     utils.objectToMessageKeys({
+          SIMPLE_APP_MESSAGE_CHUNK_TRACE: 1
+        }));
+        sinon.assert.notCalled(traceHandler);
+
+        // transfer 1, reassembly 3, deserialize 2, dispatch 5, dispatched
+        sendTrace([1, 0, 0, 0, 3, 0, 0, 0, 2, 0, 0, 0, 5, 0, 0, 0, 1, 0, 0, 0]);
+
+        var trace = traceHandler.firstCall.args[0];
+        assert.strictEqual(trace.namespace, 'TEST');
+        assert.strictEqual(trace.transferId, 1);
+        assert.strictEqual(trace.size, serialize(data).length);
+        assert.strictEqual(typeof trace.serialize, 'number');
+        assert.strictEqual(typeof trace.acked, 'number');
+        assert.deepEqual(trace.chunks.map(function(chunk) {
+          return chunk.index;
+        }), [0, 1, 2, 3]);
+        assert.strictEqual(typeof trace.chunks[3].acked, 'number');
+        assert.strictEqual(typeof trace.watch.echoed, 'number');
+        assert.strictEqual(trace.watch.reassembly, 3);
+        assert.strictEqual(trace.watch.deserialize, 2);
+        assert.strictEqual(trace.watch.dispatch, 5);
+        assert.strictEqual(trace.watch.dispatched, true);
+
+        setTimeout(function() {
+          sinon.assert.calledOnce(traceHandler);
+          done();
+        }, simpleAppMessage._timeout + 10);
+      });
+    });
+
+    it('leaves room in each chunk for the trace flag', function(done) {
+      simpleAppMessage._sendData('TEST', data, function() {
+        sendTrace([1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0]);
+
+        var trace = traceHandler.firstCall.args[0];
+        assert.strictEqual(trace.chunks.length, Math.ceil(trace.size / 8));
+        assert.strictEqual(trace.chunks[0].size, 8);
+        assert.strictEqual(trace.watch.dispatched, false);
+        done();
+      });
+    });
+
+    it('ignores traces for other transfers and short ones', function(done) {
+      simpleAppMessage._sendData('TEST', data, function() {
+        sendTrace([2, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0]);
+        sendTrace([1, 0, 0, 0]);
+
+        sinon.assert.notCalled(traceHandler);
+        done();
+      });
+    });
+
+    it('reports the timeline without the watch\'s trace after the timeout',
+    function(done) {
+      simpleAppMessage._sendData('TEST', data, function() {
+        setTimeout(function() {
+          sinon.assert.calledOnce(traceHandler);
+          assert.strictEqual(traceHandler.firstCall.args[0].watch, null);
+          done();
+        }, simpleAppMessage._timeout + 10);
+      });
+    });
+
+    it('reports the timeline of a failed send with its error', function(done) {
+      var error = {some: 'error'};
+      Pebble.sendAppMessage.callsArgWith(2, error);
+      simpleAppMessage._maxRetries = 0;
+
+      simpleAppMessage._sendData('TEST', data, function() {
+        setTimeout(function() {
+          var trace = traceHandler.firstCall.args[0];
+          assert.strictEqual(trace.error, error);
+          assert.strictEqual(trace.acked, null);
+          assert.strictEqual(trace.chunks[0].error, error);
+          assert.strictEqual(trace.watch, null);
+          done();
+        }, 10);
+      });
+    });
+
+    it('does not trace once the handler is removed', function(done) {
+      simpleAppMessage._sendData('TEST', data, function() {
+        simpleAppMessage.setTraceHandler();
+        sendTrace([1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 0]);
+        sinon.assert.notCalled(traceHandler);
+
+        Pebble.sendAppMessage.reset();
+        simpleAppMessage._sendData('TEST', {a: 1}, function() {
+          sinon.assert.neverCalledWithMatch(Pebble.sendAppMessage,
+                                            utils.objectToMessageKeys({
+            SIMPLE_APP_MESSAGE_CHUNK_TRACE: 1
+          }));
+          done();
+        });
+      });
+    });
+
+    it('does not trace for watches that do not echo traces', function(done) {
+      simpleAppMessage._traceEchoes = false;
+
+      simpleAppMessage._sendData('TEST', data, function() {
+        setTimeout(function() {
+          sinon.assert.notCalled(traceHandler);
+          done();
+        }, simpleAppMessage._timeout + 10);
+      });
+    });
+  });
+
+  describe('._sendChunk', function() {
+    it('sends the chunk with the correct data and returns a promise', function() {
+      var chunk = serialize({test1: 'TEST1', test2: 'TEST2'});
+      var result = simpleAppMessage._sendChunk('TEST', chunk, 1, 2, 7);
+
+      assert.strictEqual(typeof result.then, 'function');
+      assert.strictEqual(typeof result.catch, 'function');
+
+      result.then(function() {
+        sinon.assert.calledWith(Pebble.sendAppMessage, utils.objectToMessageKeys({
+          SIMPLE_APP_MESSAGE_CHUNK_DATA: Array.from(chunk),
+          SIMPLE_APP_MESSAGE_CHUNK_REMAINING: 1,
+          SIMPLE_APP_MESSAGE_CHUNK_TOTAL: 2,
+          SIMPLE_APP_MESSAGE_CHUNK_NAMESPACE: 'TEST',
+          SIMPLE_APP_MESSAGE_CHUNK_TRANSFER_ID: 7
+        }));
+      });
+    });
+  });
+
+  describe('._sendChunk with the link controller', function() {
+    it('reports acks to the link', function(done) {
+      Pebble.sendAppMessage.callsArg(1);
+
+      simpleAppMessage._sendChunk('TEST', [1], 0, 1, 7).then(function() {
+        var estimates = simpleAppMessage.getLinkEstimates();
+        assert.strictEqual(typeof estimates.latency, 'number');
+        assert.strictEqual(estimates.failureRate, 0);
+        done();
+      });
+    });
+
+    it('reports failures to the link and waits longer after them',
+    function(done) {
+      var error = {some: 'error'};
+      Pebble.sendAppMessage.callsArgWith(2, error);
+
+      simpleAppMessage._sendChunk('TEST', [1], 0, 1, 7).catch(function(e) {
+        assert.strictEqual(e, error);
+        assert.strictEqual(simpleAppMessage.getLinkEstimates().chunkDelay,
+                           simpleAppMessage._chunkDelay + 10);
+        assert.ok(simpleAppMessage.getLinkEstimates().failureRate > 0);
+        done();
+      });
+    });
+  });
+
+  describe('._sendChunk with a namespace ID', function() {
+    it('sends the ID instead of the namespace', function(done) {
+      simpleAppMessage._namespaceIds = {TEST: 3};
+      Pebble.sendAppMessage.callsArg(1);
+
+      simpleAppMessage._sendChunk('TEST', [1], 0, 1, 7).then(function() {
+        sinon.assert.calledWith(Pebble.sendAppMessage,
+                                utils.objectToMessageKeys({
+          SIMPLE_APP_MESSAGE_CHUNK_DATA: [1],
+          SIMPLE_APP_MESSAGE_CHUNK_REMAINING: 0,
+          SIMPLE_APP_MESSAGE_CHUNK_TOTAL: 1,
+          SIMPLE_APP_MESSAGE_CHUNK_TRANSFER_ID: 7,
+          SIMPLE_APP_MESSAGE_CHUNK_NAMESPACE_ID: [3]
+        }));
+        done();
+      });
+    });
+  });
+
+  describe('._parseNamespaceTable', function() {
+    it('returns nothing for an empty table', function() {
+      assert.deepEqual(simpleAppMessage._parseNamespaceTable([]), {});
+    });
+
+    it('keeps the entries before a truncated one', function() {
+      sinon.stub(console, 'log');
+      var namespaceIds = simpleAppMessage._parseNamespaceTable([
+        1, 0x41, 0, 2, 0x42
+      ]);
+      console.log.restore();
+
+      assert.deepEqual(namespaceIds, {A: 1});
+    });
+  });
+
+  describe('.subscribe', function() {
+    it('listens for appmessage events once', function() {
+      simpleAppMessage.subscribe('TEST', function() {});
+      simpleAppMessage.subscribe('OTHER', function() {});
+
+      sinon.assert.calledOnce(Pebble.addEventListener);
+      sinon.assert.calledWith(Pebble.addEventListener, 'appmessage');
+    });
+
+    it('delivers v2 messages from the watch', function() {
+      var data = fixtures.appMessageData();
+      var callback = sinon.spy();
+      simpleAppMessage.subscribe('TEST', callback);
+
+      sendWatchChunks('TEST', watchPayload(data, 2), 4);
+
+      sinon.assert.calledOnce(callback);
+      assert.deepEqual(callback.firstCall.args[0], data);
+    });
+
+    it('delivers reassembled messages from the watch', function() {
+      var data = fixtures.appMessageData();
+      var bytes = watchPayload(data);
+      var callback = sinon.spy();
+      simpleAppMessage.subscribe('TEST', callback);
+
+      sendWatchChunks('TEST', bytes, 4);
+
+      sinon.assert.calledOnce(callback);
+      assert.deepEqual(callback.firstCall.args[0], data);
+    });
+  });
+
+  describe('.unsubscribe', function() {
+    it('removes a single callback', function() {
+      var callback1 = sinon.spy();
+      var callback2 = sinon.spy();
+      simpleAppMessage.subscribe('TEST', callback1);
+      simpleAppMessage.subscribe('TEST', callback2);
+
+      simpleAppMessage.unsubscribe('TEST', callback1);
+      sendWatchChunks('TEST', watchPayload({a: 1}), 64);
+
+      sinon.assert.notCalled(callback1);
+      sinon.assert.calledOnce(callback2);
+      sinon.assert.notCalled(Pebble.removeEventListener);
+    });
+
+    it('stops listening once nothing is subscribed', function() {
+      simpleAppMessage.subscribe('TEST', function() {});
+      var handler = Pebble.addEventListener.firstCall.args[1];
+
+      simpleAppMessage.unsubscribe('TEST');
+      simpleAppMessage.unsubscribe('UNKNOWN');
+
+      sinon.assert.calledOnce(Pebble.removeEventListener);
+      sinon.assert.calledWith(Pebble.removeEventListener, 'appmessage',
+                              handler);
+      assert.deepEqual(simpleAppMessage._subscriptions, {});
+    });
+  });
+
+  describe('rpc', function() {
+    beforeEach(function() {
+      sinon.stub(simpleAppMessage, 'send');
+    });
+
+    afterEach(function() {
+      simpleAppMessage.send.restore();
+    });
+
+    it('calls methods on the watch and passes on their responses',
+    function() {
+      var callback = sinon.spy();
+
+      simpleAppMessage.call('weather', {city: 'Oslo'}, callback);
+      simpleAppMessage.call('steps', {}, callback);
+      sinon.assert.calledWith(simpleAppMessage.send, 'weather',
+                              {'city': 'Oslo', '#id': 1});
+      sinon.assert.calledWith(simpleAppMessage.send, 'steps', {'#id': 2});
+      assert.strictEqual(simpleAppMessage._rpc._timeout, 50);
+
+      sendWatchChunks('steps', watchPayload({'#re': 2, 'count': 800}), 64);
+      sendWatchChunks('weather', watchPayload({'#re': 1, 'temp': 12}), 64);
+
+      assert.deepEqual(callback.args, [
+        [null, {count: 800}],
+        [null, {temp: 12}]
+      ]);
+    });
+
+    it('answers calls from the watch while a handler is set', function() {
+      simpleAppMessage.handle('location', function(params, respond) {
+        respond(null, {lat: params.accuracy});
+      });
+
+      sendWatchChunks('location', watchPayload({'#id': 4, 'accuracy': 5}),
+                      64);
+      simpleAppMessage.unhandle('location');
+      sendWatchChunks('location', watchPayload({'#id': 5}), 64);
+
+      sinon.assert.calledWith(simpleAppMessage.send, 'location',
+                              {'lat': 5, '#re': 4});
+      sinon.assert.calledWith(simpleAppMessage.send, 'location',
+                              {'#re': 5, '#err': 'no handler for location'});
+    });
+  });
+
+  describe('sync', function() {
+    beforeEach(function() {
+      sinon.stub(simpleAppMessage, 'send');
+    });
+
+    afterEach(function() {
+      simpleAppMessage.send.restore();
+    });
+
+    it('sends what changed and the whole state when the watch asks for it',
+    function() {
+      simpleAppMessage.sync('weather', {temp: 12, city: 'Oslo'});
+      simpleAppMessage.send.lastCall.args[2]({data: {}});
+      simpleAppMessage.sync('weather', {temp: 13, city: 'Oslo'});
+      simpleAppMessage.send.lastCall.args[2]({data: {}});
+      sendWatchChunks('weather', watchPayload({'#resync': 1}), 64);
+
+      assert.deepEqual(simpleAppMessage.send.args.map(function(args) {
+        return args[1];
+      }), [
+        {'temp': 12, 'city': 'Oslo', '#gen': 1},
+        {'temp': 13, '#base': 1, '#gen': 2},
+        {'temp': 13, 'city': 'Oslo', '#gen': 3}
+      ]);
+    });
+  });
+
+  describe('._handleAppMessage', function() {
+    var callback;
+
+    beforeEach(function() {
+      callback = sinon.spy();
+      simpleAppMessage.subscribe('TEST', callback);
+      sinon.stub(console, 'log');
+    });
+
+    afterEach(function() {
+      console.log.restore();
+    });
+
+    it('ignores messages that are not chunks', function() {
+      simpleAppMessage._handleAppMessage({
+        payload: { SIMPLE_APP_MESSAGE_CHUNK_SIZE: 64 }
+      });
+
+      assert.deepEqual(simpleAppMessage._assemblies, {});
+    });
+
+    it('ignores chunks for namespaces without subscribers', function() {
+      sendWatchChunks('OTHER', watchPayload({a: 1}), 64);
+
+      sinon.assert.notCalled(callback);
+      assert.deepEqual(simpleAppMessage._assemblies, {});
+    });
+
+    it('drops an assembly when a chunk is missing', function() {
+      var bytes = watchPayload({test1: 'value1', test2: 'value2'});
+
+      sendWatchChunk('TEST', bytes.slice(0, 8), 2, 3);
+      sendWatchChunk('TEST', bytes.slice(16), 0, 3);
+
+      sinon.assert.notCalled(callback);
+      assert(console.log.calledWithMatch('Unexpected chunk'));
+      assert.deepEqual(simpleAppMessage._assemblies, {});
+    });
+
+    it('restarts the assembly when a new message begins', function() {
+      var bytes = watchPayload({test1: 'value1'});
+
+      sendWatchChunk('TEST', [1, 2, 3], 1, 2);
+      sendWatchChunks('TEST', bytes, 8);
+
+      sinon.assert.calledOnce(callback);
+      assert.deepEqual(callback.firstCall.args[0], {test1: 'value1'});
+    });
+
+    it('logs and drops messages that fail to deserialize', function() {
+      sendWatchChunk('TEST', [1, 0x6B], 0, 1);
+
+      sinon.assert.notCalled(callback);
+      assert(console.log.calledWithMatch('Unterminated'));
+    });
+
+    it('handles chunks without data', function() {
+      sendWatchChunk('TEST', undefined, 0, 1);
+
+      sinon.assert.notCalled(callback);
+      assert(console.log.calledWithMatch('truncated'));
+    });
+  });
+});
+
+/**
+ * @return {object} the handshake the phone sends before its first chunk
+ */
+function chunkSizeRequest() {
+  return {
+    SIMPLE_APP_MESSAGE_CHUNK_SIZE: 1,
+    SIMPLE_APP_MESSAGE_FORMAT_VERSION: 3
+  };
+}
+
+/**
+ * Answer the chunk size request as the watch would
+ * @param {object} [extra] - keys sent along with the chunk size
+ * @return {void}
+ */
+function respond(extra) {
+  var payload = { SIMPLE_APP_MESSAGE_CHUNK_SIZE: 64 };
+  Object.keys(extra || {}).forEach(function(key) {
+    payload[key] = extra[key];
+  });
+  Pebble.addEventListener
+    .withArgs('appmessage')
+    .callArgWith(1, { payload: payload });
+}
+
+/**
+ * Serialize data as the watch would, as bytes
+ * @param {object} data
+ * @param {number} [format]
+ * @return {Array}
+ */
+function watchPayload(data, format) {
+  return Array.from(serialize(data, format));
+}
+
+/**
+ * @param {string} namespace
+ * @param {Array} data
+ * @param {number} remaining
+ * @param {number} total
+ * @return {void}
+ */
+function sendWatchChunk(namespace, data, remaining, total) {
+  simpleAppMessage._handleAppMessage({
+    payload: {
+      SIMPLE_APP_MESSAGE_CHUNK_NAMESPACE: namespace,
+      SIMPLE_APP_MESSAGE_CHUNK_DATA: data,
+      SIMPLE_APP_MESSAGE_CHUNK_REMAINING: remaining,
+      SIMPLE_APP_MESSAGE_CHUNK_TOTAL: total
+    }
+  });
+}
+
+/**
+ * @param {string} namespace
+ * @param {Array} bytes
+ * @param {number} chunkSize
+ * @return {void}
+ */
+function sendWatchChunks(namespace, bytes, chunkSize) {
+  var total = Math.ceil(bytes.length / chunkSize);
+  for (var i = 0; i < total; i++) {
+    sendWatchChunk(namespace, bytes.slice(i * chunkSize, (i + 1) * chunkSize),
+                   total - i - 1, total);
+  }
+}
@@ -0,0 +1,98 @@
+'use strict';
+
+var assert = require('assert');
+var compress = require('../../../../src/js/lib/compress');
+var serialize = require('../../../../src/js/lib/serialize');
+
+/**
+ * Same decoding as simple-app-message-compression.c
+ * @param {Uint8Array} bytes
+ * @return {Array}
+ */
+function decompress(bytes) {
+  var offset = 3;
+  var size = 0;
+  var shift = 0;
+  var byte;
+  do {
+    byte = bytes[offset++];
+    size |= (byte & 0x7F) << shift;
+    shift += 7;
+  } while (byte & 0x80);
+
+  var output = [];
+  while (offset < bytes.length) {
+    var flags = bytes[offset++];
+    for (var i = 0; i < 8 && offset < bytes.length; i++) {
+      if (flags & (1 << i)) {
+        var distance = bytes[offset++] + 1;
+        var length = bytes[offset++] + 3;
+        for (var j = 0; j < length; j++) {
+          output.push(output[output.length - distance]);
+        }
+      } else {
+        output.push(bytes[offset++]);
+      }
+    }
+  }
+
+  assert.strictEqual(output.length, size);
+  return output;
+}
+
+describe('compress', function() {
+
+  it('writes the header', function() {
+    var payload = serialize({a: 'xyzxyzxyzxyzxyzxyz', b: 'xyzxyzxyzxyzxyz'});
+
+    assert.deepEqual(Array.from(compress(payload, 2, 256).subarray(0, 4)),
+                     [0, 0x80, 2, payload.length]);
+  });
+
+  it('round trips repetitive payloads', function() {
+    var payload = serialize({
+      temperature: 21,
+      temperatureMin: 18,
+      temperatureMax: 24,
+      condition: 'cloudy cloudy cloudy'
+    }, 2);
+    var compressed = compress(payload, 4, 256);
+
+    assert.ok(compressed.length < payload.length);
+    assert.deepEqual(decompress(compressed), Array.from(payload));
+  });
+
+  it('encodes runs as overlapping matches', function() {
+    var payload = new Uint8Array(100).fill(7);
+
+    assert.deepEqual(Array.from(compress(payload, 0, 256)),
+                     [0, 0x80, 0, 100, 0x02, 7, 0, 96]);
+  });
+
+  it('only matches within the window', function() {
+    var payload = new Uint8Array(320);
+    for (var i = 0; i < 320; i++) {
+      payload[i] = i % 160;
+    }
+
+    assert.deepEqual(decompress(compress(payload, 0, 256)),
+                     Array.from(payload));
+    assert.strictEqual(compress(payload, 0, 8), null);
+  });
+
+  it('returns null if the payload does not get smaller', function() {
+    assert.strictEqual(compress(serialize({a: 1}), 1, 256), null);
+  });
+
+  it('round trips UTF-8 strings', function() {
+    var payload = serialize({a: '☃☃☃☃☃☃'});
+
+    assert.deepEqual(decompress(compress(payload, 1, 256)),
+                     Array.from(payload));
+  });
+
+  it('returns null for payloads no bigger than the header', function() {
+    assert.strictEqual(compress(new Uint8Array(0), 0, 256), null);
+    assert.strictEqual(compress(serialize({}), 0, 256), null);
+  });
+});
@@ -0,0 +1,132 @@
+'use strict';
+
+var assert = require('assert');
+var deserialize = require('../../../../src/js/lib/deserialize');
+var serialize = require('../../../../src/js/lib/serialize');
+
+describe('deserialize', function() {
+  it('decodes every type written by serialize', function() {
+    var data = {
+      Null: null,
+      Bool0: false,
+      Bool1: true,
+      Int: 257,
+      Negative: -5,
+      Data: [1, 2, 3, 4],
+      String: 'test'
+    };
+
+    assert.deepEqual(deserialize(serialize(data)), data);
+  });
+
+  it('decodes every type written by serialize in the v2 format', function() {
+    var data = {
+      Null: null,
+      Bool0: false,
+      Bool1: true,
+      Small: 7,
+      Negative: -8,
+      Large: 0x7FFFFFFF,
+      Min: -0x80000000,
+      Data: [1, 2, 3, 4],
+      LongData: new Array(300).fill(9),
+      String: 'test'
+    };
+
+    assert.deepEqual(deserialize(serialize(data, 2)), data);
+  });
+
+  it('decodes arrays and nested objects in the v3 format', function() {
+    var data = {
+      Series: new Int16Array([-300, 0, 300]),
+      Large: new Uint32Array([0xFFFFFFFF]),
+      Nested: {
+        Inner: {x: -1},
+        List: new Int8Array([-1, 2]),
+        Name: 'test'
+      },
+      Data: [1, 2]
+    };
+
+    assert.deepEqual(deserialize(serialize(data, 3)), data);
+  });
+
+  it('decodes plain arrays as the typed array they were packed as', function() {
+    assert.deepEqual(deserialize(serialize({A: [1, -2, 300]}, 3)).A,
+                     new Int16Array([1, -2, 300]));
+  });
+
+  it('throws for arrays in payloads older than v3', function() {
+    assert.throws(function() {
+      deserialize([0, 2, 1, 0x41, 0, 0x51, 0]);
+    }, /Unknown type/);
+  });
+
+  it('decodes an empty v2 message', function() {
+    assert.deepEqual(deserialize([0, 2, 0]), {});
+  });
+
+  it('throws for truncated v2 values', function() {
+    [
+      [0, 2, 1, 0x6B, 0, 0x2F, 0x80],
+      [0, 2, 1, 0x6B, 0, 0x33, 1, 2],
+      [0, 2, 1, 0x6B, 0]
+    ].forEach(function(bytes) {
+      assert.throws(function() { deserialize(bytes); }, /truncated/);
+    });
+  });
+
+  it('throws for v2 varints longer than 5 bytes', function() {
+    assert.throws(function() {
+      deserialize([0, 2, 1, 0x6B, 0, 0x2F, 0x80, 0x80, 0x80, 0x80, 0x80, 0]);
+    }, /Varint/);
+  });
+
+  it('throws for unknown v2 types', function() {
+    assert.throws(function() {
+      deserialize([0, 2, 1, 0x6B, 0, 0x90]);
+    }, /Unknown type 9/);
+  });
+
+  it('decodes UTF-8 strings', function() {
+    var bytes = [
+      1, 0x6B, 0, 4,
+      0x61, 0xC3, 0xA9, 0xE2, 0x82, 0xAC, 0xF0, 0x9F, 0x98, 0x80, 0
+    ];
+
+    assert.deepEqual(deserialize(bytes), {k: 'aé€😀'});
+  });
+
+  it('decodes an empty message', function() {
+    assert.deepEqual(deserialize([0]), {});
+  });
+
+  it('throws for an empty payload', function() {
+    assert.throws(function() { deserialize([]); }, /truncated/);
+  });
+
+  it('throws for unterminated strings', function() {
+    assert.throws(function() { deserialize([1, 0x6B]); }, /Unterminated/);
+  });
+
+  it('throws for truncated values', function() {
+    [
+      [1, 0x6B, 0, 2, 1, 2],
+      [1, 0x6B, 0, 3, 4, 0, 1],
+      [1, 0x6B, 0, 1],
+      [1, 0x6B, 0]
+    ].forEach(function(bytes) {
+      assert.throws(function() { deserialize(bytes); }, /truncated/);
+    });
+  });
+
+  it('throws for unknown types', function() {
+    assert.throws(function() {
+      deserialize([1, 0x6B, 0, 99]);
+    }, /Unknown type 99/);
+  });
+
+  it('throws for trailing data', function() {
+    assert.throws(function() { deserialize([0, 1]); }, /end of payload/);
+  });
+});
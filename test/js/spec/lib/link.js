@@ -0,0 +1,118 @@
+'use strict';
+
+var assert = require('assert');
+var Link = require('../../../../src/js/lib/link');
+
+describe('Link', function() {
+  // far enough apart that every failure backs off
+  var now = 0;
+
+  it('starts at the watch\'s chunk size without extra delay', function() {
+    var link = new Link();
+
+    assert.strictEqual(link.chunkSize(256), 256);
+    assert.strictEqual(link.delay(40), 40);
+  });
+
+  it('halves the chunk size and backs off on failure', function() {
+    var link = new Link();
+    link.chunkSize(256);
+
+    link.failed(now += 10000);
+    assert.strictEqual(link.chunkSize(256), 128);
+    assert.strictEqual(link.delay(0), 10);
+
+    link.failed(now += 10000);
+    assert.strictEqual(link.chunkSize(256), 64);
+    assert.strictEqual(link.delay(0), 20);
+  });
+
+  it('grows back a step per ack up to the watch\'s chunk size', function() {
+    var link = new Link();
+    link.chunkSize(256);
+    link.failed(now += 10000);
+
+    link.acked(20);
+    assert.strictEqual(link.chunkSize(256), 144);
+    assert.strictEqual(link.delay(0), 0);
+
+    for (var i = 0; i < 10; i++) {
+      link.acked(20);
+    }
+    assert.strictEqual(link.chunkSize(256), 256);
+  });
+
+  it('never shrinks below the minimum or backs off past the maximum',
+  function() {
+    var link = new Link();
+    link.chunkSize(256);
+
+    for (var i = 0; i < 20; i++) {
+      link.failed(now += 10000);
+    }
+    assert.strictEqual(link.chunkSize(256), 16);
+    assert.strictEqual(link.delay(0), 1000);
+  });
+
+  it('does not grow chunks past a small watch chunk size', function() {
+    var link = new Link();
+    link.chunkSize(8);
+
+    link.failed(now += 10000);
+    assert.strictEqual(link.chunkSize(8), 8);
+    link.acked(10);
+    assert.strictEqual(link.chunkSize(8), 8);
+  });
+
+  it('starts over when the watch\'s chunk size changes', function() {
+    var link = new Link();
+    link.chunkSize(256);
+    link.failed(now += 10000);
+
+    assert.strictEqual(link.chunkSize(512), 512);
+  });
+
+  it('backs off once for failures within a round trip', function() {
+    var link = new Link();
+    link.chunkSize(256);
+    link.acked(50);
+
+    link.failed(1000);
+    link.failed(1050);
+    assert.strictEqual(link.chunkSize(256), 128);
+    assert.strictEqual(link.delay(0), 10);
+    assert.ok(link.estimates(0).failureRate > 0.2);
+
+    link.failed(1110);
+    assert.strictEqual(link.chunkSize(256), 64);
+  });
+
+  it('spaces chunks out in the order they were scheduled', function() {
+    var link = new Link();
+    link.chunkSize(64);
+
+    assert.strictEqual(link.schedule(0, 1000), 0);
+    link.failed(now += 10000);
+    link.failed(now += 10000);
+    assert.strictEqual(link.schedule(0, 1000), 20);
+    link.acked(10);
+    assert.strictEqual(link.schedule(0, 1005), 25);
+    assert.strictEqual(link.schedule(40, 2000), 40);
+  });
+
+  it('averages latency and failures', function() {
+    var link = new Link();
+    link.chunkSize(64);
+
+    link.acked(80);
+    link.acked(160);
+    link.failed(now += 10000);
+
+    assert.deepEqual(link.estimates(40), {
+      chunkSize: 32,
+      chunkDelay: 50,
+      latency: 90,
+      failureRate: 0.125
+    });
+  });
+});
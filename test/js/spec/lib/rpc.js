@@ -0,0 +1,157 @@
+'use strict';
+
+var assert = require('assert');
+var fixtures = require('../../fixtures');
+var Rpc = require('../../../../src/js/lib/rpc');
+
+describe('Rpc', function() {
+  it('sends calls without waiting for earlier ones to be answered',
+  function() {
+    var link = fixtures.transport();
+    var rpc = new Rpc(link, 1000);
+    var results = [];
+
+    ['weather', 'steps', 'weather'].forEach(function(method, index) {
+      rpc.call(method, {index: index}, function(error, result) {
+        results.push([method, error, result]);
+      });
+    });
+
+    assert.deepEqual(link.sent.map(function(send) {
+      return [send.namespace, send.data];
+    }), [
+      ['weather', {'index': 0, '#id': 1}],
+      ['steps', {'index': 1, '#id': 2}],
+      ['weather', {'index': 2, '#id': 3}]
+    ]);
+    assert.deepEqual(Object.keys(link.subscribers), ['weather', 'steps']);
+
+    // answered out of order, and each only once
+    link.deliver('weather', {'#re': 3, 'temp': 12});
+    link.deliver('steps', {'#re': 2, 'count': 800});
+    link.deliver('weather', {'#re': 1, 'temp': 9});
+    link.deliver('weather', {'#re': 1, 'temp': 10});
+
+    assert.deepEqual(results, [
+      ['weather', null, {temp: 12}],
+      ['steps', null, {count: 800}],
+      ['weather', null, {temp: 9}]
+    ]);
+  });
+
+  it('passes on error responses and failed sends', function() {
+    var link = fixtures.transport();
+    var rpc = new Rpc(link, 1000);
+    var errors = [];
+    var callback = function(error) {
+      errors.push(error);
+    };
+
+    rpc.call('weather', {}, callback);
+    rpc.call('weather', {}, callback);
+    rpc.call('weather', {}, callback);
+    link.sent[0].callback({data: {}});
+    link.deliver('weather', {'#re': 1, '#err': 'no location'});
+    link.sent[1].callback({error: {message: 'NACK'}});
+    link.sent[2].callback('simpleAppMessage: Request timed out.');
+
+    assert.deepEqual(errors[0], {error: 'no location'});
+    assert(errors[1].error.match(/failed to send call to weather/));
+    assert.deepEqual(errors[1].cause, {error: {message: 'NACK'}});
+    assert.strictEqual(errors[2].cause, 'simpleAppMessage: Request timed out.');
+  });
+
+  it('times out calls that aren\'t answered', function() {
+    var originalSetTimeout = global.setTimeout;
+    var originalClearTimeout = global.clearTimeout;
+    var timers = [];
+    global.setTimeout = function(fn, ms) {
+      timers.push({fn: fn, ms: ms});
+      return timers.length;
+    };
+    global.clearTimeout = function(id) {
+      timers[id - 1].cleared = true;
+    };
+
+    try {
+      var link = fixtures.transport();
+      var rpc = new Rpc(link, 1000);
+      var errors = [];
+      var callback = function(error) {
+        errors.push(error);
+      };
+
+      rpc.call('weather', {}, callback);
+      rpc.call('steps', {}, callback, 200);
+      link.deliver('weather', {'#re': 1});
+
+      assert.deepEqual(timers.map(function(timer) {
+        return [timer.ms, !!timer.cleared];
+      }), [[1000, true], [200, false]]);
+      timers[1].fn();
+      link.deliver('steps', {'#re': 2});
+
+      assert.deepEqual(errors, [null, {
+        error: 'simpleAppMessage: call to steps timed out',
+        timedOut: true
+      }]);
+    } finally {
+      global.setTimeout = originalSetTimeout;
+      global.clearTimeout = originalClearTimeout;
+    }
+  });
+
+  it('wraps IDs around before they overflow an int', function() {
+    var link = fixtures.transport();
+    var rpc = new Rpc(link, 1000);
+    rpc._nextId = 0x7fffffff;
+
+    rpc.call('weather', {}, function() {});
+    rpc.call('weather', {}, function() {});
+
+    assert.strictEqual(link.sent[0].data['#id'], 0x7fffffff);
+    assert.strictEqual(link.sent[1].data['#id'], 1);
+  });
+
+  it('answers calls from the watch with the handler\'s result', function() {
+    var link = fixtures.transport();
+    var rpc = new Rpc(link, 1000);
+    var respond;
+    rpc.handle('location', function(params, callback) {
+      assert.deepEqual(params, {accuracy: 100});
+      respond = callback;
+    });
+
+    link.deliver('location', {'#id': 7, 'accuracy': 100});
+    assert.strictEqual(link.sent.length, 0);
+
+    respond(null, {lat: 51, lon: 0});
+    respond(null, {lat: 52, lon: 0});
+    assert.deepEqual(link.sent.map(function(send) {
+      return [send.namespace, send.data];
+    }), [['location', {'lat': 51, 'lon': 0, '#re': 7}]]);
+  });
+
+  it('answers calls it can\'t handle with errors', function() {
+    var link = fixtures.transport();
+    var rpc = new Rpc(link, 1000);
+    rpc.handle('location', function(params, callback) {
+      callback({error: 'permission denied'});
+    });
+
+    link.deliver('location', {'#id': 1});
+    rpc.unhandle('location');
+    link.deliver('location', {'#id': 2});
+    // neither a call nor a response
+    link.deliver('location', {lat: 51});
+
+    assert.deepEqual(link.sent.map(function(send) {
+      return send.data;
+    }), [
+      {'#re': 1, '#err': 'permission denied'},
+      {'#re': 2, '#err': 'no handler for location'}
+    ]);
+    link.sent[0].callback({data: {}});
+    link.sent[1].callback({error: {message: 'NACK'}});
+  });
+});
@@ -3,6 +3,24 @@
 var assert = require('assert');
 var serialize = require('../../../../src/js/lib/serialize');
 
+/**
+ * Bytes from numbers and ASCII strings
+ * @return {Uint8Array}
+ */
+function bytes() {
+  var result = [];
+  Array.prototype.forEach.call(arguments, function(val) {
+    if (typeof val === 'string') {
+      val.split('').forEach(function(char) {
+        result.push(char.charCodeAt(0));
+      });
+    } else {
+      result.push(val);
+    }
+  });
+  return new Uint8Array(result);
+}
+
 describe('serialize', function() {
 
   // @TODO Could really use more extensive tests here
@@ -15,16 +33,119 @@ describe('serialize', function() {
       Data: [1, 2, 3, 4],
       String: 'test'
     };
-    var expected = [
-      6, 'N', 'u', 'l', 'l', '\u0000', 0, 'B', 'o', 'o', 'l', '0', '\u0000', 1, 0,
-      'B', 'o', 'o', 'l', '1', '\u0000', 1, 1, 'I', 'n', 't', '\u0000', 2, 1, 1, 0,
-      0, 'D', 'a', 't', 'a', '\u0000', 3, 4, 0, 1, 2, 3, 4, 'S', 't', 'r', 'i',
-      'n', 'g', '\u0000', 4, 't', 'e', 's', 't', '\u0000'
-    ];
+    var expected = bytes(
+      6, 'Null\0', 0, 'Bool0\0', 1, 0, 'Bool1\0', 1, 1, 'Int\0', 2, 1, 1, 0, 0,
+      'Data\0', 3, 4, 0, 1, 2, 3, 4, 'String\0', 4, 'test\0'
+    );
 
     assert.deepEqual(serialize(data), expected);
   });
 
+  it('serializes compactly with the v2 format', function() {
+    var data = {
+      N: null,
+      B: true,
+      I: -3,
+      L: 300,
+      D: [1, 2],
+      S: 'x'
+    };
+    var expected = bytes(
+      0, 2, 6,
+      'N\0', 0x00,
+      'B\0', 0x11,
+      'I\0', 0x25,
+      'L\0', 0x2F, 0xD8, 0x04,
+      'D\0', 0x32, 1, 2,
+      'S\0', 0x40, 'x\0'
+    );
+
+    assert.deepEqual(serialize(data, 2), expected);
+  });
+
+  it('writes long data lengths as a varint', function() {
+    var data = {D: new Array(20).fill(7)};
+
+    assert.deepEqual(serialize(data, 2).subarray(0, 7),
+                     bytes(0, 2, 1, 'D\0', 0x3F, 20));
+  });
+
+  it('writes typed arrays as data', function() {
+    var data = {D: new Uint8Array([1, 2])};
+
+    assert.deepEqual(serialize(data, 2), bytes(0, 2, 1, 'D\0', 0x32, 1, 2));
+  });
+
+  it('writes wider typed arrays as the bytes they hold before v3', function() {
+    var data = {A: new Int16Array([1, -2]), B: new Uint32Array([0x01020304])};
+
+    assert.deepEqual(serialize(data, 2), bytes(
+      0, 2, 2, 'A\0', 0x34, 1, 0, 0xFE, 0xFF, 'B\0', 0x34, 4, 3, 2, 1
+    ));
+  });
+
+  it('packs arrays of numbers that need more than a byte with v3', function() {
+    var data = {A: [1, -2, 300]};
+
+    assert.deepEqual(serialize(data, 3), bytes(
+      0, 3, 1, 'A\0', 0x57, 2, 1, 0, 0xFE, 0xFF, 0x2C, 0x01
+    ));
+  });
+
+  it('keeps arrays of bytes as data with v3', function() {
+    assert.deepEqual(serialize({D: [1, 2]}, 3),
+                     bytes(0, 3, 1, 'D\0', 0x32, 1, 2));
+  });
+
+  it('writes wider typed arrays as arrays with v3', function() {
+    var data = {A: new Uint16Array([1, 0xFFFF])};
+
+    assert.deepEqual(serialize(data, 3), bytes(
+      0, 3, 1, 'A\0', 0x55, 3, 1, 0, 0xFF, 0xFF
+    ));
+  });
+
+  it('packs arrays of numbers above the int32 range as uint32 with v3',
+  function() {
+    assert.deepEqual(serialize({A: [0xFFFFFFFF]}, 3),
+                     bytes(0, 3, 1, 'A\0', 0x55, 5, 0xFF, 0xFF, 0xFF, 0xFF));
+  });
+
+  it('throws for arrays it can\'t pack without losing elements', function() {
+    [[1.5], [1, 'x'], [NaN], [0x100000000], [-1, 0x80000000]].forEach(
+    function(val) {
+      assert.throws(function() { serialize({A: val}, 3); }, /Array elements/);
+    });
+  });
+
+  it('nests objects with v3', function() {
+    var data = {O: {a: 1, b: 'x'}};
+
+    assert.deepEqual(serialize(data, 3), bytes(
+      0, 3, 1, 'O\0', 0x69, 2, 'a\0', 0x22, 'b\0', 0x40, 'x\0'
+    ));
+  });
+
+  it('sends arrays as data and objects as null before v3', function() {
+    var data = {A: [300], O: {a: 1}};
+
+    assert.deepEqual(serialize(data, 2), bytes(
+      0, 2, 2, 'A\0', 0x31, 44, 'O\0', 0x00
+    ));
+  });
+
+  it('encodes keys and strings as UTF-8', function() {
+    var data = {'é': 'a€😀'};
+
+    assert.deepEqual(serialize(data), bytes(
+      1, 0xC3, 0xA9, 0, 4, 'a', 0xE2, 0x82, 0xAC, 0xF0, 0x9F, 0x98, 0x80, 0
+    ));
+  });
+
+  it('skips values it has no type for', function() {
+    assert.deepEqual(serialize({u: undefined}), bytes(1, 'u\0'));
+  });
+
   it('throws for objects with too many keys', function() {
     var data = {};
     for (var i = 0; i < 256; i++) {
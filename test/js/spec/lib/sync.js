@@ -0,0 +1,134 @@
+'use strict';
+
+var assert = require('assert');
+var fixtures = require('../../fixtures');
+var Sync = require('../../../../src/js/lib/sync');
+
+describe('Sync', function() {
+  it('sends the whole state first and only what changed after', function() {
+    var link = fixtures.transport();
+    var sync = new Sync(link);
+    var results = [];
+    var callback = function(result) {
+      results.push(result);
+    };
+
+    sync.update('weather', {temp: 12, city: 'Oslo', wind: null}, callback);
+    link.sent[0].callback({data: {}});
+    sync.update('weather', {temp: 13, city: 'Oslo', hours: [1, 2]}, callback);
+    link.sent[1].callback({data: {}});
+    sync.update('weather', {temp: 13, hours: [1, 2]}, callback);
+    link.sent[2].callback({data: {}});
+    sync.update('weather', {temp: 13, hours: [1, 2]}, callback);
+
+    assert.deepEqual(link.sent.map(function(send) {
+      return send.data;
+    }), [
+      {'temp': 12, 'city': 'Oslo', '#gen': 1},
+      {'temp': 13, 'hours': [1, 2], '#base': 1, '#gen': 2},
+      {'city': null, '#base': 2, '#gen': 3}
+    ]);
+    assert.deepEqual(results, [{data: {}}, {data: {}}, {data: {}}, undefined]);
+    assert.deepEqual(Object.keys(link.subscribers), ['weather']);
+  });
+
+  it('sends only the newest state that waited for an update in flight',
+  function() {
+    var link = fixtures.transport();
+    var sync = new Sync(link);
+    var results = [];
+
+    sync.update('weather', {temp: 12});
+    sync.update('weather', {temp: 13}, function() {
+      results.push(13);
+    });
+    sync.update('weather', {temp: 14}, function() {
+      results.push(14);
+    });
+    assert.strictEqual(link.sent.length, 1);
+
+    link.sent[0].callback({data: {}});
+    assert.deepEqual(link.sent[1].data, {'temp': 14, '#base': 1, '#gen': 2});
+    link.sent[1].callback({data: {}});
+    assert.deepEqual(results, [13, 14]);
+  });
+
+  it('diffs against the last state the watch acknowledged', function() {
+    var link = fixtures.transport();
+    var sync = new Sync(link);
+
+    sync.update('weather', {temp: 12});
+    link.sent[0].callback({data: {}});
+    sync.update('weather', {temp: 13});
+    link.sent[1].callback({error: {message: 'NACK'}});
+    sync.update('weather', {temp: 13, city: 'Oslo'});
+
+    assert.deepEqual(link.sent[2].data,
+                     {'temp': 13, 'city': 'Oslo', '#base': 1, '#gen': 2});
+  });
+
+  it('sends the whole state when the watch asks for it', function() {
+    var link = fixtures.transport();
+    var sync = new Sync(link);
+
+    sync.update('weather', {temp: 12, city: 'Oslo'});
+    link.sent[0].callback({data: {}});
+    link.deliver('weather', {'#resync': 0});
+    link.sent[1].callback({data: {}});
+
+    // asked while an update is in flight, sent once it's done
+    sync.update('weather', {temp: 13, city: 'Oslo'});
+    link.deliver('weather', {'#resync': 1});
+    link.deliver('weather', {temp: 1});
+    assert.strictEqual(link.sent.length, 3);
+    link.sent[2].callback('simpleAppMessage: Request timed out.');
+
+    assert.deepEqual(link.sent.map(function(send) {
+      return send.data;
+    }), [
+      {'temp': 12, 'city': 'Oslo', '#gen': 1},
+      {'temp': 12, 'city': 'Oslo', '#gen': 2},
+      {'temp': 13, '#base': 2, '#gen': 3},
+      {'temp': 13, 'city': 'Oslo', '#gen': 3}
+    ]);
+  });
+
+  it('wraps generations around before they overflow an int', function() {
+    var link = fixtures.transport();
+    var sync = new Sync(link);
+
+    sync.update('weather', {temp: 12});
+    link.sent[0].callback({data: {}});
+    sync._namespaces.weather.generation = 0x7fffffff - 1;
+    sync.update('weather', {temp: 13});
+    link.sent[1].callback({data: {}});
+    sync.update('weather', {temp: 14});
+
+    assert.strictEqual(link.sent[1].data['#gen'], 0x7fffffff);
+    assert.strictEqual(link.sent[2].data['#gen'], 1);
+  });
+
+  it('compares arrays, typed arrays and objects by value', function() {
+    assert.deepEqual(Sync.diff({
+      a: [1, 2],
+      b: new Uint8Array([1, 2]),
+      c: {x: 1},
+      d: [1, 2],
+      e: {x: 1},
+      f: [1]
+    }, {
+      a: [1, 2],
+      b: new Int16Array([1, 2]),
+      c: {x: 1, y: 2},
+      d: [1, 3],
+      e: 0,
+      f: 'a'
+    }), {
+      b: new Int16Array([1, 2]),
+      c: {x: 1, y: 2},
+      d: [1, 3],
+      e: 0,
+      f: 'a'
+    });
+  });
+});